@@ -31,6 +31,7 @@ macro(actor_find_dependencies)
         c-ares
         fmt
         lz4
+        zstd
         # Private and private/public dependencies.
         Concepts
         GnuTLS
@@ -69,6 +70,7 @@ macro(actor_find_dependencies)
     set(_actor_dep_args_c-ares 1.13 REQUIRED)
     set(_actor_dep_args_fmt 5.0.0 REQUIRED)
     set(_actor_dep_args_lz4 1.7.3 REQUIRED)
+    set(_actor_dep_args_zstd 1.4.0 REQUIRED)
     set(_actor_dep_args_GnuTLS 3.3.26 REQUIRED)
     set(_actor_dep_args_Protobuf 2.5.0 REQUIRED)
     set(_actor_dep_args_StdAtomic REQUIRED)
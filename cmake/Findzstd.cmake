@@ -0,0 +1,39 @@
+find_package (PkgConfig REQUIRED)
+
+pkg_search_module (zstd_PC libzstd)
+
+find_library (zstd_LIBRARY
+  NAMES zstd
+  HINTS
+    ${zstd_PC_LIBDIR}
+    ${zstd_PC_LIBRARY_DIRS})
+
+find_path (zstd_INCLUDE_DIR
+  NAMES zstd.h
+  HINTS
+    ${zstd_PC_INCLUDEDIR}
+    ${zstd_PC_INCLUDEDIRS})
+
+mark_as_advanced (
+  zstd_LIBRARY
+  zstd_INCLUDE_DIR)
+
+include (FindPackageHandleStandardArgs)
+
+find_package_handle_standard_args (zstd
+  REQUIRED_VARS
+    zstd_LIBRARY
+    zstd_INCLUDE_DIR
+  VERSION_VAR zstd_PC_VERSION)
+
+set (zstd_LIBRARIES ${zstd_LIBRARY})
+set (zstd_INCLUDE_DIRS ${zstd_INCLUDE_DIR})
+
+if (zstd_FOUND AND NOT (TARGET zstd::zstd))
+  add_library (zstd::zstd UNKNOWN IMPORTED)
+
+  set_target_properties (zstd::zstd
+    PROPERTIES
+      IMPORTED_LOCATION ${zstd_LIBRARY}
+      INTERFACE_INCLUDE_DIRECTORIES ${zstd_INCLUDE_DIRS})
+endif ()
@@ -24,6 +24,7 @@
 
 #pragma once
 
+#include <string_view>
 #include <unordered_map>
 
 #include <nil/actor/core/sstring.hh>
@@ -71,6 +72,14 @@ namespace nil {
              */
             operation_type str2type(const sstring &type);
 
+            /**
+             * URL decode a string
+             * @param in the encoded string
+             * @param out will hold the decoded string
+             * @return false if the string is not properly encoded
+             */
+            bool url_decode(std::string_view in, sstring &out);
+
         }    // namespace httpd
 
     }    // namespace actor
@@ -0,0 +1,147 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#pragma once
+
+#include <nil/actor/core/future.hh>
+#include <nil/actor/core/lowres_clock.hh>
+#include <nil/actor/core/shared_ptr.hh>
+#include <nil/actor/core/sstring.hh>
+#include <nil/actor/core/temporary_buffer.hh>
+
+#include <chrono>
+#include <list>
+#include <unordered_map>
+
+namespace nil {
+    namespace actor {
+
+        namespace httpd {
+
+            /**
+             * A file held by a file_cache, along with the compressed variants of it
+             * found next to it on the disk.
+             */
+            struct cached_file {
+                /**
+                 * The file itself or one of its variants
+                 */
+                struct variant {
+                    /**
+                     * The content, shared with the replies that send it, empty when there is none
+                     */
+                    temporary_buffer<char> content;
+                    /**
+                     * The strong entity tag, made of the hash of the content
+                     */
+                    sstring etag;
+                    /**
+                     * The modification time of the path on the disk when the file was read, even if the
+                     * variant was not used, the epoch when there is no such file
+                     */
+                    std::chrono::system_clock::time_point mtime;
+                };
+                variant identity;
+                /**
+                 * file.gz and file.br
+                 */
+                variant gzip;
+                variant brotli;
+                /**
+                 * The modification time of the file as an HTTP-date
+                 */
+                sstring last_modified;
+                // when the modification times were last compared with the disk
+                lowres_clock::time_point checked;
+
+                size_t size() const {
+                    return identity.content.size() + gzip.content.size() + brotli.content.size();
+                }
+            };
+
+            /**
+             * A least recently used cache of static files, keyed by path and modification
+             * time, for the file and directory handlers of a shard.
+             *
+             * A cached file is served without touching the disk, the modification times of it
+             * and of its variants are compared with the ones on the disk at most once per
+             * revalidate interval, and the file is read again when one of them changed. The
+             * precompressed variants of a file, file.gz and file.br, are cached with it when they
+             * are not older than the file. Files larger than the max file size are not cached and
+             * neither are the ones that cannot be read.
+             */
+            class file_cache {
+                struct entry {
+                    lw_shared_ptr<cached_file> file;
+                    std::list<sstring>::iterator lru;
+                };
+                std::unordered_map<sstring, entry> _files;
+                // the paths of the files, most recently used first
+                std::list<sstring> _lru;
+                size_t _size = 0;
+                size_t _budget;
+                size_t _max_file_size;
+                lowres_clock::duration _revalidate_interval;
+                uint64_t _hits = 0;
+                uint64_t _misses = 0;
+
+                future<lw_shared_ptr<cached_file>> load(const sstring &path);
+                void insert(const sstring &path, lw_shared_ptr<cached_file> file);
+                void erase(const sstring &path);
+
+            public:
+                /**
+                 * @param budget the total size of the cached contents, variants included
+                 * @param max_file_size the size of the largest file to cache
+                 * @param revalidate_interval how long a file is served before its modification
+                 * time is checked again
+                 */
+                explicit file_cache(size_t budget = 64 << 20, size_t max_file_size = 1 << 20,
+                                    lowres_clock::duration revalidate_interval = std::chrono::seconds(1));
+
+                /**
+                 * Get a file, reading it from the disk when it is not cached or it changed
+                 * @param path the full path to the file
+                 * @return the file, or null when it is not cached
+                 */
+                future<lw_shared_ptr<cached_file>> get(const sstring &path);
+
+                size_t size() const {
+                    return _size;
+                }
+                size_t budget() const {
+                    return _budget;
+                }
+                uint64_t hits() const {
+                    return _hits;
+                }
+                uint64_t misses() const {
+                    return _misses;
+                }
+            };
+
+        }    // namespace httpd
+
+    }    // namespace actor
+}    // namespace nil
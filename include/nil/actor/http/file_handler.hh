@@ -25,6 +25,7 @@
 #pragma once
 
 #include <nil/actor/http/handlers.hh>
+#include <nil/actor/http/file_cache.hh>
 #include <nil/actor/core/iostream.hh>
 
 namespace nil {
@@ -81,6 +82,20 @@ namespace nil {
                     return this;
                 }
 
+                /**
+                 * Allows serving the files from a cache, the handlers of a shard can share one.
+                 * Cached files are replied with strong entity tags and a Last-Modified header,
+                 * conditional requests that match them get a 304 without touching the disk,
+                 * and the precompressed variants are sent to the clients that accept them.
+                 * The cache is not used when a transformer is set.
+                 * @param c the cache to use
+                 * @return this
+                 */
+                file_interaction_handler *set_cache(lw_shared_ptr<file_cache> c) {
+                    cache = std::move(c);
+                    return this;
+                }
+
                 /**
                  * if the url ends without a slash redirect
                  * @param req the request
@@ -106,9 +121,20 @@ namespace nil {
                 future<std::unique_ptr<reply>> read(sstring file, std::unique_ptr<request> req,
                                                     std::unique_ptr<reply> rep);
                 file_transformer *transformer;
+                lw_shared_ptr<file_cache> cache;
 
                 output_stream<char> get_stream(std::unique_ptr<request> req, const sstring &extension,
                                                output_stream<char> &&s);
+
+            private:
+                future<std::unique_ptr<reply>> read_from_disk(sstring file, std::unique_ptr<request> req,
+                                                              std::unique_ptr<reply> rep);
+                /**
+                 * Reply with a cached file, or with a 304 when the request is conditional and the
+                 * variant the client would get did not change
+                 */
+                static void reply_from_cache(cached_file &file, const sstring &extension, const request &req,
+                                             reply &rep);
             };
 
             /**
@@ -67,7 +67,19 @@ namespace nil {
                     return *this;
                 }
 
+                /**
+                 * Pass the request body to the handler as request::content_stream,
+                 * instead of reading all of it into request::content first
+                 * @param enable whether to stream the body
+                 * @return a reference to the handler
+                 */
+                handler_base &stream_body(bool enable = true) {
+                    _stream_body = enable;
+                    return *this;
+                }
+
                 std::vector<sstring> _mandatory_param;
+                bool _stream_body = false;
             };
 
         }    // namespace httpd
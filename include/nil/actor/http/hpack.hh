@@ -0,0 +1,189 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#pragma once
+
+#include <nil/actor/core/sstring.hh>
+
+#include <cstdint>
+#include <deque>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace nil {
+    namespace actor {
+
+        namespace httpd {
+
+            /**
+             * A malformed HPACK header block. The decoder state is lost with it,
+             * so it is a connection error of type COMPRESSION_ERROR.
+             */
+            class hpack_error : public std::runtime_error {
+            public:
+                using std::runtime_error::runtime_error;
+            };
+
+            using hpack_header_list = std::vector<std::pair<sstring, sstring>>;
+
+            /**
+             * The header table of HPACK (RFC 7541): the static table followed by the
+             * dynamic table, both indexed from 1. The newest dynamic entry comes first,
+             * the oldest entries are evicted to keep the size of the dynamic table
+             * under its limit.
+             */
+            class hpack_table {
+            public:
+                struct entry {
+                    sstring name;
+                    sstring value;
+                };
+
+                // what an entry counts for in the size of the table, besides its name and value
+                static constexpr size_t entry_overhead = 32;
+                static constexpr size_t default_max_size = 4096;
+                static constexpr size_t static_entries = 61;
+
+                /**
+                 * Get an entry
+                 * @param index the index of the entry, from 1
+                 * @return the entry, or nullptr if there is no such index
+                 */
+                const entry *get(size_t index) const;
+
+                /**
+                 * Search for a header
+                 * @return the index of an entry of the same name and value and true, or
+                 * the index of an entry of the same name and false, or 0 if there is none
+                 */
+                std::pair<size_t, bool> find(std::string_view name, std::string_view value) const;
+
+                /**
+                 * Insert an entry at the head of the dynamic table, an entry larger
+                 * than the limit leaves the table empty
+                 */
+                void add(sstring name, sstring value);
+
+                void set_max_size(size_t max_size);
+
+                size_t max_size() const {
+                    return _max_size;
+                }
+                size_t size() const {
+                    return _size;
+                }
+                size_t dynamic_entries() const {
+                    return _entries.size();
+                }
+
+            private:
+                void evict(size_t max_size);
+
+                std::deque<entry> _entries;
+                size_t _size = 0;
+                size_t _max_size = default_max_size;
+            };
+
+            /**
+             * Decodes the header blocks of one direction of a connection
+             */
+            class hpack_decoder {
+                hpack_table _table;
+                size_t _max_table_size;
+                size_t _max_header_list_size;
+
+            public:
+                /**
+                 * @param max_table_size the limit of the dynamic table advertised to the peer
+                 * @param max_header_list_size the limit of the decoded size of a header block,
+                 * counted as in SETTINGS_MAX_HEADER_LIST_SIZE
+                 */
+                explicit hpack_decoder(size_t max_table_size = hpack_table::default_max_size,
+                                       size_t max_header_list_size = 64 * 1024);
+
+                /**
+                 * Decode a complete header block, the headers are appended to the list in order
+                 * @throws hpack_error if the block is malformed or its headers are too large
+                 */
+                void decode(std::string_view block, hpack_header_list &headers);
+
+                const hpack_table &table() const {
+                    return _table;
+                }
+            };
+
+            /**
+             * Encodes the header blocks of one direction of a connection.
+             *
+             * Headers are added to the dynamic table, except for the ones that
+             * change with every message (content-length, date) or are sensitive
+             * (set-cookie, authorization), which are never indexed. Strings are
+             * Huffman coded when it makes them shorter.
+             */
+            class hpack_encoder {
+                hpack_table _table;
+                // the smallest and the last limit set since the last header block
+                size_t _min_pending_size = 0;
+                bool _size_update_pending = false;
+
+            public:
+                /**
+                 * Set the limit of the dynamic table, e.g. from SETTINGS_HEADER_TABLE_SIZE of
+                 * the peer. The encoder uses at most hpack_table::default_max_size.
+                 */
+                void set_max_table_size(size_t max_size);
+
+                /**
+                 * Encode a header block, header names must be lower case
+                 */
+                void encode(const hpack_header_list &headers, std::string &out);
+
+                const hpack_table &table() const {
+                    return _table;
+                }
+            };
+
+            /**
+             * Huffman code a string with the code of HPACK
+             */
+            void hpack_huffman_encode(std::string_view in, std::string &out);
+
+            /**
+             * The length of a string Huffman coded with the code of HPACK
+             */
+            size_t hpack_huffman_encoded_size(std::string_view in);
+
+            /**
+             * Decode a string Huffman coded with the code of HPACK
+             * @throws hpack_error if the string is not properly coded or padded
+             */
+            void hpack_huffman_decode(std::string_view in, std::string &out);
+
+        }    // namespace httpd
+
+    }    // namespace actor
+}    // namespace nil
@@ -0,0 +1,172 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#pragma once
+
+#include <nil/actor/http/hpack.hh>
+#include <nil/actor/http/request.hh>
+#include <nil/actor/http/reply.hh>
+
+#include <nil/actor/core/condition_variable.hh>
+#include <nil/actor/core/future.hh>
+#include <nil/actor/core/gate.hh>
+#include <nil/actor/core/iostream.hh>
+#include <nil/actor/core/semaphore.hh>
+#include <nil/actor/core/shared_ptr.hh>
+#include <nil/actor/core/sstring.hh>
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace nil {
+    namespace actor {
+
+        namespace httpd {
+
+            class http_server;
+
+            /**
+             * A stream of an HTTP/2 connection, one request and its reply
+             */
+            struct http2_stream {
+                uint32_t id;
+                std::unique_ptr<request> req;
+                // the request body, handed to the handler once the request is complete
+                std::vector<temporary_buffer<char>> body;
+                size_t body_size = 0;
+                // the bytes of the DATA frames of the stream not given back to the connection window yet
+                int64_t uncredited = 0;
+                int64_t send_window;
+                int64_t recv_window;
+                // the client sent the whole request
+                bool end_stream = false;
+                // either side reset the stream, nothing more is sent on it
+                bool reset = false;
+                // the body exceeded the content length limit of the server
+                bool too_large = false;
+
+                http2_stream(uint32_t id, std::unique_ptr<request> req, int64_t send_window, int64_t recv_window) :
+                    id(id), req(std::move(req)), send_window(send_window), recv_window(recv_window) {
+                }
+            };
+
+            /**
+             * Serves HTTP/2 (RFC 7540) on a connection of an http_server, once the client
+             * chose it with the connection preface, either in clear text with prior knowledge
+             * or through ALPN over TLS.
+             *
+             * Each stream is a request, handed to the routes of the server as soon as the
+             * client sent it whole, so that the requests of a connection are handled
+             * concurrently and their replies interleave. A reply is sent as a HEADERS frame
+             * and DATA frames within the flow control windows of the client.
+             *
+             * Request bodies are read into memory, up to the content length limit of the
+             * server, before the handler is called. The window of a stream is not credited back
+             * while its body is buffered, so a body has to fit in it, and the connection window
+             * is given back once the handler is done with a body. What a client can make a
+             * connection hold is thus bounded by the connection window. Server push is not used.
+             */
+            class http2_connection {
+            public:
+                // the client connection preface, the first bytes a client sends
+                static constexpr std::string_view preface = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+                static constexpr uint32_t max_concurrent_streams = 100;
+                static constexpr uint32_t default_window_size = 65535;
+                // the receive window of a stream, a request body has to be smaller
+                static constexpr uint32_t stream_window_size = 1 << 20;
+                // the receive window of the connection, the bodies buffered or held by the handlers
+                static constexpr uint32_t connection_window_size = 4 << 20;
+                static constexpr uint32_t default_max_frame_size = 16384;
+                static constexpr size_t max_header_list_size = 64 * 1024;
+
+                /**
+                 * @param server the server whose routes handle the requests
+                 * @param in the input of the connection, after the connection preface
+                 * @param out the output of the connection, it is flushed but not closed
+                 * @param protocol_name "http" or "https"
+                 */
+                http2_connection(http_server &server, input_stream<char> &in, output_stream<char> &out,
+                                 sstring protocol_name);
+
+                /**
+                 * Serve the connection until the client closes it, or an error closes it
+                 * @return a future that resolves once the replies of all the streams were sent
+                 */
+                future<> process();
+
+            private:
+                class body_sink_impl;
+
+                future<stop_iteration> read_frame();
+                future<> handle_frame(uint8_t type, uint8_t flags, uint32_t stream_id, temporary_buffer<char> payload);
+                future<> handle_data(uint8_t flags, uint32_t stream_id, temporary_buffer<char> payload);
+                future<> handle_headers(uint8_t flags, uint32_t stream_id, temporary_buffer<char> payload);
+                future<> handle_continuation(uint8_t flags, uint32_t stream_id, temporary_buffer<char> payload);
+                future<> handle_settings(uint8_t flags, uint32_t stream_id, temporary_buffer<char> payload);
+                future<> handle_window_update(uint32_t stream_id, temporary_buffer<char> payload);
+                future<> end_headers();
+                std::unique_ptr<request> make_request(const hpack_header_list &headers);
+                void dispatch(lw_shared_ptr<http2_stream> stream);
+                future<> send_reply(lw_shared_ptr<http2_stream> stream, std::unique_ptr<reply> rep);
+                future<> send_data(lw_shared_ptr<http2_stream> stream, temporary_buffer<char> data, bool end_stream);
+                future<> send_window_update(uint32_t stream_id, uint32_t increment);
+                future<> release_body(http2_stream &stream);
+                future<> reset_stream(uint32_t stream_id, uint32_t error);
+                future<> write_frame(uint8_t type, uint8_t flags, uint32_t stream_id, temporary_buffer<char> payload);
+                future<> write_frames(temporary_buffer<char> frames);
+                future<> flush();
+
+                http_server &_server;
+                input_stream<char> &_in;
+                output_stream<char> &_out;
+                sstring _protocol_name;
+                hpack_decoder _decoder {hpack_table::default_max_size, max_header_list_size};
+                hpack_encoder _encoder;
+                std::unordered_map<uint32_t, lw_shared_ptr<http2_stream>> _streams;
+                // the highest stream the client opened
+                uint32_t _last_stream_id = 0;
+                bool _settings_received = false;
+                // the header block being read, continued by CONTINUATION frames until END_HEADERS
+                std::string _header_block;
+                uint32_t _header_stream_id = 0;
+                bool _header_end_stream = false;
+                // the settings of the client
+                uint32_t _max_frame_size = default_max_frame_size;
+                int64_t _initial_window_size = default_window_size;
+                int64_t _send_window = default_window_size;
+                int64_t _recv_window = connection_window_size;
+                // signalled when a send window grows, broken once the connection closes
+                condition_variable _window_available;
+                bool _closing = false;
+                semaphore _write_sem {1};
+                gate _streams_gate;
+            };
+
+        }    // namespace httpd
+
+    }    // namespace actor
+}    // namespace nil
@@ -25,6 +25,7 @@
 #pragma once
 
 #include <nil/actor/http/request_parser.hh>
+#include <nil/actor/http/simd_request_parser.hh>
 #include <nil/actor/http/request.hh>
 #include <nil/actor/core/core.hh>
 #include <nil/actor/core/sstring.hh>
@@ -33,6 +34,7 @@
 #include <nil/actor/core/distributed.hh>
 #include <nil/actor/core/queue.hh>
 #include <nil/actor/core/gate.hh>
+#include <nil/actor/core/semaphore.hh>
 #include <nil/actor/core/metrics_registration.hh>
 #include <nil/actor/detail/std-compat.hh>
 
@@ -43,6 +45,7 @@
 #include <bitset>
 #include <limits>
 #include <cctype>
+#include <ctime>
 #include <vector>
 
 #include <boost/intrusive/list.hpp>
@@ -58,10 +61,19 @@ namespace nil {
 
             class http_server;
             class http_stats;
+            class http2_connection;
             struct reply;
 
             using namespace std::chrono_literals;
 
+            /**
+             * The parser the connections of an http_server read request heads with
+             */
+            enum class request_parser_type {
+                ragel,    ///< http_request_parser, the default
+                simd,     ///< simd_request_parser
+            };
+
             class http_stats {
                 metrics::metric_groups _metric_groups;
 
@@ -73,66 +85,74 @@ namespace nil {
                 http_server &_server;
                 connected_socket _fd;
                 input_stream<char> _read_buf;
+                // its flushes are not batched when files are sent with sendfile(), which has to follow
+                // the head once it is on the socket
                 output_stream<char> _write_buf;
                 static constexpr size_t limit = 4096;
+                // bodies up to this size are sent in the same buffer as the headers
+                static constexpr size_t max_inlined_body = 8192;
                 using tmp_buf = temporary_buffer<char>;
                 http_request_parser _parser;
+                simd_request_parser _simd_parser;
                 std::unique_ptr<request> _req;
                 std::unique_ptr<reply> _resp;
-                // null element marks eof
-                queue<std::unique_ptr<reply>> _replies {10};
+                // the replies in the order of the requests, resolved once their handler is done,
+                // a null reply marks eof
+                queue<future<std::unique_ptr<reply>>> _replies {10};
+                // the requests being handled, up to the pipeline depth of the server
+                size_t _pipeline_depth = 1;
+                semaphore _pipeline_sem {0};
                 bool _done = false;
+                bool _first_request = true;
+                // the client chose HTTP/2, the connection is handed to an http2_connection
+                bool _http2 = false;
 
             public:
-                connection(http_server &server, connected_socket &&fd, socket_address addr) :
-                    _server(server), _fd(std::move(fd)), _read_buf(_fd.input()), _write_buf(_fd.output()) {
-                    on_new_connection();
-                }
+                connection(http_server &server, connected_socket &&fd, socket_address addr);
                 ~connection();
                 void on_new_connection();
 
                 future<> process();
                 void shutdown();
                 future<> read();
+                future<> negotiate_protocol();
                 future<> read_one();
+                template<typename Parser>
+                future<> read_one(Parser &parser);
                 future<> respond();
                 future<> do_response_loop();
 
-                void set_headers(reply &resp);
-
                 future<> start_response();
-                future<> write_reply_headers(std::unordered_map<sstring, sstring>::iterator hi);
-
-                static short hex_to_byte(char c);
-
-                /**
-                 * Convert a hex encoded 2 bytes substring to char
-                 */
-                static char hexstr_to_char(const std::string_view &in, size_t from);
 
                 /**
-                 * URL_decode a substring and place it in the given out sstring
+                 * Get the path part of the request url, the query parameters
+                 * after the question mark are decoded by request::get_query_param
                  */
-                static bool url_decode(const std::string_view &in, sstring &out);
+                static sstring set_query_param(request &req);
 
                 /**
-                 * Add a single query parameter to the parameter list
+                 * Hand a request to the routes of the server
+                 * @return the reply, once the handler is done with it
                  */
-                static void add_param(request &req, const std::string_view &param);
+                future<std::unique_ptr<reply>> generate_reply(std::unique_ptr<request> req);
 
                 /**
-                 * Set the query parameters in the request objects.
-                 * query param appear after the question mark and are separated
-                 * by the ampersand sign
+                 * Whether the connection is closed after the reply to a request
                  */
-                static sstring set_query_param(request &req);
-
-                future<bool> generate_reply(std::unique_ptr<request> req);
+                static bool should_close(const request &req);
                 void generate_error_reply_and_close(std::unique_ptr<request> req, reply::status_type status,
                                                     const sstring &msg);
 
                 future<> write_body();
 
+                /**
+                 * Send the file offered by the reply with a Content-Length, straight from the
+                 * page cache to the socket
+                 * @param fd the file, opened by open_cached_file()
+                 * @param size the size of the file
+                 */
+                future<> send_file(file_desc fd, size_t size);
+
                 output_stream<char> &out();
             };
 
@@ -147,9 +167,18 @@ namespace nil {
                 uint64_t _read_errors = 0;
                 uint64_t _respond_errors = 0;
                 shared_ptr<nil::actor::tls::server_credentials> _credentials;
+                // the Server and Date headers of every reply, rendered once a second
                 sstring _date = http_date();
-                timer<> _date_format_timer {[this] { _date = http_date(); }};
+                sstring _common_headers = common_headers(_date);
+                timer<> _date_format_timer {[this] {
+                    _date = http_date();
+                    _common_headers = common_headers(_date);
+                }};
                 size_t _content_length_limit = std::numeric_limits<size_t>::max();
+                request_parser_type _request_parser = request_parser_type::ragel;
+                size_t _pipeline_depth = 1;
+                bool _http2 = false;
+                bool _sendfile = false;
                 gate _task_gate;
 
             public:
@@ -190,6 +219,49 @@ namespace nil {
 
                 void set_content_length_limit(size_t limit);
 
+                request_parser_type get_request_parser() const;
+
+                /**
+                 * Select the parser of the request heads, it applies to
+                 * the requests read after the call
+                 */
+                void set_request_parser(request_parser_type type);
+
+                size_t get_pipeline_depth() const;
+
+                /**
+                 * Set how many requests of a connection are handled concurrently, it
+                 * applies to the connections accepted after the call. When a client
+                 * pipelines requests, the ones that follow a request without a body are
+                 * read and handed to their handlers while it is handled, the replies
+                 * are still sent in the order of the requests. The default of 1 handles
+                 * the requests of a connection one after the other.
+                 */
+                void set_pipeline_depth(size_t depth);
+
+                bool get_http2() const;
+
+                /**
+                 * Serve HTTP/2 to the clients that ask for it, next to HTTP/1.x.
+                 * In clear text a client chooses it with prior knowledge, by starting
+                 * the connection with the HTTP/2 preface (h2c), there is no upgrade
+                 * from HTTP/1.1. With tls credentials it is negotiated with ALPN, the
+                 * listeners created after the call offer "h2" and "http/1.1", the
+                 * credentials themselves are left as they are.
+                 */
+                void set_http2(bool enable);
+
+                bool get_sendfile() const;
+
+                /**
+                 * Send the files offered by the replies (reply::set_body_file) with sendfile(),
+                 * on the sockets that support it. A file is only sent this way when it is in
+                 * the page cache already, the others are read and written as usual. Replies
+                 * are no longer flushed in batches, it affects the connections accepted after
+                 * the call.
+                 */
+                void set_sendfile(bool enable);
+
                 future<> listen(socket_address addr, listen_options lo);
                 future<> listen(socket_address addr);
                 future<> stop();
@@ -204,11 +276,15 @@ namespace nil {
                 // Write the current date in the specific "preferred format" defined in
                 // RFC 7231, Section 7.1.1.1.
                 static sstring http_date();
+                // Write the given time in the same format.
+                static sstring http_date(std::time_t t);
 
             private:
+                static sstring common_headers(const sstring &date);
                 future<> do_accept_one(int which);
                 boost::intrusive::list<connection> _connections;
                 friend class nil::actor::httpd::connection;
+                friend class http2_connection;
                 friend class http_server_tester;
             };
 
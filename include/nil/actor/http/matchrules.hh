@@ -116,6 +116,20 @@ namespace nil {
                     return *this;
                 }
 
+                /**
+                 * @return the handler returned when this match rule is met
+                 */
+                handler_base *handler() const {
+                    return _handler;
+                }
+
+                /**
+                 * @return the matchers of the rule, in the order they are applied
+                 */
+                const std::vector<matcher *> &matchers() const {
+                    return _match_list;
+                }
+
             private:
                 std::vector<matcher *> _match_list;
                 handler_base *_handler;
@@ -34,6 +34,8 @@
 //
 #pragma once
 
+#include <optional>
+#include <string_view>
 #include <unordered_map>
 
 #include <nil/actor/core/sstring.hh>
@@ -47,6 +49,7 @@ namespace nil {
         namespace httpd {
 
             class connection;
+            class http2_connection;
             class routes;
 
             /**
@@ -89,7 +92,6 @@ namespace nil {
                  */
                 sstring _content;
 
-                sstring _response_line;
                 reply() : _status(status_type::ok) {
                 }
 
@@ -135,13 +137,12 @@ namespace nil {
                 }
                 /**
                  * Done should be called before using the reply.
-                 * It would set the response line
+                 * The response line is rendered when the reply is written
                  */
                 reply &done() {
-                    _response_line = response_line();
                     return *this;
                 }
-                sstring response_line();
+                sstring response_line() const;
 
                 /*!
                  * \brief use an output stream to write the message body
@@ -173,13 +174,62 @@ namespace nil {
                  */
                 void write_body(const sstring &content_type, const sstring &content);
 
+                /*!
+                 * \brief Write a buffer as the reply
+                 *
+                 * Like the string overload, but the buffer is sent as it is, so a content shared between
+                 * replies, e.g. by a cache, is not copied for each of them.
+                 *
+                 * \param content_type - is used to choose the content type of the body
+                 * \param content - the message content, it replaces _content
+                 */
+                void write_body(const sstring &content_type, temporary_buffer<char> content);
+
+                /*!
+                 * \brief Offer to send a file on the disk as the message body
+                 *
+                 * When the server enables it (http_server::set_sendfile), the socket supports it and the file
+                 * is in the page cache, the file is sent with a Content-Length, straight from the page cache
+                 * to the socket with sendfile(). Otherwise, e.g. over TLS, the native stack or for a cold file,
+                 * the body writer given to write_body() is used, so it must write the same content.
+                 *
+                 * \param file_name - the full path to the file
+                 */
+                void set_body_file(const sstring &file_name);
+
             private:
-                future<> write_reply_to_connection(connection &con);
-                future<> write_reply_headers(connection &connection);
+                /**
+                 * Render the response line, the common headers, the reply headers and the framing of the
+                 * body into one buffer, followed by the body itself if with_body is set. A body_length
+                 * frames the body with a Content-Length even if it is written by the body writer.
+                 */
+                temporary_buffer<char> render_head(const sstring &common_headers, bool with_body,
+                                                   std::optional<size_t> body_length = std::nullopt) const;
+                /**
+                 * Write the head render_head() renders to a buffered stream
+                 */
+                future<> write_head(output_stream<char> &out, const sstring &common_headers, bool with_body,
+                                    std::optional<size_t> body_length = std::nullopt) const;
+                future<> write_reply_to_connection(output_stream<char> &out, const sstring &common_headers);
+
+                /**
+                 * The body of a reply without a body writer, the buffer given to write_body() if there is one
+                 */
+                std::string_view body() const {
+                    if (_body_buffer.empty()) {
+                        return _content;
+                    }
+                    return std::string_view(_body_buffer.get(), _body_buffer.size());
+                }
 
                 noncopyable_function<future<>(output_stream<char> &&)> _body_writer;
+                // the body given to write_body() as a buffer, in place of _content
+                temporary_buffer<char> _body_buffer;
+                // the file set_body_file() offered in place of the body writer
+                sstring _body_file;
                 friend class routes;
                 friend class connection;
+                friend class http2_connection;
             };
 
         }    // namespace httpd
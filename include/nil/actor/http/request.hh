@@ -33,11 +33,17 @@
 //
 #pragma once
 
+#include <algorithm>
+#include <initializer_list>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 #include <strings.h>
 
 #include <nil/actor/core/sstring.hh>
+#include <nil/actor/core/iostream.hh>
 #include <nil/actor/http/common.hh>
 
 namespace nil {
@@ -46,6 +52,172 @@ namespace nil {
         namespace httpd {
             class connection;
 
+            /**
+             * Allocates the strings of a request from a few large blocks, so that
+             * parsing a request does not allocate per header. The strings stay in
+             * place until the arena is destroyed.
+             */
+            class request_arena {
+                static constexpr size_t block_size = 2048;
+                std::vector<std::unique_ptr<char[]>> _blocks;
+                std::vector<temporary_buffer<char>> _buffers;
+                char *_pos = nullptr;
+                size_t _free = 0;
+
+            public:
+                /**
+                 * Copy the concatenation of strings into the arena
+                 * @param parts the strings to concatenate
+                 * @return the copy, valid as long as the arena
+                 */
+                std::string_view store(std::initializer_list<std::string_view> parts);
+
+                /**
+                 * Reserve room in the arena
+                 * @param size the number of bytes
+                 * @return the room, valid as long as the arena
+                 */
+                char *allocate(size_t size);
+
+                /**
+                 * Keep a buffer, so that views into it can be used instead of copies
+                 * @param buf the buffer to keep
+                 * @return the buffer contents, valid as long as the arena
+                 */
+                std::string_view adopt(temporary_buffer<char> buf) {
+                    _buffers.push_back(std::move(buf));
+                    return std::string_view(_buffers.back().get(), _buffers.back().size());
+                }
+            };
+
+            /**
+             * The headers of a request, names and values are views into the
+             * request arena. Names are compared case insensitively and a name
+             * appears at most once, repeated headers are combined into one.
+             * Lookups are hashed once a request has more than a few headers, and
+             * a combined value grows in place with room to spare, so neither the
+             * number of headers nor of repetitions makes parsing quadratic.
+             */
+            class header_map {
+            public:
+                using value_type = std::pair<std::string_view, std::string_view>;
+                using const_iterator = std::vector<value_type>::const_iterator;
+
+                const_iterator begin() const {
+                    return _headers.begin();
+                }
+
+                const_iterator end() const {
+                    return _headers.end();
+                }
+
+                size_t size() const {
+                    return _headers.size();
+                }
+
+                bool empty() const {
+                    return _headers.empty();
+                }
+
+                /**
+                 * Search for a header
+                 * @param name the header name
+                 * @return an iterator to the header, or end() if it does not exist
+                 */
+                const_iterator find(std::string_view name) const;
+
+                size_t count(std::string_view name) const {
+                    return find(name) != end();
+                }
+
+                /**
+                 * Set a header, replacing the value of an existing header of that name
+                 * @param name the header name
+                 * @param value the header value
+                 */
+                void set(std::string_view name, std::string_view value);
+
+                /**
+                 * Add a header, the value of an existing header of that name
+                 * is extended with the separator and the new value
+                 * @param name the header name
+                 * @param value the header value
+                 * @param separator placed between the existing and the new value
+                 */
+                void add(std::string_view name, std::string_view value, std::string_view separator = ",");
+
+                /**
+                 * Add a header like add(), without copying strings that the
+                 * arena of the map already holds
+                 * @param name the header name, held by arena()
+                 * @param value the header value, held by arena()
+                 */
+                void add_stored(std::string_view name, std::string_view value);
+
+                request_arena &arena() {
+                    return _arena;
+                }
+
+                /**
+                 * The value of a header, assigning to it sets the header
+                 */
+                class reference {
+                    header_map &_map;
+                    std::string_view _name;
+
+                public:
+                    reference(header_map &map, std::string_view name) : _map(map), _name(name) {
+                    }
+
+                    reference &operator=(std::string_view value) {
+                        _map.set(_name, value);
+                        return *this;
+                    }
+
+                    /**
+                     * @return the header value, or empty string if it does not exist
+                     */
+                    operator sstring() const {
+                        auto i = _map.find(_name);
+                        return i == _map.end() ? sstring() : sstring(i->second.data(), i->second.size());
+                    }
+                };
+
+                /**
+                 * Access a header by name, as with the map the headers used to be,
+                 * e.g. headers["Host"] = "localhost". Unlike the map, reading a header
+                 * that does not exist does not add it.
+                 * @param name the header name, it only has to live as long as the reference
+                 */
+                reference operator[](std::string_view name) {
+                    return reference(*this, name);
+                }
+
+            private:
+                // a linear scan is faster for the few headers of a typical request
+                static constexpr size_t index_threshold = 16;
+
+                struct name_hash {
+                    size_t operator()(std::string_view name) const;
+                };
+                struct name_equal {
+                    bool operator()(std::string_view a, std::string_view b) const;
+                };
+                // the room a combined value may grow into before it has to move
+                struct growable {
+                    char *data = nullptr;
+                    size_t capacity = 0;
+                };
+
+                void push(std::string_view name, std::string_view value);
+                void append(size_t index, std::string_view separator, std::string_view value);
+
+                request_arena _arena;
+                std::vector<value_type> _headers;
+                std::vector<growable> _growable;
+                std::unordered_map<std::string_view, size_t, name_hash, name_equal> _index;
+            };
+
             /**
              * A request received from a client.
              */
@@ -57,7 +229,7 @@ namespace nil {
                 };
 
                 struct case_insensitive_cmp {
-                    bool operator()(const sstring &s1, const sstring &s2) const {
+                    bool operator()(std::string_view s1, std::string_view s2) const {
                         return std::equal(s1.begin(), s1.end(), s2.begin(), s2.end(),
                                           [](char a, char b) { return ::tolower(a) == ::tolower(b); });
                     }
@@ -77,11 +249,18 @@ namespace nil {
                 int http_version_minor;
                 ctclass content_type_class;
                 size_t content_length = 0;
-                std::unordered_map<sstring, sstring, case_insensitive_hash, case_insensitive_cmp> _headers;
-                std::unordered_map<sstring, sstring> query_parameters;
+                // the body is sent with chunked transfer-encoding, content_length is then 0
+                bool chunked = false;
+                header_map _headers;
                 connection *connection_ptr;
                 parameters param;
                 sstring content;
+                /**
+                 * The request body, for handlers that asked for it with handler_base::stream_body().
+                 * For the other handlers the body is read into content before they are called.
+                 * Whatever the handler leaves unread is skipped once its reply is ready.
+                 */
+                input_stream<char> content_stream;
                 sstring protocol_name = "http";
 
                 /**
@@ -94,20 +273,36 @@ namespace nil {
                     if (res == _headers.end()) {
                         return "";
                     }
-                    return res->second;
+                    return sstring(res->second.data(), res->second.size());
                 }
 
                 /**
-                 * Search for the first header of a given name
-                 * @param name the header name
-                 * @return a pointer to the header value, if it exists or empty string
+                 * Search for a query parameter, the query string of the url is
+                 * decoded on each call. A parameter whose key or value is not
+                 * properly encoded is ignored, and when a parameter is repeated,
+                 * the last one that is properly encoded wins.
+                 * @param name the parameter name
+                 * @return the decoded parameter value, if it exists or empty string
                  */
-                sstring get_query_param(const sstring &name) const {
-                    auto res = query_parameters.find(name);
-                    if (res == query_parameters.end()) {
-                        return "";
-                    }
-                    return res->second;
+                sstring get_query_param(const sstring &name) const;
+
+                /**
+                 * Decode all the query parameters, with the rules of get_query_param().
+                 * It used to be a member filled for every request, it is now built on
+                 * each call, so code that wrote to it has to change.
+                 * @return the decoded parameters by name
+                 */
+                [[deprecated("use get_query_param()")]] std::unordered_map<sstring, sstring>
+                    query_parameters() const;
+
+                /**
+                 * Get the query string of the url
+                 * @return the part of the url after the question mark, or empty string
+                 */
+                std::string_view query_string() const {
+                    std::string_view url = _url;
+                    auto pos = url.find('?');
+                    return (pos == std::string_view::npos) ? std::string_view() : url.substr(pos + 1);
                 }
 
                 /**
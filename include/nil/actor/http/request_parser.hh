@@ -57,16 +57,20 @@ namespace nil {
                 eof,
                 done,
             };
+            // a longer head is rejected rather than buffered without bound
+            static constexpr size_t max_head_size = 64 * 1024;
             std::unique_ptr<httpd::request> _req;
             sstring _field_name;
             sstring _value;
             state _state;
+            size_t _head_size;
 
         public:
             void init() {
                 init_base();
                 _req.reset(new httpd::request());
                 _state = state::eof;
+                _head_size = 0;
 
 #line 70 "include/nil/actor/network/http/request_parser.hh"
                 { _fsm_cs = (int)start; }
@@ -80,6 +84,7 @@ namespace nil {
                     return get_str();
                 };
                 bool done = false;
+                char *start = p;
                 if (p != pe) {
                     _state = state::error;
                 }
@@ -423,16 +428,12 @@ namespace nil {
                 _ctr41 : {
 #line 78 "src/http/request_parser.rl"
 
-                    if (_req->_headers.count(_field_name)) {
-                        // RFC 7230, section 3.2.2.  Field Parsing:
-                        // A recipient MAY combine multiple header fields with the same field name into one
-                        // "field-name: field-value" pair, without changing the semantics of the message,
-                        // by appending each subsequent field value to the combined field value in order, separated by a
-                        // comma.
-                        _req->_headers[_field_name] += sstring(",") + std::move(_value);
-                    } else {
-                        _req->_headers[_field_name] = std::move(_value);
-                    }
+                    // RFC 7230, section 3.2.2.  Field Parsing:
+                    // A recipient MAY combine multiple header fields with the same field name into one
+                    // "field-name: field-value" pair, without changing the semantics of the message,
+                    // by appending each subsequent field value to the combined field value in order, separated by a
+                    // comma.
+                    _req->_headers.add(_field_name, _value);
                 }
 
 #line 476 "include/nil/actor/network/http/request_parser.hh"
@@ -445,7 +446,7 @@ namespace nil {
                     // A server that receives an obs-fold in a request message that is not
                     // within a message/http container MUST either reject the message [...]
                     // or replace each received obs-fold with one or more SP octets [...]
-                    _req->_headers[_field_name] += sstring(" ") + std::move(_value);
+                    _req->_headers.add(_field_name, _value, " ");
                 }
 
 #line 490 "include/nil/actor/network/http/request_parser.hh"
@@ -491,16 +492,12 @@ namespace nil {
                 _ctr42 : {
 #line 78 "src/http/request_parser.rl"
 
-                    if (_req->_headers.count(_field_name)) {
-                        // RFC 7230, section 3.2.2.  Field Parsing:
-                        // A recipient MAY combine multiple header fields with the same field name into one
-                        // "field-name: field-value" pair, without changing the semantics of the message,
-                        // by appending each subsequent field value to the combined field value in order, separated by a
-                        // comma.
-                        _req->_headers[_field_name] += sstring(",") + std::move(_value);
-                    } else {
-                        _req->_headers[_field_name] = std::move(_value);
-                    }
+                    // RFC 7230, section 3.2.2.  Field Parsing:
+                    // A recipient MAY combine multiple header fields with the same field name into one
+                    // "field-name: field-value" pair, without changing the semantics of the message,
+                    // by appending each subsequent field value to the combined field value in order, separated by a
+                    // comma.
+                    _req->_headers.add(_field_name, _value);
                 }
 
 #line 548 "include/nil/actor/network/http/request_parser.hh"
@@ -521,7 +518,7 @@ namespace nil {
                     // A server that receives an obs-fold in a request message that is not
                     // within a message/http container MUST either reject the message [...]
                     // or replace each received obs-fold with one or more SP octets [...]
-                    _req->_headers[_field_name] += sstring(" ") + std::move(_value);
+                    _req->_headers.add(_field_name, _value, " ");
                 }
 
 #line 570 "include/nil/actor/network/http/request_parser.hh"
@@ -808,16 +805,12 @@ namespace nil {
                 _ctr40 : {
 #line 78 "src/http/request_parser.rl"
 
-                    if (_req->_headers.count(_field_name)) {
-                        // RFC 7230, section 3.2.2.  Field Parsing:
-                        // A recipient MAY combine multiple header fields with the same field name into one
-                        // "field-name: field-value" pair, without changing the semantics of the message,
-                        // by appending each subsequent field value to the combined field value in order, separated by a
-                        // comma.
-                        _req->_headers[_field_name] += sstring(",") + std::move(_value);
-                    } else {
-                        _req->_headers[_field_name] = std::move(_value);
-                    }
+                    // RFC 7230, section 3.2.2.  Field Parsing:
+                    // A recipient MAY combine multiple header fields with the same field name into one
+                    // "field-name: field-value" pair, without changing the semantics of the message,
+                    // by appending each subsequent field value to the combined field value in order, separated by a
+                    // comma.
+                    _req->_headers.add(_field_name, _value);
                 }
 
 #line 885 "include/nil/actor/network/http/request_parser.hh"
@@ -830,7 +823,7 @@ namespace nil {
                     // A server that receives an obs-fold in a request message that is not
                     // within a message/http container MUST either reject the message [...]
                     // or replace each received obs-fold with one or more SP octets [...]
-                    _req->_headers[_field_name] += sstring(" ") + std::move(_value);
+                    _req->_headers.add(_field_name, _value, " ");
                 }
 
 #line 899 "include/nil/actor/network/http/request_parser.hh"
@@ -1155,6 +1148,11 @@ namespace nil {
                 //#ifdef __clang__
                 //#pragma clang diagnostic pop
                 //#endif
+                _head_size += p - start;
+                if (_head_size > max_head_size) {
+                    _state = state::error;
+                    return p;
+                }
                 if (!done) {
                     if (p == eof) {
                         _state = state::eof;
@@ -0,0 +1,144 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#pragma once
+
+#include <nil/actor/http/matchrules.hh>
+#include <nil/actor/http/common.hh>
+
+#include <nil/actor/core/sstring.hh>
+
+#include <array>
+#include <limits>
+#include <map>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+namespace nil {
+    namespace actor {
+
+        namespace httpd {
+
+            /**
+             * route_tree compiles the match rules of one operation type into a tree
+             * of url path segments, so that a url is matched against all the rules
+             * at once instead of rule after rule.
+             *
+             * A rule made of str_matcher and param_matcher objects is split into
+             * segments, each starting with a slash. A segment is either a fixed
+             * string, a parameter taking the url up to the next slash, or a parameter
+             * taking the remainder of the url. When several rules match a url, the
+             * first one added wins, as with a linear scan of the rules.
+             *
+             * Rules the tree cannot compile (custom matchers, strings that do not start
+             * with a slash, an empty rule) are kept aside and tried in order, ahead of
+             * the compiled rules that were added after them.
+             *
+             * The rules must not be modified after they were inserted.
+             */
+            class route_tree {
+            public:
+                using rule_cookie = uint64_t;
+
+                /**
+                 * The number of parameters a compiled rule can hold,
+                 * rules with more parameters are kept aside
+                 */
+                static constexpr unsigned max_params = 16;
+
+                /**
+                 * Add a rule to the tree
+                 * @param cookie the rule position, lower cookies have higher priority
+                 * @param rule the rule to add, it is not owned by the tree
+                 * @throws std::runtime_error if a rule with the same pattern was already
+                 * added, the tree is then left unchanged
+                 */
+                void insert(rule_cookie cookie, match_rule *rule);
+
+                /**
+                 * Remove a rule from the tree
+                 * @param cookie the cookie the rule was inserted with
+                 */
+                void erase(rule_cookie cookie);
+
+                /**
+                 * Search the rule with the highest priority that matches a url
+                 * @param url the url to match
+                 * @param params the parameters object, filled with the parameters of
+                 * the matching rule
+                 * @return the handler of the matching rule or nullptr if none matches
+                 */
+                handler_base *find(const sstring &url, parameters &params) const;
+
+            private:
+                enum class segment_type { fixed, param, remainder };
+
+                struct segment {
+                    segment_type type;
+                    sstring str;
+                };
+
+                struct terminal {
+                    rule_cookie cookie;
+                    handler_base *handler;
+                    std::vector<sstring> names;
+                };
+
+                struct node {
+                    // fixed string children, sorted by their segment
+                    std::vector<std::pair<sstring, std::unique_ptr<node>>> children;
+                    std::unique_ptr<node> param;
+                    std::unique_ptr<node> remainder;
+                    std::unique_ptr<terminal> term;
+                    // the lowest cookie of the rules ending in this subtree
+                    rule_cookie min_cookie = std::numeric_limits<rule_cookie>::max();
+                };
+
+                using span = std::pair<size_t, size_t>;
+
+                struct match_state {
+                    rule_cookie cookie = std::numeric_limits<rule_cookie>::max();
+                    const terminal *best = nullptr;
+                    std::array<span, max_params> spans;
+                    std::array<span, max_params> best_spans;
+                };
+
+                static bool compile(const match_rule &rule, std::vector<segment> &segments,
+                                    std::vector<sstring> &names);
+                static sstring describe(const std::vector<segment> &segments, const std::vector<sstring> &names);
+                const node *find_node(const std::vector<segment> &segments) const;
+                void add(rule_cookie cookie, const match_rule &rule, std::vector<segment> segments,
+                         std::vector<sstring> names);
+                void match(const node &n, std::string_view url, size_t ind, unsigned depth, match_state &st) const;
+
+                node _root;
+                std::map<rule_cookie, const match_rule *> _compiled;
+                std::map<rule_cookie, match_rule *> _opaque;
+            };
+
+        }    // namespace httpd
+
+    }    // namespace actor
+}    // namespace nil
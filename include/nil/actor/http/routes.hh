@@ -25,6 +25,7 @@
 #pragma once
 
 #include <nil/actor/http/matchrules.hh>
+#include <nil/actor/http/route_tree.hh>
 #include <nil/actor/http/handlers.hh>
 #include <nil/actor/http/common.hh>
 #include <nil/actor/http/reply.hh>
@@ -75,7 +76,8 @@ namespace nil {
              * It uses two decision mechanism exact match, if a url matches exactly
              * (an optional leading slash is permitted) it is choosen
              * If not, the matching rules are used.
-             * matching rules are evaluated by their insertion order
+             * matching rules are evaluated by their insertion order,
+             * they are compiled into a \ref route_tree "route_tree" per operation type
              */
             class routes {
             public:
@@ -107,19 +109,23 @@ namespace nil {
                  * @param rule a rule to add
                  * @param type the operation type
                  * @return it self
+                 * @throws std::runtime_error if a rule with the same pattern was already
+                 * added, the rule is then not added and still belongs to the caller
                  */
                 routes &add(match_rule *rule, operation_type type = GET) {
-                    _rules[type][_rover++] = rule;
+                    add_cookie(rule, type);
                     return *this;
                 }
 
                 /**
                  * Add a url match to a handler:
                  * Example  routes.add(GET, url("/api").remainder("path"), handler);
+                 * The routes object owns the handler, even if adding it fails
                  * @param type
                  * @param url
                  * @param handler
                  * @return
+                 * @throws std::runtime_error if a rule with the same url was already added
                  */
                 routes &add(operation_type type, const url &url, handler_base *handler);
 
@@ -173,14 +179,18 @@ namespace nil {
                  */
                 sstring normalize_url(const sstring &url);
 
+                future<std::unique_ptr<reply>> call_handler(handler_base *handler, const sstring &path,
+                                                            std::unique_ptr<request> req, std::unique_ptr<reply> rep);
+
                 std::unordered_map<sstring, handler_base *> _map[NUM_OPERATION];
 
             public:
-                using rule_cookie = uint64_t;
+                using rule_cookie = route_tree::rule_cookie;
 
             private:
                 rule_cookie _rover = 0;
                 std::map<rule_cookie, match_rule *> _rules[NUM_OPERATION];
+                route_tree _rule_trees[NUM_OPERATION];
                 // default Handler -- for any HTTP Method and Path (/*)
                 handler_base *_default_handler = nullptr;
 
@@ -229,8 +239,11 @@ namespace nil {
                  * @param rule a rule to add
                  * @param type the operation type
                  * @return a cookie using which the rule can be removed
+                 * @throws std::runtime_error if a rule with the same pattern was already
+                 * added, the rule is then not added and still belongs to the caller
                  */
                 rule_cookie add_cookie(match_rule *rule, operation_type type) {
+                    _rule_trees[type].insert(_rover, rule);
                     auto pos = _rover++;
                     _rules[type][pos] = rule;
                     return pos;
@@ -0,0 +1,123 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#pragma once
+
+#include <nil/actor/core/future.hh>
+#include <nil/actor/core/temporary_buffer.hh>
+#include <nil/actor/http/request.hh>
+
+#include <memory>
+#include <optional>
+#include <vector>
+
+namespace nil {
+    namespace actor {
+
+        /**
+         * A request head parser accepting the same grammar as http_request_parser,
+         * meant for servers where parsing is a large part of the work.
+         *
+         * It first finds the blank line ending the head, then splits the start line
+         * and the header fields with scans of 32 bytes (AVX2) or 16 bytes (SSE4.2)
+         * at a time, and byte by byte otherwise. The scans of every instruction set
+         * are built whatever the build targets, a parser uses the best one the CPU
+         * supports unless it is given another. Header names and values are views
+         * into the received buffer, which the request keeps in its arena instead of
+         * copying each string.
+         * A head split across several buffers is first gathered into one.
+         *
+         * Like http_request_parser, it is used as a consumer of an input_stream.
+         */
+        class simd_request_parser {
+        public:
+            using unconsumed_remainder = std::optional<temporary_buffer<char>>;
+
+            /**
+             * Heads longer than that many bytes are rejected
+             */
+            static constexpr size_t max_head_size = 64 * 1024;
+
+            /**
+             * The instruction sets of the block scans, generic scans byte by byte
+             * (and 16 bytes at a time with SSE2 on x86-64)
+             */
+            enum class isa {
+                generic,
+                sse4_2,
+                avx2,
+            };
+
+            /**
+             * The block scans of an instruction set, defined in the source
+             */
+            struct scans;
+
+            /**
+             * Whether the CPU supports the scans of an instruction set
+             */
+            static bool supports(isa set);
+
+            /**
+             * The fastest instruction set supported by the CPU
+             */
+            static isa best_isa();
+
+            /**
+             * @param set the instruction set of the scans, throws std::invalid_argument if the
+             * CPU does not support it
+             */
+            explicit simd_request_parser(isa set = best_isa());
+
+            void init();
+            future<unconsumed_remainder> operator()(temporary_buffer<char> buf);
+
+            std::unique_ptr<httpd::request> get_parsed_request() {
+                return std::move(_req);
+            }
+            bool eof() const {
+                return _state == state::eof;
+            }
+            bool failed() const {
+                return _state == state::error;
+            }
+
+        private:
+            enum class state {
+                error,
+                eof,
+                done,
+            };
+
+            bool parse(temporary_buffer<char> head);
+
+            const scans *_scans;
+            std::unique_ptr<httpd::request> _req;
+            // the beginning of a head that did not fit in one buffer
+            std::vector<char> _partial;
+            state _state = state::eof;
+        };
+
+    }    // namespace actor
+}    // namespace nil
@@ -41,6 +41,8 @@
 namespace nil {
     namespace actor {
 
+        class file_desc;
+
         inline bool is_ip_unspecified(const ipv4_addr &addr) noexcept {
             return addr.is_ip_unspecified();
         }
@@ -198,7 +200,20 @@ namespace nil {
             ///
             /// Gets an object that sends data to the remote endpoint.
             /// \param buffer_size how much data to buffer
-            output_stream<char> output(size_t buffer_size = 8192);
+            /// \param batch_flushes whether the flushes are deferred and batched with the other
+            ///        streams of the shard, when unset the data is on the socket once flush() resolves
+            output_stream<char> output(size_t buffer_size = 8192, bool batch_flushes = true);
+            /// Whether sendfile() is supported, only the sockets of the posix stack support it.
+            bool supports_sendfile() const;
+            /// Sends a range of a file to the remote endpoint, without copying it through userspace.
+            ///
+            /// The data written to the output stream before has to be on the socket already, flush an
+            /// output stream without batched flushes first. The file should be in the page cache, the
+            /// call blocks the reactor while it reads the pages that are not.
+            /// \param fd the file, opened for reading
+            /// \param offset where the range starts in the file
+            /// \param size the length of the range, the file must not end before it
+            future<> sendfile(file_desc &fd, uint64_t offset, size_t size);
             /// Sets the TCP_NODELAY option (disabling Nagle's algorithm)
             void set_nodelay(bool nodelay);
             /// Gets the TCP_NODELAY option (Nagle's algorithm)
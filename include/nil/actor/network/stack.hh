@@ -52,6 +52,8 @@ namespace nil {
                 virtual keepalive_params get_keepalive_parameters() const = 0;
                 virtual void set_sockopt(int level, int optname, const void *data, size_t len) = 0;
                 virtual int get_sockopt(int level, int optname, void *data, size_t len) const = 0;
+                virtual bool supports_sendfile() const;
+                virtual future<> sendfile(file_desc &fd, uint64_t offset, size_t size);
             };
 
             class socket_impl {
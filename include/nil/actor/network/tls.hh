@@ -26,6 +26,7 @@
 
 #include <functional>
 #include <unordered_set>
+#include <vector>
 
 #include <boost/any.hpp>
 
@@ -211,6 +212,15 @@ namespace nil {
                  */
                 void set_dn_verification_callback(dn_callback);
 
+                /**
+                 * Application protocols to negotiate with ALPN (RFC 7301), in order
+                 * of preference, e.g. {"h2", "http/1.1"}. A server picks the first
+                 * of its own protocols the client offers.
+                 * The negotiated protocol is returned by get_alpn_protocol().
+                 */
+                void set_alpn_protocols(const std::vector<sstring> &);
+                const std::vector<sstring> &get_alpn_protocols() const;
+
             private:
                 class impl;
                 friend class session;
@@ -278,6 +288,7 @@ namespace nil {
                 future<> set_system_trust();
                 void set_client_auth(client_auth);
                 void set_priority_string(const sstring &);
+                void set_alpn_protocols(const std::vector<sstring> &);
 
                 void apply_to(certificate_credentials &) const;
 
@@ -288,6 +299,7 @@ namespace nil {
                 std::multimap<sstring, boost::any> _blobs;
                 client_auth _client_auth = client_auth::NONE;
                 sstring _priority;
+                std::vector<sstring> _alpn_protocols;
             };
 
             /**
@@ -321,6 +333,10 @@ namespace nil {
             future<connected_socket> wrap_client(shared_ptr<certificate_credentials>, connected_socket &&,
                                                  sstring name = {});
             future<connected_socket> wrap_server(shared_ptr<server_credentials>, connected_socket &&);
+            /// Like the one above, offering the given ALPN protocols in place of the ones of the credentials,
+            /// if there are any
+            future<connected_socket> wrap_server(shared_ptr<server_credentials>, connected_socket &&,
+                                                 std::vector<sstring> alpn_protocols);
             /// @}
 
             /**
@@ -335,6 +351,26 @@ namespace nil {
             // Wraps an existing server socket in SSL
             server_socket listen(shared_ptr<server_credentials>, server_socket);
             /// @}
+
+            /**
+             * Like the ones above, but the listener offers the given ALPN protocols, if there are any,
+             * in place of the ones of the credentials. The credentials are left as they are, so they
+             * can be shared with listeners that offer other protocols.
+             */
+            /// @{
+            server_socket listen(shared_ptr<server_credentials>, socket_address sa, listen_options opts,
+                                 std::vector<sstring> alpn_protocols);
+            server_socket listen(shared_ptr<server_credentials>, server_socket, std::vector<sstring> alpn_protocols);
+            /// @}
+
+            /**
+             * Get the application protocol negotiated with ALPN on a connection,
+             * waiting for the handshake to complete if it has not yet.
+             *
+             * \return the protocol, or an empty string if none was negotiated or
+             *         the connection is not a TLS one
+             */
+            future<sstring> get_alpn_protocol(connected_socket &);
         }    // namespace tls
     }        // namespace actor
 }    // namespace nil
@@ -0,0 +1,86 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+
+#pragma once
+
+#include <nil/actor/core/future.hh>
+#include <nil/actor/core/queue.hh>
+#include <nil/actor/core/shared_ptr.hh>
+#include <nil/actor/core/sharded.hh>
+#include <nil/actor/network/api.hh>
+#include <nil/actor/network/stack.hh>
+
+#include <boost/optional.hpp>
+
+namespace nil {
+    namespace actor {
+
+        namespace rpc {
+
+            /// Connects rpc clients to rpc servers of the same process without going through the
+            /// network stack.
+            ///
+            /// A server listens by being given the socket returned by listen() on its shard, a
+            /// client connects through a socket made by make_socket(), passed to its constructor
+            /// instead of a network socket. The connection goes to the server on the shard the
+            /// socket was made for, by default the client's own shard, so that a call to a
+            /// service on the same shard never leaves it.
+            ///
+            /// Written buffers are handed to the peer as they are, across shards only their
+            /// ownership moves and they are freed on the shard that allocated them. The address
+            /// given to connect() is ignored and peers see each other at an unspecified address.
+            ///
+            /// The transport must be constructed before, and stopped after, the servers and
+            /// clients using it, and be reachable from all shards.
+            class in_process_transport {
+                std::vector<lw_shared_ptr<queue<connected_socket>>> _listeners;
+                size_t _max_queued_buffers;
+
+            public:
+                /// \param max_queued_buffers buffers a connection queues for a reader that is
+                ///        behind, before the writer has to wait
+                explicit in_process_transport(size_t max_queued_buffers = 128);
+
+                /// Returns the socket the server of this shard accepts in-process connections on.
+                server_socket listen();
+                /// Returns a socket connecting to the server on the given shard, by default the current one.
+                socket make_socket(boost::optional<unsigned> shard = boost::none);
+                /// Stops accepting connections on all shards, must be called after the servers are
+                /// stopped and before the transport is destroyed.
+                future<> stop();
+
+                // the queue of connections made to the server of this shard, if it listens
+                lw_shared_ptr<queue<connected_socket>> listener() const {
+                    return _listeners[this_shard_id()];
+                }
+                size_t max_queued_buffers() const {
+                    return _max_queued_buffers;
+                }
+            };
+
+        }    // namespace rpc
+
+    }    // namespace actor
+}    // namespace nil
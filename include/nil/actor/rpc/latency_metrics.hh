@@ -0,0 +1,124 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <memory>
+#include <unordered_map>
+
+#include <nil/actor/core/sstring.hh>
+#include <nil/actor/core/metrics_registration.hh>
+#include <nil/actor/core/metrics_types.hh>
+
+namespace nil {
+    namespace actor {
+        namespace rpc {
+
+            /// Log-linear (HDR style) latency histogram with microsecond resolution.
+            ///
+            /// Every power of two range is split into 2^sub_bucket_bits linear sub-buckets,
+            /// so the recorded value is known to within 1/2^sub_bucket_bits of itself.
+            /// Values above 2^max_value_bits microseconds are clamped.
+            class latency_histogram {
+            public:
+                using clock_type = std::chrono::steady_clock;
+                using duration = clock_type::duration;
+
+                static constexpr unsigned sub_bucket_bits = 3;
+                static constexpr unsigned max_value_bits = 32;
+                static constexpr size_t bucket_count = size_t(max_value_bits - sub_bucket_bits + 1) << sub_bucket_bits;
+
+            private:
+                std::array<uint64_t, bucket_count> _buckets {};
+                uint64_t _count = 0;
+                uint64_t _sum = 0;
+
+                static size_t bucket_of(uint64_t us) noexcept;
+                static uint64_t upper_bound_of(size_t bucket) noexcept;
+
+            public:
+                void record(duration d) noexcept;
+
+                uint64_t count() const noexcept {
+                    return _count;
+                }
+                /// Sum of all recorded values.
+                duration sum() const noexcept {
+                    return std::chrono::microseconds(_sum);
+                }
+                /// Upper bound of the value below which a \c q fraction (0..1) of samples lie.
+                duration quantile(double q) const noexcept;
+                /// Exports the histogram with one bucket per power of two, in microseconds.
+                metrics::histogram to_metrics_histogram() const;
+            };
+
+            /// Per-verb RPC latency histograms exported through the metrics registry.
+            ///
+            /// Pass a pointer to client_options::latency and/or server_options::latency to
+            /// enable recording. An instance may be shared by any number of clients and
+            /// servers of the same shard and has to outlive them.
+            ///
+            /// Client side: \c latency is measured from sending a request until its reply
+            /// (or error) arrives, \c queue is the time the request waited in the outgoing
+            /// queue. Server side: \c latency is measured from reading the frame of a request
+            /// until its response is queued, broken down into \c semaphore (waiting for the
+            /// scheduling group of the verb and for memory resources) and \c handler (running
+            /// the handler); \c queue is the time the response waited in the outgoing queue.
+            class latency_metrics {
+            public:
+                struct client_verb {
+                    latency_histogram latency;
+                    latency_histogram queue;
+                };
+                struct server_verb {
+                    latency_histogram latency;
+                    latency_histogram queue;
+                    latency_histogram semaphore;
+                    latency_histogram handler;
+                };
+
+            private:
+                sstring _service;
+                std::unordered_map<uint64_t, std::unique_ptr<client_verb>> _client;
+                std::unordered_map<uint64_t, std::unique_ptr<server_verb>> _server;
+                metrics::metric_groups _metric_groups;
+
+            public:
+                /// \param service value of the "service" label of all exported metrics
+                explicit latency_metrics(sstring service);
+                latency_metrics(const latency_metrics &) = delete;
+                latency_metrics &operator=(const latency_metrics &) = delete;
+
+                /// Histograms of a verb, created and registered on first use. References stay
+                /// valid for the lifetime of this object.
+                client_verb &client(uint64_t verb);
+                server_verb &server(uint64_t verb);
+            };
+
+        }    // namespace rpc
+    }        // namespace actor
+}    // namespace nil
@@ -36,6 +36,8 @@
 #include <nil/actor/core/condition_variable.hh>
 #include <nil/actor/core/gate.hh>
 #include <nil/actor/rpc/rpc_types.hh>
+#include <nil/actor/rpc/timer_wheel.hh>
+#include <nil/actor/rpc/latency_metrics.hh>
 #include <nil/actor/core/byteorder.hh>
 #include <nil/actor/core/shared_future.hh>
 #include <nil/actor/core/queue.hh>
@@ -43,6 +45,7 @@
 #include <nil/actor/core/scheduling.hh>
 #include <nil/actor/detail/backtrace.hh>
 #include <nil/actor/detail/log.hh>
+#include <nil/actor/detail/noncopyable_function.hh>
 
 namespace nil {
     namespace actor {
@@ -106,6 +109,86 @@ namespace nil {
                     default_isolate_connection;
             };
 
+            /// Controls when frames on a compressed connection are sent uncompressed.
+            ///
+            /// Takes effect only if the peer understands raw frames, which is
+            /// negotiated together with compression.
+            struct compression_bypass_options {
+                /// Frames smaller than this are never compressed.
+                size_t min_size = 256;
+                /// Compression is skipped while the recent compressed/raw size ratio of
+                /// a verb (or of responses and stream frames) stays above this value.
+                double max_ratio = 0.9;
+                /// Compression is also skipped while it costs more than this many
+                /// nanoseconds per saved byte, zero disables the check.
+                double max_ns_per_saved_byte = 0;
+                /// While bypassing because of a poor ratio or high cost, every
+                /// probe_interval-th frame is still compressed to re-evaluate the decision.
+                unsigned probe_interval = 32;
+            };
+
+            /// Configures priority classes of the messages a connection sends.
+            ///
+            /// Every outgoing message is queued in a class. The send loop serves the classes
+            /// either strictly in order (class 0 first) or by deficit round-robin, where a class
+            /// may send up to weight * quantum bytes per turn before the next class gets its turn.
+            /// Unless fragmentation is enabled a frame is never split, so a large one delays the
+            /// other classes until it is written, but only once per turn of its class.
+            struct send_priority_options {
+                /// Weights of the classes, class 0 is the default one. Messages of a class
+                /// outside of the range are queued in the last class.
+                std::vector<unsigned> weights = {1};
+                /// Serve a class only while all lower-numbered classes are empty.
+                bool strict = false;
+                /// Bytes a class of weight 1 may send per round-robin turn.
+                size_t quantum = 64 * 1024;
+                /// Split frames larger than the credit of their class, so that the other classes
+                /// are served between the fragments. The peer reassembles them; fragmentation is
+                /// offered by a client that enables it and is used by the server only if enabled
+                /// there too.
+                bool fragment = false;
+                /// Class of the requests (on a client) or responses (on a server) of a verb,
+                /// everything is sent in class 0 if unset.
+                std::function<unsigned(uint64_t verb)> verb_class;
+            };
+
+            /// Overrides the priority class of a single call, see send_priority_options.
+            struct message_priority {
+                unsigned id;
+            };
+
+            /// Configures credit based flow control and batching of stream frames. Both ends of a
+            /// stream connection must enable it, otherwise the stream falls back to one frame per
+            /// element, with the receiver's memory limit as the only backpressure.
+            ///
+            /// Each receiver advertises a window: the sender may have at most that many bytes sent
+            /// but not yet taken by the receiving source, and waits for credit returned by the
+            /// receiver once it is used up. Elements written while the previous frame is still
+            /// being sent are coalesced into a single frame.
+            struct stream_flow_control_options {
+                /// Bytes the peer's sink may send ahead of this end's source.
+                uint32_t window = 512 * 1024;
+                /// A batch is sent without waiting for the previous frame once it reaches this size.
+                uint32_t batch_max_bytes = 64 * 1024;
+            };
+
+            /// Configures load shedding on a server, based on how long requests wait between
+            /// the reading of their frame and the start of their handler (their sojourn time),
+            /// which includes the wait for their scheduling group and for memory.
+            ///
+            /// Follows CoDel: once the sojourn time of the requests of a scheduling group stays
+            /// above target for a whole interval, requests start to be rejected with
+            /// overloaded_error, at a rate that grows with the square root of the number of
+            /// rejections until the sojourn time drops below target again. Independently of
+            /// that, requests whose propagated timeout expired while they waited are dropped,
+            /// since the client is no longer waiting for the reply.
+            struct load_shedding_options {
+                std::chrono::microseconds target = std::chrono::milliseconds(5);
+                std::chrono::microseconds interval = std::chrono::milliseconds(100);
+            };
+
+            class zero_rtt_cache;
+
             struct client_options {
                 boost::optional<net::tcp_keepalive_params> keepalive;
                 bool tcp_nodelay = true;
@@ -117,6 +200,69 @@ namespace nil {
                 ///
                 /// \see resource_limits::isolate_connection
                 sstring isolation_cookie;
+                /// Maximum number of queued messages the send loop writes back-to-back
+                /// before flushing the socket. A value of 1 disables coalescing.
+                unsigned send_batch_max_messages = 1;
+                /// Maximum number of (uncompressed) bytes coalesced into a single flush.
+                size_t send_batch_max_bytes = 256 * 1024;
+                /// Enables sending small or incompressible frames raw, see compression_bypass_options.
+                boost::optional<compression_bypass_options> compression_bypass;
+                /// Per-verb latency histograms to record into, disabled if null.
+                latency_metrics *latency = nullptr;
+                /// Priority classes of outgoing requests and stream frames.
+                send_priority_options send_priorities;
+                /// Flow control of the streams opened by this client, disabled if unset.
+                boost::optional<stream_flow_control_options> stream_flow_control;
+                /// Features negotiated with earlier connections, disabled if null. If the cache holds
+                /// the outcome of a negotiation with the same server, queued requests are sent right
+                /// behind the negotiation frame instead of after the server's reply.
+                ///
+                /// \see zero_rtt_cache
+                zero_rtt_cache *zero_rtt = nullptr;
+            };
+
+            /// Configures how a client_pool spreads calls over its connections.
+            struct client_pool_options {
+                enum class routing_type {
+                    /// Each call goes to the connection with the fewest calls awaiting a reply.
+                    least_outstanding,
+                    /// Calls go to the connection selected by verb_class, so that e.g. bulk
+                    /// transfers cannot head-of-line block latency critical verbs.
+                    verb_class,
+                };
+                /// Number of connections to the server.
+                unsigned connections = 4;
+                routing_type routing = routing_type::least_outstanding;
+                /// Maps a verb to a connection index (taken modulo the number of connections)
+                /// when routing by verb class. If the selected connection is broken, the
+                /// call falls back to the least loaded connection.
+                std::function<unsigned(uint64_t verb)> verb_class;
+                /// A broken connection is replaced on the next call routed to it, but not
+                /// sooner than this after the previous connection attempt.
+                rpc_clock_type::duration reconnect_interval = std::chrono::milliseconds(100);
+                /// If set, connection i binds to local port local_port_base + i. Together with
+                /// server_socket::load_balancing_algorithm::port on the server, and a base that
+                /// is a multiple of the server shard count, connections land on distinct shards.
+                boost::optional<uint16_t> local_port_base;
+            };
+
+            /// Configures hedging and retrying of the calls made through protocol::make_hedged_client().
+            struct call_policy_options {
+                /// A call of an idempotent verb that did not complete after this quantile (0..1) of
+                /// the verb's latency is sent again, to the alternate destination.
+                double hedge_quantile = 0.95;
+                /// Hedge delay used until the verb has min_latency_samples completed calls.
+                rpc_clock_type::duration default_hedge_delay = std::chrono::milliseconds(10);
+                uint64_t min_latency_samples = 100;
+                /// Bounds of the hedge delay derived from the latency quantile.
+                rpc_clock_type::duration min_hedge_delay = std::chrono::milliseconds(1);
+                rpc_clock_type::duration max_hedge_delay = std::chrono::seconds(1);
+                /// Number of times a call of an idempotent verb failing with closed_error is
+                /// retried, alternating between the destinations.
+                unsigned max_retries = 2;
+                /// Wait before the first retry, doubled for every further one up to max_retry_backoff.
+                rpc_clock_type::duration retry_backoff = std::chrono::milliseconds(10);
+                rpc_clock_type::duration max_retry_backoff = std::chrono::milliseconds(500);
             };
 
             /// @}
@@ -153,6 +299,20 @@ namespace nil {
                 boost::optional<streaming_domain_type> streaming_domain;
                 server_socket::load_balancing_algorithm load_balancing_algorithm =
                     server_socket::load_balancing_algorithm::default_;
+                /// \see client_options::send_batch_max_messages
+                unsigned send_batch_max_messages = 1;
+                /// \see client_options::send_batch_max_bytes
+                size_t send_batch_max_bytes = 256 * 1024;
+                /// \see client_options::compression_bypass
+                boost::optional<compression_bypass_options> compression_bypass;
+                /// \see client_options::latency
+                latency_metrics *latency = nullptr;
+                /// Priority classes of outgoing responses and stream frames.
+                send_priority_options send_priorities;
+                /// Enables shedding of requests that wait too long, disabled if unset.
+                boost::optional<load_shedding_options> load_shedding;
+                /// \see client_options::stream_flow_control
+                boost::optional<stream_flow_control_options> stream_flow_control;
             };
 
             /// @}
@@ -173,11 +333,44 @@ namespace nil {
                 CONNECTION_ID = 2,
                 STREAM_PARENT = 3,
                 ISOLATION = 4,
+                COMPRESSION_BYPASS = 5,
+                ZERO_RTT = 6,
+                STREAM_FLOW_CONTROL = 7,
+                FRAGMENTATION = 8,
             };
 
             // internal representation of feature data
             using feature_map = std::map<protocol_features, sstring>;
 
+            /// Remembers, per server address, the features a client negotiated, so that the next
+            /// connection to that server can send requests before the server answers the
+            /// negotiation. Only servers that acknowledged zero-RTT support are remembered.
+            ///
+            /// A connection that uses a cached entry offers exactly the cached features. A server
+            /// that cannot grant all of them discards the early requests without running them
+            /// and replies without acknowledging zero-RTT; the client then drops the entry and
+            /// fails the connection, so the early requests fail with closed_error and may safely
+            /// be retried on a new connection, which negotiates in full.
+            ///
+            /// The cache is not synchronized, share it between the clients of one shard only.
+            class zero_rtt_cache {
+                struct entry {
+                    // what the client offered, a client configured differently must not use the entry
+                    feature_map offered;
+                    feature_map negotiated;
+                };
+                std::unordered_map<socket_address, entry> _entries;
+
+            public:
+                /// Returns the features negotiated with peer for the given offer, if known.
+                boost::optional<feature_map> get(const socket_address &peer, const feature_map &offered) const;
+                void put(const socket_address &peer, feature_map offered, feature_map negotiated);
+                void invalidate(const socket_address &peer);
+                size_t size() const {
+                    return _entries.size();
+                }
+            };
+
             // An rpc signature, in the form signature<Ret (In0, In1, In2)>.
             template<typename Function>
             struct signature;
@@ -228,6 +421,9 @@ namespace nil {
                 void operator()(const socket_address &addr, log_level level, std::string_view str) const;
             };
 
+            // frames of a stream connection, batches and credits are only sent once flow control is negotiated
+            enum class stream_frame_type { element, end_of_stream, batch, credit };
+
             class connection {
             protected:
                 connected_socket _fd;
@@ -242,14 +438,22 @@ namespace nil {
                 // The type of the pointer is erased here, but the original type is Serializer
                 void *_serializer;
                 struct outgoing_entry {
-                    timer<rpc_clock_type> t;
+                    timer_wheel::entry t;
                     snd_buf buf;
                     boost::optional<promise<>> p = promise<>();
                     cancellable *pcancel = nullptr;
+                    // records the time spent in the queue if set
+                    latency_histogram *queue_latency = nullptr;
+                    latency_histogram::clock_type::time_point queued_at;
+                    unsigned priority_class = 0;
+                    // set once buf holds the wire encoding, the rest of a fragmented frame is queued again
+                    bool prepared = false;
                     outgoing_entry(snd_buf b) : buf(std::move(b)) {
                     }
                     outgoing_entry(outgoing_entry &&o) noexcept :
-                        t(std::move(o.t)), buf(std::move(o.buf)), p(std::move(o.p)), pcancel(o.pcancel) {
+                        t(std::move(o.t)), buf(std::move(o.buf)), p(std::move(o.p)), pcancel(o.pcancel),
+                        queue_latency(o.queue_latency), queued_at(o.queued_at), priority_class(o.priority_class),
+                        prepared(o.prepared) {
                         o.p = boost::none;
                     }
                     ~outgoing_entry() {
@@ -263,10 +467,39 @@ namespace nil {
                     }
                 };
                 friend outgoing_entry;
-                std::list<outgoing_entry> _outgoing_queue;
+                // one queue per priority class, never resized once the connection is set up
+                // since queued entries hold iterators into them
+                std::vector<std::list<outgoing_entry>> _outgoing_queues = std::vector<std::list<outgoing_entry>>(1);
+                send_priority_options _send_priorities;
+                // deficit round-robin state: the class whose turn it is and the bytes each class may still send
+                unsigned _priority_turn = 0;
+                bool _priority_turn_started = false;
+                std::vector<int64_t> _priority_deficit = std::vector<int64_t>(1);
+                // expires queued messages whose send timeout passed before they were sent
+                timer_wheel _send_timeouts;
                 condition_variable _outgoing_queue_cond;
                 future<> _send_loop_stopped = make_ready_future<>();
+                // limits on how many queued messages send_loop() writes before a single flush
+                unsigned _send_batch_max_messages = 1;
+                size_t _send_batch_max_bytes = 0;
                 std::unique_ptr<compressor> _compressor;
+                // peer accepts frames flagged as raw on a compressed connection
+                bool _raw_frames_negotiated = false;
+                // every frame is sent as one or more fragments, see send_priority_options::fragment
+                bool _fragmentation_negotiated = false;
+                // fragments received so far of the frames still incomplete, by the sender's class
+                std::unordered_map<uint32_t, rcv_buf> _partial_frames;
+                boost::optional<compression_bypass_options> _compression_bypass;
+                // recent compression efficiency of a class of frames
+                struct compression_history {
+                    float ratio = 0;
+                    float ns_per_saved_byte = 0;
+                    unsigned bypassed = 0;
+                    bool sampled = false;
+                };
+                // outgoing requests are tracked per verb, responses and stream frames per connection
+                std::unordered_map<uint64_t, compression_history> _verb_compression_history;
+                compression_history _compression_history;
                 bool _timeout_negotiated = false;
                 // stream related fields
                 bool _is_stream = false;
@@ -277,6 +510,12 @@ namespace nil {
                 semaphore _stream_sem = semaphore(max_stream_buffers_memory);
                 bool _sink_closed = true;
                 bool _source_closed = true;
+                // flow control as configured locally, in effect once negotiated
+                boost::optional<stream_flow_control_options> _stream_flow_control;
+                bool _stream_flow_control_negotiated = false;
+                // bytes the local sink may still send, replenished by credit frames of the peer
+                semaphore _stream_credit = semaphore(0);
+                uint32_t _stream_send_window = 0;
                 // the future holds if sink is already closed
                 // if it is not ready it means the sink is been closed
                 future<bool> _sink_closed_future = make_ready_future<bool>(false);
@@ -285,21 +524,34 @@ namespace nil {
                     return _is_stream;
                 }
 
-                snd_buf compress(snd_buf buf);
+                snd_buf compress(snd_buf buf, compression_history &history);
                 future<> send_buffer(snd_buf buf);
+                void set_send_priorities(const send_priority_options &options);
+                // moves the message to be sent next from the priority queues to the end of batch,
+                // at least one of the queues must not be empty
+                size_t take_next_outgoing(std::list<outgoing_entry> &batch);
+                void fragment_outgoing(std::list<outgoing_entry> &batch, size_t credit);
+                bool outgoing_queue_empty() const;
+                size_t outgoing_queue_size() const;
 
                 enum class outgoing_queue_type { request, response, stream = response };
 
+                template<outgoing_queue_type QueueType>
+                void prepare_outgoing(outgoing_entry &d);
                 template<outgoing_queue_type QueueType>
                 void send_loop();
                 future<> stop_send_loop();
-                future<boost::optional<rcv_buf>> read_stream_frame_compressed(input_stream<char> &in);
+                future<boost::optional<std::tuple<stream_frame_type, rcv_buf>>>
+                    read_stream_frame_compressed(input_stream<char> &in);
                 bool stream_check_twoway_closed() {
                     return _sink_closed && _source_closed;
                 }
                 future<> stream_close();
                 future<> stream_process_incoming(rcv_buf &&);
+                future<> stream_process_batch(rcv_buf &&);
                 future<> handle_stream_frame();
+                sstring stream_flow_control_feature() const;
+                void negotiate_stream_flow_control(const sstring &peer_window);
 
             public:
                 connection(connected_socket &&fd, const logger &l, void *s, connection_id id = invalid_connection_id) :
@@ -312,17 +564,31 @@ namespace nil {
                 virtual ~connection() {
                 }
                 void set_socket(connected_socket &&fd);
-                future<> send_negotiation_frame(feature_map features);
+                // without flush the frame goes out with whatever the send loop writes next
+                future<> send_negotiation_frame(feature_map features, bool flush = true);
                 // functions below are public because they are used by external heavily templated functions
                 // and I am not smart enough to know how to define them as friends
                 future<> send(snd_buf buf, boost::optional<rpc_clock_type::time_point> timeout = {},
-                              cancellable *cancel = nullptr);
+                              cancellable *cancel = nullptr, latency_histogram *queue_latency = nullptr,
+                              unsigned priority = 0);
                 bool error() {
                     return _error;
                 }
+                /// Priority class of the messages of a verb sent by this connection.
+                unsigned verb_priority(uint64_t verb) const {
+                    return _send_priorities.verb_class ? _send_priorities.verb_class(verb) : 0;
+                }
                 void abort();
                 future<> stop();
                 future<> stream_receive(circular_buffer<foreign_ptr<std::unique_ptr<rcv_buf>>> &bufs);
+                // sends a stream frame holding charge bytes of elements once the peer granted the credit
+                future<> stream_send(snd_buf buf, uint32_t charge);
+                bool stream_flow_control_negotiated() const {
+                    return _stream_flow_control_negotiated;
+                }
+                uint32_t stream_batch_max_bytes() const {
+                    return _stream_flow_control ? _stream_flow_control->batch_max_bytes : 0;
+                }
                 future<> close_sink() {
                     _sink_closed = true;
                     if (stream_check_twoway_closed()) {
@@ -359,6 +625,25 @@ namespace nil {
                 template<typename FrameType>
                 typename FrameType::return_type read_frame(socket_address info, input_stream<char> &in);
 
+                // decodes a frame out of a whole (decompressed) buffer, the payload is a
+                // zero-copy slice of it
+                template<typename FrameType>
+                typename FrameType::return_type parse_frame(socket_address info, rcv_buf buf);
+
+                template<typename FrameType>
+                typename FrameType::return_type decode_frame(socket_address info,
+                                                             std::unique_ptr<compressor> &compressor,
+                                                             bool raw,
+                                                             rcv_buf data);
+
+                // decodes a frame reassembled from its fragments, still in its on-wire encoding
+                template<typename FrameType>
+                typename FrameType::return_type parse_frame_compressed(socket_address info,
+                                                                       std::unique_ptr<compressor> &compressor,
+                                                                       rcv_buf buf);
+
+                future<boost::optional<rcv_buf>> read_fragmented_frame(socket_address info, input_stream<char> &in);
+
                 template<typename FrameType>
                 typename FrameType::return_type read_frame_compressed(socket_address info,
                                                                       std::unique_ptr<compressor> &compressor,
@@ -370,11 +655,30 @@ namespace nil {
                 friend class source_impl;
             };
 
+            // concatenates stream elements, each with its length prefix, into a single batch frame
+            snd_buf make_stream_batch_frame(std::vector<snd_buf> elements, uint32_t size);
+
+            // decodes a response frame out of a whole (decompressed) buffer the way a client does, into
+            // the message id and the payload, a zero-copy slice of buf; no payload if buf ends early
+            future<std::tuple<int64_t, boost::optional<rcv_buf>>> parse_response_frame(rcv_buf buf);
+
             // send data Out...
             template<typename Serializer, typename... Out>
             class sink_impl : public sink<Out...>::impl {
+                // with flow control, elements written while frames are in flight wait here to go out as one batch
+                bool _batching;
+                uint32_t _batch_max_bytes;
+                std::vector<snd_buf> _pending;
+                uint32_t _pending_bytes = 0;
+                size_t _pending_units = 0;
+                unsigned _frames_in_flight = 0;
+
+                void send_pending();
+
             public:
-                sink_impl(xshard_connection_ptr con) : sink<Out...>::impl(std::move(con)) {
+                sink_impl(xshard_connection_ptr con) :
+                    sink<Out...>::impl(std::move(con)), _batching(this->_con->get()->stream_flow_control_negotiated()),
+                    _batch_max_bytes(this->_con->get()->stream_batch_max_bytes()) {
                     this->_con->get()->_sink_closed = false;
                 }
                 future<> operator()(const Out &...args) override;
@@ -397,7 +701,7 @@ namespace nil {
                 socket _socket;
                 id_type _message_id = 1;
                 struct reply_handler_base {
-                    timer<rpc_clock_type> t;
+                    timer_wheel::entry t;
                     cancellable *pcancel = nullptr;
                     virtual void operator()(client &, id_type, rcv_buf data) = 0;
                     virtual void timeout() {
@@ -435,11 +739,42 @@ namespace nil {
                 };
 
             private:
-                std::unordered_map<id_type, std::unique_ptr<reply_handler_base>> _outstanding;
+                // Calls waiting for a reply, indexed by message id. Ids are handed out in
+                // increasing order, so instead of a hash map the handlers live in a ring whose
+                // slot is (id - first id); slots of completed calls are reclaimed once they
+                // reach the head. A head slot pinned by a long running call is spilled into a
+                // small overflow map when the ring spans more than max_span ids, bounding the
+                // memory taken by the holes behind it.
+                class outstanding_table {
+                    using handler_ptr = std::unique_ptr<reply_handler_base>;
+                    static constexpr size_t max_span = 64 * 1024;
+                    circular_buffer<handler_ptr> _slots;
+                    std::unordered_map<id_type, handler_ptr> _overflow;
+                    id_type _first_id = 0;
+                    size_t _size = 0;
+
+                    void trim_head() noexcept;
+
+                public:
+                    void emplace(id_type id, handler_ptr h);
+                    // removes and returns the handler of id, or nullptr if there is none
+                    handler_ptr extract(id_type id);
+                    size_t size() const noexcept {
+                        return _size;
+                    }
+                    void clear();
+                };
+
+                outstanding_table _outstanding;
+                timer_wheel _reply_timeouts;
                 socket_address _server_addr;
                 client_options _options;
                 boost::optional<shared_promise<>> _client_negotiated = shared_promise<>();
                 weak_ptr<client> _parent;    // for stream clients
+                // the encoding features this client offers, the key of its zero_rtt_cache entry
+                feature_map _zero_rtt_offer;
+                // requests were sent before the server replied to the negotiation
+                bool _sent_early_data = false;
 
             private:
                 future<> negotiate_protocol(input_stream<char> &in);
@@ -456,6 +791,10 @@ namespace nil {
                 }
 
             public:
+                latency_metrics *latency() const noexcept {
+                    return _options.latency;
+                }
+
                 /**
                  * Create client object which will attempt to connect to the remote address.
                  *
@@ -487,6 +826,15 @@ namespace nil {
                 stats &get_stats_internal() {
                     return _stats;
                 }
+                /// Number of calls sent on this connection that still wait for a reply.
+                size_t outstanding_replies() const noexcept {
+                    return _outstanding.size();
+                }
+                /// Whether this connection sent requests before the server replied to the
+                /// negotiation, using the features cached in client_options::zero_rtt.
+                bool sent_early_data() const noexcept {
+                    return _sent_early_data;
+                }
                 auto next_message_id() {
                     return _message_id++;
                 }
@@ -533,8 +881,141 @@ namespace nil {
                 }
             };
 
+            /// A set of client connections to the same server.
+            ///
+            /// Verbs created with protocol::make_client() accept a pool wherever they accept a
+            /// client; each call is then routed to one of the connections according to
+            /// client_pool_options. Broken connections are transparently replaced, calls that
+            /// were in flight on them fail with closed_error as they would on a plain client.
+            class client_pool {
+            public:
+                using connect_function = noncopyable_function<shared_ptr<client>(const socket_address &local)>;
+
+            private:
+                struct slot {
+                    shared_ptr<client> c;
+                    rpc_clock_type::time_point connected_at;
+                };
+
+                client_pool_options _options;
+                connect_function _connect;
+                std::vector<slot> _slots;
+                unsigned _next = 0;
+                uint64_t _reconnects = 0;
+                bool _stopped = false;
+                // replaced connections that are still being stopped
+                gate _retired;
+
+            private:
+                socket_address local_address(unsigned index) const;
+                void connect(unsigned index);
+                // replaces the connection if it is broken and may be reconnected, returns true if usable
+                bool refresh(unsigned index);
+                shared_ptr<client> least_outstanding();
+
+            public:
+                /// \param options pool configuration, options.connections must be positive
+                /// \param connect creates a client connection bound to the given local address
+                client_pool(client_pool_options options, connect_function connect);
+                client_pool(client_pool &&) = delete;
+
+                /// Selects the connection for a call of the given verb, reconnecting it if needed.
+                shared_ptr<client> pick(uint64_t verb);
+                /// Stops all connections, must be called before the pool is destroyed.
+                future<> stop();
+                size_t size() const noexcept {
+                    return _slots.size();
+                }
+                client &connection(unsigned index) {
+                    return *_slots[index].c;
+                }
+                /// Number of broken connections replaced so far.
+                uint64_t reconnects() const noexcept {
+                    return _reconnects;
+                }
+            };
+
+            /// Per-verb policy of the calls made through protocol::make_hedged_client().
+            ///
+            /// Only verbs marked idempotent are hedged and retried, calls of the others go to the
+            /// primary destination once, as with make_client(). The hedge delay of a verb follows
+            /// the latency of its successful calls. An instance may be shared by any number of
+            /// verbs and destinations of the same shard and has to outlive their calls.
+            class call_policy {
+            public:
+                struct stats {
+                    /// Calls sent again to the alternate destination after the hedge delay.
+                    uint64_t hedges = 0;
+                    /// Hedges that completed before the call they were hedging.
+                    uint64_t hedge_wins = 0;
+                    /// Calls sent again after failing with closed_error.
+                    uint64_t retries = 0;
+                };
+
+            private:
+                struct verb {
+                    bool idempotent = false;
+                    latency_histogram latency;
+                };
+
+                call_policy_options _options;
+                std::unordered_map<uint64_t, std::unique_ptr<verb>> _verbs;
+                stats _stats;
+
+            private:
+                verb &get(uint64_t v);
+
+            public:
+                explicit call_policy(call_policy_options options = {});
+
+                /// Marks a verb as safe to be executed more than once per call.
+                void set_idempotent(uint64_t verb, bool idempotent = true);
+                bool idempotent(uint64_t verb) const;
+                /// Latency of the successful calls of a verb.
+                latency_histogram &latency(uint64_t verb) {
+                    return get(verb).latency;
+                }
+                /// Time after which a call of the verb is hedged.
+                rpc_clock_type::duration hedge_delay(uint64_t verb) const;
+                /// Wait before the given retry, counting from zero.
+                rpc_clock_type::duration retry_backoff(unsigned retry) const;
+                const call_policy_options &options() const noexcept {
+                    return _options;
+                }
+                stats &get_stats() noexcept {
+                    return _stats;
+                }
+            };
+
             class protocol_base;
 
+            /// CoDel state of the requests of one scheduling group on a server.
+            class admission_controller {
+            public:
+                using clock_type = latency_histogram::clock_type;
+
+            private:
+                load_shedding_options _options;
+                // when the sojourn time first went above target plus interval, zero while below target
+                clock_type::time_point _first_above_time {};
+                clock_type::time_point _drop_next {};
+                unsigned _drop_count = 0;
+                bool _dropping = false;
+
+            private:
+                clock_type::duration drop_delay() const;
+
+            public:
+                explicit admission_controller(load_shedding_options options) : _options(options) {
+                }
+                /// Accounts for a request about to start after waiting for sojourn, returns
+                /// true if it should be rejected instead.
+                bool should_shed(clock_type::duration sojourn, clock_type::time_point now);
+                bool dropping() const noexcept {
+                    return _dropping;
+                }
+            };
+
             class server {
             private:
                 static thread_local std::unordered_map<streaming_domain_type, server *> _servers;
@@ -545,6 +1026,11 @@ namespace nil {
                     client_info _info;
                     connection_id _parent_id = invalid_connection_id;
                     boost::optional<isolation_config> _isolation_config;
+                    // the client sent requests encoded with features this server did not grant
+                    bool _early_data_rejected = false;
+                    // when the frame of the request being dispatched was read, only set when latency
+                    // metrics or load shedding need it
+                    admission_controller::clock_type::time_point _request_arrival;
 
                 private:
                     future<> negotiate_protocol(input_stream<char> &in);
@@ -565,7 +1051,8 @@ namespace nil {
                     connection(server &s, connected_socket &&fd, socket_address &&addr, const logger &l,
                                void *seralizer, connection_id id);
                     future<> process();
-                    future<> respond(int64_t msg_id, snd_buf &&data, boost::optional<rpc_clock_type::time_point> timeout);
+                    future<> respond(int64_t msg_id, snd_buf &&data, boost::optional<rpc_clock_type::time_point> timeout,
+                                     latency_histogram *queue_latency = nullptr, unsigned priority = 0);
                     client_info &info() {
                         return _info;
                     }
@@ -574,7 +1061,7 @@ namespace nil {
                     }
                     stats get_stats() const {
                         stats res = _stats;
-                        res.pending = _outgoing_queue.size();
+                        res.pending = outgoing_queue_size();
                         return res;
                     }
 
@@ -599,9 +1086,22 @@ namespace nil {
                     size_t max_request_size() const {
                         return _server._limits.max_memory;
                     }
+                    enum class shed_reason { none, expired, overloaded };
+                    bool load_shedding_enabled() const {
+                        return bool(_server._options.load_shedding);
+                    }
+                    // Decides whether a request that arrived at the given time and is about to be
+                    // handled should be dropped instead. Only valid with load shedding enabled.
+                    shed_reason should_shed(admission_controller::clock_type::time_point arrival,
+                                            boost::optional<rpc_clock_type::time_point> timeout);
                     server &get_server() {
                         return _server;
                     }
+                    // When the request handed to its handler was read off the connection, the start of
+                    // its sojourn time. Only valid with latency metrics or load shedding enabled.
+                    admission_controller::clock_type::time_point request_arrival() const {
+                        return _request_arrival;
+                    }
                     future<> deregister_this_stream();
                 };
 
@@ -615,6 +1115,11 @@ namespace nil {
                 gate _reply_gate;
                 server_options _options;
                 uint64_t _next_client_id = 1;
+                // load shedding state per scheduling group, there are only a handful of them
+                std::vector<std::pair<scheduling_group, admission_controller>> _admission_controllers;
+
+            private:
+                admission_controller &get_admission_controller(scheduling_group sg);
 
             public:
                 server(protocol_base *proto, const socket_address &addr,
@@ -636,6 +1141,9 @@ namespace nil {
                 gate &reply_gate() {
                     return _reply_gate;
                 }
+                latency_metrics *latency() const noexcept {
+                    return _options.latency;
+                }
                 friend connection;
                 friend client;
             };
@@ -644,9 +1152,18 @@ namespace nil {
                 std::function<future<>(shared_ptr<server::connection>,
                                        boost::optional<rpc_clock_type::time_point> timeout, int64_t msgid, rcv_buf data)>;
 
-            struct rpc_handler {
+            /// Per-verb server side counters.
+            struct rpc_handler_stats {
+                uint64_t dispatched = 0;
+                uint64_t received_bytes = 0;
+            };
+
+            // Fields are ordered so that everything dispatch touches (scheduling group,
+            // function, counters and the gate's use count) shares the first cache line.
+            struct alignas(64) rpc_handler {
                 scheduling_group sg;
                 rpc_handler_func func;
+                rpc_handler_stats stats;
                 gate use_gate;
             };
 
@@ -812,16 +1329,58 @@ namespace nil {
                         rpc::client(p.get_logger(), &p._serializer, options, std::move(socket), addr, local) {
                     }
                 };
+                /// Represents a set of client connections to the same server, see rpc::client_pool.
+                class client_pool : public rpc::client_pool {
+                    static client_options pool_client_options(const client_pool_options &pool_options,
+                                                              client_options options) {
+                        // connections bound to fixed ports have to be able to rebind after a reconnect
+                        options.reuseaddr |= bool(pool_options.local_port_base);
+                        return options;
+                    }
+
+                public:
+                    client_pool(protocol &p, client_pool_options pool_options, client_options options,
+                                const socket_address &addr) :
+                        rpc::client_pool(pool_options,
+                                         [&p, options = pool_client_options(pool_options, options),
+                                          addr](const socket_address &local) {
+                                             return make_shared<client>(p, options, addr, local);
+                                         }) {
+                    }
+                    /// \param make_socket creates the socket of every (re)connection
+                    client_pool(protocol &p, client_pool_options pool_options, client_options options,
+                                noncopyable_function<socket()> make_socket, const socket_address &addr) :
+                        rpc::client_pool(pool_options,
+                                         [&p, options = pool_client_options(pool_options, options), addr,
+                                          make_socket = std::move(make_socket)](const socket_address &local) {
+                                             return make_shared<client>(p, options, make_socket(), addr, local);
+                                         }) {
+                    }
+                };
 
                 friend server;
 
+                /// Verbs below this value are dispatched through a flat array by default.
+                static constexpr size_t default_dense_verbs = 64;
+
             private:
+                // Handlers for verbs below _dense_handlers_size live in a flat array indexed by
+                // verb, the rest in a hash map. The array is never resized so handler pointers
+                // held by running requests stay valid.
+                std::unique_ptr<boost::optional<rpc_handler>[]> _dense_handlers;
+                size_t _dense_handlers_size = 0;
+                size_t _dense_handlers_registered = 0;
                 std::unordered_map<MsgType, rpc_handler> _handlers;
                 Serializer _serializer;
                 logger _logger;
 
             public:
-                protocol(Serializer &&serializer) : _serializer(std::forward<Serializer>(serializer)) {
+                /// \param serializer the serializer used for all verbs of the protocol
+                /// \param dense_verbs verbs whose numeric value is below this limit are looked up in
+                ///     a flat array instead of a hash map; pass 0 to always use the hash map
+                protocol(Serializer &&serializer, size_t dense_verbs = default_dense_verbs) :
+                    _dense_handlers(dense_verbs ? new boost::optional<rpc_handler>[dense_verbs] : nullptr),
+                    _dense_handlers_size(dense_verbs), _serializer(std::forward<Serializer>(serializer)) {
                 }
 
                 /// Creates a callable that can be used to invoke the verb on the remote.
@@ -836,6 +1395,21 @@ namespace nil {
                 template<typename Func>
                 auto make_client(MsgType t);
 
+                /// Creates a callable that invokes the verb on one of two destinations according
+                /// to a call_policy.
+                ///
+                /// The callable takes a primary and an alternate destination, both rpc::client or
+                /// both client_pool, followed by an optional timeout and the verb's arguments. A
+                /// call of an idempotent verb is sent to the alternate destination as well if it
+                /// does not complete within the hedge delay, the first reply wins and the other
+                /// call is canceled. Calls failing with closed_error are retried with backoff,
+                /// alternating between the destinations, as long as the timeout allows.
+                ///
+                /// \param t the verb to invoke on the remote.
+                /// \param policy the policy of the verb, has to outlive all calls.
+                template<typename Func>
+                auto make_hedged_client(MsgType t, call_policy &policy);
+
                 /// Register a handler to be called when this verb is invoked.
                 ///
                 /// \tparam Func the type of the handler for the verb. This determines the
@@ -915,17 +1489,33 @@ namespace nil {
                 ///
                 /// \returns true if there are, false if there are no registered handlers.
                 bool has_handlers() const noexcept {
-                    return !_handlers.empty();
+                    return _dense_handlers_registered || !_handlers.empty();
                 }
 
+                /// Returns the counters of a verb, all zero if it has no handler.
+                rpc_handler_stats get_handler_stats(MsgType t);
+
             private:
                 rpc_handler *get_handler(uint64_t msg_id) override;
                 void put_handler(rpc_handler *) override;
+                rpc_handler *find_handler(uint64_t id);
 
                 template<typename Ret, typename... In>
                 auto make_client(signature<Ret(In...)> sig, MsgType t);
+                template<typename Ret, typename... In>
+                auto make_hedged_client(signature<Ret(In...)> sig, MsgType t, call_policy &policy);
 
                 void register_receiver(MsgType t, rpc_handler &&handler) {
+                    auto id = static_cast<uint64_t>(t);
+                    if (id < _dense_handlers_size) {
+                        auto &slot = _dense_handlers[id];
+                        if (slot) {
+                            throw_with_backtrace<std::runtime_error>("registered handler already exists");
+                        }
+                        slot.emplace(std::move(handler));
+                        _dense_handlers_registered++;
+                        return;
+                    }
                     auto r = _handlers.emplace(t, std::move(handler));
                     if (!r.second) {
                         throw_with_backtrace<std::runtime_error>("registered handler already exists");
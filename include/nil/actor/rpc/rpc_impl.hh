@@ -28,6 +28,8 @@
 #include <nil/actor/core/shared_ptr.hh>
 #include <nil/actor/core/sstring.hh>
 #include <nil/actor/core/when_all.hh>
+#include <nil/actor/core/sleep.hh>
+#include <nil/actor/core/timer.hh>
 #include <nil/actor/detail/is_smart_ptr.hh>
 #include <nil/actor/core/simple_stream.hh>
 #include <boost/endian/conversion.hpp>
@@ -44,6 +46,7 @@ namespace nil {
             enum class exception_type : uint32_t {
                 USER = 0,
                 UNKNOWN_VERB = 1,
+                OVERLOADED = 2,
             };
 
             template<typename T>
@@ -211,14 +214,43 @@ namespace nil {
             template<typename Serializer, typename Output, typename... T>
             inline void do_marshall(Serializer &serializer, Output &out, const T &...args);
 
+            // elements of a bulk serializable type go out as a count followed by their raw bytes
+            template<typename Output, typename T>
+            inline void marshall_bulk(Output &out, const T *data, size_t count) {
+                char size[4];
+                write_le<uint32_t>(size, count);
+                out.write(size, sizeof(size));
+                out.write(reinterpret_cast<const char *>(data), count * sizeof(T));
+            }
+
             template<typename Serializer, typename Output>
             struct marshall_one {
                 template<typename T>
                 struct helper {
                     static void doit(Serializer &serializer, Output &out, const T &arg) {
-                        using serialize_helper_type =
-                            serialize_helper<is_smart_ptr<typename std::remove_reference<T>::type>::value>;
-                        serialize_helper_type::serialize(serializer, out, arg);
+                        if constexpr (is_bulk_serializable<T>::value) {
+                            out.write(reinterpret_cast<const char *>(&arg), sizeof(T));
+                        } else {
+                            using serialize_helper_type =
+                                serialize_helper<is_smart_ptr<typename std::remove_reference<T>::type>::value>;
+                            serialize_helper_type::serialize(serializer, out, arg);
+                        }
+                    }
+                };
+                template<typename T>
+                struct helper<std::vector<T>> {
+                    static void doit(Serializer &serializer, Output &out, const std::vector<T> &arg) {
+                        if constexpr (is_bulk_serializable<T>::value) {
+                            marshall_bulk(out, arg.data(), arg.size());
+                        } else {
+                            write(serializer, out, arg);
+                        }
+                    }
+                };
+                template<typename T>
+                struct helper<bulk_view<T>> {
+                    static void doit(Serializer &serializer, Output &out, const bulk_view<T> &arg) {
+                        marshall_bulk(out, arg.data(), arg.size());
                     }
                 };
                 template<typename T>
@@ -289,12 +321,62 @@ namespace nil {
                 return std::make_tuple();
             }
 
+            // Deserializer input over a received frame, which can also hand out parts of the frame
+            // without copying them.
+            class rcv_buf_input : public memory_input_stream<rcv_buf::iterator> {
+                rcv_buf &_buf;
+
+            public:
+                explicit rcv_buf_input(rcv_buf &buf) :
+                    memory_input_stream<rcv_buf::iterator>(make_deserializer_stream(buf)), _buf(buf) {
+                }
+                // Consumes the next n bytes. They share the frame if they lie in a single fragment
+                // and start at the given alignment, otherwise they are copied into a buffer that does.
+                temporary_buffer<char> read_shared(size_t n, size_t alignment);
+            };
+
+            template<typename T, typename Input>
+            inline size_t unmarshall_bulk_count(Input &in) {
+                char size[4];
+                in.read(size, sizeof(size));
+                auto count = read_le<uint32_t>(size);
+                if (count > in.size() / sizeof(T)) {
+                    throw std::out_of_range("truncated bulk rpc argument");
+                }
+                return count;
+            }
+
             template<typename Serializer, typename Input>
             struct unmarshal_one {
                 template<typename T>
                 struct helper {
                     static T doit(connection &c, Input &in) {
-                        return read(c.serializer<Serializer>(), in, type<T>());
+                        if constexpr (is_bulk_serializable<T>::value) {
+                            T ret;
+                            in.read(reinterpret_cast<char *>(&ret), sizeof(T));
+                            return ret;
+                        } else {
+                            return read(c.serializer<Serializer>(), in, type<T>());
+                        }
+                    }
+                };
+                template<typename T>
+                struct helper<std::vector<T>> {
+                    static std::vector<T> doit(connection &c, Input &in) {
+                        if constexpr (is_bulk_serializable<T>::value) {
+                            std::vector<T> ret(unmarshall_bulk_count<T>(in));
+                            in.read(reinterpret_cast<char *>(ret.data()), ret.size() * sizeof(T));
+                            return ret;
+                        } else {
+                            return read(c.serializer<Serializer>(), in, type<std::vector<T>>());
+                        }
+                    }
+                };
+                template<typename T>
+                struct helper<bulk_view<T>> {
+                    static bulk_view<T> doit(connection &c, Input &in) {
+                        auto count = unmarshall_bulk_count<T>(in);
+                        return bulk_view<T>(in.read_shared(count * sizeof(T), alignof(T)));
                     }
                 };
                 template<typename T>
@@ -351,8 +433,8 @@ namespace nil {
 
             template<typename Serializer, typename... T>
             inline std::tuple<T...> unmarshall(connection &c, rcv_buf input) {
-                auto in = make_deserializer_stream(input);
-                return do_unmarshall<Serializer, decltype(in), T...>(c, in);
+                rcv_buf_input in(input);
+                return do_unmarshall<Serializer, rcv_buf_input, T...>(c, in);
             }
 
             inline std::exception_ptr unmarshal_exception(rcv_buf &d) {
@@ -378,6 +460,9 @@ namespace nil {
                         ex = std::make_exception_ptr(unknown_verb_error(boost::endian::little_to_native(v64)));
                         break;
                     }
+                    case exception_type::OVERLOADED:
+                        ex = std::make_exception_ptr(overloaded_error());
+                        break;
                     default:
                         ex = std::make_exception_ptr(unknown_exception_error());
                         break;
@@ -479,7 +564,7 @@ namespace nil {
                     MsgType t;
                     signature<Ret(InArgs...)> sig;
                     auto send(rpc::client &dst, boost::optional<rpc_clock_type::time_point> timeout, cancellable *cancel,
-                              const InArgs &...args) {
+                              boost::optional<unsigned> priority, const InArgs &...args) {
                         if (dst.error()) {
                             using cleaned_ret_type = typename wait_signature<Ret>::cleaned_type;
                             return futurize<cleaned_ret_type>::make_exception_future(closed_error());
@@ -494,35 +579,220 @@ namespace nil {
                         write_le<int64_t>(p + 8, msg_id);
                         write_le<uint32_t>(p + 16, data.size - 28);
 
+                        latency_metrics::client_verb *latency = nullptr;
+                        latency_histogram::clock_type::time_point start;
+                        if (auto metrics = dst.latency()) {
+                            latency = &metrics->client(uint64_t(t));
+                            start = latency_histogram::clock_type::now();
+                        }
+
                         // prepare reply handler, if return type is now_wait_type this does nothing, since no reply will
                         // be sent
                         using wait = wait_signature_t<Ret>;
-                        return when_all(dst.send(std::move(data), timeout, cancel),
-                                        wait_for_reply<Serializer>(wait(), timeout, cancel, dst, msg_id, sig))
-                            .then([](auto r) {
-                                return std::move(std::get<1>(r));    // return future of wait_for_reply
+                        auto queue_latency = latency ? &latency->queue : nullptr;
+                        auto f = when_all(dst.send(std::move(data), timeout, cancel, queue_latency,
+                                                   priority.value_or(dst.verb_priority(uint64_t(t)))),
+                                          wait_for_reply<Serializer>(wait(), timeout, cancel, dst, msg_id, sig))
+                                     .then([](auto r) {
+                                         return std::move(std::get<1>(r));    // return future of wait_for_reply
+                                     });
+                        if (latency) {
+                            return f.finally([latency, start] {
+                                latency->latency.record(latency_histogram::clock_type::now() - start);
                             });
+                        }
+                        return f;
+                    }
+                    auto send(client_pool &pool, boost::optional<rpc_clock_type::time_point> timeout,
+                              cancellable *cancel, boost::optional<unsigned> priority, const InArgs &...args) {
+                        // the connection is kept alive until the call completes even if the pool replaces it
+                        auto dst = pool.pick(uint64_t(t));
+                        return send(*dst, timeout, cancel, priority, args...).finally([dst] {});
                     }
                     auto operator()(rpc::client &dst, const InArgs &...args) {
-                        return send(dst, {}, nullptr, args...);
+                        return send(dst, {}, nullptr, {}, args...);
                     }
                     auto operator()(rpc::client &dst, rpc_clock_type::time_point timeout, const InArgs &...args) {
-                        return send(dst, timeout, nullptr, args...);
+                        return send(dst, timeout, nullptr, {}, args...);
                     }
                     auto operator()(rpc::client &dst, rpc_clock_type::duration timeout, const InArgs &...args) {
-                        return send(dst, relative_timeout_to_absolute(timeout), nullptr, args...);
+                        return send(dst, relative_timeout_to_absolute(timeout), nullptr, {}, args...);
                     }
                     auto operator()(rpc::client &dst, cancellable &cancel, const InArgs &...args) {
-                        return send(dst, {}, &cancel, args...);
+                        return send(dst, {}, &cancel, {}, args...);
+                    }
+                    auto operator()(rpc::client &dst, message_priority priority, const InArgs &...args) {
+                        return send(dst, {}, nullptr, priority.id, args...);
+                    }
+                    auto operator()(client_pool &pool, const InArgs &...args) {
+                        return send(pool, {}, nullptr, {}, args...);
+                    }
+                    auto operator()(client_pool &pool, rpc_clock_type::time_point timeout, const InArgs &...args) {
+                        return send(pool, timeout, nullptr, {}, args...);
+                    }
+                    auto operator()(client_pool &pool, rpc_clock_type::duration timeout, const InArgs &...args) {
+                        return send(pool, relative_timeout_to_absolute(timeout), nullptr, {}, args...);
+                    }
+                    auto operator()(client_pool &pool, cancellable &cancel, const InArgs &...args) {
+                        return send(pool, {}, &cancel, {}, args...);
+                    }
+                    auto operator()(client_pool &pool, message_priority priority, const InArgs &...args) {
+                        return send(pool, {}, nullptr, priority.id, args...);
                     }
                 };
                 return shelper {xt, xsig};
             }
 
+            // One attempt of a hedged call: the call to the first destination and, if it does not
+            // complete within the hedge delay, another one to the second destination. The attempt
+            // resolves with the first successful reply, or with an error once all calls failed.
+            template<typename Future>
+            class hedged_attempt : public enable_lw_shared_from_this<hedged_attempt<Future>> {
+            public:
+                using send_function = noncopyable_function<Future(unsigned destination, cancellable &cancel)>;
+
+            private:
+                call_policy &_policy;
+                uint64_t _verb;
+                lw_shared_ptr<send_function> _send;
+                unsigned _first;
+                typename Future::promise_type _result;
+                std::array<cancellable, 2> _cancel;
+                timer<rpc_clock_type> _hedge_timer;
+                unsigned _in_flight = 0;
+                bool _done = false;
+
+                void launch(unsigned destination) {
+                    _in_flight++;
+                    auto start = latency_histogram::clock_type::now();
+                    (void)(*_send)(destination, _cancel[destination])
+                        .then_wrapped([self = this->shared_from_this(), destination, start](Future f) {
+                            self->_in_flight--;
+                            if (self->_done) {
+                                // lost to the other call and canceled
+                                f.ignore_ready_future();
+                                return;
+                            }
+                            if (f.failed() && self->_in_flight) {
+                                // the other call may still succeed
+                                f.ignore_ready_future();
+                                return;
+                            }
+                            if (!f.failed()) {
+                                self->_policy.latency(self->_verb).record(latency_histogram::clock_type::now() - start);
+                                if (destination != self->_first) {
+                                    self->_policy.get_stats().hedge_wins++;
+                                }
+                            }
+                            self->_done = true;
+                            self->_hedge_timer.cancel();
+                            self->_cancel[destination ^ 1].cancel();
+                            f.forward_to(std::move(self->_result));
+                        });
+                }
+
+            public:
+                hedged_attempt(call_policy &policy, uint64_t verb, lw_shared_ptr<send_function> send, unsigned first) :
+                    _policy(policy), _verb(verb), _send(std::move(send)), _first(first), _hedge_timer([this] {
+                        // the call to the first destination is still in flight and keeps us alive
+                        _policy.get_stats().hedges++;
+                        launch(_first ^ 1);
+                    }) {
+                }
+                Future run() {
+                    auto f = _result.get_future();
+                    _hedge_timer.arm(_policy.hedge_delay(_verb));
+                    launch(_first);
+                    return f;
+                }
+            };
+
+            template<typename Future>
+            Future hedged_call(call_policy &policy, uint64_t verb,
+                               lw_shared_ptr<typename hedged_attempt<Future>::send_function> send,
+                               boost::optional<rpc_clock_type::time_point> timeout, unsigned attempt = 0) {
+                auto a = make_lw_shared<hedged_attempt<Future>>(policy, verb, send, attempt % 2);
+                return a->run().then_wrapped([&policy, verb, send, timeout, attempt](Future f) mutable {
+                    if (!f.failed() || attempt >= policy.options().max_retries) {
+                        return f;
+                    }
+                    auto ex = f.get_exception();
+                    try {
+                        std::rethrow_exception(ex);
+                    } catch (closed_error &) {
+                    } catch (...) {
+                        return futurize<Future>::make_exception_future(std::move(ex));
+                    }
+                    auto backoff = policy.retry_backoff(attempt);
+                    if (timeout && rpc_clock_type::now() + backoff >= *timeout) {
+                        return futurize<Future>::make_exception_future(std::move(ex));
+                    }
+                    policy.get_stats().retries++;
+                    return sleep(backoff).then([&policy, verb, send = std::move(send), timeout, attempt]() mutable {
+                        return hedged_call<Future>(policy, verb, std::move(send), timeout, attempt + 1);
+                    });
+                });
+            }
+
+            // Returns a callable sending rpc messages like the one returned by send_helper(), but to
+            // one of two destinations with hedging and retries as configured by a call_policy.
+            template<typename Serializer, typename MsgType, typename Ret, typename... InArgs>
+            auto hedged_send_helper(MsgType xt, signature<Ret(InArgs...)> xsig, call_policy &xpolicy) {
+                using send_helper_type = decltype(send_helper<Serializer>(xt, xsig));
+                struct hhelper {
+                    send_helper_type sh;
+                    call_policy *policy;
+                    template<typename Dst>
+                    auto send(Dst &primary, Dst &alternate, boost::optional<rpc_clock_type::time_point> timeout,
+                              const InArgs &...args) {
+                        using future_type = decltype(sh.send(primary, timeout, nullptr, {}, args...));
+                        auto verb = uint64_t(sh.t);
+                        // one way messages complete before any reply could tell which destination won
+                        if (std::is_same<wait_signature_t<Ret>, no_wait_type>::value || !policy->idempotent(verb)) {
+                            return sh.send(primary, timeout, nullptr, {}, args...);
+                        }
+                        using send_function = typename hedged_attempt<future_type>::send_function;
+                        auto send = make_lw_shared<send_function>(
+                            [sh = sh, &primary, &alternate, timeout,
+                             saved = std::tuple<InArgs...>(args...)](unsigned destination, cancellable &cancel) mutable {
+                                auto &dst = destination ? alternate : primary;
+                                return std::apply(
+                                    [&](const InArgs &...args) { return sh.send(dst, timeout, &cancel, {}, args...); },
+                                    saved);
+                            });
+                        return hedged_call<future_type>(*policy, verb, std::move(send), timeout);
+                    }
+                    auto operator()(rpc::client &primary, rpc::client &alternate, const InArgs &...args) {
+                        return send(primary, alternate, {}, args...);
+                    }
+                    auto operator()(rpc::client &primary, rpc::client &alternate, rpc_clock_type::time_point timeout,
+                                    const InArgs &...args) {
+                        return send(primary, alternate, timeout, args...);
+                    }
+                    auto operator()(rpc::client &primary, rpc::client &alternate, rpc_clock_type::duration timeout,
+                                    const InArgs &...args) {
+                        return send(primary, alternate, relative_timeout_to_absolute(timeout), args...);
+                    }
+                    auto operator()(client_pool &primary, client_pool &alternate, const InArgs &...args) {
+                        return send(primary, alternate, {}, args...);
+                    }
+                    auto operator()(client_pool &primary, client_pool &alternate, rpc_clock_type::time_point timeout,
+                                    const InArgs &...args) {
+                        return send(primary, alternate, timeout, args...);
+                    }
+                    auto operator()(client_pool &primary, client_pool &alternate, rpc_clock_type::duration timeout,
+                                    const InArgs &...args) {
+                        return send(primary, alternate, relative_timeout_to_absolute(timeout), args...);
+                    }
+                };
+                return hhelper {send_helper<Serializer>(xt, xsig), &xpolicy};
+            }
+
             template<typename Serializer, typename ACTOR_ELLIPSIS RetTypes>
             inline future<> reply(wait_type, future<RetTypes ACTOR_ELLIPSIS> &&ret, int64_t msg_id,
                                   shared_ptr<server::connection> client,
-                                  boost::optional<rpc_clock_type::time_point> timeout) {
+                                  boost::optional<rpc_clock_type::time_point> timeout,
+                                  latency_histogram *queue_latency = nullptr, unsigned priority = 0) {
                 if (!client->error()) {
                     snd_buf data;
                     try {
@@ -539,6 +809,15 @@ namespace nil {
                                                std::ref(client->template serializer<Serializer>()), 12,
                                                std::move(ret.get0()));
                         }
+                    } catch (overloaded_error &) {
+                        data = snd_buf(20);
+                        auto os = make_serializer_stream(data);
+                        os.skip(12);
+                        uint32_t v32 = boost::endian::native_to_little(uint32_t(exception_type::OVERLOADED));
+                        os.write(reinterpret_cast<char *>(&v32), sizeof(v32));
+                        v32 = 0;
+                        os.write(reinterpret_cast<char *>(&v32), sizeof(v32));
+                        msg_id = -msg_id;
                     } catch (std::exception &ex) {
                         uint32_t len = std::strlen(ex.what());
                         data = snd_buf(20 + len);
@@ -552,7 +831,7 @@ namespace nil {
                         msg_id = -msg_id;
                     }
 
-                    return client->respond(msg_id, std::move(data), timeout);
+                    return client->respond(msg_id, std::move(data), timeout, queue_latency, priority);
                 } else {
                     ret.ignore_ready_future();
                     return make_ready_future<>();
@@ -563,7 +842,8 @@ namespace nil {
             template<typename Serializer>
             inline future<> reply(no_wait_type, future<no_wait_type> &&r, int64_t msgid,
                                   shared_ptr<server::connection> client,
-                                  boost::optional<rpc_clock_type::time_point> timeout) {
+                                  boost::optional<rpc_clock_type::time_point> timeout,
+                                  latency_histogram *queue_latency = nullptr, unsigned priority = 0) {
                 try {
                     r.get();
                 } catch (std::exception &ex) {
@@ -573,6 +853,21 @@ namespace nil {
                 return make_ready_future<>();
             }
 
+            // Fails a request rejected by load shedding with overloaded_error, so that the
+            // client can back off or go elsewhere instead of waiting for its timeout.
+            template<typename Serializer, typename Ret>
+            void reply_overloaded(shared_ptr<server::connection> client, int64_t msg_id,
+                                  boost::optional<rpc_clock_type::time_point> timeout, unsigned priority,
+                                  resource_permit permit) {
+                using wait_style = wait_signature_t<Ret>;
+                (void)try_with_gate(client->get_server().reply_gate(), [client, msg_id, timeout, priority,
+                                                                        permit = std::move(permit)]() mutable {
+                    auto ret = futurize<Ret>::make_exception_future(overloaded_error());
+                    return reply<Serializer>(wait_style(), std::move(ret), msg_id, client, timeout, nullptr, priority)
+                        .handle_exception([permit = std::move(permit)](std::exception_ptr) {});
+                }).handle_exception_type([](gate_closed_exception &) { /* ignore */ });
+            }
+
             template<typename Ret, typename... InArgs, typename WantClientInfo, typename WantTimePoint, typename Func,
                      typename ArgsTuple>
             inline futurize_t<Ret> apply(Func &func, client_info &info, opt_time_point time_point, WantClientInfo wci,
@@ -603,14 +898,16 @@ namespace nil {
             // client
             template<typename Serializer, typename Func, typename Ret, typename... InArgs, typename WantClientInfo,
                      typename WantTimePoint>
-            auto recv_helper(signature<Ret(InArgs...)> sig, Func &&func, WantClientInfo wci, WantTimePoint wtp) {
+            auto recv_helper(signature<Ret(InArgs...)> sig, Func &&func, WantClientInfo wci, WantTimePoint wtp,
+                             uint64_t verb) {
                 using signature = decltype(sig);
                 using wait_style = wait_signature_t<Ret>;
-                return [func = lref_to_cref(std::forward<Func>(func))](shared_ptr<server::connection> client,
-                                                                       boost::optional<rpc_clock_type::time_point>
-                                                                           timeout,
-                                                                       int64_t msg_id,
-                                                                       rcv_buf data) mutable {
+                using latency_clock = latency_histogram::clock_type;
+                return [func = lref_to_cref(std::forward<Func>(func)), verb](shared_ptr<server::connection> client,
+                                                                             boost::optional<rpc_clock_type::time_point>
+                                                                                 timeout,
+                                                                             int64_t msg_id,
+                                                                             rcv_buf data) mutable {
                     auto memory_consumed = client->estimate_request_size(data.size);
                     if (memory_consumed > client->max_request_size()) {
                         auto err = format("request size {:d} large than memory limit {:d}", memory_consumed,
@@ -631,23 +928,62 @@ namespace nil {
                         }).handle_exception_type([](gate_closed_exception &) { /* ignore */ });
                         return make_ready_future();
                     }
+                    auto priority = client->verb_priority(verb);
+                    auto shedding = client->load_shedding_enabled();
+                    latency_metrics::server_verb *latency = nullptr;
+                    latency_clock::time_point arrival;
+                    if (auto metrics = client->get_server().latency()) {
+                        latency = &metrics->server(verb);
+                    }
+                    if (latency || shedding) {
+                        // the frame was read before the handler got its scheduling group
+                        arrival = client->request_arrival();
+                    }
                     // note: apply is executed asynchronously with regards to networking so we cannot chain futures here
                     // by doing "return apply()"
                     auto f = client->wait_for_resources(memory_consumed, timeout)
-                                 .then([client, timeout, msg_id, data = std::move(data), &func](auto permit) mutable {
+                                 .then([client, timeout, msg_id, data = std::move(data), &func, latency, arrival,
+                                        priority, shedding](auto permit) mutable {
+                                     if (shedding) {
+                                         auto reason = client->should_shed(arrival, timeout);
+                                         if (reason == server::connection::shed_reason::overloaded) {
+                                             reply_overloaded<Serializer, Ret>(client, msg_id, timeout, priority,
+                                                                               std::move(permit));
+                                         }
+                                         if (reason != server::connection::shed_reason::none) {
+                                             // an expired request is dropped silently, nobody waits for its reply
+                                             return;
+                                         }
+                                     }
+                                     latency_clock::time_point handler_start;
+                                     if (latency) {
+                                         handler_start = latency_clock::now();
+                                         latency->semaphore.record(handler_start - arrival);
+                                     }
                                      // FIXME: future is discarded
                                      (void)try_with_gate(client->get_server().reply_gate(), [client, timeout, msg_id,
                                                                                              data = std::move(data),
                                                                                              permit = std::move(permit),
-                                                                                             &func]() mutable {
+                                                                                             &func, latency, arrival,
+                                                                                             handler_start,
+                                                                                             priority]() mutable {
                                          try {
                                              auto args = unmarshall<Serializer, InArgs...>(*client, std::move(data));
                                              return apply(func, client->info(), timeout, WantClientInfo(),
                                                           WantTimePoint(), signature(), std::move(args))
-                                                 .then_wrapped([client, timeout, msg_id, permit = std::move(permit)](
-                                                                   futurize_t<Ret> ret) mutable {
+                                                 .then_wrapped([client, timeout, msg_id, permit = std::move(permit),
+                                                                latency, arrival, handler_start,
+                                                                priority](futurize_t<Ret> ret) mutable {
+                                                     latency_histogram *queue_latency = nullptr;
+                                                     if (latency) {
+                                                         auto now = latency_clock::now();
+                                                         latency->handler.record(now - handler_start);
+                                                         latency->latency.record(now - arrival);
+                                                         queue_latency = &latency->queue;
+                                                     }
                                                      return reply<Serializer>(wait_style(), std::move(ret), msg_id,
-                                                                              client, timeout)
+                                                                              client, timeout, queue_latency,
+                                                                              priority)
                                                          .handle_exception([permit = std::move(permit), client,
                                                                             msg_id](std::exception_ptr eptr) {
                                                              client->get_logger()(
@@ -732,6 +1068,21 @@ namespace nil {
                 return make_client(typename signature<typename function_traits<Func>::signature>::clean(), t);
             }
 
+            template<typename Serializer, typename MsgType>
+            template<typename Ret, typename... In>
+            auto protocol<Serializer, MsgType>::make_hedged_client(signature<Ret(In...)> clear_sig, MsgType t,
+                                                                   call_policy &policy) {
+                using sig_type = signature<typename client_function_type<Ret, In...>::type>;
+                return hedged_send_helper<Serializer>(t, sig_type(), policy);
+            }
+
+            template<typename Serializer, typename MsgType>
+            template<typename Func>
+            auto protocol<Serializer, MsgType>::make_hedged_client(MsgType t, call_policy &policy) {
+                return make_hedged_client(typename signature<typename function_traits<Func>::signature>::clean(), t,
+                                          policy);
+            }
+
             template<typename Serializer, typename MsgType>
             template<typename Func>
             auto protocol<Serializer, MsgType>::register_handler(MsgType t, scheduling_group sg, Func &&func) {
@@ -740,7 +1091,7 @@ namespace nil {
                 using want_client_info = typename sig_type::want_client_info;
                 using want_time_point = typename sig_type::want_time_point;
                 auto recv = recv_helper<Serializer>(clean_sig_type(), std::forward<Func>(func), want_client_info(),
-                                                    want_time_point());
+                                                    want_time_point(), uint64_t(t));
                 register_receiver(t, rpc_handler {sg, make_copyable_function(std::move(recv))});
                 return make_client(clean_sig_type(), t);
             }
@@ -753,6 +1104,17 @@ namespace nil {
 
             template<typename Serializer, typename MsgType>
             future<> protocol<Serializer, MsgType>::unregister_handler(MsgType t) {
+                auto id = static_cast<uint64_t>(t);
+                if (id < _dense_handlers_size) {
+                    auto &slot = _dense_handlers[id];
+                    if (slot) {
+                        return slot->use_gate.close().finally([this, &slot] {
+                            slot = boost::none;
+                            _dense_handlers_registered--;
+                        });
+                    }
+                    return make_ready_future<>();
+                }
                 auto it = _handlers.find(t);
                 if (it != _handlers.end()) {
                     return it->second.use_gate.close().finally([this, t] { _handlers.erase(t); });
@@ -761,24 +1123,36 @@ namespace nil {
             }
 
             template<typename Serializer, typename MsgType>
-            bool protocol<Serializer, MsgType>::has_handler(MsgType msg_id) {
-                auto it = _handlers.find(msg_id);
-                if (it == _handlers.end()) {
-                    return false;
+            rpc_handler *protocol<Serializer, MsgType>::find_handler(uint64_t id) {
+                if (id < _dense_handlers_size) {
+                    auto &slot = _dense_handlers[id];
+                    return slot ? &*slot : nullptr;
                 }
-                return !it->second.use_gate.is_closed();
+                auto it = _handlers.find(MsgType(id));
+                return it != _handlers.end() ? &it->second : nullptr;
+            }
+
+            template<typename Serializer, typename MsgType>
+            bool protocol<Serializer, MsgType>::has_handler(MsgType msg_id) {
+                auto h = find_handler(static_cast<uint64_t>(msg_id));
+                return h && !h->use_gate.is_closed();
+            }
+
+            template<typename Serializer, typename MsgType>
+            rpc_handler_stats protocol<Serializer, MsgType>::get_handler_stats(MsgType t) {
+                auto h = find_handler(static_cast<uint64_t>(t));
+                return h ? h->stats : rpc_handler_stats();
             }
 
             template<typename Serializer, typename MsgType>
             rpc_handler *protocol<Serializer, MsgType>::get_handler(uint64_t msg_id) {
-                rpc_handler *h = nullptr;
-                auto it = _handlers.find(MsgType(msg_id));
-                if (it != _handlers.end()) {
+                rpc_handler *h = find_handler(msg_id);
+                if (h) {
                     try {
-                        it->second.use_gate.enter();
-                        h = &it->second;
+                        h->use_gate.enter();
                     } catch (gate_closed_exception &) {
                         // unregistered, just ignore
+                        h = nullptr;
                     }
                 }
                 return h;
@@ -803,6 +1177,22 @@ namespace nil {
                 // we do not want to dead lock on huge packets, so let them in
                 // but only one at a time
                 auto size = std::min(size_t(data.size), max_stream_buffers_memory);
+                if (_batching) {
+                    return this->_sem.wait(size).then([this, size, data = std::move(data)]() mutable {
+                        if (this->_ex) {
+                            this->_sem.signal(size);
+                            return make_exception_future(this->_ex);
+                        }
+                        _pending_bytes += data.size;
+                        _pending_units += size;
+                        _pending.push_back(std::move(data));
+                        // While a frame is on its way, elements accumulate and go out with the next one.
+                        if (!_frames_in_flight || _pending_bytes >= _batch_max_bytes) {
+                            send_pending();
+                        }
+                        return make_ready_future<>();
+                    });
+                }
                 return get_units(this->_sem, size)
                     .then([this, data = make_foreign(std::make_unique<snd_buf>(std::move(data)))](
                               semaphore_units<> su) mutable {
@@ -831,9 +1221,53 @@ namespace nil {
                     });
             }
 
+            template<typename Serializer, typename... Out>
+            void sink_impl<Serializer, Out...>::send_pending() {
+                // a single element goes out as a plain frame, its length prefix is the frame header
+                auto charge = _pending_bytes;
+                snd_buf frame = _pending.size() == 1 ? std::move(_pending.front()) :
+                                                       make_stream_batch_frame(std::move(_pending), charge);
+                auto units = std::exchange(_pending_units, 0);
+                _pending.clear();
+                _pending_bytes = 0;
+                auto data = make_foreign(std::make_unique<snd_buf>(std::move(frame)));
+                ++_frames_in_flight;
+                // It is OK to discard this future. The user is required to
+                // wait for it when closing.
+                (void)smp::submit_to(this->_con->get_owner_shard(),
+                                     [this, charge, data = std::move(data)]() mutable {
+                                         connection *con = this->_con->get();
+                                         if (con->error()) {
+                                             return make_exception_future(closed_error());
+                                         }
+                                         if (con->sink_closed()) {
+                                             return make_exception_future(stream_closed());
+                                         }
+                                         return con->stream_send(make_shard_local_buffer_copy(std::move(data)), charge);
+                                     })
+                    .then_wrapped([this, units](future<> f) {
+                        if (f.failed() && !this->_ex) {    // first error is the interesting one
+                            this->_ex = f.get_exception();
+                        } else {
+                            f.ignore_ready_future();
+                        }
+                        this->_sem.signal(units);
+                        --_frames_in_flight;
+                        if (this->_ex) {
+                            // nothing more is sent, release what waits so that flush() and close() can fail
+                            this->_sem.signal(std::exchange(_pending_units, 0));
+                            _pending.clear();
+                            _pending_bytes = 0;
+                        } else if (!_frames_in_flight && !_pending.empty()) {
+                            send_pending();
+                        }
+                    });
+            }
+
             template<typename Serializer, typename... Out>
             future<> sink_impl<Serializer, Out...>::flush() {
-                // wait until everything is sent out before returning.
+                // wait until everything is sent out before returning, a pending batch goes out once the frames
+                // ahead of it are sent, which in turn may wait for credit from the receiver.
                 return with_semaphore(this->_sem, max_stream_buffers_memory, [this] {
                     if (this->_ex) {
                         return make_exception_future(this->_ex);
@@ -27,6 +27,7 @@
 #include <nil/actor/network/api.hh>
 #include <stdexcept>
 #include <string>
+#include <type_traits>
 #include <boost/any.hpp>
 #include <boost/type.hpp>
 #include <nil/actor/detail/std-compat.hh>
@@ -55,8 +56,27 @@ namespace nil {
                 counter_type pending = 0;
                 counter_type exception_received = 0;
                 counter_type sent_messages = 0;
+                // number of flushes issued by the send loop; sent_messages / sent_batches
+                // is the average number of messages coalesced into one write
+                counter_type sent_batches = 0;
                 counter_type wait_reply = 0;
                 counter_type timeout = 0;
+                // frames passed through the negotiated compressor, with their total size
+                // before and after compression and the time spent compressing them
+                counter_type compressed_frames = 0;
+                counter_type compression_bytes_in = 0;
+                counter_type compression_bytes_out = 0;
+                counter_type compression_time_ns = 0;
+                // frames sent raw on a compressed connection because they were too small
+                // or because recent frames of the same kind did not compress well
+                counter_type compression_bypassed_small = 0;
+                counter_type compression_bypassed_ratio = 0;
+                // raw frames received on a compressed connection
+                counter_type raw_frames_received = 0;
+                // requests dropped by the server because their timeout expired before the
+                // handler could start, or rejected with overloaded_error by load shedding
+                counter_type shed_expired = 0;
+                counter_type shed_overloaded = 0;
             };
 
             struct client_info {
@@ -121,6 +141,13 @@ namespace nil {
                 }
             };
 
+            /// The server shed the request instead of handling it, see server_options::load_shedding.
+            class overloaded_error : public error {
+            public:
+                overloaded_error() : error("rpc server is overloaded") {
+                }
+            };
+
             class stream_closed : public error {
             public:
                 stream_closed() : error("rpc stream was closed by peer") {
@@ -222,6 +249,15 @@ namespace nil {
                 temporary_buffer<char> &front();
             };
 
+            /// Removes the first \c n bytes from \c buf and returns them as a separate
+            /// buffer sharing the same fragments, no data is copied. Throws std::out_of_range if \c n
+            /// exceeds buf.size, leaving \c buf untouched.
+            rcv_buf split_rcv_buf(rcv_buf &buf, size_t n);
+
+            /// Returns a pointer to the first \c n bytes of \c buf without consuming them.
+            /// Bytes straddling fragments are copied into \c scratch, which must hold \c n bytes.
+            const char *peek_rcv_buf(const rcv_buf &buf, size_t n, char *scratch);
+
             static inline memory_input_stream<rcv_buf::iterator> make_deserializer_stream(rcv_buf &input) {
                 auto *b = std::get_if<temporary_buffer<char>>(&input.bufs);
                 if (b) {
@@ -385,6 +421,55 @@ namespace nil {
                 }
             };
 
+            /// Opts a trivially copyable type into bulk marshalling: arguments and return values of
+            /// the type, and std::vector of it, are copied to and from the wire as raw bytes instead
+            /// of going through the Serializer. A vector is sent as a 32 bit element count followed
+            /// by the elements.
+            ///
+            /// Both peers must opt in and share the type's layout and byte order, e.g. by being
+            /// built for the same platform. Specialize it as
+            /// `template<> struct rpc::is_bulk_serializable<my_pod> : std::true_type {};`
+            template<typename T>
+            struct is_bulk_serializable : std::false_type { };
+
+            /// Receives a std::vector<T> of a bulk serializable T without copying it.
+            ///
+            /// If the elements lie in a single fragment of the received frame, suitably aligned,
+            /// the view shares that fragment, otherwise it holds a copy. Either way the view may
+            /// keep the whole received frame alive, copy the elements out if they are kept
+            /// beyond the call.
+            template<typename T>
+            class bulk_view {
+                static_assert(std::is_trivially_copyable<T>::value, "bulk_view needs a trivially copyable type");
+                temporary_buffer<char> _buf;
+
+            public:
+                bulk_view() = default;
+                explicit bulk_view(temporary_buffer<char> buf) : _buf(std::move(buf)) {
+                }
+                const T *data() const {
+                    return reinterpret_cast<const T *>(_buf.get());
+                }
+                size_t size() const {
+                    return _buf.size() / sizeof(T);
+                }
+                bool empty() const {
+                    return _buf.empty();
+                }
+                const T *begin() const {
+                    return data();
+                }
+                const T *end() const {
+                    return data() + size();
+                }
+                const T &operator[](size_t i) const {
+                    return data()[i];
+                }
+                std::vector<T> to_vector() const {
+                    return std::vector<T>(begin(), end());
+                }
+            };
+
             /// @}
 
             template<typename... T>
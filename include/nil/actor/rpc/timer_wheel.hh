@@ -0,0 +1,125 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+
+#pragma once
+
+#include <memory>
+
+#include <boost/intrusive/list.hpp>
+
+#include <nil/actor/core/timer.hh>
+#include <nil/actor/detail/noncopyable_function.hh>
+#include <nil/actor/rpc/rpc_types.hh>
+
+namespace nil {
+    namespace actor {
+
+        namespace rpc {
+
+            /// Coarse hashed timer wheel used for RPC timeouts.
+            ///
+            /// Instead of arming a reactor timer per message, entries are hashed into
+            /// buckets by the tick their deadline falls into, and a single periodic timer
+            /// per wheel expires a whole bucket at a time. An entry fires no earlier than its
+            /// deadline and at most one tick later.
+            class timer_wheel {
+            public:
+                using clock_type = rpc_clock_type;
+                using time_point = clock_type::time_point;
+                using duration = clock_type::duration;
+
+                class entry : public boost::intrusive::list_base_hook<
+                                  boost::intrusive::link_mode<boost::intrusive::auto_unlink>> {
+                    timer_wheel *_wheel = nullptr;
+                    time_point _deadline = {};
+                    noncopyable_function<void()> _callback;
+                    friend timer_wheel;
+
+                public:
+                    entry() = default;
+                    entry(entry &&o) noexcept :
+                        _wheel(o._wheel), _deadline(o._deadline), _callback(std::move(o._callback)) {
+                        if (o.is_linked()) {
+                            this->swap_nodes(o);
+                        }
+                    }
+                    entry &operator=(entry &&) = delete;
+                    ~entry() {
+                        cancel();
+                    }
+                    // the deadline the entry was last armed with, or time_point() if it never was
+                    time_point get_timeout() const noexcept {
+                        return _deadline;
+                    }
+                    bool armed() const noexcept {
+                        return this->is_linked();
+                    }
+                    void cancel() noexcept {
+                        if (this->is_linked()) {
+                            this->unlink();
+                            _wheel->_size--;
+                        }
+                    }
+                };
+
+            private:
+                using bucket = boost::intrusive::list<entry, boost::intrusive::constant_time_size<false>>;
+                static constexpr size_t bucket_count = 256;
+                static_assert((bucket_count & (bucket_count - 1)) == 0, "bucket_count must be a power of two");
+
+                duration _granularity;
+                // allocated on first use, connections that never set a timeout do not pay for it
+                std::unique_ptr<bucket[]> _buckets;
+                uint64_t _current_tick = 0;
+                size_t _size = 0;
+                timer<clock_type> _timer;
+
+                uint64_t tick_of(time_point tp) const noexcept {
+                    return tp.time_since_epoch() / _granularity;
+                }
+                bucket &bucket_of(uint64_t tick) noexcept {
+                    return _buckets[tick & (bucket_count - 1)];
+                }
+                void expire();
+
+            public:
+                explicit timer_wheel(duration granularity = std::chrono::milliseconds(10));
+                timer_wheel(timer_wheel &&) = delete;
+                ~timer_wheel();
+
+                /// Arms \c e to call \c callback once \c deadline passes. Re-arming an armed
+                /// entry moves it to the new deadline.
+                void arm(entry &e, time_point deadline, noncopyable_function<void()> callback);
+
+                /// Number of armed entries.
+                size_t size() const noexcept {
+                    return _size;
+                }
+            };
+
+        }    // namespace rpc
+
+    }    // namespace actor
+}    // namespace nil
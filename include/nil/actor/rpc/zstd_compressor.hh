@@ -0,0 +1,128 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <nil/actor/core/sstring.hh>
+#include <nil/actor/rpc/rpc_types.hh>
+
+struct ZSTD_CDict_s;
+struct ZSTD_DDict_s;
+
+namespace nil {
+    namespace actor {
+        namespace rpc {
+
+            /// A pre-trained zstd dictionary shared by both sides of a connection.
+            ///
+            /// The dictionary must be in zstd format (as produced by \ref train() or
+            /// the `zstd --train` command line tool), its embedded id is what peers
+            /// use to make sure they agree on the dictionary during negotiation.
+            /// Digested compression and decompression tables are built once on
+            /// construction and are only read afterwards, so a single instance can
+            /// be shared by compressors running on every shard.
+            class zstd_dictionary {
+                struct cdict_deleter {
+                    void operator()(ZSTD_CDict_s *) const noexcept;
+                };
+                struct ddict_deleter {
+                    void operator()(ZSTD_DDict_s *) const noexcept;
+                };
+
+                sstring _content;
+                uint32_t _id;
+                int _level;
+                std::unique_ptr<ZSTD_CDict_s, cdict_deleter> _cdict;
+                std::unique_ptr<ZSTD_DDict_s, ddict_deleter> _ddict;
+
+            public:
+                /// \param content serialized dictionary in zstd format
+                /// \param level compression level used by compressors referring to this dictionary
+                explicit zstd_dictionary(sstring content, int level = 3);
+                ~zstd_dictionary();
+
+                /// Trains a dictionary of at most \c capacity bytes on a set of sample messages.
+                static sstring train(const std::vector<sstring> &samples, size_t capacity = 16 * 1024);
+
+                uint32_t id() const noexcept {
+                    return _id;
+                }
+                int level() const noexcept {
+                    return _level;
+                }
+                const sstring &content() const noexcept {
+                    return _content;
+                }
+                const ZSTD_CDict_s *cdict() const noexcept {
+                    return _cdict.get();
+                }
+                const ZSTD_DDict_s *ddict() const noexcept {
+                    return _ddict.get();
+                }
+            };
+
+            /// Zstandard compressor.
+            ///
+            /// Every message is encoded as a single zstd frame. Messages that fit into
+            /// one fragment are compressed in one shot, larger (fragmented) ones are fed
+            /// through the streaming interface fragment by fragment, so neither side
+            /// ever linearizes the payload. When a dictionary is attached the feature
+            /// name carries its id ("ZSTD:<id>") and is only negotiated with a peer
+            /// holding the same dictionary. To fall back to dictionary-less compression
+            /// list both a dictionary and a plain factory in
+            /// \ref multi_algo_compressor_factory.
+            class zstd_compressor final : public compressor {
+                int _level;
+                std::shared_ptr<const zstd_dictionary> _dictionary;
+
+            public:
+                static constexpr int default_level = 3;
+
+                class factory final : public rpc::compressor::factory {
+                    int _level = default_level;
+                    std::shared_ptr<const zstd_dictionary> _dictionary;
+                    sstring _name;
+
+                public:
+                    explicit factory(int level = default_level);
+                    explicit factory(std::shared_ptr<const zstd_dictionary> dictionary);
+                    virtual const sstring &supported() const override;
+                    virtual std::unique_ptr<rpc::compressor> negotiate(sstring feature, bool is_server) const override;
+                };
+
+            public:
+                explicit zstd_compressor(int level = default_level,
+                                         std::shared_ptr<const zstd_dictionary> dictionary = nullptr);
+                virtual snd_buf compress(size_t head_space, snd_buf data) override;
+                virtual rcv_buf decompress(rcv_buf data) override;
+                sstring name() const override;
+            };
+
+        }    // namespace rpc
+    }        // namespace actor
+}    // namespace nil
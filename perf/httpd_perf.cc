@@ -0,0 +1,136 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#include "loopback_socket.hh"
+
+#include <nil/actor/http/httpd.hh>
+#include <nil/actor/http/function_handlers.hh>
+#include <nil/actor/http/response_parser.hh>
+#include <nil/actor/core/loop.hh>
+
+#include <nil/actor/testing/perf_tests.hh>
+
+#include <boost/range/irange.hpp>
+
+// Benchmarks of the HTTP server: a client and a server on every shard talking through
+// loopback_socket, so request parsing, dispatch and reply rendering are measured without
+// any network underneath. One iteration is one request and its complete response.
+
+using namespace nil::actor;
+using namespace httpd;
+
+class httpd_loopback {
+public:
+    // number of requests written before reading the responses in a pipelined iteration
+    static constexpr unsigned pipeline_depth = 16;
+
+private:
+    loopback_connection_factory _lcf;
+    http_server _server {"perf"};
+    connected_socket _socket;
+    input_stream<char> _in;
+    output_stream<char> _out;
+    http_response_parser _parser;
+
+    sstring _small_json_request = "GET /json HTTP/1.1\r\nHost: perf\r\n\r\n";
+    sstring _many_headers_request = "GET /headers HTTP/1.1\r\nHost: perf\r\n\r\n";
+    sstring _large_body_request = "GET /large HTTP/1.1\r\nHost: perf\r\n\r\n";
+
+    future<> read_response() {
+        _parser.init();
+        return _in.consume(_parser).then([this] {
+            auto rsp = _parser.get_parsed_response();
+            if (!rsp || _parser.eof()) {
+                throw std::runtime_error("connection closed before the response");
+            }
+            return _in.skip(std::stoul(rsp->_headers["Content-Length"]));
+        });
+    }
+
+public:
+    httpd_loopback() {
+        _server._routes.put(GET, "/json",
+                            new function_handler([](const_req req) { return sstring("{\"status\":\"ok\"}"); }, "json"));
+        _server._routes.put(GET, "/headers", new function_handler(
+                                                 [](const_req req, reply &rep) {
+                                                     for (auto i : boost::irange(0, 8)) {
+                                                         rep.add_header("X-Header-" + to_sstring(i), "value");
+                                                     }
+                                                     return sstring("{}");
+                                                 },
+                                                 "json"));
+        _server._routes.put(GET, "/large",
+                            new function_handler([](const_req req) { return sstring(64 * 1024, 'x'); }, "txt"));
+        http_server_tester::listeners(_server).emplace_back(_lcf.get_server_socket());
+        _server.do_accepts(0).get();
+        _socket = loopback_socket_impl(_lcf).connect(socket_address(ipv4_addr()), socket_address(ipv4_addr())).get0();
+        _in = _socket.input();
+        _out = _socket.output();
+    }
+
+    ~httpd_loopback() {
+        _out.close().get();
+        _in.close().get();
+        _server.stop().get();
+        _lcf.destroy_all_shards().get();
+    }
+
+    future<> request(const sstring &req) {
+        return _out.write(req).then([this] { return _out.flush(); }).then([this] { return read_response(); });
+    }
+
+    future<> pipelined(const sstring &req) {
+        return do_for_each(boost::irange(0u, pipeline_depth), [this, &req](unsigned) { return _out.write(req); })
+            .then([this] { return _out.flush(); })
+            .then([this] {
+                return do_for_each(boost::irange(0u, pipeline_depth), [this](unsigned) { return read_response(); });
+            });
+    }
+
+    const sstring &small_json_request() const {
+        return _small_json_request;
+    }
+    const sstring &many_headers_request() const {
+        return _many_headers_request;
+    }
+    const sstring &large_body_request() const {
+        return _large_body_request;
+    }
+};
+
+PERF_TEST_F(httpd_loopback, small_json) {
+    return request(small_json_request());
+}
+
+PERF_TEST_F(httpd_loopback, many_headers) {
+    return request(many_headers_request());
+}
+
+PERF_TEST_F(httpd_loopback, large_body) {
+    return request(large_body_request());
+}
+
+PERF_TEST_F(httpd_loopback, pipelined_small_json) {
+    return pipelined(small_json_request());
+}
@@ -0,0 +1,343 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+#include <cstring>
+#include <iterator>
+#include <random>
+
+#include "loopback_socket.hh"
+
+#include <nil/actor/rpc/rpc.hh>
+#include <nil/actor/rpc/in_process_transport.hh>
+#include <nil/actor/rpc/lz4_compressor.hh>
+#include <nil/actor/core/gate.hh>
+#include <nil/actor/core/loop.hh>
+#include <nil/actor/core/sharded.hh>
+
+#include <nil/actor/testing/perf_tests.hh>
+#include <nil/actor/testing/random.hh>
+
+#include <boost/iterator/counting_iterator.hpp>
+#include <boost/range/irange.hpp>
+
+// Benchmarks of the RPC stack itself: a client and a server on every shard talking
+// through loopback_socket, or rpc::in_process_transport, so send_loop(), frame parsing
+// and (optionally) compression are measured without any network underneath.
+
+using namespace nil::actor;
+
+struct serializer { };
+
+template<typename Output>
+inline void write(serializer, Output &out, uint64_t v) {
+    out.write(reinterpret_cast<const char *>(&v), sizeof(v));
+}
+template<typename Input>
+inline uint64_t read(serializer, Input &in, rpc::type<uint64_t>) {
+    uint64_t v;
+    in.read(reinterpret_cast<char *>(&v), sizeof(v));
+    return v;
+}
+
+template<typename Output>
+inline void write(serializer, Output &out, const sstring &v) {
+    write(serializer(), out, uint64_t(v.size()));
+    out.write(v.c_str(), v.size());
+}
+template<typename Input>
+inline sstring read(serializer, Input &in, rpc::type<sstring>) {
+    auto size = read(serializer(), in, rpc::type<uint64_t>());
+    sstring ret = uninitialized_string(size);
+    in.read(ret.data(), size);
+    return ret;
+}
+
+using perf_rpc_proto = rpc::protocol<serializer>;
+
+enum perf_verb : uint32_t {
+    ping_verb = 1,
+    write_verb,
+    stream_verb,
+};
+
+class rpc_loopback_service {
+    perf_rpc_proto _proto;
+    perf_rpc_proto::server _server;
+    gate _streams;
+
+public:
+    rpc_loopback_service(const rpc::server_options &so, loopback_connection_factory &lcf,
+                         rpc::in_process_transport *ipt) :
+        _proto(serializer()), _server(_proto, so, ipt ? ipt->listen() : lcf.get_server_socket()) {
+        _proto.register_handler(perf_verb::ping_verb, [](uint64_t v) { return v; });
+        _proto.register_handler(perf_verb::write_verb, [](sstring payload) { return uint64_t(payload.size()); });
+        _proto.register_handler(perf_verb::stream_verb, [this](rpc::source<sstring> source) {
+            // drain the stream in the background until the client closes its sink
+            (void)try_with_gate(_streams, [source]() mutable {
+                return repeat([source]() mutable {
+                    return source().then([](boost::optional<std::tuple<sstring>> data) {
+                        return data ? stop_iteration::no : stop_iteration::yes;
+                    });
+                });
+            }).handle_exception([](std::exception_ptr) {});
+        });
+    }
+
+    perf_rpc_proto &proto() {
+        return _proto;
+    }
+
+    future<> stop() {
+        return _server.stop().then([this] { return _streams.close(); });
+    }
+};
+
+enum class rpc_loopback_mode {
+    plain,
+    lz4,
+    batched,
+    // same as plain, but connected through rpc::in_process_transport instead of loopback_socket
+    in_process,
+};
+
+template<rpc_loopback_mode Mode>
+class rpc_loopback_fixture {
+public:
+    // number of concurrent calls issued by one pipelined iteration
+    static constexpr unsigned pipeline_depth = 32;
+    // number of stream elements written by one streaming iteration before flushing
+    static constexpr unsigned stream_batch = 64;
+
+private:
+    rpc::lz4_compressor::factory _compressor_factory;
+    rpc::client_options _client_options;
+    rpc::server_options _server_options;
+    loopback_connection_factory _lcf;
+    rpc::in_process_transport _ipt;
+    sharded<rpc_loopback_service> _service;
+    std::unique_ptr<perf_rpc_proto::client> _client;
+    boost::optional<rpc::sink<sstring>> _sink;
+
+    sstring _payload_64b;
+    sstring _payload_4kb;
+    sstring _payload_64kb;
+    sstring _payload_1mb;
+
+    // Random words from a small vocabulary: repetitive enough for LZ4 to find matches,
+    // unlike uniformly random bytes which would always be sent uncompressed.
+    static sstring make_payload(size_t size) {
+        static const char *words[] = {"actor ", "future ", "promise ", "shard ", "reactor ", "rpc ", "verb ", "frame "};
+        auto &eng = testing::local_random_engine;
+        auto dist = std::uniform_int_distribution<size_t>(0, std::size(words) - 1);
+        sstring ret = uninitialized_string(size);
+        size_t pos = 0;
+        while (pos < size) {
+            auto w = words[dist(eng)];
+            auto n = std::min(std::strlen(w), size - pos);
+            std::copy_n(w, n, ret.data() + pos);
+            pos += n;
+        }
+        return ret;
+    }
+
+    nil::actor::socket make_socket() {
+        if (Mode == rpc_loopback_mode::in_process) {
+            return _ipt.make_socket();
+        }
+        return nil::actor::socket(std::make_unique<loopback_socket_impl>(_lcf));
+    }
+
+public:
+    rpc_loopback_fixture() :
+        _payload_64b(make_payload(64)), _payload_4kb(make_payload(4 * 1024)), _payload_64kb(make_payload(64 * 1024)),
+        _payload_1mb(make_payload(1024 * 1024)) {
+        _server_options.streaming_domain = rpc::streaming_domain_type(1);
+        if (Mode == rpc_loopback_mode::lz4) {
+            _client_options.compressor_factory = &_compressor_factory;
+            _server_options.compressor_factory = &_compressor_factory;
+        } else if (Mode == rpc_loopback_mode::batched) {
+            _client_options.send_batch_max_messages = 16;
+            _server_options.send_batch_max_messages = 16;
+        }
+        auto ipt = Mode == rpc_loopback_mode::in_process ? &_ipt : nullptr;
+        _service.start(std::cref(_server_options), std::ref(_lcf), ipt).get();
+        _client = std::make_unique<perf_rpc_proto::client>(proto(), _client_options, make_socket(), ipv4_addr());
+        // complete negotiation before anything is measured
+        ping(0).get();
+        _sink = _client->make_stream_sink<serializer, sstring>(make_socket()).get0();
+        proto().make_client<void(rpc::sink<sstring>)>(perf_verb::stream_verb)(*_client, *_sink).get();
+    }
+
+    ~rpc_loopback_fixture() {
+        _sink->close().get();
+        _client->stop().get();
+        _service.stop().get();
+        _lcf.destroy_all_shards().get();
+        _ipt.stop().get();
+    }
+
+    perf_rpc_proto &proto() {
+        return _service.local().proto();
+    }
+
+    future<uint64_t> ping(uint64_t v) {
+        return proto().make_client<uint64_t(uint64_t)>(perf_verb::ping_verb)(*_client, v);
+    }
+
+    // pipeline_depth calls carrying the payload are in flight at the same time
+    future<> pipelined(const sstring &payload) {
+        return parallel_for_each(boost::irange(0u, pipeline_depth), [this, &payload](unsigned) {
+            return proto()
+                .make_client<uint64_t(sstring)>(perf_verb::write_verb)(*_client, payload)
+                .then([](uint64_t size) { perf_tests::do_not_optimize(size); });
+        });
+    }
+
+    future<> stream(const sstring &payload) {
+        return do_for_each(boost::counting_iterator<unsigned>(0), boost::counting_iterator<unsigned>(stream_batch),
+                           [this, &payload](unsigned) { return (*_sink)(payload); })
+            .then([this] { return _sink->flush(); });
+    }
+
+    const sstring &payload_64b() const {
+        return _payload_64b;
+    }
+    const sstring &payload_4kb() const {
+        return _payload_4kb;
+    }
+    const sstring &payload_64kb() const {
+        return _payload_64kb;
+    }
+    const sstring &payload_1mb() const {
+        return _payload_1mb;
+    }
+};
+
+using rpc_loopback = rpc_loopback_fixture<rpc_loopback_mode::plain>;
+
+PERF_TEST_F(rpc_loopback, ping_pong) {
+    return ping(1).then([](uint64_t v) { perf_tests::do_not_optimize(v); });
+}
+
+PERF_TEST_F(rpc_loopback, pipelined_64b) {
+    return pipelined(payload_64b());
+}
+
+PERF_TEST_F(rpc_loopback, pipelined_4kb) {
+    return pipelined(payload_4kb());
+}
+
+PERF_TEST_F(rpc_loopback, pipelined_64kb) {
+    return pipelined(payload_64kb());
+}
+
+PERF_TEST_F(rpc_loopback, pipelined_1mb) {
+    return pipelined(payload_1mb());
+}
+
+PERF_TEST_F(rpc_loopback, stream_64b) {
+    return stream(payload_64b());
+}
+
+PERF_TEST_F(rpc_loopback, stream_4kb) {
+    return stream(payload_4kb());
+}
+
+PERF_TEST_F(rpc_loopback, stream_64kb) {
+    return stream(payload_64kb());
+}
+
+using rpc_loopback_lz4 = rpc_loopback_fixture<rpc_loopback_mode::lz4>;
+
+PERF_TEST_F(rpc_loopback_lz4, ping_pong) {
+    return ping(1).then([](uint64_t v) { perf_tests::do_not_optimize(v); });
+}
+
+PERF_TEST_F(rpc_loopback_lz4, pipelined_64b) {
+    return pipelined(payload_64b());
+}
+
+PERF_TEST_F(rpc_loopback_lz4, pipelined_4kb) {
+    return pipelined(payload_4kb());
+}
+
+PERF_TEST_F(rpc_loopback_lz4, pipelined_64kb) {
+    return pipelined(payload_64kb());
+}
+
+PERF_TEST_F(rpc_loopback_lz4, pipelined_1mb) {
+    return pipelined(payload_1mb());
+}
+
+PERF_TEST_F(rpc_loopback_lz4, stream_64b) {
+    return stream(payload_64b());
+}
+
+PERF_TEST_F(rpc_loopback_lz4, stream_4kb) {
+    return stream(payload_4kb());
+}
+
+PERF_TEST_F(rpc_loopback_lz4, stream_64kb) {
+    return stream(payload_64kb());
+}
+
+using rpc_loopback_batched = rpc_loopback_fixture<rpc_loopback_mode::batched>;
+
+PERF_TEST_F(rpc_loopback_batched, ping_pong) {
+    return ping(1).then([](uint64_t v) { perf_tests::do_not_optimize(v); });
+}
+
+PERF_TEST_F(rpc_loopback_batched, pipelined_64b) {
+    return pipelined(payload_64b());
+}
+
+PERF_TEST_F(rpc_loopback_batched, pipelined_4kb) {
+    return pipelined(payload_4kb());
+}
+
+PERF_TEST_F(rpc_loopback_batched, stream_64b) {
+    return stream(payload_64b());
+}
+
+using rpc_in_process = rpc_loopback_fixture<rpc_loopback_mode::in_process>;
+
+PERF_TEST_F(rpc_in_process, ping_pong) {
+    return ping(1).then([](uint64_t v) { perf_tests::do_not_optimize(v); });
+}
+
+PERF_TEST_F(rpc_in_process, pipelined_64b) {
+    return pipelined(payload_64b());
+}
+
+PERF_TEST_F(rpc_in_process, pipelined_4kb) {
+    return pipelined(payload_4kb());
+}
+
+PERF_TEST_F(rpc_in_process, pipelined_1mb) {
+    return pipelined(payload_1mb());
+}
+
+PERF_TEST_F(rpc_in_process, stream_4kb) {
+    return stream(payload_4kb());
+}
@@ -24,8 +24,12 @@
 
 #include <random>
 
+#include <nil/actor/rpc/rpc.hh>
 #include <nil/actor/rpc/lz4_compressor.hh>
 #include <nil/actor/rpc/lz4_fragmented_compressor.hh>
+#include <nil/actor/rpc/zstd_compressor.hh>
+#include <nil/actor/network/packet-data-source.hh>
+#include <nil/actor/core/byteorder.hh>
 
 #include <nil/actor/testing/perf_tests.hh>
 #include <nil/actor/testing/random.hh>
@@ -234,3 +238,138 @@ PERF_TEST_F(lz4_fragmented, large_random_buffer_decompress) {
 PERF_TEST_F(lz4_fragmented, large_zeroed_buffer_decompress) {
     perf_tests::do_not_optimize(compressor().decompress(large_compressed_buffer_zeroes()));
 }
+
+using zstd = compression<nil::actor::rpc::zstd_compressor>;
+
+PERF_TEST_F(zstd, small_random_buffer_compress) {
+    perf_tests::do_not_optimize(compressor().compress(0, small_buffer_random()));
+}
+
+PERF_TEST_F(zstd, small_zeroed_buffer_compress) {
+    perf_tests::do_not_optimize(compressor().compress(0, small_buffer_zeroes()));
+}
+
+PERF_TEST_F(zstd, large_random_buffer_compress) {
+    perf_tests::do_not_optimize(compressor().compress(0, large_buffer_random()));
+}
+
+PERF_TEST_F(zstd, large_zeroed_buffer_compress) {
+    perf_tests::do_not_optimize(compressor().compress(0, large_buffer_zeroes()));
+}
+
+PERF_TEST_F(zstd, small_random_buffer_decompress) {
+    perf_tests::do_not_optimize(compressor().decompress(small_compressed_buffer_random()));
+}
+
+PERF_TEST_F(zstd, small_zeroed_buffer_decompress) {
+    perf_tests::do_not_optimize(compressor().decompress(small_compressed_buffer_zeroes()));
+}
+
+PERF_TEST_F(zstd, large_random_buffer_decompress) {
+    perf_tests::do_not_optimize(compressor().decompress(large_compressed_buffer_random()));
+}
+
+PERF_TEST_F(zstd, large_zeroed_buffer_decompress) {
+    perf_tests::do_not_optimize(compressor().decompress(large_compressed_buffer_zeroes()));
+}
+
+// Decoding a response frame (12 byte header + payload) out of a decompressed buffer:
+// rpc::parse_response_frame, which slices the decompressed fragments like a client does,
+// versus re-reading them through a packet backed input_stream.
+struct frame_parsing {
+    static constexpr size_t small_payload_size = 128;
+    static constexpr size_t large_payload_size = 1024 * 1024;
+    static constexpr size_t header_size = 12;
+
+private:
+    nil::actor::rpc::lz4_fragmented_compressor _compressor;
+    std::vector<nil::actor::temporary_buffer<char>> _small_frame;
+    std::vector<nil::actor::temporary_buffer<char>> _large_frame;
+
+    std::vector<nil::actor::temporary_buffer<char>> make_frame(size_t payload_size) {
+        auto &eng = testing::local_random_engine;
+        auto dist = std::uniform_int_distribution<char>('a', 'z');
+        nil::actor::rpc::snd_buf frame(header_size + payload_size);
+        auto &bufs = frame.bufs;
+        auto fill = [&](nil::actor::temporary_buffer<char> &b) {
+            std::generate_n(b.get_write(), b.size(), [&] { return dist(eng); });
+        };
+        if (auto *one = std::get_if<nil::actor::temporary_buffer<char>>(&bufs)) {
+            fill(*one);
+        } else {
+            for (auto &&b : std::get<std::vector<nil::actor::temporary_buffer<char>>>(bufs)) {
+                fill(b);
+            }
+        }
+        nil::actor::write_le<int64_t>(frame.front().get_write(), 1);
+        nil::actor::write_le<uint32_t>(frame.front().get_write() + 8, payload_size);
+        auto compressed = _compressor.compress(0, std::move(frame));
+        if (auto *one = std::get_if<nil::actor::temporary_buffer<char>>(&compressed.bufs)) {
+            std::vector<nil::actor::temporary_buffer<char>> v;
+            v.push_back(std::move(*one));
+            return v;
+        }
+        return std::move(std::get<std::vector<nil::actor::temporary_buffer<char>>>(compressed.bufs));
+    }
+
+    nil::actor::rpc::rcv_buf decompress(std::vector<nil::actor::temporary_buffer<char>> &input) {
+        auto bufs = std::vector<temporary_buffer<char>> {};
+        auto total_size =
+            std::accumulate(input.begin(), input.end(), size_t(0), [&](size_t n, temporary_buffer<char> &buf) {
+                bufs.emplace_back(buf.share());
+                return n + buf.size();
+            });
+        return _compressor.decompress(nil::actor::rpc::rcv_buf(std::move(bufs), total_size));
+    }
+
+    static future<temporary_buffer<char>> parse_input_stream(nil::actor::rpc::rcv_buf buf) {
+        nil::actor::net::packet p;
+        if (auto *one = std::get_if<temporary_buffer<char>>(&buf.bufs)) {
+            p = nil::actor::net::packet(std::move(p), std::move(*one));
+        } else {
+            auto &&bufs = std::get<std::vector<temporary_buffer<char>>>(buf.bufs);
+            p.reserve(bufs.size());
+            for (auto &&b : bufs) {
+                p = nil::actor::net::packet(std::move(p), std::move(b));
+            }
+        }
+        return do_with(nil::actor::net::as_input_stream(std::move(p)), [](input_stream<char> &in) {
+            return in.read_exactly(header_size).then([&in](temporary_buffer<char> header) {
+                return in.read_exactly(nil::actor::read_le<uint32_t>(header.get() + 8));
+            });
+        });
+    }
+
+public:
+    frame_parsing() : _small_frame(make_frame(small_payload_size)), _large_frame(make_frame(large_payload_size)) {
+    }
+
+    future<std::tuple<int64_t, boost::optional<nil::actor::rpc::rcv_buf>>> small_frame_direct() {
+        return nil::actor::rpc::parse_response_frame(decompress(_small_frame));
+    }
+    future<std::tuple<int64_t, boost::optional<nil::actor::rpc::rcv_buf>>> large_frame_direct() {
+        return nil::actor::rpc::parse_response_frame(decompress(_large_frame));
+    }
+    future<temporary_buffer<char>> small_frame_input_stream() {
+        return parse_input_stream(decompress(_small_frame));
+    }
+    future<temporary_buffer<char>> large_frame_input_stream() {
+        return parse_input_stream(decompress(_large_frame));
+    }
+};
+
+PERF_TEST_F(frame_parsing, small_frame_direct) {
+    return small_frame_direct().then([](auto frame) { perf_tests::do_not_optimize(frame); });
+}
+
+PERF_TEST_F(frame_parsing, large_frame_direct) {
+    return large_frame_direct().then([](auto frame) { perf_tests::do_not_optimize(frame); });
+}
+
+PERF_TEST_F(frame_parsing, small_frame_input_stream) {
+    return small_frame_input_stream().then([](temporary_buffer<char> b) { perf_tests::do_not_optimize(b); });
+}
+
+PERF_TEST_F(frame_parsing, large_frame_input_stream) {
+    return large_frame_input_stream().then([](temporary_buffer<char> b) { perf_tests::do_not_optimize(b); });
+}
@@ -54,6 +54,44 @@ namespace nil {
                 return GET;
             }
 
+            static short hex_to_byte(char c) {
+                if (c >= 'a' && c <= 'z') {
+                    return c - 'a' + 10;
+                } else if (c >= 'A' && c <= 'Z') {
+                    return c - 'A' + 10;
+                }
+                return c - '0';
+            }
+
+            /**
+             * Convert a hex encoded 2 bytes substring to char
+             */
+            static char hexstr_to_char(std::string_view in, size_t from) {
+                return static_cast<char>(hex_to_byte(in[from]) * 16 + hex_to_byte(in[from + 1]));
+            }
+
+            bool url_decode(std::string_view in, sstring &out) {
+                size_t pos = 0;
+                sstring buff(in.length(), 0);
+                for (size_t i = 0; i < in.length(); ++i) {
+                    if (in[i] == '%') {
+                        if (i + 3 <= in.size()) {
+                            buff[pos++] = hexstr_to_char(in, i + 1);
+                            i += 2;
+                        } else {
+                            return false;
+                        }
+                    } else if (in[i] == '+') {
+                        buff[pos++] = ' ';
+                    } else {
+                        buff[pos++] = in[i];
+                    }
+                }
+                buff.resize(pos);
+                out = buff;
+                return true;
+            }
+
         }    // namespace httpd
 
     }    // namespace actor
@@ -0,0 +1,180 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+#include <nil/actor/http/file_cache.hh>
+#include <nil/actor/http/httpd.hh>
+#include <nil/actor/core/core.hh>
+#include <nil/actor/core/reactor.hh>
+#include <nil/actor/core/file.hh>
+#include <nil/actor/core/print.hh>
+
+namespace nil {
+    namespace actor {
+
+        namespace httpd {
+
+            // FNV-1a, the tag only has to change with the content
+            static uint64_t content_hash(const temporary_buffer<char> &content) {
+                uint64_t h = 14695981039346656037ull;
+                for (size_t i = 0; i < content.size(); ++i) {
+                    h = (h ^ uint8_t(content[i])) * 1099511628211ull;
+                }
+                return h;
+            }
+
+            static future<temporary_buffer<char>> read_file(const sstring &path) {
+                return open_file_dma(path, open_flags::ro).then([](file f) {
+                    return f.size()
+                        .then([f](uint64_t size) mutable { return f.dma_read_bulk<char>(0, size); })
+                        .finally([f]() mutable { return f.close(); });
+                });
+            }
+
+            // The modification time of a path, the epoch when there is no such file.
+            static future<std::chrono::system_clock::time_point> modification_time(const sstring &path) {
+                return engine()
+                    .file_stat(path)
+                    .then([](stat_data st) { return st.time_modified; })
+                    .handle_exception([](std::exception_ptr) { return std::chrono::system_clock::time_point(); });
+            }
+
+            // Whether the path of a variant still has the modification time it had when it was read.
+            static future<bool> unchanged(const sstring &path, const cached_file::variant &v) {
+                return modification_time(path).then([&v](auto mtime) { return mtime == v.mtime; });
+            }
+
+            file_cache::file_cache(size_t budget, size_t max_file_size, lowres_clock::duration revalidate_interval) :
+                _budget(budget), _max_file_size(max_file_size), _revalidate_interval(revalidate_interval) {
+            }
+
+            future<lw_shared_ptr<cached_file>> file_cache::get(const sstring &path) {
+                auto it = _files.find(path);
+                if (it == _files.end()) {
+                    return load(path);
+                }
+                _lru.splice(_lru.begin(), _lru, it->second.lru);
+                auto file = it->second.file;
+                auto now = lowres_clock::now();
+                if (now - file->checked < _revalidate_interval) {
+                    ++_hits;
+                    return make_ready_future<lw_shared_ptr<cached_file>>(std::move(file));
+                }
+                // a variant written, removed or replaced since changes the reply as much as the file does
+                return unchanged(path, file->identity)
+                    .then([path, file](bool same) {
+                        return same ? unchanged(path + ".gz", file->gzip) : make_ready_future<bool>(false);
+                    })
+                    .then([path, file](bool same) {
+                        return same ? unchanged(path + ".br", file->brotli) : make_ready_future<bool>(false);
+                    })
+                    .then([this, path, file, now](bool unchanged) {
+                        if (!unchanged) {
+                            erase(path);
+                            return load(path);
+                        }
+                        ++_hits;
+                        file->checked = now;
+                        return make_ready_future<lw_shared_ptr<cached_file>>(file);
+                    });
+            }
+
+            future<lw_shared_ptr<cached_file>> file_cache::load(const sstring &path) {
+                ++_misses;
+                // a variant is only used when it was written after the file
+                auto read_variant = [this](sstring path, std::chrono::system_clock::time_point mtime) {
+                    return engine()
+                        .file_stat(path)
+                        .then([this, path, mtime](stat_data st) {
+                            cached_file::variant v;
+                            v.mtime = st.time_modified;
+                            if (st.type != directory_entry_type::regular || st.size > _max_file_size ||
+                                st.time_modified < mtime) {
+                                return make_ready_future<cached_file::variant>(std::move(v));
+                            }
+                            return read_file(path).then([v = std::move(v)](temporary_buffer<char> content) mutable {
+                                v.content = std::move(content);
+                                return std::move(v);
+                            });
+                        })
+                        .handle_exception([](std::exception_ptr) { return cached_file::variant(); });
+                };
+                return engine()
+                    .file_stat(path)
+                    .then([this, path, read_variant](stat_data st) {
+                        if (st.type != directory_entry_type::regular || st.size > _max_file_size) {
+                            return make_ready_future<lw_shared_ptr<cached_file>>();
+                        }
+                        auto file = make_lw_shared<cached_file>();
+                        file->identity.mtime = st.time_modified;
+                        return read_file(path)
+                            .then([file, path, read_variant](temporary_buffer<char> content) {
+                                file->identity.content = std::move(content);
+                                return read_variant(path + ".gz", file->identity.mtime);
+                            })
+                            .then([file, path, read_variant](cached_file::variant gzip) {
+                                file->gzip = std::move(gzip);
+                                return read_variant(path + ".br", file->identity.mtime);
+                            })
+                            .then([this, file, path](cached_file::variant brotli) {
+                                file->brotli = std::move(brotli);
+                                for (auto v : {&file->identity, &file->gzip, &file->brotli}) {
+                                    v->etag = format("\"{:016x}-{:x}\"", content_hash(v->content), v->content.size());
+                                }
+                                file->last_modified =
+                                    http_server::http_date(std::chrono::system_clock::to_time_t(file->identity.mtime));
+                                file->checked = lowres_clock::now();
+                                insert(path, file);
+                                return file;
+                            });
+                    })
+                    .handle_exception([](std::exception_ptr) { return lw_shared_ptr<cached_file>(); });
+            }
+
+            void file_cache::insert(const sstring &path, lw_shared_ptr<cached_file> file) {
+                // a concurrent miss may have loaded the file already
+                erase(path);
+                if (file->size() > _budget) {
+                    return;
+                }
+                while (_size + file->size() > _budget) {
+                    erase(sstring(_lru.back()));
+                }
+                _lru.push_front(path);
+                _size += file->size();
+                _files.emplace(path, entry {std::move(file), _lru.begin()});
+            }
+
+            void file_cache::erase(const sstring &path) {
+                auto it = _files.find(path);
+                if (it == _files.end()) {
+                    return;
+                }
+                _size -= it->second.file->size();
+                _lru.erase(it->second.lru);
+                _files.erase(it);
+            }
+
+        }    // namespace httpd
+
+    }    // namespace actor
+}    // namespace nil
@@ -23,7 +23,14 @@
 //---------------------------------------------------------------------------//
 
 #include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
 #include <iostream>
+#include <optional>
+#include <string_view>
 
 #include <nil/actor/http/file_handler.hh>
 #include <nil/actor/core/core.hh>
@@ -85,10 +92,125 @@ namespace nil {
                 return std::move(s);
             }
 
+            // Whether a content coding is acceptable, codings with a zero quality value are not.
+            static bool accepts_encoding(const sstring &accept_encoding, std::string_view coding) {
+                std::string_view s(accept_encoding.data(), accept_encoding.size());
+                while (!s.empty()) {
+                    auto comma = s.find(',');
+                    auto item = s.substr(0, comma);
+                    s = comma == std::string_view::npos ? std::string_view() : s.substr(comma + 1);
+                    auto semicolon = item.find(';');
+                    auto name = item.substr(0, semicolon);
+                    while (!name.empty() && (name.front() == ' ' || name.front() == '\t')) {
+                        name.remove_prefix(1);
+                    }
+                    while (!name.empty() && (name.back() == ' ' || name.back() == '\t')) {
+                        name.remove_suffix(1);
+                    }
+                    if (!std::equal(name.begin(), name.end(), coding.begin(), coding.end(),
+                                    [](char a, char b) { return std::tolower(static_cast<unsigned char>(a)) == b; })) {
+                        continue;
+                    }
+                    if (semicolon == std::string_view::npos) {
+                        return true;
+                    }
+                    auto q = item.find("q=", semicolon);
+                    return q == std::string_view::npos || std::strtod(sstring(item.substr(q + 2)).c_str(), nullptr) > 0;
+                }
+                return false;
+            }
+
+            // Whether an If-None-Match list matches an entity tag, with the weak comparison.
+            static bool etag_matches(const sstring &if_none_match, const sstring &etag) {
+                std::string_view s(if_none_match.data(), if_none_match.size());
+                auto first = s.find_first_not_of(" \t");
+                if (first != std::string_view::npos && s[first] == '*') {
+                    return true;
+                }
+                // the tags are quoted, so one cannot match a part of another, and W/ is ignored
+                return s.find(std::string_view(etag.data(), etag.size())) != std::string_view::npos;
+            }
+
+            // Parses an IMF-fixdate, the format HTTP/1.1 senders must use.
+            static std::optional<std::time_t> parse_http_date(const sstring &date) {
+                static const char *months[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                               "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+                char month[4];
+                struct tm tm = {};
+                if (std::sscanf(date.c_str(), "%*3s, %2d %3s %4d %2d:%2d:%2d GMT", &tm.tm_mday, month, &tm.tm_year,
+                                &tm.tm_hour, &tm.tm_min, &tm.tm_sec) != 6) {
+                    return std::nullopt;
+                }
+                auto m = std::find_if(std::begin(months), std::end(months),
+                                      [&month](const char *name) { return std::strcmp(name, month) == 0; });
+                if (m == std::end(months)) {
+                    return std::nullopt;
+                }
+                tm.tm_mon = m - std::begin(months);
+                tm.tm_year -= 1900;
+                return timegm(&tm);
+            }
+
+            void file_interaction_handler::reply_from_cache(cached_file &file, const sstring &extension,
+                                                            const request &req, reply &rep) {
+                auto *variant = &file.identity;
+                auto accept_encoding = req.get_header("Accept-Encoding");
+                if (!file.brotli.content.empty() && accepts_encoding(accept_encoding, "br")) {
+                    variant = &file.brotli;
+                    rep._headers["Content-Encoding"] = "br";
+                } else if (!file.gzip.content.empty() && accepts_encoding(accept_encoding, "gzip")) {
+                    variant = &file.gzip;
+                    rep._headers["Content-Encoding"] = "gzip";
+                }
+                rep._headers["ETag"] = variant->etag;
+                rep._headers["Last-Modified"] = file.last_modified;
+                if (!file.gzip.content.empty() || !file.brotli.content.empty()) {
+                    rep._headers["Vary"] = "Accept-Encoding";
+                }
+
+                bool not_modified = false;
+                if (req._method == "GET" || req._method == "HEAD") {
+                    auto if_none_match = req.get_header("If-None-Match");
+                    if (!if_none_match.empty()) {
+                        not_modified = etag_matches(if_none_match, variant->etag);
+                    } else {
+                        // If-Modified-Since is ignored when If-None-Match is present
+                        auto since = parse_http_date(req.get_header("If-Modified-Since"));
+                        not_modified = since && std::chrono::system_clock::to_time_t(file.identity.mtime) <= *since;
+                    }
+                }
+                if (not_modified) {
+                    rep._headers.erase("Content-Encoding");
+                    rep.set_status(reply::status_type::not_modified).done();
+                    return;
+                }
+                rep.write_body(extension, variant->content.share());
+            }
+
             future<std::unique_ptr<reply>> file_interaction_handler::read(sstring file_name,
                                                                           std::unique_ptr<request> req,
                                                                           std::unique_ptr<reply> rep) {
+                if (!cache || transformer) {
+                    return read_from_disk(std::move(file_name), std::move(req), std::move(rep));
+                }
+                return cache->get(file_name).then([this, file_name, req = std::move(req), rep = std::move(rep)](
+                                                      lw_shared_ptr<cached_file> file) mutable {
+                    if (!file) {
+                        return read_from_disk(std::move(file_name), std::move(req), std::move(rep));
+                    }
+                    reply_from_cache(*file, get_extension(file_name), *req, *rep);
+                    return make_ready_future<std::unique_ptr<reply>>(std::move(rep));
+                });
+            }
+
+            future<std::unique_ptr<reply>> file_interaction_handler::read_from_disk(sstring file_name,
+                                                                                    std::unique_ptr<request> req,
+                                                                                    std::unique_ptr<reply> rep) {
                 sstring extension = get_extension(file_name);
+                if (!transformer) {
+                    // the connection may send the file with sendfile() in place of the body writer
+                    rep->set_body_file(file_name);
+                }
                 rep->write_body(extension, [req = std::move(req), extension, file_name,
                                             this](output_stream<char> &&s) mutable {
                     return do_with(output_stream<char>(get_stream(std::move(req), extension, std::move(s))),
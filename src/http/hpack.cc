@@ -0,0 +1,423 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+#include <nil/actor/http/hpack.hh>
+
+#include <algorithm>
+#include <array>
+
+namespace nil {
+    namespace actor {
+
+        namespace httpd {
+
+            // RFC 7541, appendix A
+            static const hpack_table::entry static_table[hpack_table::static_entries] = {
+                {":authority", ""}, {":method", "GET"}, {":method", "POST"}, {":path", "/"}, {":path", "/index.html"},
+                {":scheme", "http"}, {":scheme", "https"}, {":status", "200"}, {":status", "204"}, {":status", "206"},
+                {":status", "304"}, {":status", "400"}, {":status", "404"}, {":status", "500"}, {"accept-charset", ""},
+                {"accept-encoding", "gzip, deflate"}, {"accept-language", ""}, {"accept-ranges", ""}, {"accept", ""},
+                {"access-control-allow-origin", ""}, {"age", ""}, {"allow", ""}, {"authorization", ""},
+                {"cache-control", ""}, {"content-disposition", ""}, {"content-encoding", ""}, {"content-language", ""},
+                {"content-length", ""}, {"content-location", ""}, {"content-range", ""}, {"content-type", ""},
+                {"cookie", ""}, {"date", ""}, {"etag", ""}, {"expect", ""}, {"expires", ""}, {"from", ""}, {"host", ""},
+                {"if-match", ""}, {"if-modified-since", ""}, {"if-none-match", ""}, {"if-range", ""},
+                {"if-unmodified-since", ""}, {"last-modified", ""}, {"link", ""}, {"location", ""},
+                {"max-forwards", ""}, {"proxy-authenticate", ""}, {"proxy-authorization", ""}, {"range", ""},
+                {"referer", ""}, {"refresh", ""}, {"retry-after", ""}, {"server", ""}, {"set-cookie", ""},
+                {"strict-transport-security", ""}, {"transfer-encoding", ""}, {"user-agent", ""}, {"vary", ""},
+                {"via", ""}, {"www-authenticate", ""}
+            };
+
+            // RFC 7541, appendix B: the code and its length in bits of each symbol, 256 is EOS
+            static constexpr std::pair<uint32_t, uint8_t> huffman_codes[257] = {
+                {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28}, {0xfffffe4, 28}, {0xfffffe5, 28},
+                {0xfffffe6, 28}, {0xfffffe7, 28}, {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+                {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28}, {0xfffffed, 28}, {0xfffffee, 28},
+                {0xfffffef, 28}, {0xffffff0, 28}, {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+                {0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28}, {0xffffff8, 28}, {0xffffff9, 28},
+                {0xffffffa, 28}, {0xffffffb, 28}, {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12}, {0x1ff9, 13},
+                {0x15, 6}, {0xf8, 8}, {0x7fa, 11}, {0x3fa, 10}, {0x3fb, 10}, {0xf9, 8}, {0x7fb, 11}, {0xfa, 8},
+                {0x16, 6}, {0x17, 6}, {0x18, 6}, {0x0, 5}, {0x1, 5}, {0x2, 5}, {0x19, 6}, {0x1a, 6}, {0x1b, 6},
+                {0x1c, 6}, {0x1d, 6}, {0x1e, 6}, {0x1f, 6}, {0x5c, 7}, {0xfb, 8}, {0x7ffc, 15}, {0x20, 6}, {0xffb, 12},
+                {0x3fc, 10}, {0x1ffa, 13}, {0x21, 6}, {0x5d, 7}, {0x5e, 7}, {0x5f, 7}, {0x60, 7}, {0x61, 7}, {0x62, 7},
+                {0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7}, {0x67, 7}, {0x68, 7}, {0x69, 7}, {0x6a, 7}, {0x6b, 7},
+                {0x6c, 7}, {0x6d, 7}, {0x6e, 7}, {0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7}, {0xfc, 8}, {0x73, 7},
+                {0xfd, 8}, {0x1ffb, 13}, {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6}, {0x7ffd, 15}, {0x3, 5},
+                {0x23, 6}, {0x4, 5}, {0x24, 6}, {0x5, 5}, {0x25, 6}, {0x26, 6}, {0x27, 6}, {0x6, 5}, {0x74, 7},
+                {0x75, 7}, {0x28, 6}, {0x29, 6}, {0x2a, 6}, {0x7, 5}, {0x2b, 6}, {0x76, 7}, {0x2c, 6}, {0x8, 5},
+                {0x9, 5}, {0x2d, 6}, {0x77, 7}, {0x78, 7}, {0x79, 7}, {0x7a, 7}, {0x7b, 7}, {0x7ffe, 15}, {0x7fc, 11},
+                {0x3ffd, 14}, {0x1ffd, 13}, {0xffffffc, 28}, {0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20},
+                {0xfffe8, 20}, {0x3fffd3, 22}, {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23}, {0x3fffd6, 22},
+                {0x7fffda, 23}, {0x7fffdb, 23}, {0x7fffdc, 23}, {0x7fffdd, 23}, {0x7fffde, 23}, {0xffffeb, 24},
+                {0x7fffdf, 23}, {0xffffec, 24}, {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23}, {0xffffee, 24},
+                {0x7fffe1, 23}, {0x7fffe2, 23}, {0x7fffe3, 23}, {0x7fffe4, 23}, {0x1fffdc, 21}, {0x3fffd8, 22},
+                {0x7fffe5, 23}, {0x3fffd9, 22}, {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24}, {0x3fffda, 22},
+                {0x1fffdd, 21}, {0xfffe9, 20}, {0x3fffdb, 22}, {0x3fffdc, 22}, {0x7fffe8, 23}, {0x7fffe9, 23},
+                {0x1fffde, 21}, {0x7fffea, 23}, {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24}, {0x1fffdf, 21},
+                {0x3fffdf, 22}, {0x7fffeb, 23}, {0x7fffec, 23}, {0x1fffe0, 21}, {0x1fffe1, 21}, {0x3fffe0, 22},
+                {0x1fffe2, 21}, {0x7fffed, 23}, {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23}, {0xfffea, 20},
+                {0x3fffe2, 22}, {0x3fffe3, 22}, {0x3fffe4, 22}, {0x7ffff0, 23}, {0x3fffe5, 22}, {0x3fffe6, 22},
+                {0x7ffff1, 23}, {0x3ffffe0, 26}, {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19}, {0x3fffe7, 22},
+                {0x7ffff2, 23}, {0x3fffe8, 22}, {0x1ffffec, 25}, {0x3ffffe2, 26}, {0x3ffffe3, 26}, {0x3ffffe4, 26},
+                {0x7ffffde, 27}, {0x7ffffdf, 27}, {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25}, {0x7fff2, 19},
+                {0x1fffe3, 21}, {0x3ffffe6, 26}, {0x7ffffe0, 27}, {0x7ffffe1, 27}, {0x3ffffe7, 26}, {0x7ffffe2, 27},
+                {0xfffff2, 24}, {0x1fffe4, 21}, {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26}, {0xffffffd, 28},
+                {0x7ffffe3, 27}, {0x7ffffe4, 27}, {0x7ffffe5, 27}, {0xfffec, 20}, {0xfffff3, 24}, {0xfffed, 20},
+                {0x1fffe6, 21}, {0x3fffe9, 22}, {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23}, {0x3fffea, 22},
+                {0x3fffeb, 22}, {0x1ffffee, 25}, {0x1ffffef, 25}, {0xfffff4, 24}, {0xfffff5, 24}, {0x3ffffea, 26},
+                {0x7ffff4, 23}, {0x3ffffeb, 26}, {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26}, {0x7ffffe7, 27},
+                {0x7ffffe8, 27}, {0x7ffffe9, 27}, {0x7ffffea, 27}, {0x7ffffeb, 27}, {0xffffffe, 28}, {0x7ffffec, 27},
+                {0x7ffffed, 27}, {0x7ffffee, 27}, {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26}, {0x3fffffff, 30}
+            };
+
+            static constexpr unsigned huffman_eos = 256;
+
+            // The Huffman code as a binary tree, a child is the index of an inner node,
+            // or minus one minus the symbol of a leaf, 0 is no child (the root is no one's child).
+            using huffman_tree = std::vector<std::array<int16_t, 2>>;
+
+            static huffman_tree build_huffman_tree() {
+                huffman_tree tree(1, {0, 0});
+                for (unsigned sym = 0; sym <= huffman_eos; ++sym) {
+                    auto [code, length] = huffman_codes[sym];
+                    size_t node = 0;
+                    for (int bit = length - 1; bit > 0; --bit) {
+                        auto next = (code >> bit) & 1;
+                        if (tree[node][next] == 0) {
+                            tree[node][next] = tree.size();
+                            tree.push_back({0, 0});
+                        }
+                        node = tree[node][next];
+                    }
+                    tree[node][code & 1] = -1 - int16_t(sym);
+                }
+                return tree;
+            }
+
+            static const huffman_tree &get_huffman_tree() {
+                static const huffman_tree tree = build_huffman_tree();
+                return tree;
+            }
+
+            void hpack_huffman_encode(std::string_view in, std::string &out) {
+                uint64_t bits = 0;
+                unsigned pending = 0;
+                for (unsigned char c : in) {
+                    auto [code, length] = huffman_codes[c];
+                    bits = (bits << length) | code;
+                    pending += length;
+                    while (pending >= 8) {
+                        pending -= 8;
+                        out.push_back(char(bits >> pending));
+                    }
+                    bits &= (uint64_t(1) << pending) - 1;
+                }
+                if (pending) {
+                    // padded with the most significant bits of EOS
+                    out.push_back(char((bits << (8 - pending)) | (0xff >> pending)));
+                }
+            }
+
+            size_t hpack_huffman_encoded_size(std::string_view in) {
+                size_t bits = 0;
+                for (unsigned char c : in) {
+                    bits += huffman_codes[c].second;
+                }
+                return (bits + 7) / 8;
+            }
+
+            void hpack_huffman_decode(std::string_view in, std::string &out) {
+                auto &tree = get_huffman_tree();
+                int node = 0;
+                unsigned depth = 0;
+                bool all_ones = true;
+                for (unsigned char c : in) {
+                    for (int bit = 7; bit >= 0; --bit) {
+                        auto b = (c >> bit) & 1;
+                        auto next = tree[node][b];
+                        ++depth;
+                        all_ones &= b == 1;
+                        if (next < 0) {
+                            if (unsigned(-1 - next) == huffman_eos) {
+                                throw hpack_error("EOS in a Huffman coded string");
+                            }
+                            out.push_back(char(-1 - next));
+                            node = 0;
+                            depth = 0;
+                            all_ones = true;
+                        } else if (next == 0) {
+                            throw hpack_error("Invalid Huffman code");
+                        } else {
+                            node = next;
+                        }
+                    }
+                }
+                // the padding is the shortest prefix of EOS that completes the last byte
+                if (depth > 7 || !all_ones) {
+                    throw hpack_error("Invalid Huffman padding");
+                }
+            }
+
+            static size_t entry_size(std::string_view name, std::string_view value) {
+                return name.size() + value.size() + hpack_table::entry_overhead;
+            }
+
+            const hpack_table::entry *hpack_table::get(size_t index) const {
+                if (index == 0) {
+                    return nullptr;
+                }
+                if (index <= static_entries) {
+                    return &static_table[index - 1];
+                }
+                index -= static_entries + 1;
+                return index < _entries.size() ? &_entries[index] : nullptr;
+            }
+
+            std::pair<size_t, bool> hpack_table::find(std::string_view name, std::string_view value) const {
+                size_t name_index = 0;
+                for (size_t i = 0; i < static_entries; ++i) {
+                    auto &e = static_table[i];
+                    if (std::string_view(e.name) == name) {
+                        if (std::string_view(e.value) == value) {
+                            return {i + 1, true};
+                        }
+                        if (!name_index) {
+                            name_index = i + 1;
+                        }
+                    }
+                }
+                for (size_t i = 0; i < _entries.size(); ++i) {
+                    auto &e = _entries[i];
+                    if (std::string_view(e.name) == name) {
+                        if (std::string_view(e.value) == value) {
+                            return {static_entries + 1 + i, true};
+                        }
+                        if (!name_index) {
+                            name_index = static_entries + 1 + i;
+                        }
+                    }
+                }
+                return {name_index, false};
+            }
+
+            void hpack_table::add(sstring name, sstring value) {
+                auto size = entry_size(name, value);
+                if (size > _max_size) {
+                    evict(0);
+                    return;
+                }
+                evict(_max_size - size);
+                _entries.push_front(entry {std::move(name), std::move(value)});
+                _size += size;
+            }
+
+            void hpack_table::set_max_size(size_t max_size) {
+                _max_size = max_size;
+                evict(max_size);
+            }
+
+            void hpack_table::evict(size_t max_size) {
+                while (_size > max_size) {
+                    auto &e = _entries.back();
+                    _size -= entry_size(e.name, e.value);
+                    _entries.pop_back();
+                }
+            }
+
+            // An integer with an N-bit prefix, RFC 7541 section 5.1
+            static uint64_t decode_integer(const uint8_t *&p, const uint8_t *end, unsigned prefix_bits) {
+                uint64_t max_prefix = (1u << prefix_bits) - 1;
+                uint64_t value = *p++ & max_prefix;
+                if (value < max_prefix) {
+                    return value;
+                }
+                // anything above 2^35 is too large for any use
+                for (unsigned shift = 0; shift <= 28; shift += 7) {
+                    if (p == end) {
+                        throw hpack_error("Truncated integer");
+                    }
+                    uint8_t b = *p++;
+                    value += uint64_t(b & 0x7f) << shift;
+                    if (!(b & 0x80)) {
+                        return value;
+                    }
+                }
+                throw hpack_error("Integer overflow");
+            }
+
+            static void encode_integer(std::string &out, uint8_t flags, unsigned prefix_bits, uint64_t value) {
+                uint64_t max_prefix = (1u << prefix_bits) - 1;
+                if (value < max_prefix) {
+                    out.push_back(char(flags | value));
+                    return;
+                }
+                out.push_back(char(flags | max_prefix));
+                value -= max_prefix;
+                while (value >= 0x80) {
+                    out.push_back(char(0x80 | (value & 0x7f)));
+                    value >>= 7;
+                }
+                out.push_back(char(value));
+            }
+
+            // A string literal, RFC 7541 section 5.2
+            static sstring decode_string(const uint8_t *&p, const uint8_t *end) {
+                if (p == end) {
+                    throw hpack_error("Truncated string");
+                }
+                bool huffman = *p & 0x80;
+                auto length = decode_integer(p, end, 7);
+                if (length > size_t(end - p)) {
+                    throw hpack_error("Truncated string");
+                }
+                std::string_view s(reinterpret_cast<const char *>(p), length);
+                p += length;
+                if (!huffman) {
+                    return sstring(s.data(), s.size());
+                }
+                std::string decoded;
+                hpack_huffman_decode(s, decoded);
+                return sstring(decoded.data(), decoded.size());
+            }
+
+            static void encode_string(std::string &out, std::string_view s) {
+                auto huffman_size = hpack_huffman_encoded_size(s);
+                if (huffman_size < s.size()) {
+                    encode_integer(out, 0x80, 7, huffman_size);
+                    hpack_huffman_encode(s, out);
+                } else {
+                    encode_integer(out, 0, 7, s.size());
+                    out.append(s.data(), s.size());
+                }
+            }
+
+            hpack_decoder::hpack_decoder(size_t max_table_size, size_t max_header_list_size) :
+                _max_table_size(max_table_size), _max_header_list_size(max_header_list_size) {
+                _table.set_max_size(max_table_size);
+            }
+
+            void hpack_decoder::decode(std::string_view block, hpack_header_list &headers) {
+                auto p = reinterpret_cast<const uint8_t *>(block.data());
+                auto end = p + block.size();
+                size_t list_size = 0;
+                bool header_seen = false;
+                auto append = [&](sstring name, sstring value) {
+                    list_size += entry_size(name, value);
+                    if (list_size > _max_header_list_size) {
+                        throw hpack_error("Header list too large");
+                    }
+                    header_seen = true;
+                    headers.emplace_back(std::move(name), std::move(value));
+                };
+                auto literal = [&](unsigned prefix_bits) {
+                    auto index = decode_integer(p, end, prefix_bits);
+                    sstring name;
+                    if (index) {
+                        auto e = _table.get(index);
+                        if (!e) {
+                            throw hpack_error("Invalid header index");
+                        }
+                        name = e->name;
+                    } else {
+                        name = decode_string(p, end);
+                    }
+                    return std::make_pair(std::move(name), decode_string(p, end));
+                };
+
+                while (p != end) {
+                    uint8_t b = *p;
+                    if (b & 0x80) {
+                        // indexed header field
+                        auto e = _table.get(decode_integer(p, end, 7));
+                        if (!e) {
+                            throw hpack_error("Invalid header index");
+                        }
+                        append(e->name, e->value);
+                    } else if (b & 0x40) {
+                        // literal header field with incremental indexing
+                        auto h = literal(6);
+                        _table.add(h.first, h.second);
+                        append(std::move(h.first), std::move(h.second));
+                    } else if (b & 0x20) {
+                        // dynamic table size update
+                        if (header_seen) {
+                            throw hpack_error("Dynamic table size update after a header");
+                        }
+                        auto size = decode_integer(p, end, 5);
+                        if (size > _max_table_size) {
+                            throw hpack_error("Dynamic table size update above the limit");
+                        }
+                        _table.set_max_size(size);
+                    } else {
+                        // literal header field without indexing, or never indexed
+                        auto h = literal(4);
+                        append(std::move(h.first), std::move(h.second));
+                    }
+                }
+            }
+
+            void hpack_encoder::set_max_table_size(size_t max_size) {
+                max_size = std::min(max_size, hpack_table::default_max_size);
+                if (max_size == _table.max_size() && !_size_update_pending) {
+                    return;
+                }
+                _min_pending_size = _size_update_pending ? std::min(_min_pending_size, max_size) : max_size;
+                _size_update_pending = true;
+                _table.set_max_size(max_size);
+            }
+
+            void hpack_encoder::encode(const hpack_header_list &headers, std::string &out) {
+                if (_size_update_pending) {
+                    if (_min_pending_size < _table.max_size()) {
+                        encode_integer(out, 0x20, 5, _min_pending_size);
+                    }
+                    encode_integer(out, 0x20, 5, _table.max_size());
+                    _size_update_pending = false;
+                }
+                for (auto &&h : headers) {
+                    std::string_view name = h.first;
+                    auto [index, exact] = _table.find(name, h.second);
+                    if (exact) {
+                        encode_integer(out, 0x80, 7, index);
+                        continue;
+                    }
+                    if (name == "set-cookie" || name == "authorization") {
+                        encode_integer(out, 0x10, 4, index);
+                    } else if (name == "content-length" || name == "date") {
+                        encode_integer(out, 0, 4, index);
+                    } else {
+                        encode_integer(out, 0x40, 6, index);
+                        _table.add(h.first, h.second);
+                    }
+                    if (!index) {
+                        encode_string(out, name);
+                    }
+                    encode_string(out, h.second);
+                }
+            }
+
+        }    // namespace httpd
+
+    }    // namespace actor
+}    // namespace nil
@@ -0,0 +1,771 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+#include <nil/actor/http/http2.hh>
+#include <nil/actor/http/httpd.hh>
+
+#include <nil/actor/core/byteorder.hh>
+#include <nil/actor/core/loop.hh>
+#include <nil/actor/core/print.hh>
+
+#include <algorithm>
+#include <cctype>
+
+namespace nil {
+    namespace actor {
+
+        namespace httpd {
+
+            enum http2_frame_type : uint8_t {
+                frame_data = 0x0,
+                frame_headers = 0x1,
+                frame_priority = 0x2,
+                frame_rst_stream = 0x3,
+                frame_settings = 0x4,
+                frame_push_promise = 0x5,
+                frame_ping = 0x6,
+                frame_goaway = 0x7,
+                frame_window_update = 0x8,
+                frame_continuation = 0x9,
+            };
+
+            enum http2_flag : uint8_t {
+                flag_end_stream = 0x1,
+                flag_ack = 0x1,
+                flag_end_headers = 0x4,
+                flag_padded = 0x8,
+                flag_priority = 0x20,
+            };
+
+            enum http2_error_code : uint32_t {
+                no_error = 0x0,
+                protocol_error = 0x1,
+                internal_error = 0x2,
+                flow_control_error = 0x3,
+                stream_closed = 0x5,
+                frame_size_error = 0x6,
+                refused_stream = 0x7,
+                compression_error = 0x9,
+                enhance_your_calm = 0xb,
+            };
+
+            enum http2_setting : uint16_t {
+                setting_header_table_size = 0x1,
+                setting_enable_push = 0x2,
+                setting_max_concurrent_streams = 0x3,
+                setting_initial_window_size = 0x4,
+                setting_max_frame_size = 0x5,
+                setting_max_header_list_size = 0x6,
+            };
+
+            static constexpr size_t frame_header_size = 9;
+            static constexpr int64_t max_window_size = 0x7fffffff;
+            static constexpr uint32_t max_frame_size_limit = 0xffffff;
+
+            // An error that closes the connection with a GOAWAY frame
+            class http2_connection_error : public std::runtime_error {
+            public:
+                uint32_t code;
+                http2_connection_error(uint32_t code, const std::string &msg) : std::runtime_error(msg), code(code) {
+                }
+            };
+
+            static void put_frame_header(char *p, size_t length, uint8_t type, uint8_t flags, uint32_t stream_id) {
+                p[0] = char(length >> 16);
+                p[1] = char(length >> 8);
+                p[2] = char(length);
+                p[3] = char(type);
+                p[4] = char(flags);
+                write_be<uint32_t>(p + 5, stream_id);
+            }
+
+            // Strip the padding of a DATA or HEADERS frame
+            static void remove_padding(uint8_t flags, temporary_buffer<char> &payload) {
+                if (!(flags & flag_padded)) {
+                    return;
+                }
+                if (payload.empty() || uint8_t(payload[0]) >= payload.size()) {
+                    throw http2_connection_error(protocol_error, "Invalid padding");
+                }
+                size_t padding = uint8_t(payload[0]);
+                payload.trim_front(1);
+                payload.trim(payload.size() - padding);
+            }
+
+            // Headers the connection sets itself, or that have no meaning in HTTP/2
+            static bool is_connection_header(std::string_view name) {
+                return name == "server" || name == "date" || name == "content-length" ||
+                       name == "transfer-encoding" || name == "connection" || name == "keep-alive" ||
+                       name == "proxy-connection" || name == "upgrade";
+            }
+
+            // The buffered request body, as the content stream of the request
+            class http2_body_source_impl : public data_source_impl {
+                std::vector<temporary_buffer<char>> _buffers;
+                size_t _next = 0;
+
+            public:
+                explicit http2_body_source_impl(std::vector<temporary_buffer<char>> buffers) :
+                    _buffers(std::move(buffers)) {
+                }
+                virtual future<temporary_buffer<char>> get() override {
+                    if (_next == _buffers.size()) {
+                        return make_ready_future<temporary_buffer<char>>();
+                    }
+                    return make_ready_future<temporary_buffer<char>>(std::move(_buffers[_next++]));
+                }
+            };
+
+            // Sends what a body writer writes as DATA frames of a stream
+            class http2_connection::body_sink_impl : public data_sink_impl {
+                http2_connection &_conn;
+                lw_shared_ptr<http2_stream> _stream;
+
+            public:
+                body_sink_impl(http2_connection &conn, lw_shared_ptr<http2_stream> stream) :
+                    _conn(conn), _stream(std::move(stream)) {
+                }
+                virtual future<> put(net::packet data) override {
+                    abort();
+                }
+                using data_sink_impl::put;
+                virtual future<> put(temporary_buffer<char> buf) override {
+                    if (buf.empty()) {
+                        return make_ready_future<>();
+                    }
+                    return _conn.send_data(_stream, std::move(buf), false);
+                }
+                virtual future<> close() override {
+                    return _conn.send_data(_stream, temporary_buffer<char>(), true);
+                }
+            };
+
+            http2_connection::http2_connection(http_server &server, input_stream<char> &in, output_stream<char> &out,
+                                               sstring protocol_name) :
+                _server(server),
+                _in(in), _out(out), _protocol_name(std::move(protocol_name)) {
+            }
+
+            future<> http2_connection::process() {
+                // the server connection preface is a SETTINGS frame
+                temporary_buffer<char> settings(3 * 6);
+                auto p = settings.get_write();
+                write_be<uint16_t>(p, setting_max_concurrent_streams);
+                write_be<uint32_t>(p + 2, max_concurrent_streams);
+                write_be<uint16_t>(p + 6, setting_max_header_list_size);
+                write_be<uint32_t>(p + 8, max_header_list_size);
+                write_be<uint16_t>(p + 12, setting_initial_window_size);
+                write_be<uint32_t>(p + 14, stream_window_size);
+                return write_frame(frame_settings, 0, 0, std::move(settings))
+                    .then([this] { return send_window_update(0, connection_window_size - default_window_size); })
+                    .then([this] { return repeat([this] { return read_frame(); }); })
+                    .handle_exception([this](std::exception_ptr ep) {
+                        uint32_t code;
+                        try {
+                            std::rethrow_exception(ep);
+                        } catch (const http2_connection_error &e) {
+                            code = e.code;
+                        } catch (const hpack_error &e) {
+                            code = compression_error;
+                        } catch (...) {
+                            // the connection is broken, there is no one to tell
+                            return make_ready_future<>();
+                        }
+                        temporary_buffer<char> goaway(8);
+                        write_be<uint32_t>(goaway.get_write(), _last_stream_id);
+                        write_be<uint32_t>(goaway.get_write() + 4, code);
+                        return write_frame(frame_goaway, 0, 0, std::move(goaway)).handle_exception([](auto ep) {});
+                    })
+                    .finally([this] {
+                        // the streams that can still send their replies do, the others are cut short
+                        _closing = true;
+                        _window_available.broken();
+                        return _streams_gate.close();
+                    });
+            }
+
+            future<stop_iteration> http2_connection::read_frame() {
+                return _in.read_exactly(frame_header_size).then([this](temporary_buffer<char> head) {
+                    if (head.size() < frame_header_size) {
+                        return make_ready_future<stop_iteration>(stop_iteration::yes);
+                    }
+                    auto p = head.get();
+                    size_t length = (size_t(uint8_t(p[0])) << 16) | (size_t(uint8_t(p[1])) << 8) | uint8_t(p[2]);
+                    uint8_t type = p[3];
+                    uint8_t flags = p[4];
+                    uint32_t stream_id = read_be<uint32_t>(p + 5) & 0x7fffffff;
+                    if (length > default_max_frame_size) {
+                        throw http2_connection_error(frame_size_error, "Frame too large");
+                    }
+                    return _in.read_exactly(length).then(
+                        [this, length, type, flags, stream_id](temporary_buffer<char> payload) {
+                            if (payload.size() < length) {
+                                return make_ready_future<stop_iteration>(stop_iteration::yes);
+                            }
+                            return handle_frame(type, flags, stream_id, std::move(payload)).then([] {
+                                return stop_iteration::no;
+                            });
+                        });
+                });
+            }
+
+            future<> http2_connection::handle_frame(uint8_t type, uint8_t flags, uint32_t stream_id,
+                                                    temporary_buffer<char> payload) {
+                if (!_settings_received && type != frame_settings) {
+                    throw http2_connection_error(protocol_error, "Expected SETTINGS");
+                }
+                if (_header_stream_id && type != frame_continuation) {
+                    throw http2_connection_error(protocol_error, "Expected CONTINUATION");
+                }
+                switch (type) {
+                    case frame_data:
+                        return handle_data(flags, stream_id, std::move(payload));
+                    case frame_headers:
+                        return handle_headers(flags, stream_id, std::move(payload));
+                    case frame_continuation:
+                        return handle_continuation(flags, stream_id, std::move(payload));
+                    case frame_priority:
+                        if (!stream_id) {
+                            throw http2_connection_error(protocol_error, "PRIORITY on stream 0");
+                        }
+                        if (payload.size() != 5) {
+                            return reset_stream(stream_id, frame_size_error);
+                        }
+                        return make_ready_future<>();
+                    case frame_rst_stream: {
+                        if (!stream_id || stream_id > _last_stream_id) {
+                            throw http2_connection_error(protocol_error, "RST_STREAM on an idle stream");
+                        }
+                        if (payload.size() != 4) {
+                            throw http2_connection_error(frame_size_error, "Invalid RST_STREAM");
+                        }
+                        auto it = _streams.find(stream_id);
+                        if (it != _streams.end()) {
+                            auto s = it->second;
+                            s->reset = true;
+                            _streams.erase(it);
+                            _window_available.broadcast();
+                            // a body not handed to a handler is dropped
+                            if (!s->end_stream) {
+                                s->body.clear();
+                                return release_body(*s);
+                            }
+                        }
+                        return make_ready_future<>();
+                    }
+                    case frame_settings:
+                        return handle_settings(flags, stream_id, std::move(payload));
+                    case frame_push_promise:
+                        throw http2_connection_error(protocol_error, "PUSH_PROMISE from a client");
+                    case frame_ping:
+                        if (stream_id) {
+                            throw http2_connection_error(protocol_error, "PING on a stream");
+                        }
+                        if (payload.size() != 8) {
+                            throw http2_connection_error(frame_size_error, "Invalid PING");
+                        }
+                        if (flags & flag_ack) {
+                            return make_ready_future<>();
+                        }
+                        return write_frame(frame_ping, flag_ack, 0, std::move(payload));
+                    case frame_goaway:
+                        if (stream_id) {
+                            throw http2_connection_error(protocol_error, "GOAWAY on a stream");
+                        }
+                        // the client opens no more streams, the open ones are served
+                        return make_ready_future<>();
+                    case frame_window_update:
+                        return handle_window_update(stream_id, std::move(payload));
+                    default:
+                        // unknown frame types are ignored
+                        return make_ready_future<>();
+                }
+            }
+
+            future<> http2_connection::handle_data(uint8_t flags, uint32_t stream_id, temporary_buffer<char> payload) {
+                if (!stream_id) {
+                    throw http2_connection_error(protocol_error, "DATA on stream 0");
+                }
+                // the padding counts in flow control
+                int64_t length = payload.size();
+                remove_padding(flags, payload);
+                _recv_window -= length;
+                if (_recv_window < 0) {
+                    throw http2_connection_error(flow_control_error, "Connection window exceeded");
+                }
+                auto it = _streams.find(stream_id);
+                if (it == _streams.end() || it->second->end_stream) {
+                    if (stream_id > _last_stream_id) {
+                        throw http2_connection_error(protocol_error, "DATA on an idle stream");
+                    }
+                    _recv_window += length;
+                    return send_window_update(0, length).then([this, stream_id] {
+                        return reset_stream(stream_id, stream_closed);
+                    });
+                }
+                auto s = it->second;
+                s->recv_window -= length;
+                s->uncredited += length;
+                if (s->recv_window < 0) {
+                    s->body.clear();
+                    return reset_stream(stream_id, flow_control_error).then([this, s] { return release_body(*s); });
+                }
+                if (flags & flag_end_stream) {
+                    s->end_stream = true;
+                }
+                if (s->too_large) {
+                    // the rest of the body is dropped
+                    return release_body(*s);
+                }
+                if (s->body_size + payload.size() > _server.get_content_length_limit() ||
+                    (!s->recv_window && !s->end_stream)) {
+                    // answered right away, a body that does not fit in the window of the stream is too large too
+                    s->too_large = true;
+                    s->body.clear();
+                    dispatch(s);
+                    return release_body(*s);
+                }
+                if (!payload.empty()) {
+                    s->body_size += payload.size();
+                    s->body.push_back(std::move(payload));
+                }
+                if (s->end_stream) {
+                    dispatch(s);
+                }
+                // the window of the stream is not credited back, it bounds what the stream buffers
+                return make_ready_future<>();
+            }
+
+            future<> http2_connection::handle_headers(uint8_t flags, uint32_t stream_id,
+                                                      temporary_buffer<char> payload) {
+                if (!stream_id || !(stream_id & 1)) {
+                    throw http2_connection_error(protocol_error, "HEADERS on an invalid stream");
+                }
+                remove_padding(flags, payload);
+                if (flags & flag_priority) {
+                    if (payload.size() < 5) {
+                        throw http2_connection_error(frame_size_error, "Invalid HEADERS");
+                    }
+                    payload.trim_front(5);
+                }
+                _header_block.assign(payload.get(), payload.size());
+                _header_stream_id = stream_id;
+                _header_end_stream = flags & flag_end_stream;
+                if (flags & flag_end_headers) {
+                    return end_headers();
+                }
+                return make_ready_future<>();
+            }
+
+            future<> http2_connection::handle_continuation(uint8_t flags, uint32_t stream_id,
+                                                           temporary_buffer<char> payload) {
+                if (!stream_id || stream_id != _header_stream_id) {
+                    throw http2_connection_error(protocol_error, "Unexpected CONTINUATION");
+                }
+                if (_header_block.size() + payload.size() > max_header_list_size) {
+                    throw http2_connection_error(enhance_your_calm, "Header block too large");
+                }
+                _header_block.append(payload.get(), payload.size());
+                if (flags & flag_end_headers) {
+                    return end_headers();
+                }
+                return make_ready_future<>();
+            }
+
+            future<> http2_connection::end_headers() {
+                auto stream_id = std::exchange(_header_stream_id, 0);
+                hpack_header_list headers;
+                // decoded even when the stream is refused, to keep the table of the decoder in sync
+                _decoder.decode(_header_block, headers);
+                _header_block.clear();
+
+                if (stream_id <= _last_stream_id) {
+                    // the trailers of a request, they are not passed on
+                    auto it = _streams.find(stream_id);
+                    if (it == _streams.end() || it->second->end_stream) {
+                        return reset_stream(stream_id, stream_closed);
+                    }
+                    if (!_header_end_stream) {
+                        return reset_stream(stream_id, protocol_error);
+                    }
+                    auto s = it->second;
+                    s->end_stream = true;
+                    if (!s->too_large) {
+                        dispatch(s);
+                    }
+                    return make_ready_future<>();
+                }
+
+                _last_stream_id = stream_id;
+                if (_streams.size() >= max_concurrent_streams) {
+                    return reset_stream(stream_id, refused_stream);
+                }
+                auto req = make_request(headers);
+                if (!req) {
+                    return reset_stream(stream_id, protocol_error);
+                }
+                auto s = make_lw_shared<http2_stream>(stream_id, std::move(req), _initial_window_size,
+                                                      stream_window_size);
+                _streams.emplace(stream_id, s);
+                if (_header_end_stream) {
+                    s->end_stream = true;
+                    dispatch(s);
+                }
+                return make_ready_future<>();
+            }
+
+            std::unique_ptr<request> http2_connection::make_request(const hpack_header_list &headers) {
+                auto req = std::make_unique<request>();
+                bool regular_header_seen = false;
+                for (auto &&h : headers) {
+                    std::string_view name = h.first;
+                    if (!name.empty() && name[0] == ':') {
+                        if (regular_header_seen) {
+                            return nullptr;
+                        }
+                        if (name == ":method") {
+                            req->_method = h.second;
+                        } else if (name == ":path") {
+                            req->_url = h.second;
+                        } else if (name == ":authority") {
+                            req->_headers.add("Host", h.second);
+                        } else if (name != ":scheme") {
+                            return nullptr;
+                        }
+                        continue;
+                    }
+                    regular_header_seen = true;
+                    if (std::any_of(name.begin(), name.end(), [](char c) { return ::isupper(c); }) ||
+                        name == "connection") {
+                        return nullptr;
+                    }
+                    // a cookie may be split into several fields
+                    req->_headers.add(name, h.second, name == "cookie" ? "; " : ",");
+                }
+                if (req->_method.empty() || req->_url.empty()) {
+                    return nullptr;
+                }
+                req->_version = "2.0";
+                req->http_version_major = 2;
+                req->http_version_minor = 0;
+                req->protocol_name = _protocol_name;
+                return req;
+            }
+
+            void http2_connection::dispatch(lw_shared_ptr<http2_stream> stream) {
+                (void)with_gate(_streams_gate, [this, stream] {
+                    auto req = std::move(stream->req);
+                    future<std::unique_ptr<reply>> f = make_ready_future<std::unique_ptr<reply>>();
+                    if (stream->too_large) {
+                        auto rep = std::make_unique<reply>();
+                        rep->set_status(reply::status_type::payload_too_large,
+                                        format("Content length limit ({}) exceeded",
+                                               _server.get_content_length_limit()))
+                            .done();
+                        f = make_ready_future<std::unique_ptr<reply>>(std::move(rep));
+                    } else {
+                        req->content_length = stream->body_size;
+                        if (stream->body_size) {
+                            req->content_stream = input_stream<char>(
+                                data_source(std::make_unique<http2_body_source_impl>(std::move(stream->body))));
+                        }
+                        ++_server._requests_served;
+                        sstring url = connection::set_query_param(*req);
+                        f = _server._routes.handle(url, std::move(req), std::make_unique<reply>());
+                    }
+                    // the handler is done with the body, the connection window gets its bytes back
+                    return f.finally([this, stream] { return release_body(*stream); })
+                        .then([this, stream](std::unique_ptr<reply> rep) {
+                            return send_reply(stream, std::move(rep)).then([this, stream] {
+                                // the reply went out before the request was whole
+                                if (!stream->end_stream && !stream->reset) {
+                                    return reset_stream(stream->id, no_error);
+                                }
+                                return make_ready_future<>();
+                            });
+                        })
+                        .handle_exception([this, stream](std::exception_ptr ep) {
+                            if (stream->reset || _closing) {
+                                return make_ready_future<>();
+                            }
+                            return reset_stream(stream->id, internal_error).handle_exception([](auto ep) {});
+                        })
+                        .finally([this, stream] { _streams.erase(stream->id); });
+                });
+            }
+
+            future<> http2_connection::send_reply(lw_shared_ptr<http2_stream> stream, std::unique_ptr<reply> rep) {
+                if (stream->reset) {
+                    return make_ready_future<>();
+                }
+                hpack_header_list headers;
+                headers.emplace_back(":status", to_sstring(int(rep->_status)));
+                headers.emplace_back("server", "Actor httpd");
+                headers.emplace_back("date", _server._date);
+                for (auto &&h : rep->_headers) {
+                    sstring name = h.first;
+                    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+                    if (!is_connection_header(name)) {
+                        headers.emplace_back(std::move(name), h.second);
+                    }
+                }
+                bool has_body = rep->_body_writer || !rep->body().empty();
+                if (!rep->_body_writer) {
+                    headers.emplace_back("content-length", to_sstring(rep->body().size()));
+                }
+
+                // encoded and queued at once, the header blocks must reach the client in the order of encoding
+                std::string block;
+                _encoder.encode(headers, block);
+                size_t count = std::max<size_t>(1, (block.size() + _max_frame_size - 1) / _max_frame_size);
+                temporary_buffer<char> frames(block.size() + count * frame_header_size);
+                auto p = frames.get_write();
+                for (size_t i = 0, pos = 0; i < count; ++i) {
+                    size_t length = std::min<size_t>(block.size() - pos, _max_frame_size);
+                    uint8_t flags = (i + 1 == count) ? flag_end_headers : 0;
+                    if (i == 0 && !has_body) {
+                        flags |= flag_end_stream;
+                    }
+                    put_frame_header(p, length, i ? frame_continuation : frame_headers, flags, stream->id);
+                    p = std::copy_n(block.data() + pos, length, p + frame_header_size);
+                    pos += length;
+                }
+                auto f = write_frames(std::move(frames));
+                if (!has_body) {
+                    return f;
+                }
+                if (rep->_body_writer) {
+                    return f.then([this, stream, rep = std::move(rep)]() mutable {
+                        output_stream<char> out(data_sink(std::make_unique<body_sink_impl>(*this, stream)),
+                                                _max_frame_size, true);
+                        auto &body_writer = rep->_body_writer;
+                        return body_writer(std::move(out)).finally([rep = std::move(rep)] {});
+                    });
+                }
+                auto body = rep->_body_buffer.empty()
+                                ? temporary_buffer<char>(rep->_content.data(), rep->_content.size())
+                                : rep->_body_buffer.share();
+                return f.then([this, stream, body = std::move(body)]() mutable {
+                    return send_data(stream, std::move(body), true);
+                });
+            }
+
+            future<> http2_connection::send_data(lw_shared_ptr<http2_stream> stream, temporary_buffer<char> data,
+                                                 bool end_stream) {
+                return do_with(std::move(data), [this, stream, end_stream](temporary_buffer<char> &data) {
+                    return repeat([this, stream, end_stream, &data] {
+                        if (stream->reset) {
+                            return make_exception_future<stop_iteration>(std::runtime_error("Stream reset"));
+                        }
+                        if (data.empty()) {
+                            if (!end_stream) {
+                                return make_ready_future<stop_iteration>(stop_iteration::yes);
+                            }
+                            return write_frame(frame_data, flag_end_stream, stream->id, temporary_buffer<char>())
+                                .then([] { return stop_iteration::yes; });
+                        }
+                        return _window_available
+                            .wait([this, stream] {
+                                return stream->reset || std::min(_send_window, stream->send_window) > 0;
+                            })
+                            .then([this, stream, end_stream, &data] {
+                                if (stream->reset) {
+                                    return make_exception_future<stop_iteration>(std::runtime_error("Stream reset"));
+                                }
+                                int64_t length = std::min({int64_t(data.size()), _send_window, stream->send_window,
+                                                           int64_t(_max_frame_size)});
+                                _send_window -= length;
+                                stream->send_window -= length;
+                                auto chunk = data.share(0, length);
+                                data.trim_front(length);
+                                uint8_t flags = (data.empty() && end_stream) ? flag_end_stream : 0;
+                                return write_frame(frame_data, flags, stream->id, std::move(chunk)).then([flags] {
+                                    return flags ? stop_iteration::yes : stop_iteration::no;
+                                });
+                            });
+                    });
+                });
+            }
+
+            future<> http2_connection::handle_settings(uint8_t flags, uint32_t stream_id,
+                                                       temporary_buffer<char> payload) {
+                if (stream_id) {
+                    throw http2_connection_error(protocol_error, "SETTINGS on a stream");
+                }
+                if (flags & flag_ack) {
+                    if (!payload.empty()) {
+                        throw http2_connection_error(frame_size_error, "Invalid SETTINGS acknowledgement");
+                    }
+                    return make_ready_future<>();
+                }
+                if (payload.size() % 6) {
+                    throw http2_connection_error(frame_size_error, "Invalid SETTINGS");
+                }
+                _settings_received = true;
+                for (auto p = payload.get(); p != payload.end(); p += 6) {
+                    auto value = read_be<uint32_t>(p + 2);
+                    switch (read_be<uint16_t>(p)) {
+                        case setting_header_table_size:
+                            _encoder.set_max_table_size(value);
+                            break;
+                        case setting_enable_push:
+                            if (value > 1) {
+                                throw http2_connection_error(protocol_error, "Invalid SETTINGS_ENABLE_PUSH");
+                            }
+                            break;
+                        case setting_initial_window_size: {
+                            if (value > max_window_size) {
+                                throw http2_connection_error(flow_control_error,
+                                                             "Invalid SETTINGS_INITIAL_WINDOW_SIZE");
+                            }
+                            // applies to the windows of the open streams too
+                            int64_t delta = int64_t(value) - _initial_window_size;
+                            _initial_window_size = value;
+                            for (auto &&s : _streams) {
+                                s.second->send_window += delta;
+                                if (s.second->send_window > max_window_size) {
+                                    throw http2_connection_error(flow_control_error, "Stream window overflow");
+                                }
+                            }
+                            break;
+                        }
+                        case setting_max_frame_size:
+                            if (value < default_max_frame_size || value > max_frame_size_limit) {
+                                throw http2_connection_error(protocol_error, "Invalid SETTINGS_MAX_FRAME_SIZE");
+                            }
+                            _max_frame_size = value;
+                            break;
+                        default:
+                            // nothing to do for the other settings, or unknown ones
+                            break;
+                    }
+                }
+                _window_available.broadcast();
+                return write_frame(frame_settings, flag_ack, 0, temporary_buffer<char>());
+            }
+
+            future<> http2_connection::handle_window_update(uint32_t stream_id, temporary_buffer<char> payload) {
+                if (payload.size() != 4) {
+                    throw http2_connection_error(frame_size_error, "Invalid WINDOW_UPDATE");
+                }
+                uint32_t increment = read_be<uint32_t>(payload.get()) & 0x7fffffff;
+                if (!stream_id) {
+                    if (!increment) {
+                        throw http2_connection_error(protocol_error, "Invalid WINDOW_UPDATE");
+                    }
+                    _send_window += increment;
+                    if (_send_window > max_window_size) {
+                        throw http2_connection_error(flow_control_error, "Connection window overflow");
+                    }
+                    _window_available.broadcast();
+                    return make_ready_future<>();
+                }
+                if (stream_id > _last_stream_id) {
+                    throw http2_connection_error(protocol_error, "WINDOW_UPDATE on an idle stream");
+                }
+                auto it = _streams.find(stream_id);
+                if (it == _streams.end()) {
+                    // the stream is closed already
+                    return make_ready_future<>();
+                }
+                auto &s = *it->second;
+                s.send_window += increment;
+                if (!increment || s.send_window > max_window_size) {
+                    return reset_stream(stream_id, increment ? flow_control_error : protocol_error);
+                }
+                _window_available.broadcast();
+                return make_ready_future<>();
+            }
+
+            future<> http2_connection::release_body(http2_stream &stream) {
+                auto increment = std::exchange(stream.uncredited, 0);
+                _recv_window += increment;
+                return send_window_update(0, increment);
+            }
+
+            future<> http2_connection::send_window_update(uint32_t stream_id, uint32_t increment) {
+                if (!increment) {
+                    return make_ready_future<>();
+                }
+                // the connection window, and the one of the stream if any, in one write
+                size_t count = stream_id ? 2 : 1;
+                temporary_buffer<char> frames(count * (frame_header_size + 4));
+                auto p = frames.get_write();
+                for (uint32_t id : {uint32_t(0), stream_id}) {
+                    put_frame_header(p, 4, frame_window_update, 0, id);
+                    write_be<uint32_t>(p + frame_header_size, increment);
+                    p += frame_header_size + 4;
+                    if (!stream_id) {
+                        break;
+                    }
+                }
+                return write_frames(std::move(frames));
+            }
+
+            future<> http2_connection::reset_stream(uint32_t stream_id, uint32_t error) {
+                auto it = _streams.find(stream_id);
+                if (it != _streams.end()) {
+                    it->second->reset = true;
+                    _streams.erase(it);
+                    _window_available.broadcast();
+                }
+                temporary_buffer<char> payload(4);
+                write_be<uint32_t>(payload.get_write(), error);
+                return write_frame(frame_rst_stream, 0, stream_id, std::move(payload));
+            }
+
+            future<> http2_connection::write_frame(uint8_t type, uint8_t flags, uint32_t stream_id,
+                                                   temporary_buffer<char> payload) {
+                temporary_buffer<char> head(frame_header_size);
+                put_frame_header(head.get_write(), payload.size(), type, flags, stream_id);
+                return with_semaphore(_write_sem, 1,
+                                      [this, head = std::move(head), payload = std::move(payload)]() mutable {
+                                          return _out.write(std::move(head))
+                                              .then([this, payload = std::move(payload)]() mutable {
+                                                  if (payload.empty()) {
+                                                      return make_ready_future<>();
+                                                  }
+                                                  return _out.write(std::move(payload));
+                                              })
+                                              .then([this] { return flush(); });
+                                      });
+            }
+
+            future<> http2_connection::write_frames(temporary_buffer<char> frames) {
+                return with_semaphore(_write_sem, 1, [this, frames = std::move(frames)]() mutable {
+                    return _out.write(std::move(frames)).then([this] { return flush(); });
+                });
+            }
+
+            future<> http2_connection::flush() {
+                // the frames queued behind are written first, the last writer flushes them all
+                if (_write_sem.waiters()) {
+                    return make_ready_future<>();
+                }
+                return _out.flush();
+            }
+
+        }    // namespace httpd
+
+    }    // namespace actor
+}    // namespace nil
@@ -30,6 +30,17 @@
 #include <nil/actor/core/when_all.hh>
 #include <nil/actor/core/metrics.hh>
 #include <nil/actor/core/print.hh>
+#include <nil/actor/core/posix.hh>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#if defined(__linux__) && __has_include(<linux/openat2.h>)
+#include <linux/openat2.h>
+#endif
 
 #include <iostream>
 #include <algorithm>
@@ -38,10 +49,13 @@
 #include <bitset>
 #include <limits>
 #include <cctype>
+#include <optional>
 #include <vector>
 
 #include <nil/actor/http/httpd.hh>
+#include <nil/actor/http/http2.hh>
 #include <nil/actor/http/reply.hh>
+#include <nil/actor/http/exception.hh>
 #include <nil/actor/detail/log.hh>
 
 using namespace std::chrono_literals;
@@ -80,20 +94,75 @@ namespace nil {
                 return nil::actor::format("http-{}", idgen++);
             }
 
+            /**
+             * Open a file for sendfile() only when neither the open nor the sendfile() waits for the disk:
+             * the path has to resolve from the dentry cache (RESOLVE_CACHED) and every page of the file has
+             * to be in the page cache. A page evicted after the check is read by sendfile() again.
+             * @param name the path of the file
+             * @param size set to the size of the file
+             * @return the file, or nothing when it is cold, missing or not a regular file
+             */
+            static std::optional<file_desc> open_cached_file(const sstring &name, size_t &size) {
+#if defined(RESOLVE_CACHED) && defined(SYS_openat2)
+                open_how how {};
+                how.flags = O_RDONLY | O_CLOEXEC;
+                how.resolve = RESOLVE_CACHED;
+                int r = ::syscall(SYS_openat2, AT_FDCWD, name.c_str(), &how, sizeof(how));
+                if (r < 0) {
+                    return std::nullopt;
+                }
+                auto fd = file_desc::from_fd(r);
+                struct stat st;
+                if (::fstat(fd.get(), &st) < 0 || !S_ISREG(st.st_mode)) {
+                    return std::nullopt;
+                }
+                size = st.st_size;
+                if (size == 0) {
+                    return fd;
+                }
+                // mapping the file does not read it, mincore() tells which pages are cached
+                void *addr = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd.get(), 0);
+                if (addr == MAP_FAILED) {
+                    return std::nullopt;
+                }
+                size_t page_size = ::sysconf(_SC_PAGESIZE);
+                std::vector<unsigned char> pages((size + page_size - 1) / page_size);
+                bool cached = ::mincore(addr, size, pages.data()) == 0 &&
+                              std::all_of(pages.begin(), pages.end(), [](unsigned char p) { return p & 1; });
+                ::munmap(addr, size);
+                if (!cached) {
+                    return std::nullopt;
+                }
+                return fd;
+#else
+                // no way to open the file without risking a wait for the disk
+                return std::nullopt;
+#endif
+            }
+
             future<> connection::do_response_loop() {
-                return _replies.pop_eventually().then([this](std::unique_ptr<reply> resp) {
-                    if (!resp) {
-                        // eof
-                        return make_ready_future<>();
-                    }
-                    _resp = std::move(resp);
-                    return start_response().then([this] { return do_response_loop(); });
+                return _replies.pop_eventually().then([this](future<std::unique_ptr<reply>> next) {
+                    return next.then([this](std::unique_ptr<reply> resp) {
+                        if (!resp) {
+                            // eof
+                            return make_ready_future<>();
+                        }
+                        _resp = std::move(resp);
+                        return start_response().then([this] { return do_response_loop(); });
+                    });
                 });
             }
 
             future<> connection::start_response() {
                 if (_resp->_body_writer) {
-                    return _resp->write_reply_to_connection(*this)
+                    if (!_resp->_body_file.empty() && _server._sendfile && _fd.supports_sendfile()) {
+                        size_t size;
+                        if (auto fd = open_cached_file(_resp->_body_file, size)) {
+                            return send_file(std::move(*fd), size);
+                        }
+                        // a cold file is read by the body writer, without blocking the reactor
+                    }
+                    return _resp->write_reply_to_connection(_write_buf, _server._common_headers)
                         .then_wrapped([this](auto f) {
                             if (f.failed()) {
                                 // In case of an error during the write close the connection
@@ -101,7 +170,7 @@ namespace nil {
                                 _done = true;
                                 _replies.abort(std::make_exception_ptr(
                                     std::logic_error("Unknown exception during body creation")));
-                                _replies.push(std::unique_ptr<reply>());
+                                _replies.push(make_ready_future<std::unique_ptr<reply>>());
                                 f.ignore_ready_future();
                                 return make_ready_future<>();
                             }
@@ -115,7 +184,7 @@ namespace nil {
                                 _done = true;
                                 _replies.abort(std::make_exception_ptr(
                                     std::logic_error("Unknown exception during body creation")));
-                                _replies.push(std::unique_ptr<reply>());
+                                _replies.push(make_ready_future<std::unique_ptr<reply>>());
                                 f.ignore_ready_future();
                                 return make_ready_future<>();
                             } else {
@@ -128,19 +197,17 @@ namespace nil {
                                 _done = true;
                                 _replies.abort(std::make_exception_ptr(
                                     std::logic_error("Unknown exception during body creation")));
-                                _replies.push(std::unique_ptr<reply>());
+                                _replies.push(make_ready_future<std::unique_ptr<reply>>());
                                 f.ignore_ready_future();
                             }
                             _resp.reset();
                             return make_ready_future<>();
                         });
                 }
-                set_headers(*_resp);
-                _resp->_headers["Content-Length"] = to_sstring(_resp->_content.size());
-                return _write_buf.write(_resp->_response_line.data(), _resp->_response_line.size())
-                    .then([this] { return _resp->write_reply_headers(*this); })
-                    .then([this] { return _write_buf.write("\r\n", 2); })
-                    .then([this] { return write_body(); })
+                // a shared body is written from its buffer, rendering it into the head would copy it once more
+                bool inline_body = _resp->_body_buffer.empty() && _resp->_content.size() <= max_inlined_body;
+                return _resp->write_head(_write_buf, _server._common_headers, inline_body)
+                    .then([this, inline_body] { return inline_body ? make_ready_future<>() : write_body(); })
                     .then([this] { return _write_buf.flush(); })
                     .then([this] { _resp.reset(); });
             }
@@ -150,67 +217,256 @@ namespace nil {
                 _server._connections.erase(_server._connections.iterator_to(*this));
             }
 
-            bool connection::url_decode(const std::string_view &in, sstring &out) {
-                size_t pos = 0;
-                sstring buff(in.length(), 0);
-                for (size_t i = 0; i < in.length(); ++i) {
-                    if (in[i] == '%') {
-                        if (i + 3 <= in.size()) {
-                            buff[pos++] = hexstr_to_char(in, i + 1);
-                            i += 2;
-                        } else {
-                            return false;
-                        }
-                    } else if (in[i] == '+') {
-                        buff[pos++] = ' ';
-                    } else {
-                        buff[pos++] = in[i];
-                    }
-                }
-                buff.resize(pos);
-                out = buff;
-                return true;
+            connection::connection(http_server &server, connected_socket &&fd, socket_address addr) :
+                _server(server), _fd(std::move(fd)), _read_buf(_fd.input()),
+                _write_buf(_fd.output(8192, !_server._sendfile || !_fd.supports_sendfile())) {
+                on_new_connection();
             }
 
             void connection::on_new_connection() {
                 ++_server._total_connections;
                 ++_server._current_connections;
                 _server._connections.push_back(*this);
+                _pipeline_depth = _server._pipeline_depth;
+                _pipeline_sem.signal(_pipeline_depth);
             }
 
             future<> connection::read() {
-                return do_until([this] { return _done; }, [this] { return read_one(); })
+                return negotiate_protocol()
+                    .then([this] { return do_until([this] { return _done; }, [this] { return read_one(); }); })
+                    .then([this] {
+                        if (!_http2) {
+                            return make_ready_future<>();
+                        }
+                        auto h2 = std::make_unique<http2_connection>(_server, _read_buf, _write_buf,
+                                                                     _server._credentials ? "https" : "http");
+                        auto &c = *h2;
+                        return c.process().finally([h2 = std::move(h2)] {});
+                    })
                     .then_wrapped([this](future<> f) {
                         // swallow error
                         if (f.failed()) {
                             _server._read_errors++;
                         }
                         f.ignore_ready_future();
-                        return _replies.push_eventually({});
+                        return _replies.push_eventually(make_ready_future<std::unique_ptr<reply>>());
                     })
-                    .finally([this] { return _read_buf.close(); });
-            }
-
-            // Check if the request has a body, and if so read it. This function modifies
-            // the request object with the newly read body, and returns the object for
-            // further processing.
-            // FIXME: reading the entire request body into a string req->_content is a
-            // bad idea, because it may be very big. Instead, we should present to the
-            // handler a req->_content_stream, an input stream that reads from the request
-            // body - via a specialized input streams which reads exactly up to
-            // Content-Length or decodes chunked-encoding.
-            // FIXME: We currently support the case that there is a "Content-Length:"
-            // header - chunked encoding is not yet supported.
-            static future<std::unique_ptr<httpd::request>> read_request_body(input_stream<char> &buf,
-                                                                             std::unique_ptr<httpd::request> req) {
-                if (!req->content_length) {
-                    return make_ready_future<std::unique_ptr<httpd::request>>(std::move(req));
+                    .finally([this] {
+                        // the handlers still running hold units, they may outlive the replies that are not sent
+                        return _pipeline_sem.wait(_pipeline_depth).finally([this] { return _read_buf.close(); });
+                    });
+            }
+
+            future<> connection::negotiate_protocol() {
+                // h2 is only negotiated on the listeners that offered it
+                if (!_server._credentials) {
+                    return make_ready_future<>();
+                }
+                return tls::get_alpn_protocol(_fd).then([this](sstring protocol) {
+                    if (protocol == "h2") {
+                        _http2 = true;
+                        _done = true;
+                    }
+                });
+            }
+
+            // Consumes one LF (or CRLF) terminated line of the input, without the terminator.
+            class http_line_consumer {
+                using consumption_result_type = typename input_stream<char>::consumption_result_type;
+
+                sstring _line;
+                bool _done = false;
+
+            public:
+                static constexpr size_t max_line_length = 4096;
+
+                future<consumption_result_type> operator()(temporary_buffer<char> buf) {
+                    if (buf.empty()) {
+                        // eof
+                        return make_ready_future<consumption_result_type>(stop_consuming<char>({}));
+                    }
+                    auto lf = std::find(buf.begin(), buf.end(), '\n');
+                    _line.append(buf.get(), lf - buf.begin());
+                    if (_line.size() > max_line_length) {
+                        return make_exception_future<consumption_result_type>(
+                            bad_request_exception("Chunked body line too long"));
+                    }
+                    if (lf == buf.end()) {
+                        return make_ready_future<consumption_result_type>(continue_consuming {});
+                    }
+                    _done = true;
+                    if (!_line.empty() && _line[_line.size() - 1] == '\r') {
+                        _line.resize(_line.size() - 1);
+                    }
+                    buf.trim_front(lf - buf.begin() + 1);
+                    return make_ready_future<consumption_result_type>(stop_consuming<char>(std::move(buf)));
+                }
+                bool done() const {
+                    return _done;
+                }
+                sstring &line() {
+                    return _line;
+                }
+            };
+
+            // Reads the body of one request from the connection input, either Content-Length bytes
+            // of it or the chunks of chunked transfer-encoding, leaving the input at the next request.
+            class http_body_reader {
+                input_stream<char> &_in;
+                bool _chunked;
+                // bytes left of the body, or of the current chunk
+                size_t _remaining;
+                size_t _limit;
+                size_t _total = 0;
+                bool _first_chunk = true;
+                bool _eof;
+                bool _broken = false;
+
+                future<sstring> read_line() {
+                    return do_with(http_line_consumer(), [this](http_line_consumer &c) {
+                        return _in.consume(c).then([&c] {
+                            if (!c.done()) {
+                                throw bad_request_exception("Connection closed in the middle of a chunked body");
+                            }
+                            return std::move(c.line());
+                        });
+                    });
+                }
+
+                static size_t parse_chunk_size(const sstring &line) {
+                    size_t size = 0;
+                    unsigned digits = 0;
+                    for (char ch : line) {
+                        // the ctype functions are undefined for the negative values of a plain char
+                        auto c = static_cast<unsigned char>(ch);
+                        if (c == ';' || c == ' ' || c == '\t') {
+                            // chunk extensions are ignored
+                            break;
+                        }
+                        int v = std::isdigit(c) ? c - '0' : std::isxdigit(c) ? std::tolower(c) - 'a' + 10 : -1;
+                        if (v < 0 || size > (std::numeric_limits<size_t>::max() - v) / 16) {
+                            throw bad_request_exception("Invalid chunk size");
+                        }
+                        size = size * 16 + v;
+                        ++digits;
+                    }
+                    if (!digits) {
+                        throw bad_request_exception("Invalid chunk size");
+                    }
+                    return size;
+                }
+
+                future<temporary_buffer<char>> read_data() {
+                    return _in.read_up_to(_remaining).then([this](temporary_buffer<char> b) {
+                        if (b.empty()) {
+                            throw bad_request_exception("Connection closed in the middle of the request body");
+                        }
+                        _remaining -= b.size();
+                        _eof = !_remaining && !_chunked;
+                        return b;
+                    });
+                }
+
+                future<> skip_trailers() {
+                    return repeat([this] {
+                        return read_line().then([](sstring line) {
+                            return line.empty() ? stop_iteration::yes : stop_iteration::no;
+                        });
+                    });
+                }
+
+                future<temporary_buffer<char>> next_chunk() {
+                    // the CRLF closing the data of the previous chunk
+                    auto f = _first_chunk ? make_ready_future<>() : read_line().then([](sstring line) {
+                        if (!line.empty()) {
+                            throw bad_request_exception("Missing CRLF after chunk data");
+                        }
+                    });
+                    _first_chunk = false;
+                    return f.then([this] { return read_line(); }).then([this](sstring line) {
+                        auto size = parse_chunk_size(line);
+                        if (size > _limit - _total) {
+                            throw base_exception(format("Content length limit ({}) exceeded", _limit),
+                                                 reply::status_type::payload_too_large);
+                        }
+                        _total += size;
+                        if (!size) {
+                            return skip_trailers().then([this] {
+                                _eof = true;
+                                return temporary_buffer<char>();
+                            });
+                        }
+                        _remaining = size;
+                        return read();
+                    });
+                }
+
+            public:
+                http_body_reader(input_stream<char> &in, size_t content_length) :
+                    _in(in), _chunked(false), _remaining(content_length), _limit(content_length),
+                    _eof(!content_length) {
+                }
+                struct chunked_tag { };
+                http_body_reader(input_stream<char> &in, chunked_tag, size_t limit) :
+                    _in(in), _chunked(true), _remaining(0), _limit(limit), _eof(false) {
+                }
+
+                // returns an empty buffer at the end of the body
+                future<temporary_buffer<char>> read() {
+                    if (_broken) {
+                        return make_exception_future<temporary_buffer<char>>(
+                            std::runtime_error("request body stream is broken"));
+                    }
+                    if (_eof) {
+                        return make_ready_future<temporary_buffer<char>>();
+                    }
+                    auto f = _remaining ? read_data() : next_chunk();
+                    return f.handle_exception([this](std::exception_ptr ep) {
+                        // the position of the input in the body is unknown now
+                        _broken = true;
+                        return make_exception_future<temporary_buffer<char>>(std::move(ep));
+                    });
                 }
-                return buf.read_exactly(req->content_length)
-                    .then([req = std::move(req)](temporary_buffer<char> body) mutable {
-                        req->content = nil::actor::to_sstring(std::move(body));
-                        return make_ready_future<std::unique_ptr<httpd::request>>(std::move(req));
+
+                // skips whatever the handler did not read, fails if the connection cannot be reused
+                future<> skip_rest() {
+                    if (!_chunked && !_broken) {
+                        _eof = true;
+                        return _in.skip(std::exchange(_remaining, 0));
+                    }
+                    return repeat([this] {
+                        return read().then([](temporary_buffer<char> b) {
+                            return b.empty() ? stop_iteration::yes : stop_iteration::no;
+                        });
                     });
+                }
+            };
+
+            class http_body_data_source_impl : public data_source_impl {
+                lw_shared_ptr<http_body_reader> _reader;
+
+            public:
+                explicit http_body_data_source_impl(lw_shared_ptr<http_body_reader> reader) :
+                    _reader(std::move(reader)) {
+                }
+                future<temporary_buffer<char>> get() override {
+                    return _reader->read();
+                }
+            };
+
+            // Returns true if the last transfer coding is chunked, the only one supported.
+            static bool is_chunked(const sstring &transfer_encoding) {
+                auto pos = transfer_encoding.find_last_of(',');
+                auto coding = std::string_view(transfer_encoding);
+                coding.remove_prefix(pos == sstring::npos ? 0 : pos + 1);
+                while (!coding.empty() && std::isspace(coding.front())) {
+                    coding.remove_prefix(1);
+                }
+                while (!coding.empty() && std::isspace(coding.back())) {
+                    coding.remove_suffix(1);
+                }
+                return std::equal(coding.begin(), coding.end(), "chunked", "chunked" + 7,
+                                  [](char a, char b) { return ::tolower(a) == b; });
             }
 
             void connection::generate_error_reply_and_close(std::unique_ptr<httpd::request> req,
@@ -221,22 +477,39 @@ namespace nil {
                 resp->set_status(status, msg);
                 resp->done();
                 _done = true;
-                _replies.push(std::move(resp));
+                _replies.push(make_ready_future<std::unique_ptr<reply>>(std::move(resp)));
             }
 
             future<> connection::read_one() {
-                _parser.init();
-                return _read_buf.consume(_parser).then([this]() mutable {
-                    if (_parser.eof()) {
+                if (_server._request_parser == request_parser_type::simd) {
+                    return read_one(_simd_parser);
+                }
+                return read_one(_parser);
+            }
+
+            template<typename Parser>
+            future<> connection::read_one(Parser &parser) {
+                parser.init();
+                return _read_buf.consume(parser).then([this, &parser]() mutable {
+                    if (parser.eof()) {
                         _done = true;
                         return make_ready_future<>();
                     }
+                    std::unique_ptr<httpd::request> req = parser.get_parsed_request();
+                    if (std::exchange(_first_request, false) && _server._http2 && !parser.failed() &&
+                        req->_method == "PRI" && req->_url == "*" && req->_version == "2.0") {
+                        // the HTTP/2 connection preface, its head is followed by "SM\r\n\r\n"
+                        auto tail = http2_connection::preface.substr(http2_connection::preface.find("SM"));
+                        return _read_buf.read_exactly(tail.size()).then([this, tail](temporary_buffer<char> buf) {
+                            _http2 = std::string_view(buf.get(), buf.size()) == tail;
+                            _done = true;
+                        });
+                    }
                     ++_server._requests_served;
-                    std::unique_ptr<httpd::request> req = _parser.get_parsed_request();
                     if (_server._credentials) {
                         req->protocol_name = "https";
                     }
-                    if (_parser.failed()) {
+                    if (parser.failed()) {
                         if (req->_version.empty()) {
                             // we might have failed to parse even the version
                             req->_version = "1.1";
@@ -247,8 +520,19 @@ namespace nil {
                     }
 
                     size_t content_length_limit = _server.get_content_length_limit();
-                    sstring length_header = req->get_header("Content-Length");
-                    req->content_length = strtol(length_header.c_str(), nullptr, 10);
+                    sstring transfer_encoding = req->get_header("Transfer-Encoding");
+                    if (!transfer_encoding.empty()) {
+                        if (!is_chunked(transfer_encoding)) {
+                            generate_error_reply_and_close(std::move(req), reply::status_type::not_implemented,
+                                                           "Unsupported transfer encoding");
+                            return make_ready_future<>();
+                        }
+                        // Content-Length is ignored for a chunked body, which the reader bounds by the limit
+                        req->chunked = true;
+                    } else {
+                        sstring length_header = req->get_header("Content-Length");
+                        req->content_length = strtol(length_header.c_str(), nullptr, 10);
+                    }
 
                     if (req->content_length > content_length_limit) {
                         auto msg =
@@ -263,10 +547,10 @@ namespace nil {
                             request::case_insensitive_cmp()(req->get_header("Expect"), "100-continue")) {
                             return _replies.not_full().then([req = std::move(req), this]() mutable {
                                 auto continue_reply = std::make_unique<reply>();
-                                set_headers(*continue_reply);
                                 continue_reply->set_version(req->_version);
                                 continue_reply->set_status(reply::status_type::continue_).done();
-                                this->_replies.push(std::move(continue_reply));
+                                this->_replies.push(
+                                    make_ready_future<std::unique_ptr<reply>>(std::move(continue_reply)));
                                 return make_ready_future<std::unique_ptr<httpd::request>>(std::move(req));
                             });
                         } else {
@@ -274,16 +558,45 @@ namespace nil {
                         }
                     };
 
-                    return maybe_reply_continue().then([this](std::unique_ptr<httpd::request> req) {
-                        return read_request_body(_read_buf, std::move(req))
-                            .then([this](std::unique_ptr<httpd::request> req) {
-                                return _replies.not_full()
-                                    .then([req = std::move(req), this]() mutable {
-                                        return generate_reply(std::move(req));
-                                    })
-                                    .then([this](bool done) { _done = done; });
-                            });
-                    });
+                    return maybe_reply_continue().then(
+                        [this, content_length_limit](std::unique_ptr<httpd::request> req) {
+                            lw_shared_ptr<http_body_reader> body;
+                            if (req->chunked) {
+                                body = make_lw_shared<http_body_reader>(_read_buf, http_body_reader::chunked_tag(),
+                                                                        content_length_limit);
+                            } else if (req->content_length) {
+                                body = make_lw_shared<http_body_reader>(_read_buf, req->content_length);
+                            }
+                            if (body) {
+                                req->content_stream =
+                                    input_stream<char>(data_source(std::make_unique<http_body_data_source_impl>(body)));
+                            }
+                            bool close = should_close(*req);
+                            return _replies.not_full()
+                                .then([this] { return get_units(_pipeline_sem, 1); })
+                                .then([this, req = std::move(req), body](auto units) mutable {
+                                    auto rep = generate_reply(std::move(req)).finally([units = std::move(units)] {});
+                                    if (!body) {
+                                        // the next request is read while this one is handled
+                                        _replies.push(std::move(rep));
+                                        return make_ready_future<>();
+                                    }
+                                    // the body has to be read before the next request
+                                    return rep.then([this](std::unique_ptr<reply> rep) {
+                                        _replies.push(make_ready_future<std::unique_ptr<reply>>(std::move(rep)));
+                                    });
+                                })
+                                .then([this, body, close] {
+                                    _done = close;
+                                    if (!body) {
+                                        return make_ready_future<>();
+                                    }
+                                    return body->skip_rest().handle_exception([this](std::exception_ptr ep) {
+                                        // the next request cannot be found in the input
+                                        _done = true;
+                                    });
+                                });
+                        });
                 });
             }
 
@@ -308,64 +621,11 @@ namespace nil {
                 _fd.shutdown_output();
             }
 
-            future<> connection::write_reply_headers(std::unordered_map<sstring, sstring>::iterator hi) {
-                if (hi == _resp->_headers.end()) {
-                    return make_ready_future<>();
-                }
-                return _write_buf.write(hi->first.data(), hi->first.size())
-                    .then([this] { return _write_buf.write(": ", 2); })
-                    .then([hi, this] { return _write_buf.write(hi->second.data(), hi->second.size()); })
-                    .then([this] { return _write_buf.write("\r\n", 2); })
-                    .then([hi, this]() mutable { return write_reply_headers(++hi); });
-            }
-
-            short connection::hex_to_byte(char c) {
-                if (c >= 'a' && c <= 'z') {
-                    return c - 'a' + 10;
-                } else if (c >= 'A' && c <= 'Z') {
-                    return c - 'A' + 10;
-                }
-                return c - '0';
-            }
-
-            /**
-             * Convert a hex encoded 2 bytes substring to char
-             */
-            char connection::hexstr_to_char(const std::string_view &in, size_t from) {
-
-                return static_cast<char>(hex_to_byte(in[from]) * 16 + hex_to_byte(in[from + 1]));
-            }
-
-            void connection::add_param(request &req, const std::string_view &param) {
-                size_t split = param.find('=');
-
-                if (split >= param.length() - 1) {
-                    sstring key;
-                    if (url_decode(param.substr(0, split), key)) {
-                        req.query_parameters[key] = "";
-                    }
-                } else {
-                    sstring key;
-                    sstring value;
-                    if (url_decode(param.substr(0, split), key) && url_decode(param.substr(split + 1), value)) {
-                        req.query_parameters[key] = value;
-                    }
-                }
-            }
-
             sstring connection::set_query_param(request &req) {
                 size_t pos = req._url.find('?');
                 if (pos == sstring::npos) {
                     return req._url;
                 }
-                size_t curr = pos + 1;
-                size_t end_param;
-                std::string_view url = req._url;
-                while ((end_param = req._url.find('&', curr)) != sstring::npos) {
-                    add_param(req, url.substr(curr, end_param - curr));
-                    curr = end_param + 1;
-                }
-                add_param(req, url.substr(curr));
                 return req._url.substr(0, pos);
             }
 
@@ -385,51 +645,55 @@ namespace nil {
             }
 
             future<> connection::write_body() {
-                return _write_buf.write(_resp->_content.data(), _resp->_content.size());
+                auto body = _resp->body();
+                return _write_buf.write(body.data(), body.size());
+            }
+
+            future<> connection::send_file(file_desc fd, size_t size) {
+                auto file = make_lw_shared<file_desc>(std::move(fd));
+                // _write_buf does not batch its flushes here, the head is on the socket once flush() resolves
+                return _resp->write_head(_write_buf, _server._common_headers, false, size)
+                    .then([this] { return _write_buf.flush(); })
+                    .then([this, file, size] { return _fd.sendfile(*file, 0, size); })
+                    .then_wrapped([this](future<> f) {
+                        if (f.failed()) {
+                            // the head may be out already, the connection has to be closed
+                            _server._respond_errors++;
+                            _done = true;
+                            _replies.abort(
+                                std::make_exception_ptr(std::logic_error("Unknown exception during sendfile")));
+                            _replies.push(make_ready_future<std::unique_ptr<reply>>());
+                            f.ignore_ready_future();
+                        }
+                        _resp.reset();
+                        return make_ready_future<>();
+                    });
             }
 
-            void connection::set_headers(reply &resp) {
-                resp._headers["Server"] = "Actor httpd";
-                resp._headers["Date"] = _server._date;
+            bool connection::should_close(const request &req) {
+                auto it = req._headers.find("Connection");
+                if (req._version == "1.0") {
+                    return it == req._headers.end() || it->second != "Keep-Alive";
+                } else if (req._version == "1.1") {
+                    return it != req._headers.end() && it->second == "Close";
+                }
+                // HTTP/0.9 goes here
+                return true;
             }
 
-            future<bool> connection::generate_reply(std::unique_ptr<request> req) {
+            future<std::unique_ptr<reply>> connection::generate_reply(std::unique_ptr<request> req) {
                 auto resp = std::make_unique<reply>();
-                bool conn_keep_alive = false;
-                bool conn_close = false;
-                auto it = req->_headers.find("Connection");
-                if (it != req->_headers.end()) {
-                    if (it->second == "Keep-Alive") {
-                        conn_keep_alive = true;
-                    } else if (it->second == "Close") {
-                        conn_close = true;
-                    }
-                }
-                bool should_close;
                 // TODO: Handle HTTP/2.0 when it releases
                 resp->set_version(req->_version);
-
-                if (req->_version == "1.0") {
-                    if (conn_keep_alive) {
-                        resp->_headers["Connection"] = "Keep-Alive";
-                    }
-                    should_close = !conn_keep_alive;
-                } else if (req->_version == "1.1") {
-                    should_close = conn_close;
-                } else {
-                    // HTTP/0.9 goes here
-                    should_close = true;
+                if (req->_version == "1.0" && !should_close(*req)) {
+                    resp->_headers["Connection"] = "Keep-Alive";
                 }
                 sstring url = set_query_param(*req.get());
                 sstring version = req->_version;
-                set_headers(*resp);
                 return _server._routes.handle(url, std::move(req), std::move(resp))
-                    .
-                    // Caller guarantees enough room
-                    then([this, should_close, version = std::move(version)](std::unique_ptr<reply> rep) {
+                    .then([version = std::move(version)](std::unique_ptr<reply> rep) {
                         rep->set_version(version).done();
-                        this->_replies.push(std::move(rep));
-                        return make_ready_future<bool>(should_close);
+                        return rep;
                     });
             }
 
@@ -445,9 +709,46 @@ namespace nil {
                 _content_length_limit = limit;
             }
 
+            request_parser_type http_server::get_request_parser() const {
+                return _request_parser;
+            }
+
+            void http_server::set_request_parser(request_parser_type type) {
+                _request_parser = type;
+            }
+
+            size_t http_server::get_pipeline_depth() const {
+                return _pipeline_depth;
+            }
+
+            void http_server::set_pipeline_depth(size_t depth) {
+                _pipeline_depth = std::max<size_t>(depth, 1);
+            }
+
+            bool http_server::get_http2() const {
+                return _http2;
+            }
+
+            void http_server::set_http2(bool enable) {
+                _http2 = enable;
+            }
+
+            bool http_server::get_sendfile() const {
+                return _sendfile;
+            }
+
+            void http_server::set_sendfile(bool enable) {
+                _sendfile = enable;
+            }
+
             future<> http_server::listen(socket_address addr, listen_options lo) {
                 if (_credentials) {
-                    _listeners.push_back(nil::actor::tls::listen(_credentials, addr, lo));
+                    // the credentials are the caller's and may be shared, the listener offers the protocols
+                    std::vector<sstring> protocols;
+                    if (_http2) {
+                        protocols = {"h2", "http/1.1"};
+                    }
+                    _listeners.push_back(nil::actor::tls::listen(_credentials, addr, lo, std::move(protocols)));
                 } else {
                     _listeners.push_back(nil::actor::listen(addr, lo));
                 }
@@ -522,7 +823,10 @@ namespace nil {
             // RFC 7231, Section 7.1.1.1, a.k.a. IMF (Internet Message Format) fixdate.
             // For example: Sun, 06 Nov 1994 08:49:37 GMT
             sstring http_server::http_date() {
-                auto t = ::time(nullptr);
+                return http_date(::time(nullptr));
+            }
+
+            sstring http_server::http_date(std::time_t t) {
                 struct tm tm;
                 gmtime_r(&t, &tm);
                 // Using strftime() would have been easier, but unfortunately relies on
@@ -534,6 +838,10 @@ namespace nil {
                                           months[tm.tm_mon], 1900 + tm.tm_year, tm.tm_hour, tm.tm_min, tm.tm_sec);
             }
 
+            sstring http_server::common_headers(const sstring &date) {
+                return "Server: Actor httpd\r\nDate: " + date + "\r\n";
+            }
+
             future<> http_server_control::start(const sstring &name) {
                 return _server_dist->start(name);
             }
@@ -39,7 +39,7 @@ namespace nil {
                 if (params.size() == 0)
                     _routes.put(operations.method, path, handler);
                 else {
-                    match_rule *rule = new match_rule(handler);
+                    auto rule = std::make_unique<match_rule>(handler);
                     rule->add_str(path);
                     for (auto &&i : params) {
                         if (i.type == url_component_type::FIXED_STRING) {
@@ -48,7 +48,8 @@ namespace nil {
                             rule->add_param(i.name, i.type == url_component_type::PARAM_UNTIL_END_OF_PATH);
                         }
                     }
-                    _cookie = _routes.add_cookie(rule, operations.method);
+                    _cookie = _routes.add_cookie(rule.get(), operations.method);
+                    rule.release();
                 }
             }
 
@@ -35,6 +35,13 @@
 #include <nil/actor/core/print.hh>
 #include <nil/actor/http/httpd.hh>
 #include <nil/actor/core/loop.hh>
+#include <nil/actor/core/do_with.hh>
+
+#include <algorithm>
+#include <cassert>
+#include <cctype>
+#include <charconv>
+#include <string_view>
 
 namespace nil {
     namespace actor {
@@ -109,10 +116,106 @@ namespace nil {
                 }
             }    // namespace status_strings
 
-            sstring reply::response_line() {
+            sstring reply::response_line() const {
                 return "HTTP/" + _version + status_strings::to_string(_status);
             }
 
+            // Header names are case insensitive.
+            static bool same_header_name(std::string_view a, std::string_view b) {
+                return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](char x, char y) {
+                    return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y));
+                });
+            }
+
+            // Headers written by the connection itself, values set by handlers are ignored.
+            static bool is_connection_header(const sstring &name) {
+                return same_header_name(name, "Content-Length") || same_header_name(name, "Transfer-Encoding");
+            }
+
+            // The lines of the common headers that the reply does not set itself.
+            static sstring without_overridden(std::string_view common_headers,
+                                              const std::unordered_map<sstring, sstring> &headers) {
+                sstring ret;
+                while (!common_headers.empty()) {
+                    auto eol = common_headers.find("\r\n");
+                    auto end = eol == std::string_view::npos ? common_headers.size() : eol + 2;
+                    auto line = common_headers.substr(0, end);
+                    auto name = line.substr(0, line.find(':'));
+                    bool overridden = std::any_of(headers.begin(), headers.end(),
+                                                  [name](auto &&h) { return same_header_name(h.first, name); });
+                    if (!overridden) {
+                        ret += sstring(line.data(), line.size());
+                    }
+                    common_headers.remove_prefix(end);
+                }
+                return ret;
+            }
+
+            temporary_buffer<char> reply::render_head(const sstring &common_headers, bool with_body,
+                                                      std::optional<size_t> body_length) const {
+                static constexpr std::string_view content_length = "Content-Length: ";
+                static constexpr std::string_view chunked = "Transfer-Encoding: chunked\r\n";
+                auto &status = status_strings::to_string(_status);
+                // a Server or Date header set by the handler replaces the common one
+                std::string_view common = common_headers;
+                sstring overridden;
+                if (_headers.count("Server") || _headers.count("Date")) {
+                    overridden = without_overridden(common, _headers);
+                    common = overridden;
+                }
+                bool is_chunked = _body_writer && !body_length;
+                // a 304 has no body, the one of the reply it stands for is not sent
+                bool is_framed = _status != status_type::not_modified;
+                char length[20];
+                auto length_end = is_chunked ? length
+                                             : std::to_chars(length, length + sizeof(length),
+                                                             body_length.value_or(body().size()))
+                                                   .ptr;
+
+                // size everything up front so that the head is rendered in a single allocation
+                size_t size = 5 + _version.size() + status.size() + common.size() + 2;
+                for (auto &&h : _headers) {
+                    if (!is_connection_header(h.first)) {
+                        size += h.first.size() + h.second.size() + 4;
+                    }
+                }
+                if (is_framed) {
+                    size += is_chunked ? chunked.size() : content_length.size() + (length_end - length) + 2;
+                }
+                if (with_body) {
+                    size += body().size();
+                }
+
+                temporary_buffer<char> buf(size);
+                auto p = buf.get_write();
+                auto append = [&p](std::string_view s) { p = std::copy(s.begin(), s.end(), p); };
+                append("HTTP/");
+                append(_version);
+                append(status);
+                append(common);
+                for (auto &&h : _headers) {
+                    if (!is_connection_header(h.first)) {
+                        append(h.first);
+                        append(": ");
+                        append(h.second);
+                        append("\r\n");
+                    }
+                }
+                if (is_framed && is_chunked) {
+                    append(chunked);
+                } else if (is_framed) {
+                    append(content_length);
+                    append(std::string_view(length, length_end - length));
+                    append("\r\n");
+                }
+                append("\r\n");
+                if (with_body) {
+                    append(body());
+                }
+                assert(p == buf.end());
+                return buf;
+            }
+
             class http_chunked_data_sink_impl : public data_sink_impl {
                 output_stream<char> &_out;
 
@@ -166,18 +269,26 @@ namespace nil {
                 done(content_type);
             }
 
-            future<> reply::write_reply_to_connection(connection &con) {
-                add_header("Transfer-Encoding", "chunked");
-                return con.out()
-                    .write(response_line())
-                    .then([this, &con]() mutable { return write_reply_headers(con); })
-                    .then([&con]() mutable { return con.out().write("\r\n", 2); })
-                    .then([this, &con]() mutable { return _body_writer(make_http_chunked_output_stream(con.out())); });
+            void reply::write_body(const sstring &content_type, temporary_buffer<char> content) {
+                _body_buffer = std::move(content);
+                done(content_type);
+            }
+
+            void reply::set_body_file(const sstring &file_name) {
+                _body_file = file_name;
+            }
+
+            future<> reply::write_head(output_stream<char> &out, const sstring &common_headers, bool with_body,
+                                       std::optional<size_t> body_length) const {
+                // the stream may hold earlier buffered writes, which a zero-copy write of the buffer cannot follow
+                return do_with(render_head(common_headers, with_body, body_length),
+                               [&out](temporary_buffer<char> &head) { return out.write(head.get(), head.size()); });
             }
 
-            future<> reply::write_reply_headers(connection &con) {
-                return do_for_each(_headers,
-                                   [&con](auto &h) { return con.out().write(h.first + ": " + h.second + "\r\n"); });
+            future<> reply::write_reply_to_connection(output_stream<char> &out, const sstring &common_headers) {
+                return write_head(out, common_headers, false).then([this, &out]() mutable {
+                    return _body_writer(make_http_chunked_output_stream(out));
+                });
             }
 
         }    // namespace httpd
@@ -0,0 +1,207 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+#include <nil/actor/http/request.hh>
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+namespace nil {
+    namespace actor {
+
+        namespace httpd {
+
+            using namespace std;
+
+            char *request_arena::allocate(size_t size) {
+                if (size > _free) {
+                    auto len = std::max(size, block_size);
+                    _blocks.emplace_back(new char[len]);
+                    _pos = _blocks.back().get();
+                    _free = len;
+                }
+                char *start = _pos;
+                _pos += size;
+                _free -= size;
+                return start;
+            }
+
+            string_view request_arena::store(initializer_list<string_view> parts) {
+                size_t size = 0;
+                for (auto &&p : parts) {
+                    size += p.size();
+                }
+                char *start = allocate(size);
+                char *pos = start;
+                for (auto &&p : parts) {
+                    // empty views may have no data
+                    if (!p.empty()) {
+                        memcpy(pos, p.data(), p.size());
+                        pos += p.size();
+                    }
+                }
+                return string_view(start, size);
+            }
+
+            size_t header_map::name_hash::operator()(string_view name) const {
+                // FNV-1a over the lower case name
+                size_t h = 14695981039346656037ull;
+                for (unsigned char c : name) {
+                    h = (h ^ size_t(::tolower(c))) * 1099511628211ull;
+                }
+                return h;
+            }
+
+            bool header_map::name_equal::operator()(string_view a, string_view b) const {
+                return request::case_insensitive_cmp()(a, b);
+            }
+
+            header_map::const_iterator header_map::find(string_view name) const {
+                if (!_index.empty()) {
+                    auto i = _index.find(name);
+                    return i == _index.end() ? end() : begin() + i->second;
+                }
+                return find_if(_headers.begin(), _headers.end(),
+                               [name](const value_type &h) { return request::case_insensitive_cmp()(h.first, name); });
+            }
+
+            void header_map::push(string_view name, string_view value) {
+                if (_headers.empty()) {
+                    _headers.reserve(16);
+                }
+                _headers.emplace_back(name, value);
+                if (!_index.empty()) {
+                    _index.emplace(name, _headers.size() - 1);
+                } else if (_headers.size() > index_threshold) {
+                    _index.reserve(_headers.size() * 2);
+                    for (size_t i = 0; i < _headers.size(); i++) {
+                        _index.emplace(_headers[i].first, i);
+                    }
+                }
+            }
+
+            void header_map::append(size_t index, string_view separator, string_view value) {
+                auto &h = _headers[index];
+                if (_growable.size() <= index) {
+                    _growable.resize(index + 1);
+                }
+                auto &g = _growable[index];
+                auto size = h.second.size() + separator.size() + value.size();
+                if (size > g.capacity) {
+                    // leave as much room again, so that a header repeated n times moves O(log n) times
+                    auto capacity = size * 2;
+                    auto data = _arena.allocate(capacity);
+                    std::copy(h.second.begin(), h.second.end(), data);
+                    g = growable {data, capacity};
+                }
+                auto p = std::copy(separator.begin(), separator.end(), g.data + h.second.size());
+                std::copy(value.begin(), value.end(), p);
+                h.second = string_view(g.data, size);
+            }
+
+            void header_map::set(string_view name, string_view value) {
+                auto i = find(name);
+                if (i != end()) {
+                    auto index = i - begin();
+                    _headers[index].second = _arena.store({value});
+                    if (size_t(index) < _growable.size()) {
+                        _growable[index] = growable {};
+                    }
+                    return;
+                }
+                push(_arena.store({name}), _arena.store({value}));
+            }
+
+            void header_map::add(string_view name, string_view value, string_view separator) {
+                auto i = find(name);
+                if (i == end()) {
+                    push(_arena.store({name}), _arena.store({value}));
+                    return;
+                }
+                append(i - begin(), separator, value);
+            }
+
+            void header_map::add_stored(string_view name, string_view value) {
+                auto i = find(name);
+                if (i == end()) {
+                    push(name, value);
+                    return;
+                }
+                append(i - begin(), ",", value);
+            }
+
+            /**
+             * Call a function with the key and the value of each parameter of a query string, in order
+             * and still encoded, the value of a parameter without '=' is empty
+             */
+            template<typename Func>
+            static void split_query(string_view query, Func &&func) {
+                if (query.empty()) {
+                    return;
+                }
+                size_t curr = 0;
+                while (true) {
+                    size_t end = query.find('&', curr);
+                    auto param = query.substr(curr, (end == string_view::npos) ? end : end - curr);
+                    size_t split = param.find('=');
+                    auto value = (split == string_view::npos) ? string_view() : param.substr(split + 1);
+                    func(param.substr(0, split), value);
+                    if (end == string_view::npos) {
+                        return;
+                    }
+                    curr = end + 1;
+                }
+            }
+
+            sstring request::get_query_param(const sstring &name) const {
+                sstring res;
+                split_query(query_string(), [&name, &res](string_view key, string_view value) {
+                    sstring decoded;
+                    // most keys need no decoding
+                    bool match = (key.find_first_of("%+") == string_view::npos)
+                                     ? key == string_view(name)
+                                     : url_decode(key, decoded) && decoded == name;
+                    if (match && url_decode(value, decoded)) {
+                        res = std::move(decoded);
+                    }
+                });
+                return res;
+            }
+
+            std::unordered_map<sstring, sstring> request::query_parameters() const {
+                std::unordered_map<sstring, sstring> params;
+                split_query(query_string(), [&params](string_view key, string_view value) {
+                    sstring decoded_key;
+                    sstring decoded_value;
+                    if (url_decode(key, decoded_key) && url_decode(value, decoded_value)) {
+                        params[std::move(decoded_key)] = std::move(decoded_value);
+                    }
+                });
+                return params;
+            }
+
+        }    // namespace httpd
+
+    }    // namespace actor
+}    // namespace nil
@@ -55,15 +55,11 @@ action checkpoint {
 }
 
 action assign_field {
-    if (_req->_headers.count(_field_name)) {
-        // RFC 7230, section 3.2.2.  Field Parsing:
-        // A recipient MAY combine multiple header fields with the same field name into one
-        // "field-name: field-value" pair, without changing the semantics of the message,
-        // by appending each subsequent field value to the combined field value in order, separated by a comma.
-        _req->_headers[_field_name] += sstring(",") + std::move(_value);
-    } else {
-        _req->_headers[_field_name] = std::move(_value);
-    }
+    // RFC 7230, section 3.2.2.  Field Parsing:
+    // A recipient MAY combine multiple header fields with the same field name into one
+    // "field-name: field-value" pair, without changing the semantics of the message,
+    // by appending each subsequent field value to the combined field value in order, separated by a comma.
+    _req->_headers.add(_field_name, _value);
 }
 
 action extend_field  {
@@ -71,7 +67,7 @@ action extend_field  {
     // A server that receives an obs-fold in a request message that is not
     // within a message/http container MUST either reject the message [...]
     // or replace each received obs-fold with one or more SP octets [...]
-    _req->_headers[_field_name] += sstring(" ") + std::move(_value);
+    _req->_headers.add(_field_name, _value, " ");
 }
 
 action done {
@@ -116,21 +112,26 @@ public:
         eof,
         done,
     };
+    // a longer head is rejected rather than buffered without bound
+    static constexpr size_t max_head_size = 64 * 1024;
     std::unique_ptr<httpd::request> _req;
     sstring _field_name;
     sstring _value;
     state _state;
+    size_t _head_size;
 public:
     void init() {
         init_base();
         _req.reset(new httpd::request());
         _state = state::eof;
+        _head_size = 0;
         %% write init;
     }
     char* parse(char* p, char* pe, char* eof) {
         sstring_builder::guard g(_builder, p, pe);
         auto str = [this, &g, &p] { g.mark_end(p); return get_str(); };
         bool done = false;
+        char* start = p;
         if (p != pe) {
             _state = state::error;
         }
@@ -142,6 +143,11 @@ public:
 #ifdef __clang__
 #pragma clang diagnostic pop
 #endif
+        _head_size += p - start;
+        if (_head_size > max_head_size) {
+            _state = state::error;
+            return p;
+        }
         if (!done) {
             if (p == eof) {
                 _state = state::eof;
@@ -0,0 +1,247 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+#include <nil/actor/http/route_tree.hh>
+
+#include <nil/actor/core/print.hh>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace nil {
+    namespace actor {
+
+        namespace httpd {
+
+            using namespace std;
+
+            template<typename Children>
+            static auto find_child(Children &children, string_view seg) {
+                return lower_bound(children.begin(), children.end(), seg,
+                                   [](const auto &c, string_view s) { return string_view(c.first) < s; });
+            }
+
+            bool route_tree::compile(const match_rule &rule, vector<segment> &segments, vector<sstring> &names) {
+                if (rule.matchers().empty()) {
+                    return false;
+                }
+                for (auto m : rule.matchers()) {
+                    if (!segments.empty() && segments.back().type == segment_type::remainder) {
+                        return false;
+                    }
+                    if (auto s = dynamic_cast<const str_matcher *>(m)) {
+                        const sstring &str = s->str();
+                        if (str.empty() || str[0] != '/') {
+                            return false;
+                        }
+                        // "/a/b" matches exactly where "/a" followed by "/b" does
+                        size_t pos = 0;
+                        while (pos < str.size()) {
+                            size_t end = str.find('/', pos + 1);
+                            if (end == sstring::npos) {
+                                end = str.size();
+                            }
+                            segments.push_back({segment_type::fixed, str.substr(pos, end - pos)});
+                            pos = end;
+                        }
+                    } else if (auto p = dynamic_cast<const param_matcher *>(m)) {
+                        if (names.size() == max_params) {
+                            return false;
+                        }
+                        segments.push_back({p->entire_path() ? segment_type::remainder : segment_type::param, ""});
+                        names.push_back(p->name());
+                    } else {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            sstring route_tree::describe(const vector<segment> &segments, const vector<sstring> &names) {
+                sstring res;
+                auto name = names.begin();
+                for (auto &&s : segments) {
+                    switch (s.type) {
+                        case segment_type::fixed:
+                            res += s.str;
+                            break;
+                        case segment_type::param:
+                            res += "/{";
+                            res += *name++;
+                            res += "}";
+                            break;
+                        case segment_type::remainder:
+                            res += "/{";
+                            res += *name++;
+                            res += "...}";
+                            break;
+                    }
+                }
+                return res;
+            }
+
+            const route_tree::node *route_tree::find_node(const vector<segment> &segments) const {
+                const node *n = &_root;
+                for (auto &&s : segments) {
+                    switch (s.type) {
+                        case segment_type::fixed: {
+                            auto i = find_child(n->children, s.str);
+                            n = (i != n->children.end() && i->first == s.str) ? i->second.get() : nullptr;
+                            break;
+                        }
+                        case segment_type::param:
+                            n = n->param.get();
+                            break;
+                        case segment_type::remainder:
+                            n = n->remainder.get();
+                            break;
+                    }
+                    if (n == nullptr) {
+                        return nullptr;
+                    }
+                }
+                return n;
+            }
+
+            void route_tree::add(rule_cookie cookie, const match_rule &rule, vector<segment> segments,
+                                 vector<sstring> names) {
+                node *n = &_root;
+                for (auto &&s : segments) {
+                    n->min_cookie = std::min(n->min_cookie, cookie);
+                    unique_ptr<node> *child = nullptr;
+                    switch (s.type) {
+                        case segment_type::fixed: {
+                            auto i = find_child(n->children, s.str);
+                            if (i == n->children.end() || i->first != s.str) {
+                                i = n->children.emplace(i, std::move(s.str), nullptr);
+                            }
+                            child = &i->second;
+                            break;
+                        }
+                        case segment_type::param:
+                            child = &n->param;
+                            break;
+                        case segment_type::remainder:
+                            child = &n->remainder;
+                            break;
+                    }
+                    if (!*child) {
+                        *child = make_unique<node>();
+                    }
+                    n = child->get();
+                }
+                n->min_cookie = std::min(n->min_cookie, cookie);
+                n->term = make_unique<terminal>(terminal {cookie, rule.handler(), std::move(names)});
+            }
+
+            void route_tree::insert(rule_cookie cookie, match_rule *rule) {
+                vector<segment> segments;
+                vector<sstring> names;
+                if (!compile(*rule, segments, names)) {
+                    _opaque.emplace(cookie, rule);
+                    return;
+                }
+                auto n = find_node(segments);
+                if (n != nullptr && n->term) {
+                    throw std::runtime_error(format("Rule for {} conflicts with an existing rule.",
+                                                    describe(segments, names)));
+                }
+                add(cookie, *rule, std::move(segments), std::move(names));
+                _compiled.emplace(cookie, rule);
+            }
+
+            void route_tree::erase(rule_cookie cookie) {
+                if (_opaque.erase(cookie) || !_compiled.erase(cookie)) {
+                    return;
+                }
+                // removing is rare, rebuilding keeps the subtree cookies exact
+                _root = node();
+                for (auto &&r : _compiled) {
+                    vector<segment> segments;
+                    vector<sstring> names;
+                    compile(*r.second, segments, names);
+                    add(r.first, *r.second, std::move(segments), std::move(names));
+                }
+            }
+
+            void route_tree::match(const node &n, string_view url, size_t ind, unsigned depth, match_state &st) const {
+                if (n.min_cookie >= st.cookie) {
+                    return;
+                }
+                // like match_rule::get, a single trailing character (a slash) is ignored
+                if (n.term && ind + 1 >= url.size() && n.term->cookie < st.cookie) {
+                    st.cookie = n.term->cookie;
+                    st.best = n.term.get();
+                    std::copy_n(st.spans.begin(), depth, st.best_spans.begin());
+                }
+                if (n.remainder) {
+                    st.spans[depth] = {ind, url.size()};
+                    match(*n.remainder, url, url.size(), depth + 1, st);
+                }
+                if (ind >= url.size()) {
+                    return;
+                }
+                size_t end = url.find('/', ind + 1);
+                if (end == string_view::npos) {
+                    end = url.size();
+                }
+                auto seg = url.substr(ind, end - ind);
+                auto i = find_child(n.children, seg);
+                if (i != n.children.end() && string_view(i->first) == seg) {
+                    match(*i->second, url, end, depth, st);
+                }
+                if (n.param) {
+                    st.spans[depth] = {ind, end};
+                    match(*n.param, url, end, depth + 1, st);
+                }
+            }
+
+            handler_base *route_tree::find(const sstring &url, parameters &params) const {
+                match_state st;
+                if (!_compiled.empty()) {
+                    match(_root, url, 0, 0, st);
+                }
+                for (auto &&r : _opaque) {
+                    if (r.first >= st.cookie) {
+                        break;
+                    }
+                    auto handler = r.second->get(url, params);
+                    if (handler != nullptr) {
+                        return handler;
+                    }
+                    params.clear();
+                }
+                if (st.best == nullptr) {
+                    return nullptr;
+                }
+                for (unsigned i = 0; i < st.best->names.size(); i++) {
+                    auto &s = st.best_spans[i];
+                    params.set(st.best->names[i], url.substr(s.first, s.second - s.first));
+                }
+                return st.best->handler;
+            }
+
+        }    // namespace httpd
+
+    }    // namespace actor
+}    // namespace nil
@@ -26,6 +26,7 @@
 #include <nil/actor/http/reply.hh>
 #include <nil/actor/http/exception.hh>
 #include <nil/actor/http/json_path.hh>
+#include <nil/actor/core/loop.hh>
 
 namespace nil {
     namespace actor {
@@ -83,9 +84,46 @@ namespace nil {
                 return rep;
             }
 
+            // Reads the body of a request into request::content, for handlers that do not stream it.
+            static future<> read_content(request &req) {
+                if (!req.chunked) {
+                    return req.content_stream.read_exactly(req.content_length).then([&req](temporary_buffer<char> b) {
+                        if (b.size() != req.content_length) {
+                            throw bad_request_exception("Request body is shorter than its Content-Length");
+                        }
+                        req.content = to_sstring(std::move(b));
+                    });
+                }
+                return repeat([&req] {
+                    return req.content_stream.read().then([&req](temporary_buffer<char> b) {
+                        if (b.empty()) {
+                            return stop_iteration::yes;
+                        }
+                        req.content.append(b.get(), b.size());
+                        return stop_iteration::no;
+                    });
+                });
+            }
+
             future<std::unique_ptr<reply>> routes::handle(const sstring &path, std::unique_ptr<request> req,
                                                           std::unique_ptr<reply> rep) {
                 handler_base *handler = get_handler(str2type(req->_method), normalize_url(path), req->param);
+                if (handler != nullptr && !handler->_stream_body && (req->content_length || req->chunked)) {
+                    auto &r = *req;
+                    return read_content(r).then_wrapped(
+                        [this, handler, path, req = std::move(req), rep = std::move(rep)](future<> f) mutable {
+                            if (f.failed()) {
+                                return make_ready_future<std::unique_ptr<reply>>(exception_reply(f.get_exception()));
+                            }
+                            return call_handler(handler, path, std::move(req), std::move(rep));
+                        });
+                }
+                return call_handler(handler, path, std::move(req), std::move(rep));
+            }
+
+            future<std::unique_ptr<reply>> routes::call_handler(handler_base *handler, const sstring &path,
+                                                                std::unique_ptr<request> req,
+                                                                std::unique_ptr<reply> rep) {
                 if (handler != nullptr) {
                     try {
                         for (auto &i : handler->_mandatory_param) {
@@ -120,23 +158,19 @@ namespace nil {
                     return handler;
                 }
 
-                for (auto &&rule : _rules[type]) {
-                    handler = rule.second->get(url, params);
-                    if (handler != nullptr) {
-                        return handler;
-                    }
-                    params.clear();
-                }
-                return _default_handler;
+                handler = _rule_trees[type].find(url, params);
+                return (handler != nullptr) ? handler : _default_handler;
             }
 
             routes &routes::add(operation_type type, const url &url, handler_base *handler) {
-                match_rule *rule = new match_rule(handler);
+                auto rule = std::make_unique<match_rule>(handler);
                 rule->add_str(url._path);
                 if (url._param != "") {
                     rule->add_param(url._param, true);
                 }
-                return add(rule, type);
+                add(rule.get(), type);
+                rule.release();
+                return *this;
             }
 
             routes &routes::add_default_handler(handler_base *handler) {
@@ -170,6 +204,7 @@ namespace nil {
             }
 
             match_rule *routes::del_cookie(rule_cookie cookie, operation_type type) {
+                _rule_trees[type].erase(cookie);
                 return delete_rule_from(type, cookie, _rules);
             }
 
@@ -0,0 +1,401 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+#include <nil/actor/http/simd_request_parser.hh>
+
+#include <array>
+#include <cstring>
+
+#include <stdexcept>
+
+// The vector scans need GCC or Clang, which build them for an instruction set the build may not target
+#if defined(__x86_64__) && defined(__GNUC__)
+#define NIL_ACTOR_HTTP_X86_SCANS
+#include <immintrin.h>
+#endif
+
+namespace nil {
+    namespace actor {
+
+        using namespace httpd;
+
+        static const std::array<bool, 256> token_chars = [] {
+            std::array<bool, 256> t {};
+            for (const char *c = "!#$%&'*+-.^_`|~"; *c; ++c) {
+                t[static_cast<unsigned char>(*c)] = true;
+            }
+            for (int c = 0; c < 256; c++) {
+                t[c] = t[c] || (c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z');
+            }
+            return t;
+        }();
+
+        static bool is_token_char(char c) {
+            return token_chars[static_cast<unsigned char>(c)];
+        }
+
+        // Header values may hold any byte but the control characters other than HT
+        static bool ends_value(char c) {
+            auto u = static_cast<unsigned char>(c);
+            return (u < 0x20 && u != '\t') || u == 0x7f;
+        }
+
+        /**
+         * Search for the blank line ending a request head
+         * @return the position after the first "\r\n\r\n" in [p, end), or nullptr
+         */
+        static const char *find_head_end(const char *p, const char *end) {
+#if defined(NIL_ACTOR_HTTP_X86_SCANS)
+            // SSE2 is part of x86-64
+            const __m128i cr = _mm_set1_epi8('\r');
+            const __m128i lf = _mm_set1_epi8('\n');
+            // compare the block and the block shifted by 1, 2 and 3 bytes
+            for (; end - p >= 19; p += 16) {
+                __m128i m0 = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)), cr);
+                __m128i m1 = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 1)), lf);
+                __m128i m2 = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 2)), cr);
+                __m128i m3 = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 3)), lf);
+                uint32_t mask = _mm_movemask_epi8(_mm_and_si128(_mm_and_si128(m0, m1), _mm_and_si128(m2, m3)));
+                if (mask) {
+                    return p + __builtin_ctz(mask) + 4;
+                }
+            }
+#endif
+            for (; end - p >= 4; ++p) {
+                if (p[0] == '\r' && p[1] == '\n' && p[2] == '\r' && p[3] == '\n') {
+                    return p + 4;
+                }
+            }
+            return nullptr;
+        }
+
+        /**
+         * Search for the end of a header value
+         * @return the first byte of [p, end) that cannot be part of a value, or end
+         */
+        static const char *find_value_end(const char *p, const char *end) {
+            for (; p != end; ++p) {
+                if (ends_value(*p)) {
+                    return p;
+                }
+            }
+            return end;
+        }
+
+        /**
+         * Search for the end of a token, such as a header name
+         * @return the first byte of [p, end) that is not a token character, or end
+         */
+        static const char *find_token_end(const char *p, const char *end) {
+            for (; p != end; ++p) {
+                if (!is_token_char(*p)) {
+                    return p;
+                }
+            }
+            return end;
+        }
+
+#if defined(NIL_ACTOR_HTTP_X86_SCANS)
+        // The scans below are built for their instruction set whatever the build targets,
+        // they only run once the CPU is known to support it
+
+        __attribute__((target("sse4.2"))) static const char *find_value_end_sse4_2(const char *p,
+                                                                                  const char *end) {
+            alignas(16) static const char value_end_ranges[16] = {0x00, 0x08, 0x0a, 0x1f, 0x7f, 0x7f};
+            const __m128i ranges = _mm_load_si128(reinterpret_cast<const __m128i *>(value_end_ranges));
+            for (; end - p >= 16; p += 16) {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+                int i = _mm_cmpestri(ranges, 6, v, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_LEAST_SIGNIFICANT);
+                if (i != 16) {
+                    return p + i;
+                }
+            }
+            return find_value_end(p, end);
+        }
+
+        __attribute__((target("sse4.2"))) static const char *find_token_end_sse4_2(const char *p,
+                                                                                  const char *end) {
+            // the ranges hold the bytes that are not token characters, and '|' and '~'
+            // which are, so a match is checked again with the table
+            alignas(16) static const char non_token_ranges[16] = {0x00, ' ', '"', '"', '(', ')', ',', ',',
+                                                                  '/',  '/', ':', '@', '[', ']', '{', '\xff'};
+            const __m128i ranges = _mm_load_si128(reinterpret_cast<const __m128i *>(non_token_ranges));
+            while (end - p >= 16) {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+                int i = _mm_cmpestri(ranges, 16, v, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_LEAST_SIGNIFICANT);
+                p += i;
+                if (i != 16) {
+                    if (!is_token_char(*p)) {
+                        return p;
+                    }
+                    ++p;
+                }
+            }
+            return find_token_end(p, end);
+        }
+
+        __attribute__((target("avx2"))) static const char *find_head_end_avx2(const char *p, const char *end) {
+            const __m256i cr = _mm256_set1_epi8('\r');
+            const __m256i lf = _mm256_set1_epi8('\n');
+            for (; end - p >= 35; p += 32) {
+                __m256i m0 = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)), cr);
+                __m256i m1 = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + 1)), lf);
+                __m256i m2 = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + 2)), cr);
+                __m256i m3 = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + 3)), lf);
+                uint32_t mask = _mm256_movemask_epi8(
+                    _mm256_and_si256(_mm256_and_si256(m0, m1), _mm256_and_si256(m2, m3)));
+                if (mask) {
+                    return p + __builtin_ctz(mask) + 4;
+                }
+            }
+            return find_head_end(p, end);
+        }
+
+        __attribute__((target("avx2"))) static const char *find_value_end_avx2(const char *p, const char *end) {
+            const __m256i space = _mm256_set1_epi8(' ');
+            const __m256i tab = _mm256_set1_epi8('\t');
+            const __m256i del = _mm256_set1_epi8(0x7f);
+            for (; end - p >= 32; p += 32) {
+                __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+                // unsigned v >= ' ', as max(v, ' ') == v
+                __m256i printable = _mm256_cmpeq_epi8(_mm256_max_epu8(v, space), v);
+                __m256i ok = _mm256_andnot_si256(_mm256_cmpeq_epi8(v, del),
+                                                 _mm256_or_si256(printable, _mm256_cmpeq_epi8(v, tab)));
+                uint32_t bad = ~static_cast<uint32_t>(_mm256_movemask_epi8(ok));
+                if (bad) {
+                    return p + __builtin_ctz(bad);
+                }
+            }
+            return find_value_end_sse4_2(p, end);
+        }
+#endif
+
+        struct simd_request_parser::scans {
+            const char *(*head_end)(const char *, const char *);
+            const char *(*value_end)(const char *, const char *);
+            const char *(*token_end)(const char *, const char *);
+        };
+
+        static const simd_request_parser::scans generic_scans = {find_head_end, find_value_end, find_token_end};
+#if defined(NIL_ACTOR_HTTP_X86_SCANS)
+        static const simd_request_parser::scans sse4_2_scans = {find_head_end, find_value_end_sse4_2,
+                                                                find_token_end_sse4_2};
+        // there is no 32 byte version of the token scan, every AVX2 CPU has SSE4.2
+        static const simd_request_parser::scans avx2_scans = {find_head_end_avx2, find_value_end_avx2,
+                                                              find_token_end_sse4_2};
+#endif
+
+        bool simd_request_parser::supports(isa set) {
+#if defined(NIL_ACTOR_HTTP_X86_SCANS)
+            __builtin_cpu_init();
+            switch (set) {
+                case isa::generic:
+                    return true;
+                case isa::sse4_2:
+                    return __builtin_cpu_supports("sse4.2");
+                case isa::avx2:
+                    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("sse4.2");
+            }
+            return false;
+#else
+            return set == isa::generic;
+#endif
+        }
+
+        simd_request_parser::isa simd_request_parser::best_isa() {
+            static const isa best = supports(isa::avx2)     ? isa::avx2
+                                    : supports(isa::sse4_2) ? isa::sse4_2
+                                                            : isa::generic;
+            return best;
+        }
+
+        simd_request_parser::simd_request_parser(isa set) {
+            if (!supports(set)) {
+                throw std::invalid_argument("simd_request_parser: the CPU does not support the instruction set");
+            }
+            switch (set) {
+#if defined(NIL_ACTOR_HTTP_X86_SCANS)
+                case isa::avx2:
+                    _scans = &avx2_scans;
+                    break;
+                case isa::sse4_2:
+                    _scans = &sse4_2_scans;
+                    break;
+#endif
+                default:
+                    _scans = &generic_scans;
+                    break;
+            }
+        }
+
+        // The first "\r\n" of [p, end), which must hold one
+        static const char *find_crlf(const char *p, const char *end) {
+            while (true) {
+                p = static_cast<const char *>(memchr(p, '\r', end - p));
+                if (p[1] == '\n') {
+                    return p;
+                }
+                ++p;
+            }
+        }
+
+        static const char *skip_sp_ht(const char *p) {
+            while (*p == ' ' || *p == '\t') {
+                ++p;
+            }
+            return p;
+        }
+
+        /**
+         * Parse a header value up to the end of its line, without the
+         * trailing white space
+         * @return false if the value holds a byte that is not allowed
+         */
+        static bool parse_value(const simd_request_parser::scans &scans, const char *&p, const char *end,
+                                std::string_view &value) {
+            const char *value_end = scans.value_end(p, end);
+            if (value_end[0] != '\r' || value_end[1] != '\n') {
+                return false;
+            }
+            const char *e = value_end;
+            while (e != p && (e[-1] == ' ' || e[-1] == '\t')) {
+                --e;
+            }
+            value = std::string_view(p, e - p);
+            p = value_end + 2;
+            return true;
+        }
+
+        static bool is_digit(char c) {
+            return c >= '0' && c <= '9';
+        }
+
+        void simd_request_parser::init() {
+            _req = std::make_unique<request>();
+            _partial.clear();
+            _state = state::eof;
+        }
+
+        future<simd_request_parser::unconsumed_remainder>
+            simd_request_parser::operator()(temporary_buffer<char> buf) {
+            if (buf.empty()) {
+                _state = state::eof;
+                return make_ready_future<unconsumed_remainder>(std::move(buf));
+            }
+            _state = state::error;
+            temporary_buffer<char> head;
+            if (_partial.empty()) {
+                auto head_end = _scans->head_end(buf.begin(), buf.end());
+                if (head_end == nullptr) {
+                    _partial.assign(buf.begin(), buf.end());
+                } else {
+                    size_t len = head_end - buf.begin();
+                    head = buf.share(0, len);
+                    buf.trim_front(len);
+                }
+            } else {
+                size_t old = _partial.size();
+                _partial.insert(_partial.end(), buf.begin(), buf.end());
+                // the blank line may start in the bytes that were already there
+                auto from = _partial.data() + (old < 3 ? 0 : old - 3);
+                auto head_end = _scans->head_end(from, _partial.data() + _partial.size());
+                if (head_end != nullptr) {
+                    size_t len = head_end - _partial.data();
+                    head = temporary_buffer<char>(_partial.data(), len);
+                    buf.trim_front(len - old);
+                    _partial.clear();
+                }
+            }
+            if (head.empty()) {
+                if (_partial.size() > max_head_size) {
+                    return make_ready_future<unconsumed_remainder>(temporary_buffer<char>());
+                }
+                return make_ready_future<unconsumed_remainder>();
+            }
+            if (head.size() > max_head_size) {
+                return make_ready_future<unconsumed_remainder>(temporary_buffer<char>());
+            }
+            if (parse(std::move(head))) {
+                _state = state::done;
+            }
+            return make_ready_future<unconsumed_remainder>(std::move(buf));
+        }
+
+        bool simd_request_parser::parse(temporary_buffer<char> buf) {
+            auto &headers = _req->_headers;
+            auto head = headers.arena().adopt(std::move(buf));
+            // the head ends with "\r\n\r\n", which stops all the scans below
+            const char *p = head.data();
+            const char *end = p + head.size();
+
+            const char *line_end = find_crlf(p, end);
+            const char *method_end = p;
+            while (*method_end >= 'A' && *method_end <= 'Z') {
+                ++method_end;
+            }
+            if (method_end == p || *method_end != ' ') {
+                return false;
+            }
+            _req->_method = sstring(p, method_end - p);
+            const char *uri = method_end + 1;
+            auto uri_end = static_cast<const char *>(memchr(uri, ' ', line_end - uri));
+            if (uri_end == nullptr || uri_end == uri) {
+                return false;
+            }
+            _req->_url = sstring(uri, uri_end - uri);
+            const char *v = uri_end + 1;
+            if (line_end - v != 8 || memcmp(v, "HTTP/", 5) != 0 || !is_digit(v[5]) || v[6] != '.' ||
+                !is_digit(v[7])) {
+                return false;
+            }
+            _req->_version = sstring(v + 5, 3);
+
+            p = line_end + 2;
+            std::string_view name;
+            while (p[0] != '\r' || p[1] != '\n') {
+                std::string_view value;
+                if (*p == ' ' || *p == '\t') {
+                    // obs-fold, the value continues the previous header
+                    p = skip_sp_ht(p);
+                    if (name.empty() || !parse_value(*_scans, p, end, value)) {
+                        return false;
+                    }
+                    headers.add(name, value, " ");
+                    continue;
+                }
+                const char *name_end = _scans->token_end(p, end);
+                if (name_end == p || *name_end != ':') {
+                    return false;
+                }
+                name = std::string_view(p, name_end - p);
+                p = skip_sp_ht(name_end + 1);
+                if (!parse_value(*_scans, p, end, value)) {
+                    return false;
+                }
+                headers.add_stored(name, value);
+            }
+            return true;
+        }
+
+    }    // namespace actor
+}    // namespace nil
@@ -38,11 +38,15 @@
 #include <linux/netlink.h>
 #include <linux/rtnetlink.h>
 
+#include <sys/sendfile.h>
+
 #elif defined(__APPLE__)
 
 #include <net/if.h>
 #include <net/route.h>
 
+#include <sys/uio.h>
+
 #define __APPLE_USE_RFC_3542 1
 
 #include <netinet/in.h>
@@ -75,6 +79,7 @@
 #endif
 
 #include <nil/actor/core/loop.hh>
+#include <nil/actor/core/posix.hh>
 #include <nil/actor/core/reactor.hh>
 #include <nil/actor/network/posix-stack.hh>
 #include <nil/actor/network/net.hh>
@@ -311,6 +316,10 @@ namespace nil {
                 int get_sockopt(int level, int optname, void *data, size_t len) const override {
                     return _ops->get_sockopt(_fd.get_file_desc(), level, optname, data, len);
                 }
+                bool supports_sendfile() const override {
+                    return true;
+                }
+                future<> sendfile(file_desc &fd, uint64_t offset, size_t size) override;
                 friend class posix_server_socket_impl;
                 friend class posix_ap_server_socket_impl;
                 friend class posix_reuseport_server_socket_impl;
@@ -697,6 +706,45 @@ namespace nil {
                 return _fd.write_all(_p).then([this] { _p.reset(); });
             }
 
+            // Sends up to count bytes of the file from offset, advancing it, returns -1 with errno set on error.
+            static ssize_t sendfile_some(int out_fd, int in_fd, off_t &offset, size_t count) {
+#if defined(__linux__)
+                return ::sendfile(out_fd, in_fd, &offset, count);
+#else
+                off_t sent = count;
+                auto r = ::sendfile(in_fd, out_fd, offset, &sent, nullptr, 0);
+                // a partial write fails with EAGAIN, having sent some of the data
+                if (r < 0 && !(errno == EAGAIN && sent > 0)) {
+                    return -1;
+                }
+                offset += sent;
+                return sent;
+#endif
+            }
+
+            future<> posix_connected_socket_impl::sendfile(file_desc &fd, uint64_t offset, size_t size) {
+                // bounds the time a call may spend copying the file to the socket
+                static constexpr size_t max_chunk = 1 << 20;
+                return do_with(off_t(offset), size, [this, &fd](off_t &offset, size_t &remaining) {
+                    return do_until([&remaining] { return remaining == 0; }, [this, &fd, &offset, &remaining] {
+                        auto r = sendfile_some(_fd.get_fd(), fd.get(), offset, std::min(remaining, max_chunk));
+                        if (r < 0) {
+                            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                                return _fd.writeable();
+                            }
+                            return make_exception_future<>(
+                                std::system_error(errno, std::system_category(), "sendfile"));
+                        }
+                        if (r == 0) {
+                            return make_exception_future<>(
+                                std::runtime_error("sendfile: the file ended before the range"));
+                        }
+                        remaining -= r;
+                        return make_ready_future<>();
+                    });
+                });
+            }
+
             future<> posix_data_sink_impl::close() {
                 _fd.shutdown(SHUT_WR);
                 return make_ready_future<>();
@@ -25,6 +25,8 @@
 #include <nil/actor/network/stack.hh>
 #include <nil/actor/network/inet_address.hh>
 
+#include <system_error>
+
 namespace nil {
     namespace actor {
 
@@ -98,9 +100,8 @@ namespace nil {
             return input_stream<char>(_csi->source(csisc));
         }
 
-        output_stream<char> connected_socket::output(size_t buffer_size) {
-            // TODO: allow user to determine buffer size etc
-            return output_stream<char>(_csi->sink(), buffer_size, false, true);
+        output_stream<char> connected_socket::output(size_t buffer_size, bool batch_flushes) {
+            return output_stream<char>(_csi->sink(), buffer_size, false, batch_flushes);
         }
 
         void connected_socket::set_nodelay(bool nodelay) {
@@ -137,11 +138,27 @@ namespace nil {
             _csi->shutdown_input();
         }
 
+        bool connected_socket::supports_sendfile() const {
+            return _csi->supports_sendfile();
+        }
+
+        future<> connected_socket::sendfile(file_desc &fd, uint64_t offset, size_t size) {
+            return _csi->sendfile(fd, offset, size);
+        }
+
         data_source net::connected_socket_impl::source(connected_socket_input_stream_config csisc) {
             // Default implementation falls back to non-parameterized data_source
             return source();
         }
 
+        bool net::connected_socket_impl::supports_sendfile() const {
+            return false;
+        }
+
+        future<> net::connected_socket_impl::sendfile(file_desc &fd, uint64_t offset, size_t size) {
+            return make_exception_future<>(std::system_error(ENOTSUP, std::system_category(), "sendfile"));
+        }
+
         socket::~socket() {
         }
 
@@ -55,6 +55,9 @@ namespace nil {
             static std::unique_ptr<connected_socket_impl> get(connected_socket s) {
                 return std::move(s._csi);
             }
+            static connected_socket_impl *maybe_get_ptr(connected_socket &s) {
+                return s._csi.get();
+            }
         };
 
         class blob_wrapper : public gnutls_datum_t {
@@ -406,6 +409,13 @@ namespace nil {
                 _dn_callback = std::move(cb);
             }
 
+            void set_alpn_protocols(const std::vector<sstring> &protocols) {
+                _alpn_protocols = protocols;
+            }
+            const std::vector<sstring> &get_alpn_protocols() const {
+                return _alpn_protocols;
+            }
+
         private:
             friend class credentials_builder;
             friend class session;
@@ -429,6 +439,7 @@ namespace nil {
             bool _load_system_trust = false;
             semaphore _system_trust_sem {1};
             dn_callback _dn_callback;
+            std::vector<sstring> _alpn_protocols;
         };
 
         tls::certificate_credentials::certificate_credentials() : _impl(make_shared<impl>()) {
@@ -494,6 +505,14 @@ namespace nil {
             _impl->set_priority_string(prio);
         }
 
+        void tls::certificate_credentials::set_alpn_protocols(const std::vector<sstring> &protocols) {
+            _impl->set_alpn_protocols(protocols);
+        }
+
+        const std::vector<sstring> &tls::certificate_credentials::get_alpn_protocols() const {
+            return _impl->get_alpn_protocols();
+        }
+
         void tls::certificate_credentials::set_dn_verification_callback(dn_callback cb) {
             _impl->set_dn_verification_callback(std::move(cb));
         }
@@ -626,6 +645,10 @@ namespace nil {
             _priority = prio;
         }
 
+        void tls::credentials_builder::set_alpn_protocols(const std::vector<sstring> &protocols) {
+            _alpn_protocols = protocols;
+        }
+
         template<typename Blobs, typename Visitor>
         static void visit_blobs(Blobs &blobs, Visitor &&visitor) {
             auto visit = [&](const sstring &key, auto *vt) {
@@ -672,6 +695,9 @@ namespace nil {
             }
 
             creds._impl->set_client_auth(_client_auth);
+            if (!_alpn_protocols.empty()) {
+                creds.set_alpn_protocols(_alpn_protocols);
+            }
         }
 
         shared_ptr<tls::certificate_credentials> tls::credentials_builder::build_certificate_credentials() const {
@@ -717,7 +743,8 @@ namespace nil {
                 };
 
                 session(type t, shared_ptr<tls::certificate_credentials> creds,
-                        std::unique_ptr<net::connected_socket_impl> sock, sstring name = {}) :
+                        std::unique_ptr<net::connected_socket_impl> sock, sstring name = {},
+                        std::vector<sstring> alpn_protocols = {}) :
                     _type(t),
                     _sock(std::move(sock)), _creds(creds->_impl), _hostname(std::move(name)), _in(_sock->source()),
                     _out(_sock->sink()), _in_sem(1), _out_sem(1), _output_pending(make_ready_future<>()),
@@ -750,6 +777,18 @@ namespace nil {
                         gtls_chk(gnutls_priority_set(*this, prio));
                     }
 
+                    // the protocols of the listener, if any, take the place of the ones of the credentials
+                    auto &protocols = alpn_protocols.empty() ? _creds->get_alpn_protocols() : alpn_protocols;
+                    if (!protocols.empty()) {
+                        // gnutls copies the names
+                        std::vector<gnutls_datum_t> names;
+                        for (auto &p : protocols) {
+                            names.push_back(blob_wrapper(p));
+                        }
+                        gtls_chk(gnutls_alpn_set_protocols(*this, names.data(), names.size(),
+                                                           _type == type::SERVER ? GNUTLS_ALPN_SERVER_PRECEDENCE : 0));
+                    }
+
                     gnutls_transport_set_ptr(*this, this);
                     gnutls_transport_set_vec_push_function(*this, &vec_push_wrapper);
                     gnutls_transport_set_pull_function(*this, &pull_wrapper);
@@ -762,8 +801,10 @@ namespace nil {
                     }
 #endif
                 }
-                session(type t, shared_ptr<certificate_credentials> creds, connected_socket sock, sstring name = {}) :
-                    session(t, std::move(creds), net::get_impl::get(std::move(sock)), std::move(name)) {
+                session(type t, shared_ptr<certificate_credentials> creds, connected_socket sock, sstring name = {},
+                        std::vector<sstring> alpn_protocols = {}) :
+                    session(t, std::move(creds), net::get_impl::get(std::move(sock)), std::move(name),
+                            std::move(alpn_protocols)) {
                 }
 
                 ~session() {
@@ -835,6 +876,15 @@ namespace nil {
                         _in_sem, 1, [this] { return with_semaphore(_out_sem, 1, [this] { return do_handshake(); }); });
                 }
 
+                // the protocol negotiated with ALPN, valid once the handshake is done
+                sstring alpn_protocol() {
+                    gnutls_datum_t protocol;
+                    if (gnutls_alpn_get_selected_protocol(*this, &protocol) != GNUTLS_E_SUCCESS) {
+                        return {};
+                    }
+                    return sstring(reinterpret_cast<const char *>(protocol.data), protocol.size);
+                }
+
                 size_t in_avail() const {
                     return _input.size();
                 }
@@ -1274,6 +1324,10 @@ namespace nil {
                 int get_sockopt(int level, int optname, void *data, size_t len) const override {
                     return _session->socket().get_sockopt(level, optname, data, len);
                 }
+
+                future<sstring> alpn_protocol() {
+                    return _session->handshake().then([session = _session] { return session->alpn_protocol(); });
+                }
             };
 
             class tls_connected_socket_impl::source_impl : public data_source_impl, public session::session_ref {
@@ -1314,15 +1368,17 @@ namespace nil {
 
             class server_session : public net::server_socket_impl {
             public:
-                server_session(shared_ptr<server_credentials> creds, server_socket sock) :
-                    _creds(std::move(creds)), _sock(std::move(sock)) {
+                server_session(shared_ptr<server_credentials> creds, server_socket sock,
+                               std::vector<sstring> alpn_protocols) :
+                    _creds(std::move(creds)),
+                    _sock(std::move(sock)), _alpn_protocols(std::move(alpn_protocols)) {
                 }
                 future<accept_result> accept() override {
                     // We're not actually doing anything very SSL until we get
                     // an actual connection. Then we create a "server" session
                     // and wrap it up after handshaking.
                     return _sock.accept().then([this](accept_result ar) {
-                        return wrap_server(_creds, std::move(ar.connection))
+                        return wrap_server(_creds, std::move(ar.connection), _alpn_protocols)
                             .then([addr = std::move(ar.remote_address)](connected_socket s) {
                                 return make_ready_future<accept_result>(accept_result {std::move(s), addr});
                             });
@@ -1338,6 +1394,7 @@ namespace nil {
             private:
                 shared_ptr<server_credentials> _creds;
                 server_socket _sock;
+                std::vector<sstring> _alpn_protocols;
             };
 
             class tls_socket_impl : public net::socket_impl {
@@ -1406,7 +1463,13 @@ namespace nil {
         }
 
         future<connected_socket> tls::wrap_server(shared_ptr<server_credentials> cred, connected_socket &&s) {
-            session::session_ref sess(make_lw_shared<session>(session::type::SERVER, std::move(cred), std::move(s)));
+            return wrap_server(std::move(cred), std::move(s), {});
+        }
+
+        future<connected_socket> tls::wrap_server(shared_ptr<server_credentials> cred, connected_socket &&s,
+                                                  std::vector<sstring> alpn_protocols) {
+            session::session_ref sess(make_lw_shared<session>(session::type::SERVER, std::move(cred), std::move(s),
+                                                              sstring(), std::move(alpn_protocols)));
             connected_socket sock(std::make_unique<tls_connected_socket_impl>(std::move(sess)));
             return make_ready_future<connected_socket>(std::move(sock));
         }
@@ -1416,9 +1479,27 @@ namespace nil {
         }
 
         server_socket tls::listen(shared_ptr<server_credentials> creds, server_socket ss) {
-            server_socket ssls(std::make_unique<server_session>(creds, std::move(ss)));
+            return listen(std::move(creds), std::move(ss), {});
+        }
+
+        server_socket tls::listen(shared_ptr<server_credentials> creds, socket_address sa, listen_options opts,
+                                  std::vector<sstring> alpn_protocols) {
+            return listen(std::move(creds), nil::actor::listen(sa, opts), std::move(alpn_protocols));
+        }
+
+        server_socket tls::listen(shared_ptr<server_credentials> creds, server_socket ss,
+                                  std::vector<sstring> alpn_protocols) {
+            server_socket ssls(std::make_unique<server_session>(creds, std::move(ss), std::move(alpn_protocols)));
             return server_socket(std::move(ssls));
         }
 
+        future<sstring> tls::get_alpn_protocol(connected_socket &s) {
+            auto impl = dynamic_cast<tls_connected_socket_impl *>(net::get_impl::maybe_get_ptr(s));
+            if (!impl) {
+                return make_ready_future<sstring>();
+            }
+            return impl->alpn_protocol();
+        }
+
     }    // namespace actor
 }    // namespace nil
@@ -0,0 +1,314 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+
+#include <nil/actor/rpc/in_process_transport.hh>
+#include <nil/actor/core/do_with.hh>
+#include <nil/actor/core/loop.hh>
+#include <nil/actor/core/semaphore.hh>
+#include <nil/actor/core/smp.hh>
+
+#include <system_error>
+
+namespace nil {
+    namespace actor {
+
+        namespace rpc {
+
+            // The receiving end of one direction of a connection, lives on the shard of the reader.
+            class in_process_pipe {
+                queue<temporary_buffer<char>> _q;
+                // writes are applied in the order they arrive, so an end of file follows the data before it
+                semaphore _write_sem {1};
+                bool _aborted = false;
+                bool _eof = false;
+
+                static std::exception_ptr broken_pipe() {
+                    return std::make_exception_ptr(std::system_error(EPIPE, std::system_category()));
+                }
+
+            public:
+                explicit in_process_pipe(size_t max_buffers) : _q(max_buffers) {
+                }
+                future<> push(std::vector<temporary_buffer<char>> bufs) {
+                    return with_semaphore(_write_sem, 1, [this, bufs = std::move(bufs)]() mutable {
+                        if (_aborted || _eof) {
+                            return make_exception_future<>(broken_pipe());
+                        }
+                        return do_with(std::move(bufs), [this](std::vector<temporary_buffer<char>> &bufs) {
+                            return do_for_each(bufs, [this](temporary_buffer<char> &b) {
+                                // an empty buffer would read as end of file
+                                return b.empty() ? make_ready_future<>() : _q.push_eventually(std::move(b));
+                            });
+                        });
+                    });
+                }
+                // Queues an end of file after the data written so far. Both shutdown_output() and closing
+                // the sink end the stream, whichever comes second has nothing left to do.
+                future<> push_eof() {
+                    return with_semaphore(_write_sem, 1, [this] {
+                        if (_aborted) {
+                            return make_exception_future<>(broken_pipe());
+                        }
+                        if (_eof) {
+                            return make_ready_future<>();
+                        }
+                        _eof = true;
+                        return _q.push_eventually(temporary_buffer<char>());
+                    });
+                }
+                future<temporary_buffer<char>> pop() {
+                    if (_aborted) {
+                        return make_exception_future<temporary_buffer<char>>(broken_pipe());
+                    }
+                    return _q.pop_eventually();
+                }
+                void shutdown() {
+                    _aborted = true;
+                    _q.abort(broken_pipe());
+                }
+            };
+
+            // the writer's handle of the pipe on the peer's shard
+            using foreign_pipe = lw_shared_ptr<foreign_ptr<lw_shared_ptr<in_process_pipe>>>;
+
+            // Runs func on the shard of the pipe, which is kept alive until func completes.
+            template<typename Func>
+            static future<> with_pipe(const foreign_pipe &pipe, Func func) {
+                auto shard = pipe->get_owner_shard();
+                if (shard == this_shard_id()) {
+                    return futurize_invoke(func, **pipe).finally([pipe] {});
+                }
+                return smp::submit_to(shard, [p = pipe->get(), func = std::move(func)]() mutable { return func(*p); })
+                    .finally([pipe] {});
+            }
+
+            using buffers = std::vector<temporary_buffer<char>>;
+
+            // Makes buffers written on another shard usable on this one without copying them, they are
+            // freed on their own shard once the last of them is released.
+            static buffers import_buffers(foreign_ptr<std::unique_ptr<buffers>> org) {
+                if (org.get_owner_shard() == this_shard_id()) {
+                    return std::move(*org);
+                }
+                auto &orgbufs = *org;
+                buffers ret;
+                ret.reserve(orgbufs.size());
+                deleter d = make_object_deleter(std::move(org));
+                for (auto &&b : orgbufs) {
+                    ret.push_back(temporary_buffer<char>(b.get_write(), b.size(), d.share()));
+                }
+                return ret;
+            }
+
+            class in_process_data_sink_impl : public data_sink_impl {
+                foreign_pipe _tx;
+
+            public:
+                explicit in_process_data_sink_impl(foreign_pipe tx) : _tx(std::move(tx)) {
+                }
+                future<> put(net::packet data) override {
+                    auto bufs = make_foreign(std::make_unique<buffers>(data.release()));
+                    return with_pipe(_tx, [bufs = std::move(bufs)](in_process_pipe &p) mutable {
+                        return p.push(import_buffers(std::move(bufs)));
+                    });
+                }
+                future<> close() override {
+                    return with_pipe(_tx, [](in_process_pipe &p) { return p.push_eof(); })
+                        .handle_exception_type([](std::system_error &err) {
+                            // the reader is gone already
+                            if (err.code().value() != EPIPE) {
+                                throw;
+                            }
+                        });
+                }
+            };
+
+            class in_process_data_source_impl : public data_source_impl {
+                lw_shared_ptr<in_process_pipe> _rx;
+                bool _eof = false;
+
+            public:
+                explicit in_process_data_source_impl(lw_shared_ptr<in_process_pipe> rx) : _rx(std::move(rx)) {
+                }
+                future<temporary_buffer<char>> get() override {
+                    if (_eof) {
+                        return make_ready_future<temporary_buffer<char>>();
+                    }
+                    return _rx->pop().then([this](temporary_buffer<char> b) {
+                        _eof = b.empty();
+                        return b;
+                    });
+                }
+                future<> close() override {
+                    if (!_eof) {
+                        _rx->shutdown();
+                    }
+                    return make_ready_future<>();
+                }
+            };
+
+            class in_process_connected_socket_impl : public net::connected_socket_impl {
+                foreign_pipe _tx;
+                lw_shared_ptr<in_process_pipe> _rx;
+
+            public:
+                in_process_connected_socket_impl(foreign_pipe tx, lw_shared_ptr<in_process_pipe> rx) :
+                    _tx(std::move(tx)), _rx(std::move(rx)) {
+                }
+                data_source source() override {
+                    return data_source(std::make_unique<in_process_data_source_impl>(_rx));
+                }
+                data_sink sink() override {
+                    return data_sink(std::make_unique<in_process_data_sink_impl>(_tx));
+                }
+                void shutdown_input() override {
+                    _rx->shutdown();
+                }
+                void shutdown_output() override {
+                    // like a half-closed TCP connection, the reader still gets what was written before
+                    (void)with_pipe(_tx, [](in_process_pipe &p) { return p.push_eof(); })
+                        .handle_exception([](std::exception_ptr) {
+                            // the reader is gone already
+                        });
+                }
+                void set_nodelay(bool nodelay) override {
+                }
+                bool get_nodelay() const override {
+                    return true;
+                }
+                void set_keepalive(bool keepalive) override {
+                }
+                bool get_keepalive() const override {
+                    return false;
+                }
+                void set_keepalive_parameters(const net::keepalive_params &) override {
+                }
+                net::keepalive_params get_keepalive_parameters() const override {
+                    return net::tcp_keepalive_params {std::chrono::seconds(0), std::chrono::seconds(0), 0};
+                }
+                void set_sockopt(int level, int optname, const void *data, size_t len) override {
+                    throw std::runtime_error("Setting custom socket options is not supported for in-process sockets");
+                }
+                int get_sockopt(int level, int optname, void *data, size_t len) const override {
+                    throw std::runtime_error("Getting custom socket options is not supported for in-process sockets");
+                }
+            };
+
+            static connected_socket make_in_process_connected_socket(foreign_ptr<lw_shared_ptr<in_process_pipe>> tx,
+                                                                     lw_shared_ptr<in_process_pipe> rx) {
+                auto tx_ptr = make_lw_shared<foreign_ptr<lw_shared_ptr<in_process_pipe>>>(std::move(tx));
+                return connected_socket(
+                    std::make_unique<in_process_connected_socket_impl>(std::move(tx_ptr), std::move(rx)));
+            }
+
+            class in_process_server_socket_impl : public net::server_socket_impl {
+                lw_shared_ptr<queue<connected_socket>> _pending;
+
+            public:
+                explicit in_process_server_socket_impl(lw_shared_ptr<queue<connected_socket>> pending) :
+                    _pending(std::move(pending)) {
+                }
+                future<accept_result> accept() override {
+                    return _pending->pop_eventually().then([](connected_socket &&cs) {
+                        return make_ready_future<accept_result>(accept_result {std::move(cs), socket_address()});
+                    });
+                }
+                void abort_accept() override {
+                    _pending->abort(std::make_exception_ptr(std::system_error(ECONNABORTED, std::system_category())));
+                }
+                socket_address local_address() const override {
+                    return {};
+                }
+            };
+
+            class in_process_socket_impl : public net::socket_impl {
+                in_process_transport &_transport;
+                unsigned _shard;
+                lw_shared_ptr<in_process_pipe> _rx;
+
+            public:
+                in_process_socket_impl(in_process_transport &transport, unsigned shard) :
+                    _transport(transport), _shard(shard) {
+                }
+                future<connected_socket> connect(socket_address sa, socket_address local,
+                                                 nil::actor::transport proto = nil::actor::transport::TCP) override {
+                    _rx = make_lw_shared<in_process_pipe>(_transport.max_queued_buffers());
+                    return smp::submit_to(
+                               _shard,
+                               [&transport = _transport, client_rx = make_foreign(_rx)]() mutable {
+                                   using ret_type = foreign_ptr<lw_shared_ptr<in_process_pipe>>;
+                                   auto listener = transport.listener();
+                                   if (!listener) {
+                                       return make_exception_future<ret_type>(
+                                           std::system_error(ECONNREFUSED, std::system_category()));
+                                   }
+                                   auto server_rx = make_lw_shared<in_process_pipe>(transport.max_queued_buffers());
+                                   auto cs = make_in_process_connected_socket(std::move(client_rx), server_rx);
+                                   return listener->push_eventually(std::move(cs)).then([server_rx] {
+                                       return make_foreign(server_rx);
+                                   });
+                               })
+                        .then([this](foreign_ptr<lw_shared_ptr<in_process_pipe>> server_rx) {
+                            return make_in_process_connected_socket(std::move(server_rx), _rx);
+                        });
+                }
+                void set_reuseaddr(bool reuseaddr) override {
+                }
+                bool get_reuseaddr() const override {
+                    return false;
+                }
+                void shutdown() override {
+                    if (_rx) {
+                        _rx->shutdown();
+                    }
+                }
+            };
+
+            // connections made to a server that has not accepted them yet, before connect() has to wait
+            static constexpr size_t max_pending_connections = 10;
+
+            in_process_transport::in_process_transport(size_t max_queued_buffers) :
+                _listeners(smp::count), _max_queued_buffers(max_queued_buffers) {
+            }
+
+            server_socket in_process_transport::listen() {
+                // a stopped server aborted the previous queue, start afresh
+                auto &pending = _listeners[this_shard_id()];
+                pending = make_lw_shared<queue<connected_socket>>(max_pending_connections);
+                return server_socket(std::make_unique<in_process_server_socket_impl>(pending));
+            }
+
+            socket in_process_transport::make_socket(boost::optional<unsigned> shard) {
+                return socket(std::make_unique<in_process_socket_impl>(*this, shard.value_or(this_shard_id())));
+            }
+
+            future<> in_process_transport::stop() {
+                return smp::invoke_on_all([this] { _listeners[this_shard_id()] = nullptr; });
+            }
+
+        }    // namespace rpc
+
+    }    // namespace actor
+}    // namespace nil
@@ -0,0 +1,151 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+
+#include <nil/actor/rpc/latency_metrics.hh>
+#include <nil/actor/core/metrics.hh>
+
+#include <cmath>
+
+namespace nil {
+    namespace actor {
+        namespace rpc {
+
+            size_t latency_histogram::bucket_of(uint64_t us) noexcept {
+                constexpr uint64_t max_value = (uint64_t(1) << max_value_bits) - 1;
+                us = std::min(us, max_value);
+                if (us < (uint64_t(1) << sub_bucket_bits)) {
+                    return us;
+                }
+                unsigned msb = 63 - __builtin_clzll(us);
+                unsigned shift = msb - sub_bucket_bits;
+                auto sub_bucket = (us >> shift) - (uint64_t(1) << sub_bucket_bits);
+                return (size_t(shift + 1) << sub_bucket_bits) + sub_bucket;
+            }
+
+            uint64_t latency_histogram::upper_bound_of(size_t bucket) noexcept {
+                if (bucket < (size_t(1) << sub_bucket_bits)) {
+                    return bucket;
+                }
+                unsigned shift = (bucket >> sub_bucket_bits) - 1;
+                auto mantissa = (bucket & ((size_t(1) << sub_bucket_bits) - 1)) + (uint64_t(1) << sub_bucket_bits);
+                return ((mantissa + 1) << shift) - 1;
+            }
+
+            void latency_histogram::record(duration d) noexcept {
+                auto us = std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+                auto value = us > 0 ? uint64_t(us) : 0;
+                _buckets[bucket_of(value)]++;
+                _count++;
+                _sum += value;
+            }
+
+            latency_histogram::duration latency_histogram::quantile(double q) const noexcept {
+                if (!_count) {
+                    return duration::zero();
+                }
+                auto target = std::max<uint64_t>(1, uint64_t(std::ceil(q * _count)));
+                uint64_t seen = 0;
+                for (size_t i = 0; i < bucket_count; ++i) {
+                    seen += _buckets[i];
+                    if (seen >= target) {
+                        return std::chrono::microseconds(upper_bound_of(i));
+                    }
+                }
+                return std::chrono::microseconds(upper_bound_of(bucket_count - 1));
+            }
+
+            metrics::histogram latency_histogram::to_metrics_histogram() const {
+                metrics::histogram h;
+                h.sample_count = _count;
+                h.sample_sum = _sum;
+                constexpr size_t sub_buckets = size_t(1) << sub_bucket_bits;
+                h.buckets.resize(bucket_count / sub_buckets);
+                uint64_t cumulative = 0;
+                for (size_t i = 0; i < bucket_count; ++i) {
+                    cumulative += _buckets[i];
+                    if ((i + 1) % sub_buckets == 0) {
+                        auto &b = h.buckets[i / sub_buckets];
+                        b.count = cumulative;
+                        b.upper_bound = upper_bound_of(i) + 1;
+                    }
+                }
+                return h;
+            }
+
+            latency_metrics::latency_metrics(sstring service) : _service(std::move(service)) {
+            }
+
+            latency_metrics::client_verb &latency_metrics::client(uint64_t verb) {
+                auto &v = _client[verb];
+                if (!v) {
+                    namespace sm = nil::actor::metrics;
+                    v = std::make_unique<client_verb>();
+                    std::vector<sm::label_instance> labels {sm::label_instance("service", _service),
+                                                            sm::label_instance("verb", verb)};
+                    auto p = v.get();
+                    _metric_groups.add_group(
+                        "rpc_client",
+                        {sm::make_histogram(
+                             "latency", [p] { return p->latency.to_metrics_histogram(); },
+                             sm::description("Time from sending a request until its reply arrives in microseconds"),
+                             labels),
+                         sm::make_histogram(
+                             "queue_latency", [p] { return p->queue.to_metrics_histogram(); },
+                             sm::description("Time a request waits in the outgoing queue in microseconds"), labels)});
+                }
+                return *v;
+            }
+
+            latency_metrics::server_verb &latency_metrics::server(uint64_t verb) {
+                auto &v = _server[verb];
+                if (!v) {
+                    namespace sm = nil::actor::metrics;
+                    v = std::make_unique<server_verb>();
+                    std::vector<sm::label_instance> labels {sm::label_instance("service", _service),
+                                                            sm::label_instance("verb", verb)};
+                    auto p = v.get();
+                    _metric_groups.add_group(
+                        "rpc_server",
+                        {sm::make_histogram(
+                             "latency", [p] { return p->latency.to_metrics_histogram(); },
+                             sm::description("Time from arrival of a request until its response is queued "
+                                             "in microseconds"),
+                             labels),
+                         sm::make_histogram(
+                             "queue_latency", [p] { return p->queue.to_metrics_histogram(); },
+                             sm::description("Time a response waits in the outgoing queue in microseconds"), labels),
+                         sm::make_histogram(
+                             "semaphore_latency", [p] { return p->semaphore.to_metrics_histogram(); },
+                             sm::description("Time a request waits for memory resources in microseconds"), labels),
+                         sm::make_histogram(
+                             "handler_latency", [p] { return p->handler.to_metrics_histogram(); },
+                             sm::description("Time spent in the handler in microseconds"), labels)});
+                }
+                return *v;
+            }
+
+        }    // namespace rpc
+    }        // namespace actor
+}    // namespace nil
@@ -31,6 +31,11 @@
 
 #include <boost/range/adaptor/map.hpp>
 
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <stdexcept>
+
 namespace nil {
     namespace actor {
 
@@ -93,6 +98,97 @@ namespace nil {
                 }
             }
 
+            rcv_buf split_rcv_buf(rcv_buf &buf, size_t n) {
+                if (n > buf.size) {
+                    throw std::out_of_range(format("split_rcv_buf: {:d} bytes requested of {:d}", n, buf.size));
+                }
+                buf.size -= n;
+                if (auto *one = std::get_if<temporary_buffer<char>>(&buf.bufs)) {
+                    if (n == one->size()) {
+                        return rcv_buf(std::exchange(*one, temporary_buffer<char>()));
+                    }
+                    auto head = one->share(0, n);
+                    one->trim_front(n);
+                    return rcv_buf(std::move(head));
+                }
+                auto &v = std::get<std::vector<temporary_buffer<char>>>(buf.bufs);
+                auto it = v.begin();
+                while (it != v.end() && it->empty()) {
+                    ++it;
+                }
+                if (it == v.end() || it->size() >= n) {
+                    // common case, the slice lives in a single fragment
+                    rcv_buf head;
+                    if (n) {
+                        head = rcv_buf(it->share(0, n));
+                        it->trim_front(n);
+                    }
+                    v.erase(v.begin(), it);
+                    return head;
+                }
+                std::vector<temporary_buffer<char>> head;
+                for (auto left = n; left;) {
+                    auto this_size = std::min(left, it->size());
+                    if (this_size == it->size()) {
+                        head.push_back(std::move(*it++));
+                    } else {
+                        head.push_back(it->share(0, this_size));
+                        it->trim_front(this_size);
+                    }
+                    left -= this_size;
+                }
+                v.erase(v.begin(), it);
+                return rcv_buf(std::move(head), n);
+            }
+
+            const char *peek_rcv_buf(const rcv_buf &buf, size_t n, char *scratch) {
+                if (auto *one = std::get_if<temporary_buffer<char>>(&buf.bufs)) {
+                    return one->get();
+                }
+                auto &v = std::get<std::vector<temporary_buffer<char>>>(buf.bufs);
+                auto it = v.begin();
+                while (it != v.end() && it->empty()) {
+                    ++it;
+                }
+                if (it != v.end() && it->size() >= n) {
+                    return it->get();
+                }
+                for (auto dst = scratch; n; ++it) {
+                    auto this_size = std::min(n, it->size());
+                    dst = std::copy_n(it->get(), this_size, dst);
+                    n -= this_size;
+                }
+                return scratch;
+            }
+
+            temporary_buffer<char> rcv_buf_input::read_shared(size_t n, size_t alignment) {
+                if (!n) {
+                    return temporary_buffer<char>();
+                }
+                // find the fragment holding the first unread byte
+                size_t offset = _buf.size - size();
+                temporary_buffer<char> *fragment = nullptr;
+                if (auto *one = std::get_if<temporary_buffer<char>>(&_buf.bufs)) {
+                    fragment = one;
+                } else {
+                    for (auto &b : std::get<std::vector<temporary_buffer<char>>>(_buf.bufs)) {
+                        if (offset < b.size()) {
+                            fragment = &b;
+                            break;
+                        }
+                        offset -= b.size();
+                    }
+                }
+                if (fragment && offset + n <= fragment->size() &&
+                    reinterpret_cast<uintptr_t>(fragment->get() + offset) % alignment == 0) {
+                    skip(n);
+                    return fragment->share(offset, n);
+                }
+                auto copy = temporary_buffer<char>::aligned(alignment, n);
+                read(copy.get_write(), n);
+                return copy;
+            }
+
             // Make a copy of a remote buffer. No data is actually copied, only pointers and
             // a deleter of a new buffer takes care of deleting the original buffer
             template<typename T>    // T is either snd_buf or rcv_buf
@@ -123,13 +219,137 @@ namespace nil {
             template snd_buf make_shard_local_buffer_copy(foreign_ptr<std::unique_ptr<snd_buf>>);
             template rcv_buf make_shard_local_buffer_copy(foreign_ptr<std::unique_ptr<rcv_buf>>);
 
-            snd_buf connection::compress(snd_buf buf) {
-                if (_compressor) {
-                    buf = _compressor->compress(4, std::move(buf));
-                    static_assert(snd_buf::chunk_size >= 4, "send buffer chunk size is too small");
-                    write_le<uint32_t>(buf.front().get_write(), buf.size - 4);
+            // On a compressed connection every frame is preceded by its 4 byte on-wire
+            // length. If raw frames were negotiated, the most significant bit of the
+            // length marks a frame that is sent as is and must not be decompressed.
+            static constexpr uint32_t raw_frame_flag = uint32_t(1) << 31;
+
+            // size of the largest frame header (request with timeout)
+            static constexpr size_t max_frame_header_size = 28;
+
+            // If fragmentation was negotiated, every frame (with its compression header, if any) is
+            // sent as one or more fragments, each preceded by its 4 byte length and the 4 byte class
+            // of the frame. The most significant bit of the length marks all but the last fragment.
+            // Fragments of frames of different classes interleave, those of one class never do.
+            static constexpr size_t fragment_header_size = 8;
+            static constexpr uint32_t more_fragments_flag = uint32_t(1) << 31;
+            static constexpr size_t max_fragment_size = ~more_fragments_flag;
+            // fragments are not made smaller than this even if the class has less credit left
+            static constexpr size_t min_fragment_size = 4096;
+
+            // Removes the first n bytes of buf and returns them as a fragment of a frame of class channel.
+            static snd_buf take_fragment(snd_buf &buf, size_t n, uint32_t channel) {
+                temporary_buffer<char> header(fragment_header_size);
+                write_le<uint32_t>(header.get_write(), uint32_t(n) | (n < buf.size ? more_fragments_flag : 0));
+                write_le<uint32_t>(header.get_write() + 4, channel);
+                std::vector<temporary_buffer<char>> bufs;
+                bufs.push_back(std::move(header));
+                if (auto *one = std::get_if<temporary_buffer<char>>(&buf.bufs)) {
+                    if (n == one->size()) {
+                        bufs.push_back(std::move(*one));
+                    } else {
+                        bufs.push_back(one->share(0, n));
+                        one->trim_front(n);
+                    }
+                } else {
+                    auto &v = std::get<std::vector<temporary_buffer<char>>>(buf.bufs);
+                    auto it = v.begin();
+                    for (auto left = n; left;) {
+                        auto this_size = std::min(left, it->size());
+                        if (this_size == it->size()) {
+                            bufs.push_back(std::move(*it++));
+                        } else {
+                            bufs.push_back(it->share(0, this_size));
+                            it->trim_front(this_size);
+                        }
+                        left -= this_size;
+                    }
+                    v.erase(v.begin(), it);
+                }
+                buf.size -= n;
+                return snd_buf(std::move(bufs), n + fragment_header_size);
+            }
+
+            static void append_rcv_buf(rcv_buf &buf, rcv_buf tail) {
+                if (auto *one = std::get_if<temporary_buffer<char>>(&buf.bufs)) {
+                    std::vector<temporary_buffer<char>> v;
+                    v.push_back(std::move(*one));
+                    buf.bufs = std::move(v);
+                }
+                auto &v = std::get<std::vector<temporary_buffer<char>>>(buf.bufs);
+                if (auto *one = std::get_if<temporary_buffer<char>>(&tail.bufs)) {
+                    v.push_back(std::move(*one));
+                } else {
+                    auto &t = std::get<std::vector<temporary_buffer<char>>>(tail.bufs);
+                    std::move(t.begin(), t.end(), std::back_inserter(v));
+                }
+                buf.size += tail.size;
+            }
+
+            static snd_buf make_raw_frame(snd_buf buf) {
+                temporary_buffer<char> header(4);
+                write_le<uint32_t>(header.get_write(), raw_frame_flag | buf.size);
+                std::vector<temporary_buffer<char>> bufs;
+                if (auto *one = std::get_if<temporary_buffer<char>>(&buf.bufs)) {
+                    bufs.reserve(2);
+                    bufs.push_back(std::move(header));
+                    bufs.push_back(std::move(*one));
+                } else {
+                    bufs = std::move(std::get<std::vector<temporary_buffer<char>>>(buf.bufs));
+                    bufs.insert(bufs.begin(), std::move(header));
+                }
+                return snd_buf(std::move(bufs), buf.size + 4);
+            }
+
+            snd_buf connection::compress(snd_buf buf, compression_history &history) {
+                if (!_compressor) {
                     return buf;
                 }
+                if (_raw_frames_negotiated && _compression_bypass) {
+                    auto &opts = *_compression_bypass;
+                    if (buf.size < opts.min_size) {
+                        _stats.compression_bypassed_small++;
+                        return make_raw_frame(std::move(buf));
+                    }
+                    auto inefficient = history.sampled &&
+                                       (history.ratio > opts.max_ratio ||
+                                        (opts.max_ns_per_saved_byte &&
+                                         history.ns_per_saved_byte > opts.max_ns_per_saved_byte));
+                    if (inefficient && ++history.bypassed < opts.probe_interval) {
+                        _stats.compression_bypassed_ratio++;
+                        return make_raw_frame(std::move(buf));
+                    }
+                    history.bypassed = 0;
+                }
+
+                auto raw_size = buf.size;
+                auto start = std::chrono::steady_clock::now();
+                buf = _compressor->compress(4, std::move(buf));
+                auto elapsed =
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start)
+                        .count();
+                static_assert(snd_buf::chunk_size >= 4, "send buffer chunk size is too small");
+                write_le<uint32_t>(buf.front().get_write(), buf.size - 4);
+
+                _stats.compressed_frames++;
+                _stats.compression_bytes_in += raw_size;
+                _stats.compression_bytes_out += buf.size - 4;
+                _stats.compression_time_ns += elapsed;
+
+                if (_compression_bypass && raw_size) {
+                    // exponentially weighted, so a verb that starts compressing well is picked up quickly
+                    auto ratio = float(buf.size - 4) / raw_size;
+                    auto saved = raw_size > buf.size - 4 ? raw_size - (buf.size - 4) : 1;
+                    auto cost = float(elapsed) / saved;
+                    if (history.sampled) {
+                        history.ratio = history.ratio * 0.75f + ratio * 0.25f;
+                        history.ns_per_saved_byte = history.ns_per_saved_byte * 0.75f + cost * 0.25f;
+                    } else {
+                        history.ratio = ratio;
+                        history.ns_per_saved_byte = cost;
+                        history.sampled = true;
+                    }
+                }
                 return buf;
             }
 
@@ -147,48 +367,169 @@ namespace nil {
                 }
             }
 
+            void connection::set_send_priorities(const send_priority_options &options) {
+                _send_priorities = options;
+                auto classes = std::max<size_t>(options.weights.size(), 1);
+                _outgoing_queues.resize(classes);
+                _priority_deficit.resize(classes);
+            }
+
+            bool connection::outgoing_queue_empty() const {
+                return std::all_of(_outgoing_queues.begin(), _outgoing_queues.end(),
+                                   [](const std::list<outgoing_entry> &q) { return q.empty(); });
+            }
+
+            size_t connection::outgoing_queue_size() const {
+                return std::accumulate(_outgoing_queues.begin(), _outgoing_queues.end(), size_t(0),
+                                       [](size_t n, const std::list<outgoing_entry> &q) { return n + q.size(); });
+            }
+
+            // Moves the next entry to send to the end of batch and returns how many bytes of it may be
+            // sent in this turn of its class, which bounds the fragment sent if fragmentation is enabled.
+            size_t connection::take_next_outgoing(std::list<outgoing_entry> &batch) {
+                std::list<outgoing_entry> *first = nullptr;
+                unsigned non_empty = 0;
+                for (auto &q : _outgoing_queues) {
+                    if (!q.empty()) {
+                        first = first ? first : &q;
+                        non_empty++;
+                    }
+                }
+                if (non_empty <= 1 || _send_priorities.strict) {
+                    // nothing to share the link with, the round-robin state is left untouched
+                    auto c = size_t(first - _outgoing_queues.data());
+                    auto weight = c < _send_priorities.weights.size() ? _send_priorities.weights[c] : 1u;
+                    batch.splice(batch.end(), *first, first->begin());
+                    return std::max(std::max(weight, 1u) * _send_priorities.quantum, min_fragment_size);
+                }
+                // Deficit round-robin. A class is served while it has credit left, a frame larger than the
+                // credit is sent whole, unless it is fragmented, and the overdraft is paid back over the
+                // following turns.
+                bool fragmenting = _fragmentation_negotiated && _send_priorities.fragment;
+                for (;;) {
+                    auto &q = _outgoing_queues[_priority_turn];
+                    auto &deficit = _priority_deficit[_priority_turn];
+                    if (q.empty()) {
+                        // an idle class does not accumulate credit
+                        deficit = std::min<int64_t>(deficit, 0);
+                    } else {
+                        if (!_priority_turn_started) {
+                            auto weight = std::max(_send_priorities.weights[_priority_turn], 1u);
+                            deficit += int64_t(weight * _send_priorities.quantum);
+                            _priority_turn_started = true;
+                        }
+                        if (deficit > 0) {
+                            auto credit = std::max(size_t(deficit), min_fragment_size);
+                            auto size = size_t(q.front().buf.size);
+                            deficit -= int64_t(fragmenting ? std::min(size, credit) : size);
+                            batch.splice(batch.end(), q, q.begin());
+                            return credit;
+                        }
+                    }
+                    _priority_turn = (_priority_turn + 1) % _outgoing_queues.size();
+                    _priority_turn_started = false;
+                }
+            }
+
+            void connection::fragment_outgoing(std::list<outgoing_entry> &batch, size_t credit) {
+                auto &d = batch.back();
+                auto size = std::min(size_t(d.buf.size), max_fragment_size);
+                if (_send_priorities.fragment) {
+                    size = std::min(size, credit);
+                }
+                auto fragment = take_fragment(d.buf, size, d.priority_class);
+                if (!d.buf.size) {
+                    d.buf = std::move(fragment);
+                    return;
+                }
+                // the rest of the frame goes out in the following turns of its class
+                auto &q = _outgoing_queues[d.priority_class];
+                q.splice(q.begin(), batch, std::prev(batch.end()));
+                batch.emplace_back(std::move(fragment));
+                batch.back().p = boost::none;
+            }
+
+            template<connection::outgoing_queue_type QueueType>
+            void connection::prepare_outgoing(outgoing_entry &d) {
+                d.t.cancel();    // cancel timeout timer
+                if (d.queue_latency) {
+                    d.queue_latency->record(latency_histogram::clock_type::now() - d.queued_at);
+                }
+                if (d.pcancel) {
+                    d.pcancel->cancel_send = std::function<void()>();    // request is no longer cancellable
+                }
+                if (QueueType == outgoing_queue_type::request) {
+                    static_assert(snd_buf::chunk_size >= 8, "send buffer chunk size is too small");
+                    if (_timeout_negotiated) {
+                        auto expire = d.t.get_timeout();
+                        uint64_t left = 0;
+                        if (expire != timer_wheel::time_point()) {
+                            left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                                       expire - timer_wheel::clock_type::now())
+                                       .count();
+                        }
+                        write_le<uint64_t>(d.buf.front().get_write(), left);
+                    } else {
+                        d.buf.front().trim_front(8);
+                        d.buf.size -= 8;
+                    }
+                }
+                if (QueueType == outgoing_queue_type::request && _compressor && _compression_bypass) {
+                    // the verb follows the (possibly trimmed) timeout field
+                    auto verb = read_le<uint64_t>(d.buf.front().get() + (_timeout_negotiated ? 8 : 0));
+                    d.buf = compress(std::move(d.buf), _verb_compression_history[verb]);
+                } else {
+                    d.buf = compress(std::move(d.buf), _compression_history);
+                }
+                d.prepared = true;
+            }
+
             template<connection::outgoing_queue_type QueueType>
             void connection::send_loop() {
                 _send_loop_stopped =
                     do_until(
                         [this] { return _error; },
                         [this] {
-                            return _outgoing_queue_cond.wait([this] { return !_outgoing_queue.empty(); }).then([this] {
-                                // despite using wait with predicated above _outgoing_queue can still be empty here if
-                                // there is only one entry on the list and its expire timer runs after wait() returned
-                                // ready future, but before this continuation runs.
-                                if (_outgoing_queue.empty()) {
+                            return _outgoing_queue_cond.wait([this] { return !outgoing_queue_empty(); }).then([this] {
+                                // despite using wait with predicated above _outgoing_queues can still be empty here
+                                // if there is only one entry on the lists and its expire timer runs after wait()
+                                // returned ready future, but before this continuation runs.
+                                if (outgoing_queue_empty()) {
                                     return make_ready_future();
                                 }
-                                auto d = std::move(_outgoing_queue.front());
-                                _outgoing_queue.pop_front();
-                                d.t.cancel();    // cancel timeout timer
-                                if (d.pcancel) {
-                                    d.pcancel->cancel_send =
-                                        std::function<void()>();    // request is no longer cancellable
-                                }
-                                if (QueueType == outgoing_queue_type::request) {
-                                    static_assert(snd_buf::chunk_size >= 8, "send buffer chunk size is too small");
-                                    if (_timeout_negotiated) {
-                                        auto expire = d.t.get_timeout();
-                                        uint64_t left = 0;
-                                        if (expire != typename timer<rpc_clock_type>::time_point()) {
-                                            left = std::chrono::duration_cast<std::chrono::milliseconds>(
-                                                       expire - timer<rpc_clock_type>::clock::now())
-                                                       .count();
-                                        }
-                                        write_le<uint64_t>(d.buf.front().get_write(), left);
+                                // Take everything that is queued right now (within the configured budget) and
+                                // write it back-to-back, so that the whole batch costs a single flush. Entries are
+                                // spliced rather than moved, so cancellable back pointers stay valid.
+                                std::list<outgoing_entry> batch;
+                                size_t batch_bytes = 0;
+                                do {
+                                    auto credit = take_next_outgoing(batch);
+                                    auto &d = batch.back();
+                                    if (d.prepared) {
+                                        batch_bytes += std::min(size_t(d.buf.size), credit);
                                     } else {
-                                        d.buf.front().trim_front(8);
-                                        d.buf.size -= 8;
+                                        batch_bytes += d.buf.size;
+                                        prepare_outgoing<QueueType>(d);
                                     }
-                                }
-                                d.buf = compress(std::move(d.buf));
-                                auto f = send_buffer(std::move(d.buf)).then([this] {
-                                    _stats.sent_messages++;
-                                    return _write_buf.flush();
+                                    if (_fragmentation_negotiated) {
+                                        fragment_outgoing(batch, credit);
+                                    }
+                                } while (!outgoing_queue_empty() && batch.size() < _send_batch_max_messages &&
+                                         batch_bytes < _send_batch_max_bytes);
+                                return do_with(std::move(batch), [this](std::list<outgoing_entry> &batch) {
+                                    return do_for_each(batch.begin(), batch.end(),
+                                                       [this](outgoing_entry &d) {
+                                                           // only the last fragment of a message completes it
+                                                           bool last = bool(d.p);
+                                                           return send_buffer(std::move(d.buf)).then([this, last] {
+                                                               _stats.sent_messages += last;
+                                                           });
+                                                       })
+                                        .then([this] {
+                                            _stats.sent_batches++;
+                                            return _write_buf.flush();
+                                        });
                                 });
-                                return f.finally([d = std::move(d)] {});
                             });
                         })
                         .handle_exception([this](std::exception_ptr eptr) { _error = true; });
@@ -202,7 +543,9 @@ namespace nil {
                 }
                 return when_all(std::move(_send_loop_stopped), std::move(_sink_closed_future))
                     .then([this](std::tuple<future<>, future<bool>> res) {
-                        _outgoing_queue.clear();
+                        for (auto &q : _outgoing_queues) {
+                            q.clear();
+                        }
                         // both _send_loop_stopped and _sink_closed_future are never exceptional
                         bool sink_closed = std::get<1>(res).get0();
                         return _connected && !sink_closed ? _write_buf.close() : make_ready_future();
@@ -219,7 +562,7 @@ namespace nil {
                 _connected = true;
             }
 
-            future<> connection::send_negotiation_frame(feature_map features) {
+            future<> connection::send_negotiation_frame(feature_map features, bool flush) {
                 auto negotiation_frame_feature_record_size = [](const feature_map::value_type &e) {
                     return 8 + e.second.size();
                 };
@@ -237,32 +580,38 @@ namespace nil {
                     p += 4;
                     p = std::copy_n(e.second.begin(), e.second.size(), p);
                 }
-                return _write_buf.write(std::move(reply)).then([this] {
+                return _write_buf.write(std::move(reply)).then([this, flush] {
                     _stats.sent_messages++;
-                    return _write_buf.flush();
+                    return flush ? _write_buf.flush() : make_ready_future<>();
                 });
             }
 
             future<>
-                connection::send(snd_buf buf, boost::optional<rpc_clock_type::time_point> timeout, cancellable *cancel) {
+                connection::send(snd_buf buf, boost::optional<rpc_clock_type::time_point> timeout, cancellable *cancel,
+                                 latency_histogram *queue_latency, unsigned priority) {
                 if (!_error) {
                     if (timeout && *timeout <= rpc_clock_type::now()) {
                         return make_ready_future<>();
                     }
-                    _outgoing_queue.emplace_back(std::move(buf));
-                    auto deleter = [this, it = std::prev(_outgoing_queue.cend())] { _outgoing_queue.erase(it); };
+                    auto priority_class = std::min<unsigned>(priority, _outgoing_queues.size() - 1);
+                    auto &q = _outgoing_queues[priority_class];
+                    q.emplace_back(std::move(buf));
+                    q.back().priority_class = priority_class;
+                    if (queue_latency) {
+                        q.back().queue_latency = queue_latency;
+                        q.back().queued_at = latency_histogram::clock_type::now();
+                    }
+                    auto deleter = [&q, it = std::prev(q.cend())] { q.erase(it); };
                     if (timeout) {
-                        auto &t = _outgoing_queue.back().t;
-                        t.set_callback(deleter);
-                        t.arm(timeout.value());
+                        _send_timeouts.arm(q.back().t, timeout.value(), deleter);
                     }
                     if (cancel) {
                         cancel->cancel_send = std::move(deleter);
-                        cancel->send_back_pointer = &_outgoing_queue.back().pcancel;
-                        _outgoing_queue.back().pcancel = cancel;
+                        cancel->send_back_pointer = &q.back().pcancel;
+                        q.back().pcancel = cancel;
                     }
                     _outgoing_queue_cond.signal();
-                    return _outgoing_queue.back().p->get_future();
+                    return q.back().p->get_future();
                 } else {
                     return make_exception_future<>(closed_error());
                 }
@@ -403,10 +752,143 @@ namespace nil {
                 });
             }
 
+            // Decodes a frame out of a whole buffer, the payload is a zero-copy slice of it. A buffer
+            // ending before the frame is reported to log and yields the empty value of the frame.
+            template<typename FrameType, typename Log>
+            static typename FrameType::return_type parse_frame_buffer(rcv_buf buf, Log &&log) {
+                auto header_size = FrameType::header_size();
+                if (buf.size < header_size) {
+                    if (buf.size != 0) {
+                        log(format("unexpected eof on a {} while reading header: expected {:d} got {:d}",
+                                   FrameType::role(),
+                                   header_size,
+                                   buf.size));
+                    }
+                    return FrameType::empty_value();
+                }
+                char scratch[max_frame_header_size];
+                assert(header_size <= sizeof(scratch));
+                auto h = FrameType::decode_header(peek_rcv_buf(buf, header_size, scratch));
+                auto size = FrameType::get_size(h);
+                if (!size) {
+                    return FrameType::make_value(h, rcv_buf());
+                }
+                if (buf.size - header_size < size) {
+                    log(format("unexpected eof on a {} while reading data: expected {:d} got {:d}",
+                               FrameType::role(),
+                               size,
+                               buf.size - header_size));
+                    return FrameType::empty_value();
+                }
+                split_rcv_buf(buf, header_size);
+                return FrameType::make_value(h, split_rcv_buf(buf, size));
+            }
+
+            template<typename FrameType>
+            typename FrameType::return_type connection::parse_frame(socket_address info, rcv_buf buf) {
+                return parse_frame_buffer<FrameType>(std::move(buf),
+                                                     [this, info](const sstring &msg) { _logger(info, msg); });
+            }
+
+            template<typename FrameType>
+            typename FrameType::return_type connection::decode_frame(socket_address info,
+                                                                     std::unique_ptr<compressor> &compressor,
+                                                                     bool raw,
+                                                                     rcv_buf data) {
+                if (raw) {
+                    _stats.raw_frames_received++;
+                    return parse_frame<FrameType>(info, std::move(data));
+                }
+                return parse_frame<FrameType>(info, compressor->decompress(std::move(data)));
+            }
+
+            template<typename FrameType>
+            typename FrameType::return_type connection::parse_frame_compressed(socket_address info,
+                                                                               std::unique_ptr<compressor> &compressor,
+                                                                               rcv_buf buf) {
+                if (!compressor) {
+                    return parse_frame<FrameType>(info, std::move(buf));
+                }
+                if (buf.size < 4) {
+                    _logger(info,
+                            format("unexpected eof on a {} while reading compression header: expected 4 got {:d}",
+                                   FrameType::role(),
+                                   buf.size));
+                    return FrameType::empty_value();
+                }
+                char scratch[4];
+                auto size = read_le<uint32_t>(peek_rcv_buf(buf, 4, scratch));
+                split_rcv_buf(buf, 4);
+                auto raw = _raw_frames_negotiated && (size & raw_frame_flag);
+                if (raw) {
+                    size &= ~raw_frame_flag;
+                }
+                if (buf.size != size) {
+                    _logger(info,
+                            format("unexpected eof on a {} while reading compressed data: expected {:d} got {:d}",
+                                   FrameType::role(),
+                                   size,
+                                   buf.size));
+                    return FrameType::empty_value();
+                }
+                return decode_frame<FrameType>(info, compressor, raw, std::move(buf));
+            }
+
+            future<boost::optional<rcv_buf>> connection::read_fragmented_frame(socket_address info,
+                                                                               input_stream<char> &in) {
+                return in.read_exactly(fragment_header_size).then([this, info, &in](temporary_buffer<char> header) {
+                    if (header.size() != fragment_header_size) {
+                        if (header.size() != 0) {
+                            _logger(info,
+                                    format("unexpected eof while reading fragment header: expected {:d} got {:d}",
+                                           fragment_header_size,
+                                           header.size()));
+                        }
+                        return make_ready_future<boost::optional<rcv_buf>>(boost::none);
+                    }
+                    auto size = read_le<uint32_t>(header.get());
+                    auto channel = read_le<uint32_t>(header.get() + 4);
+                    bool more = size & more_fragments_flag;
+                    size &= ~more_fragments_flag;
+                    return read_rcv_buf(in, size).then([this, info, &in, size, channel, more](rcv_buf data) {
+                        if (data.size != size) {
+                            _logger(info,
+                                    format("unexpected eof while reading fragment: expected {:d} got {:d}",
+                                           size,
+                                           data.size));
+                            return make_ready_future<boost::optional<rcv_buf>>(boost::none);
+                        }
+                        auto it = _partial_frames.find(channel);
+                        if (it != _partial_frames.end()) {
+                            append_rcv_buf(it->second, std::move(data));
+                            if (!more) {
+                                data = std::move(it->second);
+                                _partial_frames.erase(it);
+                            }
+                        } else if (more) {
+                            _partial_frames.emplace(channel, std::move(data));
+                        }
+                        if (more) {
+                            return read_fragmented_frame(info, in);
+                        }
+                        return make_ready_future<boost::optional<rcv_buf>>(std::move(data));
+                    });
+                });
+            }
+
             template<typename FrameType>
             typename FrameType::return_type connection::read_frame_compressed(socket_address info,
                                                                               std::unique_ptr<compressor> &compressor,
                                                                               input_stream<char> &in) {
+                if (_fragmentation_negotiated) {
+                    return read_fragmented_frame(info, in).then(
+                        [this, info, &compressor](boost::optional<rcv_buf> frame) {
+                            if (!frame) {
+                                return FrameType::empty_value();
+                            }
+                            return parse_frame_compressed<FrameType>(info, compressor, std::move(*frame));
+                        });
+                }
                 if (compressor) {
                     return in.read_exactly(4).then([this, info, &in, &compressor](
                                                        temporary_buffer<char> compress_header) {
@@ -423,7 +905,12 @@ namespace nil {
                         }
                         auto ptr = compress_header.get();
                         auto size = read_le<uint32_t>(ptr);
-                        return read_rcv_buf(in, size).then([this, size, &compressor, info](rcv_buf compressed_data) {
+                        auto raw = _raw_frames_negotiated && (size & raw_frame_flag);
+                        if (raw) {
+                            size &= ~raw_frame_flag;
+                        }
+                        return read_rcv_buf(in, size).then([this, size, raw, &compressor,
+                                                            info](rcv_buf compressed_data) {
                             if (compressed_data.size != size) {
                                 _logger(
                                     info,
@@ -434,21 +921,7 @@ namespace nil {
                                         compressed_data.size));
                                 return FrameType::empty_value();
                             }
-                            auto eb = compressor->decompress(std::move(compressed_data));
-                            net::packet p;
-                            auto *one = std::get_if<temporary_buffer<char>>(&eb.bufs);
-                            if (one) {
-                                p = net::packet(std::move(p), std::move(*one));
-                            } else {
-                                auto &&bufs = std::get<std::vector<temporary_buffer<char>>>(eb.bufs);
-                                p.reserve(bufs.size());
-                                for (auto &&b : bufs) {
-                                    p = net::packet(std::move(p), std::move(b));
-                                }
-                            }
-                            return do_with(as_input_stream(std::move(p)), [this, info](input_stream<char> &in) {
-                                return read_frame<FrameType>(info, in);
-                            });
+                            return decode_frame<FrameType>(info, compressor, raw, std::move(compressed_data));
                         });
                     });
                 } else {
@@ -457,12 +930,16 @@ namespace nil {
             }
 
             struct stream_frame {
-                using opt_buf_type = boost::optional<rcv_buf>;
+                using opt_buf_type = boost::optional<std::tuple<stream_frame_type, rcv_buf>>;
                 using return_type = future<opt_buf_type>;
                 struct header_type {
                     uint32_t size;
-                    bool eos;
+                    stream_frame_type type;
                 };
+                // header values other than a plain element size
+                static constexpr uint32_t end_of_stream = -1U;
+                static constexpr uint32_t credit = -2U;
+                static constexpr uint32_t batch_flag = 1U << 31;
                 static size_t header_size() {
                     return 4;
                 }
@@ -473,28 +950,75 @@ namespace nil {
                     return make_ready_future<opt_buf_type>(boost::none);
                 }
                 static header_type decode_header(const char *ptr) {
-                    header_type h {read_le<uint32_t>(ptr), false};
-                    if (h.size == -1U) {
-                        h.size = 0;
-                        h.eos = true;
+                    auto v = read_le<uint32_t>(ptr);
+                    if (v == end_of_stream) {
+                        return {0, stream_frame_type::end_of_stream};
+                    } else if (v == credit) {
+                        return {4, stream_frame_type::credit};
+                    } else if (v & batch_flag) {
+                        return {v & ~batch_flag, stream_frame_type::batch};
                     }
-                    return h;
+                    return {v, stream_frame_type::element};
                 }
                 static uint32_t get_size(const header_type &t) {
                     return t.size;
                 }
                 static future<opt_buf_type> make_value(const header_type &t, rcv_buf data) {
-                    if (t.eos) {
+                    if (t.type == stream_frame_type::end_of_stream) {
                         data.size = -1U;
                     }
-                    return make_ready_future<opt_buf_type>(std::move(data));
+                    return make_ready_future<opt_buf_type>(std::make_tuple(t.type, std::move(data)));
                 }
             };
 
-            future<boost::optional<rcv_buf>> connection::read_stream_frame_compressed(input_stream<char> &in) {
+            future<boost::optional<std::tuple<stream_frame_type, rcv_buf>>>
+                connection::read_stream_frame_compressed(input_stream<char> &in) {
                 return read_frame_compressed<stream_frame>(peer_address(), _compressor, in);
             }
 
+            snd_buf make_stream_batch_frame(std::vector<snd_buf> elements, uint32_t size) {
+                std::vector<temporary_buffer<char>> bufs;
+                bufs.emplace_back(stream_frame::header_size());
+                write_le<uint32_t>(bufs.back().get_write(), size | stream_frame::batch_flag);
+                for (auto &&e : elements) {
+                    if (auto *b = std::get_if<temporary_buffer<char>>(&e.bufs)) {
+                        bufs.push_back(std::move(*b));
+                    } else {
+                        auto &v = std::get<std::vector<temporary_buffer<char>>>(e.bufs);
+                        std::move(v.begin(), v.end(), std::back_inserter(bufs));
+                    }
+                }
+                return snd_buf(std::move(bufs), size + stream_frame::header_size());
+            }
+
+            sstring connection::stream_flow_control_feature() const {
+                sstring p = uninitialized_string(sizeof(uint32_t));
+                write_le<uint32_t>(p.data(), _stream_flow_control->window);
+                return p;
+            }
+
+            void connection::negotiate_stream_flow_control(const sstring &peer_window) {
+                if (peer_window.size() != sizeof(uint32_t)) {
+                    throw std::runtime_error("malformed stream flow control window");
+                }
+                _stream_send_window = read_le<uint32_t>(peer_window.c_str());
+                _stream_credit.signal(_stream_send_window);
+                _stream_flow_control_negotiated = true;
+            }
+
+            future<> connection::stream_send(snd_buf buf, uint32_t charge) {
+                if (!_stream_flow_control_negotiated) {
+                    return send(std::move(buf), {}, nullptr);
+                }
+                // Like the memory limit, let an element larger than the whole window in once all credit is back,
+                // the peer returns all of it when it is taken.
+                auto wait = std::min(charge, _stream_send_window);
+                return _stream_credit.wait(wait).then([this, buf = std::move(buf), charge, wait]() mutable {
+                    _stream_credit.consume(charge - wait);
+                    return send(std::move(buf), {}, nullptr);
+                });
+            }
+
             future<> connection::stream_close() {
                 auto f = make_ready_future<>();
                 if (!error()) {
@@ -508,6 +1032,10 @@ namespace nil {
             }
 
             future<> connection::stream_process_incoming(rcv_buf &&buf) {
+                if (_stream_flow_control_negotiated) {
+                    // the window advertised to the peer already bounds what is queued
+                    return _stream_queue.push_eventually(std::move(buf));
+                }
                 // we do not want to dead lock on huge packets, so let them in
                 // but only one at a time
                 auto size = std::min(size_t(buf.size), max_stream_buffers_memory);
@@ -517,22 +1045,58 @@ namespace nil {
                 });
             }
 
-            future<> connection::handle_stream_frame() {
-                return read_stream_frame_compressed(_read_buf).then([this](boost::optional<rcv_buf> data) {
-                    if (!data) {
-                        _error = true;
-                        return make_ready_future<>();
-                    }
-                    return stream_process_incoming(std::move(*data));
+            future<> connection::stream_process_batch(rcv_buf &&buf) {
+                return do_with(std::move(buf), [this](rcv_buf &batch) {
+                    return repeat([this, &batch] {
+                        if (!batch.size) {
+                            return make_ready_future<stop_iteration>(stop_iteration::yes);
+                        }
+                        char scratch[4];
+                        auto size = batch.size >= 4 ? read_le<uint32_t>(peek_rcv_buf(batch, 4, scratch)) : -1U;
+                        if (size > batch.size - 4) {
+                            get_logger()(peer_address(), "malformed stream batch");
+                            _error = true;
+                            return make_ready_future<stop_iteration>(stop_iteration::yes);
+                        }
+                        split_rcv_buf(batch, 4);
+                        return stream_process_incoming(split_rcv_buf(batch, size)).then([] {
+                            return stop_iteration::no;
+                        });
+                    });
                 });
             }
 
+            future<> connection::handle_stream_frame() {
+                return read_stream_frame_compressed(_read_buf).then(
+                    [this](boost::optional<std::tuple<stream_frame_type, rcv_buf>> frame) {
+                        if (!frame) {
+                            _error = true;
+                            return make_ready_future<>();
+                        }
+                        auto &data = std::get<1>(*frame);
+                        switch (std::get<0>(*frame)) {
+                            case stream_frame_type::credit: {
+                                char scratch[4];
+                                _stream_credit.signal(read_le<uint32_t>(peek_rcv_buf(data, 4, scratch)));
+                                return make_ready_future<>();
+                            }
+                            case stream_frame_type::batch:
+                                return stream_process_batch(std::move(data));
+                            default:
+                                return stream_process_incoming(std::move(data));
+                        }
+                    });
+            }
+
             future<> connection::stream_receive(circular_buffer<foreign_ptr<std::unique_ptr<rcv_buf>>> &bufs) {
                 return _stream_queue.not_empty().then([this, &bufs] {
-                    bool eof = !_stream_queue.consume([&bufs](rcv_buf &&b) {
+                    uint32_t taken = 0;
+                    bool eof = !_stream_queue.consume([&bufs, &taken](rcv_buf &&b) {
                         if (b.size == -1U) {    // max fragment length marks an end of a stream
                             return false;
                         } else {
+                            // the peer charged each element with its length prefix
+                            taken += b.size + 4;
                             bufs.push_back(make_foreign(std::make_unique<rcv_buf>(std::move(b))));
                             return true;
                         }
@@ -541,6 +1105,14 @@ namespace nil {
                         assert(_stream_queue.empty());
                         _stream_queue.push(rcv_buf(-1U));    // push eof marker back for next read to notice it
                     }
+                    if (_stream_flow_control_negotiated && taken && !error()) {
+                        snd_buf credit(8);
+                        auto p = credit.front().get_write();
+                        write_le<uint32_t>(p, stream_frame::credit);
+                        write_le<uint32_t>(p + 4, taken);
+                        // a failure to return credit means the connection is gone, which the source notices
+                        (void)send(std::move(credit), {}, nullptr).handle_exception([](std::exception_ptr) {});
+                    }
                 });
             }
 
@@ -569,6 +1141,40 @@ namespace nil {
                 c.get_logger()(c.peer_address(), level, std::string_view(formatted.data(), formatted.size()));
             }
 
+            // The ZERO_RTT feature is offered with an empty value to learn whether the server supports
+            // it, and with this value when requests encoded with the cached features follow.
+            static const char zero_rtt_early_data[] = "early";
+
+            // the features that change how frames are encoded, which early requests rely on
+            static feature_map encoding_features(const feature_map &features) {
+                feature_map ret;
+                for (auto id : {protocol_features::COMPRESS, protocol_features::TIMEOUT,
+                                protocol_features::COMPRESSION_BYPASS, protocol_features::FRAGMENTATION}) {
+                    auto it = features.find(id);
+                    if (it != features.end()) {
+                        ret.emplace(*it);
+                    }
+                }
+                return ret;
+            }
+
+            boost::optional<feature_map> zero_rtt_cache::get(const socket_address &peer,
+                                                             const feature_map &offered) const {
+                auto it = _entries.find(peer);
+                if (it == _entries.end() || it->second.offered != offered) {
+                    return boost::none;
+                }
+                return it->second.negotiated;
+            }
+
+            void zero_rtt_cache::put(const socket_address &peer, feature_map offered, feature_map negotiated) {
+                _entries[peer] = entry {std::move(offered), std::move(negotiated)};
+            }
+
+            void zero_rtt_cache::invalidate(const socket_address &peer) {
+                _entries.erase(peer);
+            }
+
             void client::negotiate(feature_map provided) {
                 // record features returned here
                 for (auto &&e : provided) {
@@ -576,7 +1182,9 @@ namespace nil {
                     switch (id) {
                         // supported features go here
                         case protocol_features::COMPRESS:
-                            if (_options.compressor_factory) {
+                            // early requests may already have been compressed by the compressor set up
+                            // from the cached features, keep it
+                            if (_options.compressor_factory && (!_compressor || _compressor->name() != e.second)) {
                                 _compressor = _options.compressor_factory->negotiate(e.second, false);
                             }
                             if (!_compressor) {
@@ -591,6 +1199,15 @@ namespace nil {
                             _id = deserialize_connection_id(e.second);
                             break;
                         }
+                        case protocol_features::COMPRESSION_BYPASS:
+                            _raw_frames_negotiated = true;
+                            break;
+                        case protocol_features::STREAM_FLOW_CONTROL:
+                            negotiate_stream_flow_control(e.second);
+                            break;
+                        case protocol_features::FRAGMENTATION:
+                            _fragmentation_negotiated = true;
+                            break;
                         default:
                             // nothing to do
                             ;
@@ -599,8 +1216,23 @@ namespace nil {
             }
 
             future<> client::negotiate_protocol(input_stream<char> &in) {
-                return receive_negotiation_frame(*this, in).then(
-                    [this](feature_map features) { return negotiate(features); });
+                return receive_negotiation_frame(*this, in).then([this](feature_map features) {
+                    bool zero_rtt = features.count(protocol_features::ZERO_RTT);
+                    if (_sent_early_data && !zero_rtt) {
+                        // The server discarded the requests sent ahead of its reply, fail them so that they
+                        // can be retried on a connection that negotiates in full.
+                        _options.zero_rtt->invalidate(_server_addr);
+                        throw std::runtime_error("RPC server did not accept the cached protocol features");
+                    }
+                    negotiate(features);
+                    if (_options.zero_rtt && !_options.stream_parent && !_sent_early_data) {
+                        if (zero_rtt) {
+                            _options.zero_rtt->put(_server_addr, _zero_rtt_offer, encoding_features(features));
+                        } else {
+                            _options.zero_rtt->invalidate(_server_addr);
+                        }
+                    }
+                });
             }
 
             struct response_frame {
@@ -631,6 +1263,10 @@ namespace nil {
                 }
             };
 
+            future<std::tuple<int64_t, boost::optional<rcv_buf>>> parse_response_frame(rcv_buf buf) {
+                return parse_frame_buffer<response_frame>(std::move(buf), [](const sstring &) {});
+            }
+
             future<response_frame::header_and_buffer_type> client::read_response_frame(input_stream<char> &in) {
                 return read_frame<response_frame>(_server_addr, in);
             }
@@ -643,23 +1279,81 @@ namespace nil {
             stats client::get_stats() const {
                 stats res = _stats;
                 res.wait_reply = _outstanding.size();
-                res.pending = _outgoing_queue.size();
+                res.pending = outgoing_queue_size();
                 return res;
             }
 
+            void client::outstanding_table::trim_head() noexcept {
+                while (!_slots.empty() && !_slots.front()) {
+                    _slots.pop_front();
+                    _first_id++;
+                }
+            }
+
+            void client::outstanding_table::emplace(id_type id, handler_ptr h) {
+                if (_slots.empty()) {
+                    _first_id = id;
+                }
+                if (id < _first_id + id_type(_slots.size())) {
+                    // ids are expected to grow monotonically, be tolerant if they do not
+                    _overflow.emplace(id, std::move(h));
+                    _size++;
+                    return;
+                }
+                while (_first_id + id_type(_slots.size()) < id) {
+                    _slots.push_back(nullptr);
+                }
+                _slots.push_back(std::move(h));
+                _size++;
+                if (_slots.size() > max_span) {
+                    while (_slots.size() > max_span / 2) {
+                        if (_slots.front()) {
+                            _overflow.emplace(_first_id, std::move(_slots.front()));
+                        }
+                        _slots.pop_front();
+                        _first_id++;
+                    }
+                    trim_head();
+                }
+            }
+
+            client::outstanding_table::handler_ptr client::outstanding_table::extract(id_type id) {
+                handler_ptr h;
+                if (id >= _first_id && id < _first_id + id_type(_slots.size())) {
+                    h = std::move(_slots[id - _first_id]);
+                    trim_head();
+                } else if (!_overflow.empty()) {
+                    auto it = _overflow.find(id);
+                    if (it != _overflow.end()) {
+                        h = std::move(it->second);
+                        _overflow.erase(it);
+                    }
+                }
+                if (h) {
+                    _size--;
+                }
+                return h;
+            }
+
+            void client::outstanding_table::clear() {
+                // destroy the handlers only once the table is consistent again
+                auto slots = std::exchange(_slots, {});
+                auto overflow = std::exchange(_overflow, {});
+                _size = 0;
+            }
+
             void client::wait_for_reply(id_type id,
                                         std::unique_ptr<reply_handler_base> &&h,
                                         boost::optional<rpc_clock_type::time_point>
                                             timeout,
                                         cancellable *cancel) {
                 if (timeout) {
-                    h->t.set_callback(std::bind(std::mem_fn(&client::wait_timed_out), this, id));
-                    h->t.arm(timeout.value());
+                    _reply_timeouts.arm(h->t, timeout.value(), [this, id] { wait_timed_out(id); });
                 }
                 if (cancel) {
                     cancel->cancel_wait = [this, id] {
-                        _outstanding[id]->cancel();
-                        _outstanding.erase(id);
+                        auto h = _outstanding.extract(id);
+                        h->cancel();
                     };
                     h->pcancel = cancel;
                     cancel->wait_back_pointer = &h->pcancel;
@@ -668,8 +1362,8 @@ namespace nil {
             }
             void client::wait_timed_out(id_type id) {
                 _stats.timeout++;
-                _outstanding[id]->timeout();
-                _outstanding.erase(id);
+                auto h = _outstanding.extract(id);
+                h->timeout();
             }
 
             future<> client::stop() {
@@ -708,6 +1402,11 @@ namespace nil {
                            const socket_address &local) :
                 rpc::connection(l, s),
                 _socket(std::move(socket)), _server_addr(addr), _options(ops) {
+                _send_batch_max_messages = std::max(ops.send_batch_max_messages, 1u);
+                _send_batch_max_bytes = ops.send_batch_max_bytes;
+                _compression_bypass = ops.compression_bypass;
+                _stream_flow_control = ops.stream_flow_control;
+                set_send_priorities(ops.send_priorities);
                 _socket.set_reuseaddr(ops.reuseaddr);
                 // Run client in the background.
                 // Communicate result via _stopped.
@@ -724,6 +1423,7 @@ namespace nil {
                         feature_map features;
                         if (_options.compressor_factory) {
                             features[protocol_features::COMPRESS] = _options.compressor_factory->supported();
+                            features[protocol_features::COMPRESSION_BYPASS] = "";
                         }
                         if (_options.send_timeout_data) {
                             features[protocol_features::TIMEOUT] = "";
@@ -731,17 +1431,52 @@ namespace nil {
                         if (_options.stream_parent) {
                             features[protocol_features::STREAM_PARENT] =
                                 serialize_connection_id(_options.stream_parent);
+                            if (_stream_flow_control) {
+                                features[protocol_features::STREAM_FLOW_CONTROL] = stream_flow_control_feature();
+                            }
                         }
                         if (!_options.isolation_cookie.empty()) {
                             features[protocol_features::ISOLATION] = _options.isolation_cookie;
                         }
+                        if (_send_priorities.fragment) {
+                            features[protocol_features::FRAGMENTATION] = "";
+                        }
+                        // Stream connections gain nothing, their sink is handed out only once the
+                        // server assigned the connection id.
+                        if (_options.zero_rtt && !_options.stream_parent) {
+                            _zero_rtt_offer = encoding_features(features);
+                            auto cached = _options.zero_rtt->get(_server_addr, _zero_rtt_offer);
+                            features[protocol_features::ZERO_RTT] = "";
+                            if (cached) {
+                                // Offer exactly what was negotiated last time and encode the requests that
+                                // follow accordingly, the server either grants all of it or runs none of them.
+                                for (auto id : {protocol_features::COMPRESS, protocol_features::TIMEOUT,
+                                                protocol_features::COMPRESSION_BYPASS,
+                                                protocol_features::FRAGMENTATION}) {
+                                    features.erase(id);
+                                }
+                                features.insert(cached->begin(), cached->end());
+                                features[protocol_features::ZERO_RTT] = zero_rtt_early_data;
+                                negotiate(std::move(*cached));
+                                _sent_early_data = true;
+                            }
+                        }
 
-                        return send_negotiation_frame(std::move(features))
-                            .then([this] { return negotiate_protocol(_read_buf); })
+                        // With early data the negotiation frame is flushed together with the first requests.
+                        bool flush = !_sent_early_data || outgoing_queue_empty();
+                        return send_negotiation_frame(std::move(features), flush)
+                            .then([this] {
+                                if (_sent_early_data) {
+                                    send_loop();
+                                }
+                                return negotiate_protocol(_read_buf);
+                            })
                             .then([this]() {
                                 _client_negotiated->set_value();
                                 _client_negotiated = boost::none;
-                                send_loop();
+                                if (!_sent_early_data) {
+                                    send_loop();
+                                }
                                 return do_until(
                                     [this] { return _read_buf.eof() || _error; },
                                     [this]() mutable {
@@ -752,12 +1487,11 @@ namespace nil {
                                             [this](std::tuple<int64_t, boost::optional<rcv_buf>> msg_id_and_data) {
                                                 auto &msg_id = std::get<0>(msg_id_and_data);
                                                 auto &data = std::get<1>(msg_id_and_data);
-                                                auto it = _outstanding.find(std::abs(msg_id));
+                                                auto handler =
+                                                    data ? _outstanding.extract(std::abs(msg_id)) : nullptr;
                                                 if (!data) {
                                                     _error = true;
-                                                } else if (it != _outstanding.end()) {
-                                                    auto handler = std::move(it->second);
-                                                    _outstanding.erase(it);
+                                                } else if (handler) {
                                                     (*handler)(*this, msg_id, std::move(data.value()));
                                                 } else if (msg_id < 0) {
                                                     try {
@@ -806,6 +1540,7 @@ namespace nil {
                         }
                         _error = true;
                         _stream_queue.abort(std::make_exception_ptr(stream_closed()));
+                        _stream_credit.broken(std::make_exception_ptr(closed_error()));
                         return stop_send_loop()
                             .then_wrapped([this](future<> f) {
                                 f.ignore_ready_future();
@@ -845,6 +1580,122 @@ namespace nil {
                 client(l, s, client_options {}, std::move(socket), addr, local) {
             }
 
+            client_pool::client_pool(client_pool_options options, connect_function connect_fn) :
+                _options(std::move(options)), _connect(std::move(connect_fn)) {
+                if (!_options.connections) {
+                    throw std::invalid_argument("client_pool needs at least one connection");
+                }
+                if (_options.routing == client_pool_options::routing_type::verb_class && !_options.verb_class) {
+                    throw std::invalid_argument("client_pool routing by verb class needs a verb_class function");
+                }
+                _slots.resize(_options.connections);
+                for (unsigned i = 0; i < _slots.size(); i++) {
+                    connect(i);
+                }
+            }
+
+            socket_address client_pool::local_address(unsigned index) const {
+                if (!_options.local_port_base) {
+                    return {};
+                }
+                return socket_address(ipv4_addr(uint16_t(*_options.local_port_base + index)));
+            }
+
+            void client_pool::connect(unsigned index) {
+                _slots[index].c = _connect(local_address(index));
+                _slots[index].connected_at = rpc_clock_type::now();
+            }
+
+            bool client_pool::refresh(unsigned index) {
+                auto &s = _slots[index];
+                if (!s.c->error()) {
+                    return true;
+                }
+                if (_stopped || rpc_clock_type::now() - s.connected_at < _options.reconnect_interval) {
+                    return false;
+                }
+                // calls still running on the old connection keep it alive until they complete
+                (void)with_gate(_retired, [c = std::move(s.c)] { return c->stop().finally([c] {}); });
+                connect(index);
+                _reconnects++;
+                return !_slots[index].c->error();
+            }
+
+            shared_ptr<client> client_pool::least_outstanding() {
+                // start the scan at a rotating index so that ties are spread over all connections
+                auto start = _next++ % _slots.size();
+                boost::optional<unsigned> best;
+                for (unsigned i = 0; i < _slots.size(); i++) {
+                    auto index = (start + i) % _slots.size();
+                    if (!refresh(index)) {
+                        continue;
+                    }
+                    if (!best || _slots[index].c->outstanding_replies() < _slots[*best].c->outstanding_replies()) {
+                        best = index;
+                    }
+                }
+                // with every connection broken the call fails on one of them with closed_error
+                return _slots[best.value_or(start)].c;
+            }
+
+            shared_ptr<client> client_pool::pick(uint64_t verb) {
+                if (_options.routing == client_pool_options::routing_type::verb_class) {
+                    auto index = _options.verb_class(verb) % _slots.size();
+                    if (refresh(index)) {
+                        return _slots[index].c;
+                    }
+                }
+                return least_outstanding();
+            }
+
+            future<> client_pool::stop() {
+                _stopped = true;
+                return parallel_for_each(_slots, [](slot &s) { return s.c->stop(); }).finally([this] {
+                    return _retired.close();
+                });
+            }
+
+            call_policy::call_policy(call_policy_options options) : _options(std::move(options)) {
+                if (_options.hedge_quantile <= 0 || _options.hedge_quantile > 1) {
+                    throw std::invalid_argument("call_policy hedge quantile has to be in (0, 1]");
+                }
+            }
+
+            call_policy::verb &call_policy::get(uint64_t v) {
+                auto &p = _verbs[v];
+                if (!p) {
+                    p = std::make_unique<verb>();
+                }
+                return *p;
+            }
+
+            void call_policy::set_idempotent(uint64_t v, bool idempotent) {
+                get(v).idempotent = idempotent;
+            }
+
+            bool call_policy::idempotent(uint64_t v) const {
+                auto it = _verbs.find(v);
+                return it != _verbs.end() && it->second->idempotent;
+            }
+
+            rpc_clock_type::duration call_policy::hedge_delay(uint64_t v) const {
+                auto it = _verbs.find(v);
+                if (it == _verbs.end() || it->second->latency.count() < _options.min_latency_samples) {
+                    return _options.default_hedge_delay;
+                }
+                auto q = std::chrono::duration_cast<rpc_clock_type::duration>(
+                    it->second->latency.quantile(_options.hedge_quantile));
+                return std::clamp(q, _options.min_hedge_delay, _options.max_hedge_delay);
+            }
+
+            rpc_clock_type::duration call_policy::retry_backoff(unsigned retry) const {
+                auto backoff = _options.retry_backoff;
+                while (retry-- && backoff < _options.max_retry_backoff) {
+                    backoff *= 2;
+                }
+                return std::min(backoff, _options.max_retry_backoff);
+            }
+
             future<feature_map> server::connection::negotiate(feature_map requested) {
                 feature_map ret;
                 future<> f = make_ready_future<>();
@@ -860,6 +1711,13 @@ namespace nil {
                                 }
                             }
                         } break;
+                        case protocol_features::COMPRESSION_BYPASS:
+                            // features are negotiated in id order, so compression is already settled
+                            if (_compressor) {
+                                _raw_frames_negotiated = true;
+                                ret[protocol_features::COMPRESSION_BYPASS] = "";
+                            }
+                            break;
                         case protocol_features::TIMEOUT:
                             _timeout_negotiated = true;
                             ret[protocol_features::TIMEOUT] = "";
@@ -907,6 +1765,38 @@ namespace nil {
                             ret.emplace(e);
                             break;
                         }
+                        case protocol_features::FRAGMENTATION:
+                            // a server can always reassemble, whether it fragments its own frames is up to it
+                            _fragmentation_negotiated = true;
+                            ret[protocol_features::FRAGMENTATION] = "";
+                            break;
+                        case protocol_features::STREAM_FLOW_CONTROL:
+                            // features are negotiated in id order, so it is known whether this is a stream
+                            if (_is_stream && _stream_flow_control) {
+                                negotiate_stream_flow_control(e.second);
+                                ret[protocol_features::STREAM_FLOW_CONTROL] = stream_flow_control_feature();
+                            }
+                            break;
+                        case protocol_features::ZERO_RTT: {
+                            // Features are negotiated in id order, so the encoding is settled. Requests that
+                            // follow the negotiation frame are only readable if every encoding feature the
+                            // client offered was granted as offered. FRAGMENTATION comes later, but is
+                            // always granted.
+                            auto granted = [&](protocol_features f) {
+                                auto offered = requested.find(f);
+                                auto reply = ret.find(f);
+                                return offered == requested.end() ||
+                                       (reply != ret.end() && reply->second == offered->second);
+                            };
+                            if (e.second.empty() || (granted(protocol_features::COMPRESS) &&
+                                                     granted(protocol_features::TIMEOUT) &&
+                                                     granted(protocol_features::COMPRESSION_BYPASS))) {
+                                ret[protocol_features::ZERO_RTT] = "";
+                            } else {
+                                _early_data_rejected = true;
+                            }
+                            break;
+                        }
                         default:
                             // nothing to do
                             ;
@@ -980,12 +1870,14 @@ namespace nil {
             future<> server::connection::respond(int64_t msg_id,
                                                  snd_buf &&data,
                                                  boost::optional<rpc_clock_type::time_point>
-                                                     timeout) {
+                                                     timeout,
+                                                 latency_histogram *queue_latency,
+                                                 unsigned priority) {
                 static_assert(snd_buf::chunk_size >= 12, "send buffer chunk size is too small");
                 auto p = data.front().get_write();
                 write_le<int64_t>(p, msg_id);
                 write_le<uint32_t>(p + 8, data.size - 12);
-                return send(std::move(data), timeout);
+                return send(std::move(data), timeout, nullptr, queue_latency, priority);
             }
 
             future<> server::connection::send_unknown_verb_reply(boost::optional<rpc_clock_type::time_point> timeout,
@@ -1018,6 +1910,12 @@ namespace nil {
             future<> server::connection::process() {
                 return negotiate_protocol(_read_buf)
                     .then([this]() mutable {
+                        if (_early_data_rejected) {
+                            // The requests that follow were encoded differently than negotiated, close
+                            // without running any of them. The client sees that zero-RTT was not
+                            // acknowledged and fails them.
+                            return make_ready_future<>();
+                        }
                         auto sg = _isolation_config ? _isolation_config->sched_group : current_scheduling_group();
                         return with_scheduling_group(sg, [this] {
                             send_loop();
@@ -1029,6 +1927,10 @@ namespace nil {
                                     }
                                     return read_request_frame_compressed(_read_buf).then(
                                         [this](request_frame::header_and_buffer_type header_and_buffer) {
+                                            if (_server.latency() || load_shedding_enabled()) {
+                                                // the wait for the scheduling group and for memory counts
+                                                _request_arrival = admission_controller::clock_type::now();
+                                            }
                                             auto &expire = std::get<0>(header_and_buffer);
                                             auto &type = std::get<1>(header_and_buffer);
                                             auto &msg_id = std::get<2>(header_and_buffer);
@@ -1046,6 +1948,8 @@ namespace nil {
                                                 if (!h) {
                                                     return send_unknown_verb_reply(timeout, msg_id, type);
                                                 }
+                                                h->stats.dispatched++;
+                                                h->stats.received_bytes += data->size;
 
                                                 // If the new method of per-connection scheduling group was used, honor
                                                 // it. Otherwise, use the old per-handler scheduling group.
@@ -1079,6 +1983,7 @@ namespace nil {
                         _fd.shutdown_input();
                         _error = true;
                         _stream_queue.abort(std::make_exception_ptr(stream_closed()));
+                        _stream_credit.broken(std::make_exception_ptr(closed_error()));
                         return stop_send_loop()
                             .then_wrapped([this](future<> f) {
                                 f.ignore_ready_future();
@@ -1105,6 +2010,77 @@ namespace nil {
                 rpc::connection(std::move(fd), l, serializer, id),
                 _server(s) {
                 _info.addr = std::move(addr);
+                _send_batch_max_messages = std::max(s._options.send_batch_max_messages, 1u);
+                _send_batch_max_bytes = s._options.send_batch_max_bytes;
+                _compression_bypass = s._options.compression_bypass;
+                _stream_flow_control = s._options.stream_flow_control;
+                set_send_priorities(s._options.send_priorities);
+            }
+
+            admission_controller::clock_type::duration admission_controller::drop_delay() const {
+                return std::chrono::duration_cast<clock_type::duration>(_options.interval /
+                                                                        std::sqrt(double(_drop_count)));
+            }
+
+            bool admission_controller::should_shed(clock_type::duration sojourn, clock_type::time_point now) {
+                bool ok_to_drop = false;
+                if (sojourn < _options.target) {
+                    _first_above_time = clock_type::time_point();
+                } else if (_first_above_time == clock_type::time_point()) {
+                    _first_above_time = now + _options.interval;
+                } else if (now >= _first_above_time) {
+                    ok_to_drop = true;
+                }
+
+                if (_dropping) {
+                    if (!ok_to_drop) {
+                        _dropping = false;
+                        return false;
+                    }
+                    if (now < _drop_next) {
+                        return false;
+                    }
+                    _drop_count++;
+                    _drop_next += drop_delay();
+                    return true;
+                }
+                if (!ok_to_drop) {
+                    return false;
+                }
+                _dropping = true;
+                // if the previous dropping period ended recently, resume close to the rate it reached
+                auto recent = now - _drop_next < 8 * _options.interval;
+                _drop_count = recent && _drop_count > 2 ? _drop_count - 2 : 1;
+                _drop_next = now + drop_delay();
+                return true;
+            }
+
+            admission_controller &server::get_admission_controller(scheduling_group sg) {
+                auto it = std::find_if(_admission_controllers.begin(), _admission_controllers.end(),
+                                       [sg](auto &e) { return e.first == sg; });
+                if (it != _admission_controllers.end()) {
+                    return it->second;
+                }
+                _admission_controllers.emplace_back(sg, admission_controller(*_options.load_shedding));
+                return _admission_controllers.back().second;
+            }
+
+            server::connection::shed_reason
+                server::connection::should_shed(admission_controller::clock_type::time_point arrival,
+                                                boost::optional<rpc_clock_type::time_point> timeout) {
+                auto now = admission_controller::clock_type::now();
+                // handlers run in the scheduling group of the connection or of the verb, which is current here
+                auto overloaded = _server.get_admission_controller(current_scheduling_group())
+                                      .should_shed(now - arrival, now);
+                if (timeout && *timeout <= rpc_clock_type::now()) {
+                    _stats.shed_expired++;
+                    return shed_reason::expired;
+                }
+                if (overloaded) {
+                    _stats.shed_overloaded++;
+                    return shed_reason::overloaded;
+                }
+                return shed_reason::none;
             }
 
             future<> server::connection::deregister_this_stream() {
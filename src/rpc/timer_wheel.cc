@@ -0,0 +1,104 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+
+#include <nil/actor/rpc/timer_wheel.hh>
+
+namespace nil {
+    namespace actor {
+
+        namespace rpc {
+
+            constexpr size_t timer_wheel::bucket_count;
+
+            timer_wheel::timer_wheel(duration granularity) : _granularity(granularity), _timer([this] { expire(); }) {
+            }
+
+            timer_wheel::~timer_wheel() {
+                _timer.cancel();
+                if (_buckets) {
+                    for (size_t i = 0; i < bucket_count; i++) {
+                        _buckets[i].clear();
+                    }
+                }
+            }
+
+            void timer_wheel::arm(entry &e, time_point deadline, noncopyable_function<void()> callback) {
+                e.cancel();
+                if (!_buckets) {
+                    _buckets = std::make_unique<bucket[]>(bucket_count);
+                }
+                if (!_timer.armed()) {
+                    _current_tick = tick_of(clock_type::now());
+                    _timer.arm_periodic(_granularity);
+                }
+                e._wheel = this;
+                e._deadline = deadline;
+                e._callback = std::move(callback);
+                // a deadline that is already due goes into the bucket processed by the next tick
+                bucket_of(std::max(tick_of(deadline), _current_tick)).push_back(e);
+                _size++;
+            }
+
+            void timer_wheel::expire() {
+                auto now = clock_type::now();
+                auto now_tick = tick_of(now);
+                // ticks older than one revolution map onto the same buckets, do not scan them twice
+                auto tick = std::max(_current_tick, now_tick - std::min<uint64_t>(now_tick, bucket_count - 1));
+
+                // Collect everything that is due first: a callback may destroy other entries,
+                // which is safe while they sit on a local list but not while iterating a bucket.
+                bucket expired;
+                for (; tick <= now_tick; tick++) {
+                    auto &b = bucket_of(tick);
+                    for (auto it = b.begin(); it != b.end();) {
+                        auto &e = *it;
+                        if (e._deadline <= now) {
+                            it = b.erase(it);
+                            expired.push_back(e);
+                        } else {
+                            ++it;
+                        }
+                    }
+                }
+                // the current tick may still hold entries due later within it
+                _current_tick = now_tick;
+
+                while (!expired.empty()) {
+                    auto &e = expired.front();
+                    expired.pop_front();
+                    _size--;
+                    auto callback = std::move(e._callback);
+                    callback();
+                }
+
+                if (!_size) {
+                    _timer.cancel();
+                }
+            }
+
+        }    // namespace rpc
+
+    }    // namespace actor
+}    // namespace nil
@@ -0,0 +1,307 @@
+//---------------------------------------------------------------------------//
+// Copyright (c) 2018-2021 Mikhail Komarov <nemo@nil.foundation>
+//
+// MIT License
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//---------------------------------------------------------------------------//
+
+
+#include <nil/actor/rpc/zstd_compressor.hh>
+
+#include <zstd.h>
+#include <zdict.h>
+
+namespace nil {
+    namespace actor {
+        namespace rpc {
+
+            // Compressed message format:
+            // The message is a single standard zstd frame with the decompressed size
+            // recorded in the frame header. When a dictionary is negotiated its id is
+            // omitted from the frame header, both peers already agreed on it.
+
+            namespace {
+
+                struct compression_context_deleter {
+                    void operator()(ZSTD_CCtx *ctx) const noexcept {
+                        ZSTD_freeCCtx(ctx);
+                    }
+                };
+
+                struct decompression_context_deleter {
+                    void operator()(ZSTD_DCtx *ctx) const noexcept {
+                        ZSTD_freeDCtx(ctx);
+                    }
+                };
+
+                size_t check_zstd(size_t ret, const char *what) {
+                    if (ZSTD_isError(ret)) {
+                        throw std::runtime_error(format("RPC frame ZSTD {} failure: {}", what, ZSTD_getErrorName(ret)));
+                    }
+                    return ret;
+                }
+
+                ZSTD_CCtx *compression_context() {
+                    static thread_local auto ctx =
+                        std::unique_ptr<ZSTD_CCtx, compression_context_deleter>(ZSTD_createCCtx());
+                    return ctx.get();
+                }
+
+                ZSTD_DCtx *decompression_context() {
+                    static thread_local auto ctx =
+                        std::unique_ptr<ZSTD_DCtx, decompression_context_deleter>(ZSTD_createDCtx());
+                    return ctx.get();
+                }
+
+                sstring feature_name(const zstd_dictionary *dictionary) {
+                    if (!dictionary) {
+                        return "ZSTD";
+                    }
+                    return "ZSTD:" + to_sstring(dictionary->id());
+                }
+
+            }    // namespace
+
+            void zstd_dictionary::cdict_deleter::operator()(ZSTD_CDict_s *cdict) const noexcept {
+                ZSTD_freeCDict(cdict);
+            }
+
+            void zstd_dictionary::ddict_deleter::operator()(ZSTD_DDict_s *ddict) const noexcept {
+                ZSTD_freeDDict(ddict);
+            }
+
+            zstd_dictionary::zstd_dictionary(sstring content, int level) :
+                _content(std::move(content)), _id(ZSTD_getDictID_fromDict(_content.data(), _content.size())),
+                _level(level) {
+                if (!_id) {
+                    throw std::invalid_argument("zstd dictionary is not in zstd format and cannot be identified");
+                }
+                _cdict.reset(ZSTD_createCDict_byReference(_content.data(), _content.size(), _level));
+                _ddict.reset(ZSTD_createDDict_byReference(_content.data(), _content.size()));
+                if (!_cdict || !_ddict) {
+                    throw std::runtime_error("failed to load zstd dictionary");
+                }
+            }
+
+            zstd_dictionary::~zstd_dictionary() = default;
+
+            sstring zstd_dictionary::train(const std::vector<sstring> &samples, size_t capacity) {
+                std::string samples_buffer;
+                std::vector<size_t> sample_sizes;
+                sample_sizes.reserve(samples.size());
+                for (auto &&s : samples) {
+                    samples_buffer += s;
+                    sample_sizes.push_back(s.size());
+                }
+                sstring dictionary(sstring::initialized_later(), capacity);
+                auto size = ZDICT_trainFromBuffer(dictionary.data(), dictionary.size(), samples_buffer.data(),
+                                                  sample_sizes.data(), sample_sizes.size());
+                if (ZDICT_isError(size)) {
+                    throw std::runtime_error(
+                        format("zstd dictionary training failed: {}", ZDICT_getErrorName(size)));
+                }
+                dictionary.resize(size);
+                return dictionary;
+            }
+
+            zstd_compressor::factory::factory(int level) : _level(level), _name(feature_name(nullptr)) {
+            }
+
+            zstd_compressor::factory::factory(std::shared_ptr<const zstd_dictionary> dictionary) :
+                _level(dictionary->level()), _dictionary(std::move(dictionary)),
+                _name(feature_name(_dictionary.get())) {
+            }
+
+            const sstring &zstd_compressor::factory::supported() const {
+                return _name;
+            }
+
+            std::unique_ptr<rpc::compressor> zstd_compressor::factory::negotiate(sstring feature,
+                                                                                 bool is_server) const {
+                return feature == _name ? std::make_unique<zstd_compressor>(_level, _dictionary) : nullptr;
+            }
+
+            zstd_compressor::zstd_compressor(int level, std::shared_ptr<const zstd_dictionary> dictionary) :
+                _level(level), _dictionary(std::move(dictionary)) {
+            }
+
+            sstring zstd_compressor::name() const {
+                return feature_name(_dictionary.get());
+            }
+
+            snd_buf zstd_compressor::compress(size_t head_space, snd_buf data) {
+                auto ctx = compression_context();
+                ZSTD_CCtx_reset(ctx, ZSTD_reset_session_and_parameters);
+                if (_dictionary) {
+                    check_zstd(ZSTD_CCtx_refCDict(ctx, _dictionary->cdict()), "compression setup");
+                    check_zstd(ZSTD_CCtx_setParameter(ctx, ZSTD_c_dictIDFlag, 0), "compression setup");
+                } else {
+                    check_zstd(ZSTD_CCtx_setParameter(ctx, ZSTD_c_compressionLevel, _level), "compression setup");
+                }
+
+                auto src = std::get_if<temporary_buffer<char>>(&data.bufs);
+                auto bound = ZSTD_compressBound(data.size);
+                if (src && head_space + bound <= snd_buf::chunk_size) {
+                    // faster path for small messages
+                    auto dst = temporary_buffer<char>(head_space + bound);
+                    auto compressed_size =
+                        check_zstd(ZSTD_compress2(ctx, dst.get_write() + head_space, bound, src->get(), src->size()),
+                                   "compression");
+                    dst.trim(head_space + compressed_size);
+                    return snd_buf(std::move(dst));
+                }
+
+                // Large or fragmented message: stream it fragment by fragment into
+                // snd_buf::chunk_size output fragments.
+                check_zstd(ZSTD_CCtx_setPledgedSrcSize(ctx, data.size), "compression setup");
+
+                std::vector<temporary_buffer<char>> dst_buffers;
+                dst_buffers.emplace_back(std::max<size_t>(head_space, snd_buf::chunk_size));
+                ZSTD_outBuffer out {dst_buffers.back().get_write(), dst_buffers.back().size(), head_space};
+                size_t total_compressed_size = 0;
+
+                auto next_dst = [&] {
+                    dst_buffers.back().trim(out.pos);
+                    total_compressed_size += out.pos;
+                    dst_buffers.emplace_back(snd_buf::chunk_size);
+                    out = ZSTD_outBuffer {dst_buffers.back().get_write(), dst_buffers.back().size(), 0};
+                };
+
+                auto compress_fragment = [&](const char *ptr, size_t size, bool last) {
+                    ZSTD_inBuffer in {ptr, size, 0};
+                    auto directive = last ? ZSTD_e_end : ZSTD_e_continue;
+                    while (true) {
+                        if (out.pos == out.size) {
+                            next_dst();
+                        }
+                        auto remaining = check_zstd(ZSTD_compressStream2(ctx, &out, &in, directive), "compression");
+                        if (last ? remaining == 0 : in.pos == in.size) {
+                            break;
+                        }
+                    }
+                };
+
+                if (src) {
+                    compress_fragment(src->get(), src->size(), true);
+                } else {
+                    auto &bufs = std::get<std::vector<temporary_buffer<char>>>(data.bufs);
+                    if (bufs.empty()) {
+                        compress_fragment(nullptr, 0, true);
+                    }
+                    for (size_t i = 0; i < bufs.size(); ++i) {
+                        compress_fragment(bufs[i].get(), bufs[i].size(), i + 1 == bufs.size());
+                    }
+                }
+
+                dst_buffers.back().trim(out.pos);
+                total_compressed_size += out.pos;
+
+                if (dst_buffers.size() == 1) {
+                    return snd_buf(std::move(dst_buffers.front()));
+                }
+                return snd_buf(std::move(dst_buffers), total_compressed_size);
+            }
+
+            rcv_buf zstd_compressor::decompress(rcv_buf data) {
+                if (data.size == 0) {
+                    return rcv_buf();
+                }
+
+                auto ctx = decompression_context();
+                ZSTD_DCtx_reset(ctx, ZSTD_reset_session_and_parameters);
+
+                auto src = std::get_if<temporary_buffer<char>>(&data.bufs);
+                if (src) {
+                    auto content_size = ZSTD_getFrameContentSize(src->get(), src->size());
+                    if (content_size != ZSTD_CONTENTSIZE_UNKNOWN && content_size != ZSTD_CONTENTSIZE_ERROR &&
+                        content_size <= snd_buf::chunk_size) {
+                        // faster path for small messages: single frame in a single buffer
+                        auto dst = temporary_buffer<char>(content_size);
+                        auto size = check_zstd(ZSTD_decompress_usingDDict(
+                                                   ctx, dst.get_write(), dst.size(), src->get(), src->size(),
+                                                   _dictionary ? _dictionary->ddict() : nullptr),
+                                               "decompression (short)");
+                        if (size != content_size) {
+                            throw std::runtime_error("RPC frame ZSTD decompression failure (short): size mismatch");
+                        }
+                        return rcv_buf(std::move(dst));
+                    }
+                }
+
+                if (_dictionary) {
+                    check_zstd(ZSTD_DCtx_refDDict(ctx, _dictionary->ddict()), "decompression setup");
+                }
+
+                std::vector<temporary_buffer<char>> dst_buffers;
+                dst_buffers.emplace_back(snd_buf::chunk_size);
+                ZSTD_outBuffer out {dst_buffers.back().get_write(), dst_buffers.back().size(), 0};
+                size_t total_size = 0;
+                size_t remaining = 1;
+
+                auto next_dst = [&] {
+                    dst_buffers.back().trim(out.pos);
+                    total_size += out.pos;
+                    dst_buffers.emplace_back(snd_buf::chunk_size);
+                    out = ZSTD_outBuffer {dst_buffers.back().get_write(), dst_buffers.back().size(), 0};
+                };
+
+                auto decompress_fragment = [&](const temporary_buffer<char> &buf) {
+                    ZSTD_inBuffer in {buf.get(), buf.size(), 0};
+                    // Keep going while there is input left or the decoder may still hold
+                    // output that did not fit into the current fragment.
+                    while (remaining && (in.pos < in.size || out.pos == out.size)) {
+                        if (out.pos == out.size) {
+                            next_dst();
+                        }
+                        remaining = check_zstd(ZSTD_decompressStream(ctx, &out, &in), "decompression (long)");
+                    }
+                    if (in.pos < in.size) {
+                        throw std::runtime_error("RPC frame ZSTD decompression failure: trailing data after frame");
+                    }
+                };
+
+                if (src) {
+                    decompress_fragment(*src);
+                } else {
+                    for (auto &&buf : std::get<std::vector<temporary_buffer<char>>>(data.bufs)) {
+                        decompress_fragment(buf);
+                    }
+                }
+                if (remaining) {
+                    throw std::runtime_error(
+                        format("RPC frame ZSTD decompression failure (long): truncated frame at {} bytes",
+                               total_size + out.pos));
+                }
+
+                dst_buffers.back().trim(out.pos);
+                total_size += out.pos;
+                if (dst_buffers.size() > 1 && dst_buffers.back().empty()) {
+                    dst_buffers.pop_back();
+                }
+
+                if (dst_buffers.size() == 1) {
+                    return rcv_buf(std::move(dst_buffers.front()));
+                }
+                return rcv_buf(std::move(dst_buffers), total_size);
+            }
+
+        }    // namespace rpc
+    }        // namespace actor
+}    // namespace nil
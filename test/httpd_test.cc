@@ -24,12 +24,17 @@
 
 #include <nil/actor/http/httpd.hh>
 #include <nil/actor/http/handlers.hh>
+#include <nil/actor/http/file_handler.hh>
+#include <nil/actor/http/hpack.hh>
+#include <nil/actor/http/http2.hh>
 #include <nil/actor/http/matcher.hh>
 #include <nil/actor/http/matchrules.hh>
 #include <nil/actor/json/formatter.hh>
 #include <nil/actor/http/routes.hh>
 #include <nil/actor/http/exception.hh>
 #include <nil/actor/http/transformers.hh>
+#include <nil/actor/core/byteorder.hh>
+#include <nil/actor/core/core.hh>
 #include <nil/actor/core/do_with.hh>
 #include <nil/actor/core/loop.hh>
 #include <nil/actor/core/when_all.hh>
@@ -37,6 +42,7 @@
 #include <nil/actor/testing/thread_test_case.hh>
 
 #include "loopback_socket.hh"
+#include "tmpdir.hh"
 
 #include <boost/algorithm/string.hpp>
 
@@ -44,6 +50,9 @@
 #include <nil/actor/detail/noncopyable_function.hh>
 #include <nil/actor/http/json_path.hh>
 
+#include <filesystem>
+#include <fstream>
+#include <map>
 #include <sstream>
 
 using namespace nil::actor;
@@ -106,11 +115,72 @@ ACTOR_TEST_CASE(test_match_rule_order) {
     route.add(operation_type::GET, url("/hello"), h1);
 
     handl *h2 = new handl();
-    route.add(operation_type::GET, url("/hello"), h2);
+    route.add(operation_type::GET, url("/hello").remainder("path"), h2);
+
+    handl *h3 = new handl();
+    match_rule *mr = new match_rule(h3);
+    mr->add_str("/hello").add_param("param");
+    route.add(mr, operation_type::GET);
 
     auto rh = route.get_handler(GET, "/hello", param);
     BOOST_REQUIRE_EQUAL(rh, h1);
+    rh = route.get_handler(GET, "/hello/val1", param);
+    BOOST_REQUIRE_EQUAL(rh, h2);
+    BOOST_REQUIRE_EQUAL(param["path"], "val1");
+
+    // a rule with an existing pattern is refused, whatever its parameter names
+    handl *h4 = new handl();
+    BOOST_REQUIRE_THROW(route.add(operation_type::GET, url("/hello"), h4), std::runtime_error);
+    match_rule dup(nullptr);
+    dup.add_str("/hello").add_param("other");
+    BOOST_REQUIRE_THROW(route.add(&dup, operation_type::GET), std::runtime_error);
+
+    return make_ready_future<>();
+}
+
+ACTOR_TEST_CASE(test_route_tree) {
+    routes rts;
+    handl *files = new handl();
+    match_rule by_id(new handl());
+    by_id.add_str("/api/users").add_param("id");
+    match_rule items(new handl());
+    items.add_str("/api/users").add_param("id").add_str("/items").add_param("item");
+    match_rule me(new handl());
+    me.add_str("/api/users/me");
+    parameters params;
+    httpd::handler_base *nl = nullptr;
 
+    auto reg_items = rule_registration(rts, items);
+    auto reg_me = rule_registration(rts, me);
+    rts.add(GET, url("/files").remainder("path"), files);
+    {
+        auto reg_by_id = rule_registration(rts, by_id);
+
+        BOOST_REQUIRE_EQUAL(rts.get_handler(GET, "/api/users/17", params), by_id.handler());
+        BOOST_REQUIRE_EQUAL(params["id"], "17");
+        params.clear();
+        BOOST_REQUIRE_EQUAL(rts.get_handler(GET, "/api/users/17/", params), by_id.handler());
+        params.clear();
+        // an earlier fixed string wins over a later parameter
+        BOOST_REQUIRE_EQUAL(rts.get_handler(GET, "/api/users/me", params), me.handler());
+        params.clear();
+        BOOST_REQUIRE_EQUAL(rts.get_handler(GET, "/api/users/17/items/4", params), items.handler());
+        BOOST_REQUIRE_EQUAL(params["id"], "17");
+        BOOST_REQUIRE_EQUAL(params["item"], "4");
+        params.clear();
+        BOOST_REQUIRE_EQUAL(rts.get_handler(GET, "/files/etc/hosts", params), files);
+        BOOST_REQUIRE_EQUAL(params.path("path"), "/etc/hosts");
+        params.clear();
+        BOOST_REQUIRE_EQUAL(rts.get_handler(GET, "/files", params), files);
+        BOOST_REQUIRE_EQUAL(params.path("path"), "");
+        params.clear();
+        BOOST_REQUIRE_EQUAL(rts.get_handler(GET, "/api/users", params), nl);
+        BOOST_REQUIRE_EQUAL(rts.get_handler(GET, "/api/usersx/17", params), nl);
+        BOOST_REQUIRE_EQUAL(rts.get_handler(GET, "/api/users/17/items", params), nl);
+        BOOST_REQUIRE_EQUAL(rts.get_handler(POST, "/api/users/17", params), nl);
+    }
+    BOOST_REQUIRE_EQUAL(rts.get_handler(GET, "/api/users/17", params), nl);
+    BOOST_REQUIRE_EQUAL(rts.get_handler(GET, "/api/users/17/items/4", params), items.handler());
     return make_ready_future<>();
 }
 
@@ -211,6 +281,28 @@ ACTOR_TEST_CASE(test_decode_url) {
     http_server::connection::set_query_param(req);
     BOOST_REQUIRE_EQUAL(req.get_query_param("a"), "#$#");
     BOOST_REQUIRE_EQUAL(req.get_query_param("b"), "\"&\"");
+    req._url = "/a?a=1&b&%63=x+y&a=2&d=%2";
+    BOOST_REQUIRE_EQUAL(req.get_query_param("a"), "2");
+    BOOST_REQUIRE_EQUAL(req.get_query_param("b"), "");
+    BOOST_REQUIRE_EQUAL(req.get_query_param("c"), "x y");
+    BOOST_REQUIRE_EQUAL(req.get_query_param("d"), "");
+    BOOST_REQUIRE_EQUAL(req.get_query_param("e"), "");
+    // the last properly encoded one of repeated parameters wins
+    req._url = "/a?a=1&a=%2&b=%2&b=2&%2=3&c=1&c&d";
+    BOOST_REQUIRE_EQUAL(req.get_query_param("a"), "1");
+    BOOST_REQUIRE_EQUAL(req.get_query_param("b"), "2");
+    BOOST_REQUIRE_EQUAL(req.get_query_param("%2"), "");
+    BOOST_REQUIRE_EQUAL(req.get_query_param("c"), "");
+    BOOST_REQUIRE_EQUAL(req.get_query_param("d"), "");
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+    auto params = req.query_parameters();
+#pragma GCC diagnostic pop
+    BOOST_REQUIRE_EQUAL(params.size(), 4u);
+    BOOST_REQUIRE_EQUAL(params["a"], "1");
+    BOOST_REQUIRE_EQUAL(params["b"], "2");
+    BOOST_REQUIRE_EQUAL(params["c"], "");
+    BOOST_REQUIRE_EQUAL(params.count("d"), 1u);
     return make_ready_future<>();
 }
 
@@ -338,7 +430,7 @@ public:
 future<> test_transformer_stream(std::stringstream &ss, content_replace &cr, std::vector<sstring> &&buffer_parts) {
     std::unique_ptr<nil::actor::httpd::request> req = std::make_unique<nil::actor::httpd::request>();
     ss.str("");
-    req->_headers["Host"] = "localhost";
+    req->_headers.set("Host", "localhost");
     return do_with(
         output_stream<char>(
             cr.transform(std::move(req), "json", output_stream<char>(memory_data_sink(ss), 32000, true))),
@@ -873,6 +965,153 @@ ACTOR_TEST_CASE(test_100_continue) {
     });
 }
 
+ACTOR_TEST_CASE(test_request_body) {
+    return nil::actor::async([] {
+        loopback_connection_factory lcf;
+        http_server server("test");
+        server.set_content_length_limit(16);
+        loopback_socket_impl lsi(lcf);
+        httpd::http_server_tester::listeners(server).emplace_back(lcf.get_server_socket());
+        future<> client = nil::actor::async([&lsi] {
+            connected_socket c_socket = lsi.connect(socket_address(ipv4_addr()), socket_address(ipv4_addr())).get0();
+            input_stream<char> input(c_socket.input());
+            output_stream<char> output(c_socket.output());
+            auto request = [&](sstring path, sstring headers, sstring body) {
+                output.write("POST " + path + " HTTP/1.1\r\nHost: test\r\n" + headers + "\r\n" + body).get();
+                output.flush().get();
+                auto resp = input.read().get0();
+                return std::string(resp.get(), resp.size());
+            };
+
+            // a buffering handler gets the decoded chunks in request::content
+            auto resp = request("/buffered", "Transfer-Encoding: chunked\r\n",
+                                "4\r\nWiki\r\n5;ext=1\r\npedia\r\n0\r\nTrailer: x\r\n\r\n");
+            BOOST_REQUIRE_NE(resp.find("200 OK"), std::string::npos);
+            BOOST_REQUIRE_NE(resp.find("[Wikipedia]"), std::string::npos);
+
+            // a streaming handler reads the body itself
+            resp = request("/streamed", "Content-Length: 11\r\n", "hello world");
+            BOOST_REQUIRE_NE(resp.find("[11]"), std::string::npos);
+            resp = request("/streamed", "Transfer-Encoding: chunked\r\n", "3\r\nabc\r\n0\r\n\r\n");
+            BOOST_REQUIRE_NE(resp.find("[3]"), std::string::npos);
+
+            // what a handler leaves unread is skipped before the next request
+            resp = request("/ignored", "Transfer-Encoding: chunked\r\n", "3\r\nabc\r\n0\r\n\r\n");
+            BOOST_REQUIRE_NE(resp.find("200 OK"), std::string::npos);
+            resp = request("/ignored", "Content-Length: 5\r\n", "abcde");
+            BOOST_REQUIRE_NE(resp.find("200 OK"), std::string::npos);
+
+            // leading zeros do not count against the size of a chunk size
+            resp = request("/buffered", "Transfer-Encoding: chunked\r\n",
+                           "0000000000000000000003\r\nabc\r\n0\r\n\r\n");
+            BOOST_REQUIRE_NE(resp.find("[abc]"), std::string::npos);
+
+            // the content length limit applies to chunked bodies too
+            resp = request("/buffered", "Transfer-Encoding: chunked\r\n", "11\r\n0123456789abcdefg\r\n0\r\n\r\n");
+            BOOST_REQUIRE_NE(resp.find("413 Payload Too Large"), std::string::npos);
+
+            input.close().get();
+            output.close().get();
+
+            // chunk sizes that overflow size_t or hold bytes above 0x7f are rejected
+            for (sstring size : {"1" + sstring(sizeof(size_t) * 2, '0'), sstring("\xe0"), sstring("1\xb9")}) {
+                auto socket = lsi.connect(socket_address(ipv4_addr()), socket_address(ipv4_addr())).get0();
+                input = socket.input();
+                output = socket.output();
+                resp = request("/buffered", "Transfer-Encoding: chunked\r\n", size + "\r\nabc\r\n0\r\n\r\n");
+                BOOST_REQUIRE_NE(resp.find("400 Bad Request"), std::string::npos);
+                input.close().get();
+                output.close().get();
+            }
+        });
+
+        auto buffered = new function_handler([](const_req req) { return "[" + req.content + "]"; }, "txt");
+        auto streamed = new function_handler(
+            [](std::unique_ptr<request> req, std::unique_ptr<reply> rep) {
+                return do_with(size_t(0), std::move(req), std::move(rep),
+                               [](size_t &size, std::unique_ptr<request> &req, std::unique_ptr<reply> &rep) {
+                                   return repeat([&] {
+                                              return req->content_stream.read().then([&](temporary_buffer<char> b) {
+                                                  size += b.size();
+                                                  return b.empty() ? stop_iteration::yes : stop_iteration::no;
+                                              });
+                                          })
+                                       .then([&] {
+                                           rep->_content = "[" + to_sstring(size) + "]";
+                                           return std::move(rep);
+                                       });
+                               });
+            },
+            "txt");
+        streamed->stream_body();
+        auto ignored = new function_handler([](const_req req) { return ""; }, "txt");
+        ignored->stream_body();
+        server._routes.put(POST, "/buffered", buffered);
+        server._routes.put(POST, "/streamed", streamed);
+        server._routes.put(POST, "/ignored", ignored);
+        server.do_accepts(0).get();
+
+        client.get();
+        server.stop().get();
+    });
+}
+
+ACTOR_TEST_CASE(test_reply_head) {
+    return nil::actor::async([] {
+        loopback_connection_factory lcf;
+        http_server server("test");
+        loopback_socket_impl lsi(lcf);
+        httpd::http_server_tester::listeners(server).emplace_back(lcf.get_server_socket());
+        future<> client = nil::actor::async([&lsi] {
+            connected_socket c_socket = lsi.connect(socket_address(ipv4_addr()), socket_address(ipv4_addr())).get0();
+            input_stream<char> input(c_socket.input());
+            output_stream<char> output(c_socket.output());
+
+            output.write(sstring("GET /test HTTP/1.1\r\nHost: test\r\n\r\n")).get();
+            output.flush().get();
+            auto buf = input.read().get0();
+            auto resp = std::string(buf.get(), buf.size());
+            BOOST_REQUIRE_EQUAL(resp.find("HTTP/1.1 200 OK\r\nServer: Actor httpd\r\nDate: "), 0u);
+            BOOST_REQUIRE_NE(resp.find("\r\nX-Test: yes\r\n"), std::string::npos);
+            // the connection frames the body, whatever the handler claims
+            BOOST_REQUIRE_NE(resp.find("\r\nContent-Length: 5\r\n\r\nhello"), std::string::npos);
+            BOOST_REQUIRE_EQUAL(resp.find("Content-Length: 100"), std::string::npos);
+            // in any case
+            BOOST_REQUIRE_EQUAL(resp.find("content-length"), std::string::npos);
+            BOOST_REQUIRE_EQUAL(resp.find("TRANSFER-ENCODING"), std::string::npos);
+
+            // a Server header set by the handler, in any case, replaces the common one, Date is still added
+            output.write(sstring("GET /server HTTP/1.1\r\nHost: test\r\n\r\n")).get();
+            output.flush().get();
+            buf = input.read().get0();
+            resp = std::string(buf.get(), buf.size());
+            BOOST_REQUIRE_EQUAL(resp.find("HTTP/1.1 200 OK\r\nDate: "), 0u);
+            BOOST_REQUIRE_NE(resp.find("\r\nserver: custom\r\n"), std::string::npos);
+            BOOST_REQUIRE_EQUAL(resp.find("Actor httpd"), std::string::npos);
+
+            input.close().get();
+            output.close().get();
+        });
+
+        auto handler = new function_handler(
+            [](const_req req, reply &rep) {
+                rep.add_header("X-Test", "yes").add_header("Content-Length", "100");
+                rep.add_header("content-length", "200").add_header("TRANSFER-ENCODING", "chunked");
+                return "hello";
+            },
+            "txt");
+        server._routes.put(GET, "/test", handler);
+        server._routes.put(GET, "/server", new function_handler([](const_req req, reply &rep) {
+            rep.add_header("server", "custom");
+            return "hello";
+        }, "txt"));
+        server.do_accepts(0).get();
+
+        client.get();
+        server.stop().get();
+    });
+}
+
 ACTOR_TEST_CASE(test_unparsable_request) {
     // Test if a message that cannot be parsed as a http request is being replied with a 400 Bad Request response
     return nil::actor::async([] {
@@ -907,13 +1146,435 @@ ACTOR_TEST_CASE(test_unparsable_request) {
 
 ACTOR_TEST_CASE(case_insensitive_header) {
     std::unique_ptr<nil::actor::httpd::request> req = std::make_unique<nil::actor::httpd::request>();
-    req->_headers["conTEnt-LengtH"] = "17";
+    req->_headers.set("conTEnt-LengtH", "17");
     BOOST_REQUIRE_EQUAL(req->get_header("content-length"), "17");
     BOOST_REQUIRE_EQUAL(req->get_header("Content-Length"), "17");
     BOOST_REQUIRE_EQUAL(req->get_header("cOnTeNT-lEnGTh"), "17");
     return make_ready_future<>();
 }
 
+ACTOR_TEST_CASE(test_header_map) {
+    request req;
+    sstring long_value(3000, 'x');
+    req._headers.add("Accept", "text/html");
+    req._headers.add("accept", "application/json");
+    req._headers.add("Accept", "*/*", " ");
+    req._headers.set("X-Long", long_value);
+    req._headers.set("Host", "a");
+    req._headers.set("host", "b");
+    BOOST_REQUIRE_EQUAL(req._headers.size(), 3u);
+    BOOST_REQUIRE_EQUAL(req.get_header("ACCEPT"), "text/html,application/json */*");
+    BOOST_REQUIRE_EQUAL(req.get_header("x-long"), long_value);
+    BOOST_REQUIRE_EQUAL(req.get_header("Host"), "b");
+    BOOST_REQUIRE(req._headers.find("Host")->first == "Host");
+    BOOST_REQUIRE_EQUAL(req._headers.count("Missing"), 0u);
+    // the map interface the headers used to have
+    req._headers["HOST"] = "c";
+    req._headers["X-New"] = sstring("new");
+    BOOST_REQUIRE_EQUAL(sstring(req._headers["host"]), "c");
+    BOOST_REQUIRE_EQUAL(sstring(req._headers["x-new"]), "new");
+    BOOST_REQUIRE_EQUAL(sstring(req._headers["Missing"]), "");
+    BOOST_REQUIRE_EQUAL(req._headers.size(), 4u);
+    return make_ready_future<>();
+}
+
+ACTOR_TEST_CASE(test_hpack) {
+    auto unhex = [](std::string_view hex) {
+        std::string bytes;
+        for (size_t i = 0; i < hex.size(); i += 2) {
+            bytes.push_back(char(std::stoi(std::string(hex.substr(i, 2)), nullptr, 16)));
+        }
+        return bytes;
+    };
+    // RFC 7541, C.4: requests with Huffman coding, the second one refers to the dynamic table
+    hpack_decoder decoder;
+    hpack_header_list headers;
+    decoder.decode(unhex("828684418cf1e3c2e5f23a6ba0ab90f4ff"), headers);
+    BOOST_REQUIRE_EQUAL(headers.size(), 4u);
+    BOOST_REQUIRE_EQUAL(headers[0].second, "GET");
+    BOOST_REQUIRE_EQUAL(headers[3].second, "www.example.com");
+    headers.clear();
+    decoder.decode(unhex("828684be5886a8eb10649cbf"), headers);
+    BOOST_REQUIRE_EQUAL(headers[3].second, "www.example.com");
+    BOOST_REQUIRE_EQUAL(headers[4].first, "cache-control");
+    BOOST_REQUIRE_EQUAL(headers[4].second, "no-cache");
+    BOOST_REQUIRE_EQUAL(decoder.table().size(), 110u);
+    BOOST_REQUIRE_THROW(decoder.decode(unhex("ff00"), headers), hpack_error);
+
+    // what the encoder writes, a decoder reads back
+    hpack_encoder encoder;
+    hpack_decoder peer;
+    for (int i = 0; i < 3; ++i) {
+        hpack_header_list sent = {
+            {":status", "200"}, {"content-type", "text/html"}, {"x-id", to_sstring(i)}, {"date", "now"}};
+        std::string block;
+        encoder.encode(sent, block);
+        hpack_header_list received;
+        peer.decode(block, received);
+        BOOST_REQUIRE(received == sent);
+    }
+    return make_ready_future<>();
+}
+
+ACTOR_TEST_CASE(test_pipelined_requests) {
+    return nil::actor::async([] {
+        loopback_connection_factory lcf;
+        http_server server("test");
+        server.set_pipeline_depth(4);
+        loopback_socket_impl lsi(lcf);
+        httpd::http_server_tester::listeners(server).emplace_back(lcf.get_server_socket());
+        future<> client = nil::actor::async([&lsi] {
+            connected_socket c_socket = lsi.connect(socket_address(ipv4_addr()), socket_address(ipv4_addr())).get0();
+            input_stream<char> input(c_socket.input());
+            output_stream<char> output(c_socket.output());
+
+            output.write(sstring("GET /slow HTTP/1.1\r\nHost: test\r\n\r\nGET /fast HTTP/1.1\r\nHost: test\r\n\r\n"))
+                .get();
+            output.flush().get();
+            std::string resp;
+            while (resp.find("fast") == std::string::npos) {
+                auto buf = input.read().get0();
+                BOOST_REQUIRE(!buf.empty());
+                resp += std::string(buf.get(), buf.size());
+            }
+            // the slow reply is sent first although its handler finished last
+            BOOST_REQUIRE_LT(resp.find("slow"), resp.find("fast"));
+
+            input.close().get();
+            output.close().get();
+        });
+
+        promise<> fast_handled;
+        // the slow handler only finishes once the fast one ran, the requests must be handled concurrently
+        server._routes.put(GET, "/slow",
+                           new function_handler(
+                               [&fast_handled](std::unique_ptr<request> req, std::unique_ptr<reply> rep) {
+                                   return fast_handled.get_future().then([rep = std::move(rep)]() mutable {
+                                       rep->write_body("txt", sstring("slow"));
+                                       return std::move(rep);
+                                   });
+                               },
+                               "txt"));
+        server._routes.put(GET, "/fast",
+                           new function_handler(
+                               [&fast_handled](std::unique_ptr<request> req, std::unique_ptr<reply> rep) {
+                                   fast_handled.set_value();
+                                   rep->write_body("txt", sstring("fast"));
+                                   return make_ready_future<std::unique_ptr<reply>>(std::move(rep));
+                               },
+                               "txt"));
+        server.do_accepts(0).get();
+
+        client.get();
+        server.stop().get();
+    });
+}
+
+ACTOR_TEST_CASE(test_file_handler_sendfile) {
+    return nil::actor::async([] {
+        tmpdir tmp;
+        auto file_name = (tmp.path() / "file.txt").string();
+        std::string content;
+        for (int i = 0; content.size() < 100000; ++i) {
+            content += std::to_string(i) + "\n";
+        }
+        std::ofstream(file_name) << content;
+
+        // a posix socket, the file was just written and is in the page cache, it is sent with sendfile()
+        // and a Content-Length
+        http_server server("test");
+        BOOST_REQUIRE(!server.get_sendfile());
+        server.set_sendfile(true);
+        server._routes.put(GET, "/file", new file_handler(file_name, nullptr, false));
+        server._routes.put(GET, "/text", new function_handler([](const_req req) { return "text"; }, "txt"));
+        server.listen(socket_address(ipv4_addr("127.0.0.1", 0))).get();
+        auto addr = httpd::http_server_tester::listeners(server).front().local_address();
+        connected_socket c_socket = connect(addr).get0();
+        input_stream<char> input(c_socket.input());
+        output_stream<char> output(c_socket.output());
+
+        output.write(sstring("GET /text HTTP/1.1\r\n\r\nGET /file HTTP/1.1\r\nHost: test\r\n\r\n"
+                             "GET /file HTTP/1.1\r\nConnection: Close\r\n\r\n"))
+            .get();
+        output.flush().get();
+        std::string resp;
+        for (auto buf = input.read().get0(); !buf.empty(); buf = input.read().get0()) {
+            resp += std::string(buf.get(), buf.size());
+        }
+        // the reply before the file is flushed to the socket before the file is sent
+        auto head_end = resp.find("\r\n\r\n") + 4;
+        BOOST_REQUIRE_EQUAL(resp.substr(head_end, 4), "text");
+        resp = resp.substr(head_end + 4);
+        head_end = resp.find("\r\n\r\n") + 4;
+        auto head = resp.substr(0, head_end);
+        BOOST_REQUIRE_EQUAL(head.find("HTTP/1.1 200 OK\r\n"), 0u);
+        BOOST_REQUIRE_NE(head.find("\r\nContent-Length: " + std::to_string(content.size()) + "\r\n"),
+                         std::string::npos);
+        BOOST_REQUIRE_EQUAL(head.find("Transfer-Encoding"), std::string::npos);
+        BOOST_REQUIRE(resp.substr(head_end, content.size()) == content);
+        // the second reply follows the body of the first one
+        resp = resp.substr(head_end + content.size());
+        head_end = resp.find("\r\n\r\n") + 4;
+        BOOST_REQUIRE_EQUAL(resp.find("HTTP/1.1 200 OK\r\n"), 0u);
+        BOOST_REQUIRE(resp.substr(head_end) == content);
+
+        input.close().get();
+        output.close().get();
+        server.stop().get();
+    });
+}
+
+ACTOR_TEST_CASE(test_file_cache) {
+    return nil::actor::async([] {
+        tmpdir tmp;
+        auto file_name = (tmp.path() / "file.txt").string();
+        std::ofstream(file_name) << "hello";
+        std::ofstream(file_name + ".gz") << "compressed";
+
+        loopback_connection_factory lcf;
+        http_server server("test");
+        loopback_socket_impl lsi(lcf);
+        httpd::http_server_tester::listeners(server).emplace_back(lcf.get_server_socket());
+        // revalidated on every request
+        auto cache = make_lw_shared<file_cache>(64 << 20, 1 << 20, lowres_clock::duration(0));
+        future<> client = nil::actor::async([&lsi] {
+            connected_socket c_socket = lsi.connect(socket_address(ipv4_addr()), socket_address(ipv4_addr())).get0();
+            input_stream<char> input(c_socket.input());
+            output_stream<char> output(c_socket.output());
+            auto get = [&](const sstring &headers) {
+                output.write("GET /file HTTP/1.1\r\nHost: test\r\n" + headers + "\r\n").get();
+                output.flush().get();
+                auto buf = input.read().get0();
+                return std::string(buf.get(), buf.size());
+            };
+            auto header = [](const std::string &resp, const std::string &name) {
+                auto pos = resp.find("\r\n" + name + ": ");
+                BOOST_REQUIRE_NE(pos, std::string::npos);
+                pos += name.size() + 4;
+                return resp.substr(pos, resp.find("\r\n", pos) - pos);
+            };
+
+            auto resp = get("");
+            BOOST_REQUIRE_EQUAL(resp.find("HTTP/1.1 200 OK\r\n"), 0u);
+            BOOST_REQUIRE_EQUAL(resp.substr(resp.size() - 5), "hello");
+            BOOST_REQUIRE_EQUAL(resp.find("Content-Encoding"), std::string::npos);
+            auto etag = header(resp, "ETag");
+            auto last_modified = header(resp, "Last-Modified");
+            BOOST_REQUIRE_EQUAL(header(resp, "Vary"), "Accept-Encoding");
+
+            resp = get("If-None-Match: " + etag + "\r\n");
+            BOOST_REQUIRE_EQUAL(resp.find("HTTP/1.1 304 Not Modified\r\n"), 0u);
+            BOOST_REQUIRE_EQUAL(resp.find("Content-Length"), std::string::npos);
+            BOOST_REQUIRE_EQUAL(header(resp, "ETag"), etag);
+            resp = get("If-Modified-Since: " + last_modified + "\r\n");
+            BOOST_REQUIRE_EQUAL(resp.find("HTTP/1.1 304 Not Modified\r\n"), 0u);
+            resp = get("If-None-Match: \"other\"\r\nIf-Modified-Since: " + last_modified + "\r\n");
+            BOOST_REQUIRE_EQUAL(resp.find("HTTP/1.1 200 OK\r\n"), 0u);
+
+            resp = get("Accept-Encoding: br, gzip\r\n");
+            BOOST_REQUIRE_EQUAL(header(resp, "Content-Encoding"), "gzip");
+            auto gzip_etag = header(resp, "ETag");
+            BOOST_REQUIRE_NE(gzip_etag, etag);
+            BOOST_REQUIRE_EQUAL(resp.substr(resp.size() - 10), "compressed");
+            resp = get("Accept-Encoding: gzip;q=0\r\n");
+            BOOST_REQUIRE_EQUAL(resp.find("Content-Encoding"), std::string::npos);
+
+            // a variant regenerated next to an unchanged file is read again, with a tag of its own
+            std::ofstream(file_name + ".gz") << "recompressed";
+            std::filesystem::last_write_time(file_name + ".gz",
+                                             std::filesystem::file_time_type::clock::now() + std::chrono::seconds(10));
+            resp = get("Accept-Encoding: gzip\r\n");
+            BOOST_REQUIRE_EQUAL(resp.substr(resp.size() - 12), "recompressed");
+            BOOST_REQUIRE_NE(header(resp, "ETag"), gzip_etag);
+            resp = get("If-None-Match: " + etag + "\r\n");
+            BOOST_REQUIRE_EQUAL(resp.find("HTTP/1.1 304 Not Modified\r\n"), 0u);
+
+            input.close().get();
+            output.close().get();
+        });
+
+        server._routes.put(GET, "/file", (new file_handler(file_name, nullptr, false))->set_cache(cache));
+        server.do_accepts(0).get();
+
+        client.get();
+        server.stop().get();
+        BOOST_REQUIRE_EQUAL(cache->misses(), 2u);
+        BOOST_REQUIRE_EQUAL(cache->size(), 17u);
+    });
+}
+
+ACTOR_TEST_CASE(test_http2_prior_knowledge) {
+    return nil::actor::async([] {
+        loopback_connection_factory lcf;
+        http_server server("test");
+        server.set_http2(true);
+        loopback_socket_impl lsi(lcf);
+        httpd::http_server_tester::listeners(server).emplace_back(lcf.get_server_socket());
+        future<> client = nil::actor::async([&lsi] {
+            connected_socket c_socket = lsi.connect(socket_address(ipv4_addr()), socket_address(ipv4_addr())).get0();
+            input_stream<char> input(c_socket.input());
+            output_stream<char> output(c_socket.output());
+            auto frame = [](uint8_t type, uint8_t flags, uint32_t stream_id, const std::string &payload) {
+                std::string f(9, '\0');
+                f[0] = char(payload.size() >> 16);
+                f[1] = char(payload.size() >> 8);
+                f[2] = char(payload.size());
+                f[3] = char(type);
+                f[4] = char(flags);
+                write_be<uint32_t>(f.data() + 5, stream_id);
+                return f + payload;
+            };
+
+            hpack_encoder encoder;
+            std::string get, post;
+            encoder.encode({{":method", "GET"}, {":scheme", "http"}, {":path", "/test"}, {":authority", "test"}}, get);
+            encoder.encode({{":method", "POST"}, {":scheme", "http"}, {":path", "/echo"}, {":authority", "test"}},
+                           post);
+            // SETTINGS, then two concurrent streams, the body of the second one in two DATA frames
+            std::string request = std::string(http2_connection::preface) + frame(0x4, 0, 0, "") +
+                                  frame(0x1, 0x5, 1, get) + frame(0x1, 0x4, 3, post) + frame(0x0, 0, 3, "hel") +
+                                  frame(0x0, 0x1, 3, "lo");
+            output.write(request.data(), request.size()).get();
+            output.flush().get();
+
+            hpack_decoder decoder;
+            std::map<uint32_t, sstring> status, body;
+            bool settings_acked = false;
+            for (int ended = 0; ended < 2;) {
+                auto head = input.read_exactly(9).get0();
+                BOOST_REQUIRE_EQUAL(head.size(), 9u);
+                size_t length = (size_t(uint8_t(head[0])) << 16) | (size_t(uint8_t(head[1])) << 8) | uint8_t(head[2]);
+                uint8_t type = head[3];
+                uint8_t flags = head[4];
+                uint32_t stream_id = read_be<uint32_t>(head.get() + 5);
+                auto payload = input.read_exactly(length).get0();
+                if (type == 0x1) {
+                    hpack_header_list headers;
+                    decoder.decode(std::string_view(payload.get(), payload.size()), headers);
+                    BOOST_REQUIRE_EQUAL(headers[0].first, ":status");
+                    status[stream_id] = headers[0].second;
+                } else if (type == 0x0) {
+                    body[stream_id] += sstring(payload.get(), payload.size());
+                } else if (type == 0x4 && (flags & 0x1)) {
+                    settings_acked = true;
+                }
+                if ((type == 0x0 || type == 0x1) && (flags & 0x1)) {
+                    ++ended;
+                }
+            }
+            BOOST_REQUIRE(settings_acked);
+            BOOST_REQUIRE_EQUAL(status[1], "200");
+            BOOST_REQUIRE_EQUAL(body[1], "hello");
+            BOOST_REQUIRE_EQUAL(status[3], "200");
+            BOOST_REQUIRE_EQUAL(body[3], "[hello]");
+
+            input.close().get();
+            output.close().get();
+        });
+
+        server._routes.put(GET, "/test", new function_handler([](const_req req) { return "hello"; }, "txt"));
+        server._routes.put(POST, "/echo",
+                           new function_handler([](const_req req) { return "[" + req.content + "]"; }, "txt"));
+        server.do_accepts(0).get();
+
+        client.get();
+        server.stop().get();
+    });
+}
+
+ACTOR_TEST_CASE(test_http2_flow_control) {
+    return nil::actor::async([] {
+        loopback_connection_factory lcf;
+        http_server server("test");
+        server.set_http2(true);
+        loopback_socket_impl lsi(lcf);
+        httpd::http_server_tester::listeners(server).emplace_back(lcf.get_server_socket());
+        future<> client = nil::actor::async([&lsi] {
+            connected_socket c_socket = lsi.connect(socket_address(ipv4_addr()), socket_address(ipv4_addr())).get0();
+            input_stream<char> input(c_socket.input());
+            output_stream<char> output(c_socket.output());
+            auto frame = [](uint8_t type, uint8_t flags, uint32_t stream_id, const std::string &payload) {
+                std::string f(9, '\0');
+                f[0] = char(payload.size() >> 16);
+                f[1] = char(payload.size() >> 8);
+                f[2] = char(payload.size());
+                f[3] = char(type);
+                f[4] = char(flags);
+                write_be<uint32_t>(f.data() + 5, stream_id);
+                return f + payload;
+            };
+
+            hpack_encoder encoder;
+            std::string post;
+            encoder.encode({{":method", "POST"}, {":scheme", "http"}, {":path", "/echo"}, {":authority", "test"}},
+                           post);
+            // a body that fills the window of the stream without ending it
+            std::string request = std::string(http2_connection::preface) + frame(0x4, 0, 0, "") +
+                                  frame(0x1, 0x4, 1, post);
+            std::string chunk(http2_connection::default_max_frame_size, 'x');
+            for (size_t sent = 0; sent < http2_connection::stream_window_size; sent += chunk.size()) {
+                request += frame(0x0, 0, 1, chunk);
+            }
+            output.write(request.data(), request.size()).get();
+            output.flush().get();
+
+            hpack_decoder decoder;
+            sstring status;
+            uint64_t connection_credit = 0;
+            for (bool reset = false; !reset;) {
+                auto head = input.read_exactly(9).get0();
+                BOOST_REQUIRE_EQUAL(head.size(), 9u);
+                size_t length = (size_t(uint8_t(head[0])) << 16) | (size_t(uint8_t(head[1])) << 8) | uint8_t(head[2]);
+                uint8_t type = head[3];
+                uint32_t stream_id = read_be<uint32_t>(head.get() + 5);
+                auto payload = input.read_exactly(length).get0();
+                if (type == 0x1) {
+                    hpack_header_list headers;
+                    decoder.decode(std::string_view(payload.get(), payload.size()), headers);
+                    status = headers[0].second;
+                } else if (type == 0x8) {
+                    // the window of the stream is never credited back while its body is buffered
+                    BOOST_REQUIRE_EQUAL(stream_id, 0u);
+                    connection_credit += read_be<uint32_t>(payload.get());
+                } else if (type == 0x3) {
+                    BOOST_REQUIRE_EQUAL(stream_id, 1u);
+                    reset = true;
+                }
+            }
+            // the request is rejected, and the connection window gets the dropped body back
+            BOOST_REQUIRE_EQUAL(status, "413");
+            BOOST_REQUIRE_EQUAL(connection_credit, http2_connection::connection_window_size -
+                                                      http2_connection::default_window_size +
+                                                      http2_connection::stream_window_size);
+
+            input.close().get();
+            output.close().get();
+        });
+
+        server._routes.put(POST, "/echo",
+                           new function_handler([](const_req req) { return "[" + req.content + "]"; }, "txt"));
+        server.do_accepts(0).get();
+
+        client.get();
+        server.stop().get();
+    });
+}
+
+ACTOR_TEST_CASE(test_http2_alpn_credentials) {
+    return nil::actor::async([] {
+        auto creds = make_shared<tls::server_credentials>();
+        creds->set_alpn_protocols({"custom"});
+        http_server server("test");
+        server.set_tls_credentials(creds);
+        server.set_http2(true);
+        // the listener offers h2, the caller's credentials, which other servers may use, are left as they are
+        server.listen(socket_address(ipv4_addr("127.0.0.1", 0))).get();
+        BOOST_REQUIRE(creds->get_alpn_protocols() == std::vector<sstring>({"custom"}));
+        server.stop().get();
+        BOOST_REQUIRE(creds->get_alpn_protocols() == std::vector<sstring>({"custom"}));
+    });
+}
+
 ACTOR_THREAD_TEST_CASE(multiple_connections) {
     loopback_connection_factory lcf;
     http_server server("test");
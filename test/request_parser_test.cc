@@ -22,32 +22,32 @@
 // SOFTWARE.
 //---------------------------------------------------------------------------//
 
+#include <nil/actor/core/print.hh>
 #include <nil/actor/core/ragel.hh>
 #include <nil/actor/core/sstring.hh>
 #include <nil/actor/core/temporary_buffer.hh>
 #include <nil/actor/http/request.hh>
 #include <nil/actor/http/request_parser.hh>
+#include <nil/actor/http/simd_request_parser.hh>
 #include <nil/actor/testing/test_case.hh>
 
+#include <stdexcept>
 #include <tuple>
 #include <utility>
 #include <vector>
 
 using namespace nil::actor;
 
-ACTOR_TEST_CASE(test_header_parsing) {
-    struct test_set {
+namespace {
+    struct header_test {
         sstring msg;
         bool parsable;
         sstring header_name = "";
         sstring header_value = "";
-
-        temporary_buffer<char> buf() {
-            return temporary_buffer<char>(msg.c_str(), msg.size());
-        }
     };
 
-    std::vector<test_set> tests = {
+    // accepted or rejected alike by both parsers
+    const std::vector<header_test> header_tests = {
         {"GET /test HTTP/1.1\r\nHost: test\r\n\r\n", true, "Host", "test"},
         {"GET /hello HTTP/1.0\r\nHeader: Field\r\n\r\n", true, "Header", "Field"},
         {"GET /hello HTTP/1.0\r\nHeader: \r\n\r\n", true, "Header", ""},
@@ -62,15 +62,113 @@ ACTOR_TEST_CASE(test_header_parsing) {
         {"GET /hello HTTP/1.0\r\nHeader@: Field\r\n\r\n", false},
         {"GET /hello HTTP/1.0\r\nHeader: fiel\r\nd \r\n\r\n", false}};
 
+    // Feed each test to the parser in one buffer, then in two buffers split at each
+    // position, followed by a body that must be left unconsumed
+    template<typename Parser>
+    void check_header_parsing(Parser &parser, const std::vector<header_test> &tests) {
+        for (auto &tset : tests) {
+            for (size_t split = 1; split <= tset.msg.size(); split++) {
+                parser.init();
+                auto body = sstring("body");
+                auto second = tset.msg.substr(split) + body;
+                auto rest = parser(temporary_buffer<char>(tset.msg.c_str(), split)).get0();
+                if (!rest) {
+                    rest = parser(temporary_buffer<char>(second.c_str(), second.size())).get0();
+                }
+                BOOST_REQUIRE(rest.has_value());
+                BOOST_REQUIRE_NE(parser.failed(), tset.parsable);
+                if (tset.parsable) {
+                    BOOST_REQUIRE_EQUAL(to_sstring(std::move(*rest)), split == tset.msg.size() ? "" : body);
+                    auto req = parser.get_parsed_request();
+                    BOOST_REQUIRE_EQUAL(req->get_header(tset.header_name), tset.header_value);
+                }
+            }
+        }
+    }
+}    // namespace
+
+ACTOR_TEST_CASE(test_header_parsing) {
     http_request_parser parser;
-    for (auto &tset : tests) {
-        parser.init();
-        BOOST_REQUIRE(parser(tset.buf()).get0().has_value());
-        BOOST_REQUIRE_NE(parser.failed(), tset.parsable);
-        if (tset.parsable) {
-            auto req = parser.get_parsed_request();
-            BOOST_REQUIRE_EQUAL(req->get_header(std::move(tset.header_name)), std::move(tset.header_value));
+    check_header_parsing(parser, header_tests);
+    return make_ready_future<>();
+}
+
+ACTOR_TEST_CASE(test_simd_header_parsing) {
+    // the ends of names, values and heads on each side of the 16 and 32 byte blocks
+    std::vector<header_test> tests;
+    for (size_t n = 1; n <= 70; n++) {
+        sstring name(n, 'n');
+        sstring value(n, 'v');
+        tests.push_back({"GET / HTTP/1.1\r\n" + name + ": " + value + "\r\n\r\n", true, name, value});
+        // '|' and '~' are token characters matched by the SSE4.2 ranges
+        sstring token = name + "|~";
+        tests.push_back({"GET / HTTP/1.1\r\n" + token + ":" + value + "\r\n\r\n", true, token, value});
+        tests.push_back({"GET / HTTP/1.1\r\n" + name + "@: v\r\n\r\n", false});
+        tests.push_back({"GET / HTTP/1.1\r\nHeader: " + value + "\x01v\r\n\r\n", false});
+        tests.push_back({"GET / HTTP/1.1\r\nHeader: " + value + "\x7fv\r\n\r\n", false});
+        tests.push_back({"GET / HTTP/1.1\r\nHeader: " + value + "\rv\r\n\r\n", false});
+    }
+
+    // the scans of every instruction set the CPU supports, not only the best one
+    for (auto set : {simd_request_parser::isa::generic, simd_request_parser::isa::sse4_2,
+                     simd_request_parser::isa::avx2}) {
+        if (!simd_request_parser::supports(set)) {
+            BOOST_REQUIRE_THROW(simd_request_parser {set}, std::invalid_argument);
+            continue;
         }
+        simd_request_parser parser(set);
+        check_header_parsing(parser, header_tests);
+        check_header_parsing(parser, tests);
+
+        parser.init();
+        BOOST_REQUIRE(!parser(temporary_buffer<char>("GET / HTTP/1.1\r\n", 16)).get0());
+        BOOST_REQUIRE(parser(temporary_buffer<char>()).get0().has_value());
+        BOOST_REQUIRE(parser.eof());
+
+        // the head size limit also holds for a head that arrives in a single buffer
+        sstring huge =
+            "GET /hello HTTP/1.1\r\nHeader: " + sstring(simd_request_parser::max_head_size, 'a') + "\r\n\r\n";
+        parser.init();
+        BOOST_REQUIRE(parser(temporary_buffer<char>(huge.c_str(), huge.size())).get0().has_value());
+        BOOST_REQUIRE(parser.failed());
+    }
+    BOOST_REQUIRE(simd_request_parser::supports(simd_request_parser::best_isa()));
+    return make_ready_future<>();
+}
+
+ACTOR_TEST_CASE(test_header_limits) {
+    http_request_parser parser;
+
+    // many distinct and many repeated headers are combined as usual
+    sstring msg = "GET /hello HTTP/1.1\r\n";
+    sstring repeated;
+    for (int i = 0; i < 1000; i++) {
+        msg += format("Header-{:d}: {:d}\r\nRepeated: {:d}\r\n", i, i, i);
+        repeated += format(i ? ",{:d}" : "{:d}", i);
+    }
+    msg += "\r\n";
+    parser.init();
+    BOOST_REQUIRE(parser(temporary_buffer<char>(msg.c_str(), msg.size())).get0().has_value());
+    BOOST_REQUIRE(!parser.failed());
+    auto req = parser.get_parsed_request();
+    BOOST_REQUIRE_EQUAL(req->_headers.size(), 1001u);
+    BOOST_REQUIRE_EQUAL(req->get_header("header-999"), "999");
+    BOOST_REQUIRE_EQUAL(req->get_header("Repeated"), repeated);
+
+    // a head longer than the limit is rejected, whether it comes in one buffer or several
+    sstring huge = "GET /hello HTTP/1.1\r\nHeader: " + sstring(http_request_parser::max_head_size, 'a') + "\r\n\r\n";
+    parser.init();
+    BOOST_REQUIRE(parser(temporary_buffer<char>(huge.c_str(), huge.size())).get0().has_value());
+    BOOST_REQUIRE(parser.failed());
+    parser.init();
+    auto chunk = [&huge](size_t pos) {
+        return temporary_buffer<char>(huge.c_str() + pos, std::min<size_t>(1024, huge.size() - pos));
+    };
+    auto rest = parser(chunk(0)).get0();
+    for (size_t pos = 1024; !rest && pos < huge.size(); pos += 1024) {
+        rest = parser(chunk(pos)).get0();
     }
+    BOOST_REQUIRE(rest.has_value());
+    BOOST_REQUIRE(parser.failed());
     return make_ready_future<>();
 }
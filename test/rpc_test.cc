@@ -22,12 +22,17 @@
 // SOFTWARE.
 //---------------------------------------------------------------------------//
 
+#include <numeric>
+#include <random>
+
 #include "loopback_socket.hh"
 #include <nil/actor/rpc/rpc.hh>
 #include <nil/actor/rpc/rpc_types.hh>
+#include <nil/actor/rpc/in_process_transport.hh>
 #include <nil/actor/rpc/lz4_compressor.hh>
 #include <nil/actor/rpc/lz4_fragmented_compressor.hh>
 #include <nil/actor/rpc/multi_algo_compressor_factory.hh>
+#include <nil/actor/rpc/zstd_compressor.hh>
 #include <nil/actor/testing/test_case.hh>
 #include <nil/actor/testing/thread_test_case.hh>
 #include <nil/actor/testing/test_runner.hh>
@@ -111,6 +116,22 @@ inline sstring read(serializer, Input &in, rpc::type<sstring>) {
     return ret;
 }
 
+// marshalled as raw bytes, bypassing the serializer
+struct bulk_point {
+    int32_t x;
+    int32_t y;
+    double weight;
+};
+
+namespace nil {
+    namespace actor {
+        namespace rpc {
+            template<>
+            struct is_bulk_serializable<bulk_point> : std::true_type { };
+        }    // namespace rpc
+    }        // namespace actor
+}    // namespace nil
+
 using test_rpc_proto = rpc::protocol<serializer>;
 using make_socket_fn = std::function<nil::actor::socket()>;
 
@@ -260,6 +281,16 @@ public:
         return _service->invoke_on_all([t](rpc_test_service &s) mutable { return s.unregister_handler(t); });
     }
 
+    future<rpc::rpc_handler_stats> handler_stats(MsgType t) {
+        return _service->map_reduce0(
+            [t](rpc_test_service &s) { return s.proto().get_handler_stats(t); }, rpc::rpc_handler_stats(),
+            [](rpc::rpc_handler_stats a, const rpc::rpc_handler_stats &b) {
+                a.dispatched += b.dispatched;
+                a.received_bytes += b.received_bytes;
+                return a;
+            });
+    }
+
 private:
     rpc_test_service &local_service() {
         return _service->local();
@@ -365,6 +396,89 @@ ACTOR_TEST_CASE(test_rpc_connect_multi_compression_algo) {
         });
 }
 
+ACTOR_TEST_CASE(test_rpc_compression_bypass) {
+    auto factory = std::make_unique<cfactory>();
+    rpc::server_options so;
+    rpc::client_options co;
+    so.compressor_factory = factory.get();
+    co.compressor_factory = factory.get();
+    co.compression_bypass = rpc::compression_bypass_options();
+    co.compression_bypass->probe_interval = 1000;
+    rpc_test_config cfg;
+    cfg.server_options = so;
+    return rpc_test_env<>::do_with_thread(cfg, co, [](rpc_test_env<> &env, test_rpc_proto::client &c1) {
+        env.register_handler(1, [](sstring s) { return uint32_t(s.size()); }).get();
+        env.register_handler(2, [](sstring s) { return uint32_t(s.size()); }).get();
+        auto incompressible = env.proto().make_client<uint32_t(sstring)>(1);
+        auto compressible = env.proto().make_client<uint32_t(sstring)>(2);
+
+        // below min_size
+        BOOST_REQUIRE_EQUAL(incompressible(c1, "x").get0(), 1u);
+
+        // the first random payload is compressed to sample the verb, the rest go raw
+        std::default_random_engine eng;
+        std::uniform_int_distribution<int> dist(0, 255);
+        sstring random = uninitialized_string(8192);
+        std::generate(random.begin(), random.end(), [&] { return char(dist(eng)); });
+        for (auto i = 0; i < 4; i++) {
+            BOOST_REQUIRE_EQUAL(incompressible(c1, random).get0(), random.size());
+        }
+
+        // a different verb keeps its own history
+        for (auto i = 0; i < 2; i++) {
+            BOOST_REQUIRE_EQUAL(compressible(c1, sstring(8192, 'a')).get0(), 8192u);
+        }
+
+        auto stats = c1.get_stats();
+        BOOST_REQUIRE_EQUAL(stats.compression_bypassed_small, 1u);
+        BOOST_REQUIRE_EQUAL(stats.compression_bypassed_ratio, 3u);
+        BOOST_REQUIRE_EQUAL(stats.compressed_frames, 3u);
+        BOOST_REQUIRE_LT(stats.compression_bytes_out, stats.compression_bytes_in);
+    });
+}
+
+ACTOR_THREAD_TEST_CASE(test_latency_histogram) {
+    using namespace std::chrono_literals;
+    rpc::latency_histogram h;
+    BOOST_REQUIRE(h.quantile(0.5) == 0us);
+    for (auto i = 1; i <= 100; i++) {
+        h.record(std::chrono::microseconds(i * 100));
+    }
+    BOOST_REQUIRE_EQUAL(h.count(), 100u);
+    BOOST_REQUIRE(h.sum() == 505000us);
+    // buckets are accurate to within 1/8 of the value
+    auto p50 = h.quantile(0.5);
+    BOOST_REQUIRE(p50 >= 5000us && p50 <= 5000us * 9 / 8);
+    auto p99 = h.quantile(0.99);
+    BOOST_REQUIRE(p99 >= 9900us && p99 <= 9900us * 9 / 8);
+
+    auto exported = h.to_metrics_histogram();
+    BOOST_REQUIRE_EQUAL(exported.sample_count, 100u);
+    BOOST_REQUIRE_EQUAL(exported.buckets.back().count, 100u);
+}
+
+ACTOR_TEST_CASE(test_rpc_client_latency_metrics) {
+    return do_with(std::make_unique<rpc::latency_metrics>("test"), [](auto &metrics) {
+        rpc::client_options co;
+        co.latency = metrics.get();
+        return rpc_test_env<>::do_with_thread(
+            rpc_test_config(), co, [&metrics](rpc_test_env<> &env, test_rpc_proto::client &c1) {
+                env.register_handler(1, [](int a) {
+                       return sleep(std::chrono::milliseconds(10)).then([a] { return a; });
+                   }).get();
+                auto call = env.proto().make_client<int(int)>(1);
+                for (auto i = 0; i < 5; i++) {
+                    BOOST_REQUIRE_EQUAL(call(c1, i).get0(), i);
+                }
+                auto &verb = metrics->client(1);
+                BOOST_REQUIRE_EQUAL(verb.latency.count(), 5u);
+                BOOST_REQUIRE_EQUAL(verb.queue.count(), 5u);
+                BOOST_REQUIRE(verb.latency.quantile(0.5) >= std::chrono::milliseconds(10));
+                BOOST_REQUIRE_EQUAL(metrics->client(2).latency.count(), 0u);
+            });
+    });
+}
+
 ACTOR_TEST_CASE(test_rpc_connect_abort) {
     rpc_test_config cfg;
     cfg.connect = false;
@@ -417,6 +531,407 @@ ACTOR_TEST_CASE(test_rpc_cancel) {
     });
 }
 
+ACTOR_TEST_CASE(test_rpc_send_batching) {
+    rpc::client_options co;
+    co.send_batch_max_messages = 16;
+    rpc::server_options so;
+    so.send_batch_max_messages = 16;
+    rpc_test_config cfg;
+    cfg.server_options = so;
+    return rpc_test_env<>::do_with_thread(cfg, co, [](rpc_test_env<> &env, test_rpc_proto::client &c1) {
+        env.register_handler(1, [](int a, int b) { return make_ready_future<int>(a + b); }).get();
+        auto sum = env.proto().make_client<int(int, int)>(1);
+        std::vector<future<int>> replies;
+        for (int i = 0; i < 100; i++) {
+            replies.push_back(sum(c1, i, 1));
+        }
+        for (int i = 0; i < 100; i++) {
+            BOOST_REQUIRE_EQUAL(replies[i].get0(), i + 1);
+        }
+        auto stats = c1.get_stats();
+        // the negotiation frame is counted as a sent message, but is not a part of a batch
+        BOOST_REQUIRE_EQUAL(stats.sent_messages, 101u);
+        BOOST_REQUIRE_LT(stats.sent_batches, 100u);
+    });
+}
+
+ACTOR_TEST_CASE(test_rpc_strict_send_priority) {
+    rpc::client_options co;
+    co.send_priorities.weights = {1, 1};
+    co.send_priorities.strict = true;
+    co.send_priorities.verb_class = [](uint64_t verb) { return verb == 2 ? 0 : 1; };
+    return rpc_test_env<>::do_with_thread(rpc_test_config(), co, [](rpc_test_env<> &env, test_rpc_proto::client &c1) {
+        std::vector<int> order;
+        env.register_handler(1, [&order](int a) { order.push_back(a); }).get();
+        env.register_handler(2, [&order](int a) { order.push_back(a); }).get();
+        auto bulk = env.proto().make_client<void(int)>(1);
+        auto control = env.proto().make_client<void(int)>(2);
+        // everything is queued before the connection is negotiated, so the send loop sees it all at once
+        std::vector<future<>> replies;
+        for (int i = 0; i < 10; i++) {
+            replies.push_back(bulk(c1, i));
+        }
+        replies.push_back(control(c1, 100));
+        replies.push_back(bulk(c1, rpc::message_priority {0}, 200));
+        when_all_succeed(replies.begin(), replies.end()).get();
+        BOOST_REQUIRE_EQUAL(order.size(), 12u);
+        BOOST_REQUIRE_EQUAL(order[0], 100);
+        BOOST_REQUIRE_EQUAL(order[1], 200);
+        for (int i = 0; i < 10; i++) {
+            BOOST_REQUIRE_EQUAL(order[i + 2], i);
+        }
+    });
+}
+
+ACTOR_TEST_CASE(test_rpc_weighted_send_priority) {
+    rpc::client_options co;
+    co.send_priorities.weights = {1, 1};
+    // a single byte of credit per turn lets each class send one frame before the other gets its turn
+    co.send_priorities.quantum = 1;
+    co.send_priorities.verb_class = [](uint64_t verb) { return verb == 2 ? 0 : 1; };
+    return rpc_test_env<>::do_with_thread(rpc_test_config(), co, [](rpc_test_env<> &env, test_rpc_proto::client &c1) {
+        std::vector<int> order;
+        env.register_handler(1, [&order](int a) { order.push_back(a); }).get();
+        env.register_handler(2, [&order](int a) { order.push_back(a); }).get();
+        auto bulk = env.proto().make_client<void(int)>(1);
+        auto control = env.proto().make_client<void(int)>(2);
+        std::vector<future<>> replies;
+        for (int i = 0; i < 5; i++) {
+            replies.push_back(bulk(c1, i));
+        }
+        for (int i = 0; i < 5; i++) {
+            replies.push_back(control(c1, 100 + i));
+        }
+        when_all_succeed(replies.begin(), replies.end()).get();
+        BOOST_REQUIRE_EQUAL(order.size(), 10u);
+        for (int i = 0; i < 5; i++) {
+            BOOST_REQUIRE_EQUAL(order[2 * i], 100 + i);
+            BOOST_REQUIRE_EQUAL(order[2 * i + 1], i);
+        }
+    });
+}
+
+ACTOR_TEST_CASE(test_rpc_fragmented_send_priority) {
+    rpc::client_options co;
+    co.send_priorities.weights = {1, 1};
+    co.send_priorities.quantum = 4096;
+    co.send_priorities.fragment = true;
+    co.send_priorities.verb_class = [](uint64_t verb) { return verb == 2 ? 1 : 0; };
+    return rpc_test_env<>::do_with_thread(rpc_test_config(), co, [](rpc_test_env<> &env, test_rpc_proto::client &c1) {
+        std::vector<int> order;
+        env.register_handler(1, [&order](sstring payload) {
+               order.push_back(payload.size());
+               return payload.size();
+           }).get();
+        env.register_handler(2, [&order](int a) { order.push_back(a); }).get();
+        auto bulk = env.proto().make_client<size_t(sstring)>(1);
+        auto control = env.proto().make_client<void(int)>(2);
+        // the large frame is served first, but only its first fragment goes out before the other class's turn
+        auto big = bulk(c1, uninitialized_string(256 * 1024));
+        std::vector<future<>> replies;
+        for (int i = 0; i < 3; i++) {
+            replies.push_back(control(c1, i));
+        }
+        when_all_succeed(replies.begin(), replies.end()).get();
+        BOOST_REQUIRE_EQUAL(big.get0(), 256u * 1024);
+        BOOST_REQUIRE_EQUAL(order.size(), 4u);
+        for (int i = 0; i < 3; i++) {
+            BOOST_REQUIRE_EQUAL(order[i], i);
+        }
+        BOOST_REQUIRE_EQUAL(order[3], 256 * 1024);
+    });
+}
+
+ACTOR_TEST_CASE(test_rpc_client_pool_routing) {
+    return rpc_test_env<>::do_with_thread(rpc_test_config(), [](rpc_test_env<> &env) {
+        env.register_handler(1, [](int a) {
+               return sleep(std::chrono::milliseconds(50)).then([a] { return a; });
+           }).get();
+        env.register_handler(2, [](int a) { return a; }).get();
+        auto slow = env.proto().make_client<int(int)>(1);
+        auto fast = env.proto().make_client<int(int)>(2);
+
+        rpc::client_pool_options po;
+        po.connections = 3;
+        test_rpc_proto::client_pool least(env.proto(), po, {}, [&env] { return env.make_socket(); }, ipv4_addr());
+        auto stop_least = defer([&] { least.stop().get(); });
+        std::vector<future<int>> replies;
+        for (int i = 0; i < 6; i++) {
+            replies.push_back(slow(least, i));
+        }
+        for (unsigned i = 0; i < least.size(); i++) {
+            BOOST_REQUIRE_EQUAL(least.connection(i).outstanding_replies(), 2u);
+        }
+        for (int i = 0; i < 6; i++) {
+            BOOST_REQUIRE_EQUAL(replies[i].get0(), i);
+        }
+
+        po.connections = 2;
+        po.routing = rpc::client_pool_options::routing_type::verb_class;
+        po.verb_class = [](uint64_t verb) { return verb == 2 ? 0 : 1; };
+        test_rpc_proto::client_pool by_verb(env.proto(), po, {}, [&env] { return env.make_socket(); }, ipv4_addr());
+        auto stop_by_verb = defer([&] { by_verb.stop().get(); });
+        for (int i = 0; i < 3; i++) {
+            BOOST_REQUIRE_EQUAL(slow(by_verb, i).get0(), i);
+        }
+        BOOST_REQUIRE_EQUAL(fast(by_verb, 7).get0(), 7);
+        BOOST_REQUIRE_EQUAL(by_verb.connection(0).get_stats().replied, 1u);
+        BOOST_REQUIRE_EQUAL(by_verb.connection(1).get_stats().replied, 3u);
+    });
+}
+
+ACTOR_TEST_CASE(test_rpc_client_pool_reconnect) {
+    rpc_test_config cfg;
+    // every server side connection breaks after a few dozen reads
+    cfg.inject_error = true;
+    return rpc_test_env<>::do_with_thread(cfg, [](rpc_test_env<> &env) {
+        env.register_handler(1, [](int a) { return a; }).get();
+        auto call = env.proto().make_client<int(int)>(1);
+        rpc::client_pool_options po;
+        po.connections = 1;
+        po.reconnect_interval = rpc_clock_type::duration(0);
+        test_rpc_proto::client_pool pool(env.proto(), po, {}, [&env] { return env.make_socket(); }, ipv4_addr());
+        auto stop = defer([&] { pool.stop().get(); });
+        bool broken = false;
+        for (int i = 0; i < 1000 && !broken; i++) {
+            try {
+                BOOST_REQUIRE_EQUAL(call(pool, i).get0(), i);
+            } catch (rpc::closed_error &) {
+                broken = true;
+            }
+        }
+        BOOST_REQUIRE(broken);
+        // the next call goes over a fresh connection
+        BOOST_REQUIRE_EQUAL(call(pool, 42).get0(), 42);
+        BOOST_REQUIRE_EQUAL(pool.reconnects(), 1u);
+    });
+}
+
+ACTOR_TEST_CASE(test_rpc_hedged_call) {
+    return rpc_test_env<>::do_with_thread(rpc_test_config(), [](rpc_test_env<> &env, test_rpc_proto::client &c1) {
+        using namespace std::chrono_literals;
+        int calls = 0;
+        // only the first call is slow
+        env.register_handler(1, [&calls](int a) {
+            return sleep(calls++ ? 0ms : 200ms).then([a] { return a; });
+        }).get();
+        env.register_handler(2, [](int a) { return a; }).get();
+        rpc::call_policy_options po;
+        po.default_hedge_delay = 10ms;
+        rpc::call_policy policy(po);
+        policy.set_idempotent(1);
+        policy.set_idempotent(2);
+        auto slow = env.proto().make_hedged_client<int(int)>(1, policy);
+        auto fast = env.proto().make_hedged_client<int(int)>(2, policy);
+        test_rpc_proto::client c2(env.proto(), rpc::client_options(), env.make_socket(), ipv4_addr());
+        auto stop = defer([&] { c2.stop().get(); });
+
+        // the hedge sent to c2 replies first
+        BOOST_REQUIRE_EQUAL(slow(c1, c2, 1).get0(), 1);
+        BOOST_REQUIRE_EQUAL(calls, 2);
+        BOOST_REQUIRE_EQUAL(policy.get_stats().hedges, 1u);
+        BOOST_REQUIRE_EQUAL(policy.get_stats().hedge_wins, 1u);
+        BOOST_REQUIRE_EQUAL(policy.latency(1).count(), 1u);
+
+        // a call to a closed primary is retried on the alternate
+        test_rpc_proto::client c3(env.proto(), rpc::client_options(), env.make_socket(), ipv4_addr());
+        c3.stop().get();
+        BOOST_REQUIRE_EQUAL(fast(c3, c1, 2).get0(), 2);
+        BOOST_REQUIRE_EQUAL(policy.get_stats().retries, 1u);
+
+        // verbs that are not idempotent are neither hedged nor retried
+        policy.set_idempotent(2, false);
+        BOOST_REQUIRE_THROW(fast(c3, c1, 3).get0(), rpc::closed_error);
+        BOOST_REQUIRE_EQUAL(policy.get_stats().retries, 1u);
+    });
+}
+
+ACTOR_THREAD_TEST_CASE(test_admission_controller) {
+    using namespace std::chrono_literals;
+    using clock_type = rpc::admission_controller::clock_type;
+    rpc::load_shedding_options o;
+    o.target = 5ms;
+    o.interval = 100ms;
+    rpc::admission_controller ac(o);
+    auto t = clock_type::time_point() + 1s;
+    // a short queueing delay never sheds
+    for (int i = 0; i < 100; i++) {
+        BOOST_REQUIRE(!ac.should_shed(1ms, t));
+        t += 1ms;
+    }
+    // a standing queue is tolerated for one interval
+    BOOST_REQUIRE(!ac.should_shed(10ms, t));
+    t += 50ms;
+    BOOST_REQUIRE(!ac.should_shed(10ms, t));
+    t += 50ms;
+    BOOST_REQUIRE(ac.should_shed(10ms, t));
+    BOOST_REQUIRE(ac.dropping());
+    // then requests are shed at growing rate: the next drop after interval, the one after that sooner
+    t += 50ms;
+    BOOST_REQUIRE(!ac.should_shed(10ms, t));
+    t += 50ms;
+    BOOST_REQUIRE(ac.should_shed(10ms, t));
+    t += 71ms;
+    BOOST_REQUIRE(ac.should_shed(10ms, t));
+    // until the delay goes below target
+    t += 1ms;
+    BOOST_REQUIRE(!ac.should_shed(1ms, t));
+    BOOST_REQUIRE(!ac.dropping());
+}
+
+ACTOR_TEST_CASE(test_rpc_load_shedding) {
+    rpc::load_shedding_options lso;
+    // any delay is above target and the interval is over immediately, so everything after the first request is shed
+    lso.target = std::chrono::microseconds(0);
+    lso.interval = std::chrono::microseconds(0);
+    rpc_test_config cfg;
+    cfg.server_options.load_shedding = lso;
+    return rpc_test_env<>::do_with_thread(cfg, [](rpc_test_env<> &env, test_rpc_proto::client &c1) {
+        env.register_handler(1, [](int a) { return a; }).get();
+        auto call = env.proto().make_client<int(int)>(1);
+        BOOST_REQUIRE_EQUAL(call(c1, 1).get0(), 1);
+        BOOST_REQUIRE_THROW(call(c1, 2).get0(), rpc::overloaded_error);
+        BOOST_REQUIRE_THROW(call(c1, 3).get0(), rpc::overloaded_error);
+    });
+}
+
+ACTOR_THREAD_TEST_CASE(test_rpc_zero_rtt) {
+    rpc::zero_rtt_cache cache;
+    cfactory factory;
+    rpc::client_options co;
+    co.compressor_factory = &factory;
+    co.zero_rtt = &cache;
+    rpc_test_config cfg;
+    cfg.server_options.compressor_factory = &factory;
+    rpc_test_env<>::do_with_thread(cfg, co, [&](rpc_test_env<> &env, test_rpc_proto::client &c1) {
+        env.register_handler(1, [](int a) { return a + 1; }).get();
+        auto call = env.proto().make_client<int(int)>(1);
+        // the first connection negotiates in full and remembers the outcome
+        BOOST_REQUIRE_EQUAL(call(c1, 1).get0(), 2);
+        BOOST_REQUIRE(!c1.sent_early_data());
+        BOOST_REQUIRE_EQUAL(cache.size(), 1u);
+        // the next one sends its request right behind the negotiation frame
+        test_rpc_proto::client c2(env.proto(), co, env.make_socket(), ipv4_addr());
+        BOOST_REQUIRE_EQUAL(call(c2, 2).get0(), 3);
+        BOOST_REQUIRE(c2.sent_early_data());
+        c2.stop().get();
+    }).get();
+
+    // a server that cannot grant the cached features runs none of the early requests
+    rpc_test_env<>::do_with_thread(rpc_test_config(), [&](rpc_test_env<> &env) {
+        int calls = 0;
+        env.register_handler(1, [&calls](int a) {
+            calls++;
+            return a + 1;
+        }).get();
+        auto call = env.proto().make_client<int(int)>(1);
+        test_rpc_proto::client c3(env.proto(), co, env.make_socket(), ipv4_addr());
+        BOOST_REQUIRE_THROW(call(c3, 1).get0(), rpc::closed_error);
+        c3.stop().get();
+        BOOST_REQUIRE_EQUAL(calls, 0);
+        BOOST_REQUIRE_EQUAL(cache.size(), 0u);
+        test_rpc_proto::client c4(env.proto(), co, env.make_socket(), ipv4_addr());
+        BOOST_REQUIRE_EQUAL(call(c4, 1).get0(), 2);
+        BOOST_REQUIRE(!c4.sent_early_data());
+        BOOST_REQUIRE_EQUAL(calls, 1);
+        c4.stop().get();
+    }).get();
+}
+
+ACTOR_THREAD_TEST_CASE(test_rpc_in_process_transport) {
+    rpc::in_process_transport transport;
+    auto stop_transport = defer([&] { transport.stop().get(); });
+    test_rpc_proto proto(serializer());
+    proto.register_handler(1, [](sstring s) { return s + s; });
+    auto unregister = defer([&] { proto.unregister_handler(1).get(); });
+    auto call = proto.make_client<sstring(sstring)>(1);
+    {
+        test_rpc_proto::server server(proto, rpc::server_options(), transport.listen());
+        auto stop_server = defer([&] { server.stop().get(); });
+        test_rpc_proto::client c1(proto, rpc::client_options(), transport.make_socket(), ipv4_addr());
+        auto stop_client = defer([&] { c1.stop().get(); });
+        // larger than the buffers the connection writes, so the message spans several of them
+        sstring big(sstring::initialized_later(), 1 << 20);
+        std::iota(big.begin(), big.end(), 0);
+        BOOST_REQUIRE_EQUAL(call(c1, big).get0(), big + big);
+        BOOST_REQUIRE_EQUAL(call(c1, "x").get0(), "xx");
+    }
+    // nobody listens on the other shards
+    if (smp::count > 1) {
+        test_rpc_proto::client c2(proto, rpc::client_options(), transport.make_socket(1), ipv4_addr());
+        BOOST_REQUIRE_THROW(call(c2, "x").get0(), rpc::closed_error);
+        c2.stop().get();
+    }
+    // a server on another shard, the buffers of each direction cross shards
+    if (smp::count > 1) {
+        struct remote_server {
+            test_rpc_proto proto {serializer()};
+            std::unique_ptr<test_rpc_proto::server> server;
+        };
+        auto remote = smp::submit_to(1, [&transport] {
+                          auto r = std::make_unique<remote_server>();
+                          r->proto.register_handler(1, [](sstring s) { return s + s; });
+                          r->server = std::make_unique<test_rpc_proto::server>(r->proto, rpc::server_options(),
+                                                                               transport.listen());
+                          return make_foreign(std::move(r));
+                      }).get0();
+        test_rpc_proto::client c3(proto, rpc::client_options(), transport.make_socket(1), ipv4_addr());
+        sstring big(sstring::initialized_later(), 1 << 20);
+        std::iota(big.begin(), big.end(), 0);
+        BOOST_REQUIRE_EQUAL(call(c3, big).get0(), big + big);
+        BOOST_REQUIRE_EQUAL(call(c3, "x").get0(), "xx");
+        c3.stop().get();
+        smp::submit_to(1, [r = remote.get()] {
+            return r->server->stop().then([r] { return r->proto.unregister_handler(1); });
+        }).get();
+    }
+}
+
+ACTOR_THREAD_TEST_CASE(test_rpc_in_process_transport_shutdown_output) {
+    rpc::in_process_transport transport;
+    auto stop_transport = defer([&] { transport.stop().get(); });
+    auto listener = transport.listen();
+    auto accepted = listener.accept();
+    auto client = transport.make_socket().connect(ipv4_addr()).get0();
+    auto server_side = accepted.get0().connection;
+    auto out = client.output();
+    out.write("queued").get();
+    out.flush().get();
+    // what was written before is still delivered, followed by end of file
+    client.shutdown_output();
+    auto in = server_side.input();
+    auto data = in.read_exactly(6).get0();
+    BOOST_REQUIRE_EQUAL(sstring(data.get(), data.size()), "queued");
+    BOOST_REQUIRE(in.read().get0().empty());
+    // closing the stream after the shutdown ends it only once
+    out.close().get();
+    in.close().get();
+    listener.abort_accept();
+}
+
+ACTOR_TEST_CASE(test_rpc_many_timeouts) {
+    using namespace std::chrono_literals;
+    return rpc_test_env<>::do_with_thread(rpc_test_config(), [](rpc_test_env<> &env, test_rpc_proto::client &c1) {
+        env.register_handler(1,
+                             [](int ms) { return sleep(std::chrono::milliseconds(ms)).then([ms] { return ms; }); })
+            .get();
+        auto call = env.proto().make_client<int(int)>(1);
+        std::vector<future<int>> fast, slow;
+        for (int i = 0; i < 50; i++) {
+            slow.push_back(call(c1, 20ms, 200));
+            // replies arrive out of order with respect to message ids
+            fast.push_back(call(c1, 10s, 5 - i % 5));
+        }
+        for (int i = 0; i < 50; i++) {
+            BOOST_REQUIRE_EQUAL(fast[i].get0(), 5 - i % 5);
+            BOOST_REQUIRE_THROW(slow[i].get(), rpc::timeout_error);
+        }
+        auto stats = c1.get_stats();
+        BOOST_REQUIRE_EQUAL(stats.timeout, 50u);
+        BOOST_REQUIRE_EQUAL(stats.wait_reply, 0u);
+    });
+}
+
 ACTOR_TEST_CASE(test_message_to_big) {
     rpc_test_config cfg;
     cfg.resource_limits = {0, 1, 100};
@@ -598,6 +1113,53 @@ ACTOR_TEST_CASE(test_stream_connection_error) {
     });
 }
 
+ACTOR_TEST_CASE(test_stream_flow_control) {
+    rpc::stream_flow_control_options fc;
+    // a window of a few elements, so that both sinks keep running out of credit
+    fc.window = 64;
+    fc.batch_max_bytes = 32;
+    rpc_test_config cfg;
+    cfg.server_options.streaming_domain = rpc::streaming_domain_type(1);
+    cfg.server_options.stream_flow_control = fc;
+    rpc::client_options co;
+    co.stream_flow_control = fc;
+    return rpc_test_env<>::do_with_thread(cfg, co, [](rpc_test_env<> &env, test_rpc_proto::client &c) {
+        future<> server_done = make_ready_future();
+        env.register_handler(1,
+                             [&server_done](rpc::source<int> source) {
+                                 auto sink = source.make_sink<serializer, int>();
+                                 // echoes the running sum of what it receives
+                                 server_done = nil::actor::async([source, sink]() mutable {
+                                     int sum = 0;
+                                     while (auto data = source().get0()) {
+                                         sum += std::get<0>(*data);
+                                         sink(sum).get();
+                                     }
+                                     sink.close().get();
+                                 });
+                                 return sink;
+                             })
+            .get();
+        auto call = env.proto().make_client<rpc::source<int>(rpc::sink<int>)>(1);
+        auto sink = c.make_stream_sink<serializer, int>(env.make_socket()).get0();
+        auto source = call(c, sink).get0();
+        // nothing is read back until everything is written, the echoes wait for credit meanwhile
+        std::vector<future<>> writes;
+        for (int i = 1; i <= 1000; i++) {
+            writes.push_back(sink(i));
+        }
+        when_all_succeed(writes.begin(), writes.end()).get();
+        sink.flush().get();
+        sink.close().get();
+        int last = 0;
+        while (auto data = source().get0()) {
+            last = std::get<0>(*data);
+        }
+        BOOST_REQUIRE_EQUAL(last, 500500);
+        server_done.get();
+    });
+}
+
 ACTOR_TEST_CASE(test_rpc_scheduling) {
     return rpc_test_env<>::do_with_thread(rpc_test_config(), [](rpc_test_env<> &env, test_rpc_proto::client &c1) {
         auto sg = create_scheduling_group("rpc", 100).get0();
@@ -955,6 +1517,137 @@ ACTOR_THREAD_TEST_CASE(test_lz4_fragmented_compressor) {
     test_compressor([] { return std::make_unique<rpc::lz4_fragmented_compressor>(); });
 }
 
+ACTOR_THREAD_TEST_CASE(test_zstd_compressor) {
+    test_compressor([] { return std::make_unique<rpc::zstd_compressor>(); });
+}
+
+ACTOR_THREAD_TEST_CASE(test_zstd_dictionary_compressor) {
+    std::vector<sstring> samples;
+    for (auto i = 0; i < 2000; i++) {
+        samples.push_back(format("{{\"key\": \"user:{}\", \"shard\": {}, \"state\": \"{}\"}}", i * 7919, i % 16,
+                                 i % 3 ? "active" : "suspended"));
+    }
+    auto dictionary = std::make_shared<const rpc::zstd_dictionary>(rpc::zstd_dictionary::train(samples, 4096));
+    test_compressor([dictionary] { return std::make_unique<rpc::zstd_compressor>(dictionary->level(), dictionary); });
+
+    // A peer without the dictionary falls back to plain zstd, one with it picks the dictionary.
+    rpc::zstd_compressor::factory with_dictionary(dictionary);
+    rpc::zstd_compressor::factory plain;
+    rpc::multi_algo_compressor_factory client({&with_dictionary, &plain});
+    rpc::multi_algo_compressor_factory server_plain(&plain);
+    rpc::multi_algo_compressor_factory server_dictionary({&with_dictionary, &plain});
+    BOOST_REQUIRE_EQUAL(server_plain.negotiate(client.supported(), true)->name(), "ZSTD");
+    BOOST_REQUIRE_EQUAL(server_dictionary.negotiate(client.supported(), true)->name(), with_dictionary.supported());
+}
+
+ACTOR_THREAD_TEST_CASE(test_rcv_buf_split) {
+    auto contents = [](const rpc::rcv_buf &buf) {
+        std::string s;
+        nil::actor::visit(
+            buf.bufs, [&](const temporary_buffer<char> &b) { s.append(b.get(), b.size()); },
+            [&](const std::vector<temporary_buffer<char>> &bufs) {
+                for (auto &&b : bufs) {
+                    s.append(b.get(), b.size());
+                }
+            });
+        BOOST_REQUIRE_EQUAL(s.size(), buf.size);
+        return s;
+    };
+
+    std::vector<temporary_buffer<char>> bufs;
+    bufs.emplace_back("0123", 4);
+    bufs.emplace_back();
+    bufs.emplace_back("456789", 6);
+    rpc::rcv_buf buf(std::move(bufs), 10);
+
+    char scratch[6];
+    BOOST_REQUIRE_EQUAL(std::string(rpc::peek_rcv_buf(buf, 6, scratch), 6), "012345");
+    BOOST_REQUIRE_EQUAL(std::string(rpc::peek_rcv_buf(buf, 3, scratch), 3), "012");
+
+    auto head = rpc::split_rcv_buf(buf, 2);
+    BOOST_REQUIRE_EQUAL(contents(head), "01");
+    BOOST_REQUIRE_EQUAL(contents(buf), "23456789");
+
+    // spans the empty fragment
+    head = rpc::split_rcv_buf(buf, 5);
+    BOOST_REQUIRE_EQUAL(contents(head), "23456");
+    BOOST_REQUIRE_EQUAL(contents(buf), "789");
+
+    head = rpc::split_rcv_buf(buf, 3);
+    BOOST_REQUIRE_EQUAL(contents(head), "789");
+    BOOST_REQUIRE_EQUAL(buf.size, 0u);
+
+    rpc::rcv_buf single(temporary_buffer<char>("abcdef", 6));
+    BOOST_REQUIRE_EQUAL(contents(rpc::split_rcv_buf(single, 4)), "abcd");
+    BOOST_REQUIRE_EQUAL(contents(rpc::split_rcv_buf(single, 2)), "ef");
+    BOOST_REQUIRE_EQUAL(single.size, 0u);
+
+    // more than the buffer holds is rejected, the buffer is left as it was
+    std::vector<temporary_buffer<char>> short_bufs;
+    short_bufs.emplace_back("ab", 2);
+    rpc::rcv_buf fragmented(std::move(short_bufs), 2);
+    BOOST_REQUIRE_THROW(rpc::split_rcv_buf(fragmented, 3), std::out_of_range);
+    BOOST_REQUIRE_THROW(rpc::split_rcv_buf(single, 1), std::out_of_range);
+    BOOST_REQUIRE_EQUAL(contents(rpc::split_rcv_buf(fragmented, 2)), "ab");
+}
+
+ACTOR_THREAD_TEST_CASE(test_rcv_buf_input_read_shared) {
+    std::vector<temporary_buffer<char>> bufs;
+    bufs.emplace_back("abcd", 4);
+    bufs.emplace_back("efghij", 6);
+    rpc::rcv_buf buf(std::move(bufs), 10);
+    auto &fragments = std::get<std::vector<temporary_buffer<char>>>(buf.bufs);
+    rpc::rcv_buf_input in(buf);
+
+    auto head = in.read_shared(2, 1);
+    BOOST_REQUIRE_EQUAL(std::string(head.get(), head.size()), "ab");
+    BOOST_REQUIRE_EQUAL(head.get(), fragments[0].get());
+    // straddles the fragments, so it is copied
+    auto middle = in.read_shared(4, 1);
+    BOOST_REQUIRE_EQUAL(std::string(middle.get(), middle.size()), "cdef");
+    auto tail = in.read_shared(4, 1);
+    BOOST_REQUIRE_EQUAL(std::string(tail.get(), tail.size()), "ghij");
+    BOOST_REQUIRE_EQUAL(tail.get(), fragments[1].get() + 2);
+    BOOST_REQUIRE_EQUAL(in.size(), 0u);
+}
+
+ACTOR_TEST_CASE(test_rpc_bulk_marshalling) {
+    return rpc_test_env<>::do_with_thread(rpc_test_config(), [](rpc_test_env<> &env, test_rpc_proto::client &c1) {
+        auto weigh = [](bulk_point origin, const bulk_point *begin, const bulk_point *end) {
+            double sum = 0;
+            for (auto p = begin; p != end; ++p) {
+                sum += (p->x - origin.x) * p->weight + (p->y - origin.y);
+            }
+            return sum;
+        };
+        env.register_handler(1,
+                             [weigh](bulk_point origin, rpc::bulk_view<bulk_point> points) {
+                                 return weigh(origin, points.begin(), points.end());
+                             })
+            .get();
+        env.register_handler(2,
+                             [](int32_t n) {
+                                 std::vector<bulk_point> points;
+                                 for (int32_t i = 0; i < n; i++) {
+                                     points.push_back(bulk_point {i, -i, i * 0.5});
+                                 }
+                                 return points;
+                             })
+            .get();
+        auto weigh_remote = env.proto().make_client<double(bulk_point, std::vector<bulk_point>)>(1);
+        auto make_points = env.proto().make_client<std::vector<bulk_point>(int32_t)>(2);
+
+        auto points = make_points(c1, 1000).get0();
+        BOOST_REQUIRE_EQUAL(points.size(), 1000u);
+        BOOST_REQUIRE_EQUAL(points[999].y, -999);
+        BOOST_REQUIRE_EQUAL(points[999].weight, 499.5);
+        bulk_point origin {1, 2, 0};
+        BOOST_REQUIRE_EQUAL(weigh_remote(c1, origin, points).get0(),
+                            weigh(origin, points.data(), points.data() + points.size()));
+        BOOST_REQUIRE_EQUAL(weigh_remote(c1, origin, std::vector<bulk_point>()).get0(), 0);
+    });
+}
+
 // Test reproducing issue #671: If timeout is time_point::max(), translating
 // it to relative timeout in the sender and then back in the receiver, when
 // these calculations happen across a millisecond boundary, overflowed the
@@ -1105,6 +1798,45 @@ ACTOR_TEST_CASE(test_handler_registration) {
     });
 }
 
+ACTOR_TEST_CASE(test_sparse_handler_registration) {
+    rpc_test_config cfg;
+    cfg.connect = false;
+    return rpc_test_env<>::do_with_thread(cfg, [](rpc_test_env<> &env) {
+        auto &proto = env.proto();
+        auto handler = []() { return make_ready_future<>(); };
+
+        // verbs past the dense table go to the hash map and behave the same
+        auto sparse = int(test_rpc_proto::default_dense_verbs) + 1000;
+        proto.register_handler(sparse, handler);
+        BOOST_REQUIRE(proto.has_handler(sparse));
+        BOOST_REQUIRE(!proto.has_handler(1));
+        BOOST_REQUIRE_THROW(proto.register_handler(sparse, handler), std::runtime_error);
+        proto.unregister_handler(sparse).get();
+        BOOST_REQUIRE(!proto.has_handler(sparse));
+        BOOST_REQUIRE(!proto.has_handlers());
+    });
+}
+
+ACTOR_TEST_CASE(test_handler_stats) {
+    return rpc_test_env<>::do_with_thread(rpc_test_config(), [](rpc_test_env<> &env, test_rpc_proto::client &c1) {
+        auto sparse = int(test_rpc_proto::default_dense_verbs) + 1000;
+        env.register_handler(1, [](int a) { return a; }).get();
+        env.register_handler(sparse, [](int a) { return a; }).get();
+        auto dense_call = env.proto().make_client<int(int)>(1);
+        auto sparse_call = env.proto().make_client<int(int)>(sparse);
+        for (auto i = 0; i < 3; i++) {
+            BOOST_REQUIRE_EQUAL(dense_call(c1, i).get0(), i);
+        }
+        BOOST_REQUIRE_EQUAL(sparse_call(c1, 7).get0(), 7);
+
+        auto dense_stats = env.handler_stats(1).get0();
+        BOOST_REQUIRE_EQUAL(dense_stats.dispatched, 3u);
+        BOOST_REQUIRE_EQUAL(dense_stats.received_bytes, 3 * sizeof(int));
+        BOOST_REQUIRE_EQUAL(env.handler_stats(sparse).get0().dispatched, 1u);
+        BOOST_REQUIRE_EQUAL(env.handler_stats(2).get0().dispatched, 0u);
+    });
+}
+
 ACTOR_TEST_CASE(test_unregister_handler) {
     using namespace std::chrono_literals;
     return rpc_test_env<>::do_with_thread(rpc_test_config(), [](rpc_test_env<> &env, test_rpc_proto::client &c1) {